@@ -13,4 +13,7 @@ fi
 echo "Installing to $INSTALL_PATH..."
 mkdir -p "$INSTALL_PATH"
 cp "$BINARY" "$INSTALL_PATH/dwin"
+if [ -f build/dwinctl ]; then
+    cp build/dwinctl "$INSTALL_PATH/dwinctl"
+fi
 echo "✓ Installed to $INSTALL_PATH"
\ No newline at end of file
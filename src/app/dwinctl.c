@@ -0,0 +1,117 @@
+// dwinctl - drive a running dwin through its control socket
+//
+//   dwinctl [-s socket] [request...]
+//
+// the arguments make one request ("move 812 2; move 950 2; switch 2"),
+// without them every line of stdin is a request. Prints the replies, exits
+// 1 if a request failed and 2 if dwin couldn't be reached. After a
+// subscribe the events are printed until dwin quits
+#include "wm_server.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static void usage(void) {
+  fprintf(stderr,
+          "usage: dwinctl [-s socket] [request]\n"
+          "  commands: move <pid> <buffer>, tag <pid> <buffer>, float <pid>,\n"
+          "            tile <pid>, switch <buffer>, view <buffer>...,\n"
+          "            retile\n"
+          "  queries:  apps, buffers, frames, focus\n"
+          "  events:   subscribe [buffer] [app] [focus] [layout]\n"
+          "  separate commands with ';' to run them as one batch\n");
+}
+
+// print the events of a subscription as they come
+static int stream_events(int fd) {
+  char buffer[4096];
+  ssize_t count;
+  while ((count = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+    fwrite(buffer, 1, (size_t)count, stdout);
+    fflush(stdout);
+  }
+  return 0;
+}
+
+// send a request and print its reply, returns the exit status
+static int run(int fd, const char *request) {
+  static char reply[WM_CONTROL_MAX_REPLY];
+  int length = wm_client_request(fd, request, reply, sizeof(reply));
+  if (length < 0) {
+    fprintf(stderr, "dwinctl: no reply from dwin\n");
+    return 2;
+  }
+
+  reply[length - 1] = '\0'; // the empty line ending the reply
+  fputs(reply, stdout);
+  if (strncmp(reply, "error ", 6) == 0)
+    return 1;
+
+  // the connection is an event stream now
+  request += strspn(request, " \t");
+  if (strncmp(request, "subscribe", 9) == 0) {
+    fflush(stdout);
+    return stream_events(fd);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char path[WM_SERVER_PATH_SIZE];
+  wm_server_default_path(path, sizeof(path));
+
+  int first = 1;
+  if (argc > 1 && (strcmp(argv[1], "-h") == 0 ||
+                   strcmp(argv[1], "--help") == 0)) {
+    usage();
+    return 0;
+  }
+  if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+    if (argc < 3) {
+      usage();
+      return 2;
+    }
+    snprintf(path, sizeof(path), "%s", argv[2]);
+    first = 3;
+  }
+
+  int fd = wm_client_connect(path);
+  if (fd < 0) {
+    fprintf(stderr, "dwinctl: can't connect to %s (is dwin running?)\n",
+            path);
+    return 2;
+  }
+
+  int status = 0;
+  char request[WM_CONTROL_MAX_REQUEST];
+  if (first < argc) {
+    // the arguments joined by spaces
+    size_t length = 0;
+    request[0] = '\0';
+    for (int i = first; i < argc; i++) {
+      int written = snprintf(request + length, sizeof(request) - length,
+                             "%s%s", i > first ? " " : "", argv[i]);
+      if (written < 0 || (size_t)written >= sizeof(request) - length) {
+        fprintf(stderr, "dwinctl: request too long\n");
+        close(fd);
+        return 2;
+      }
+      length += (size_t)written;
+    }
+    status = run(fd, request);
+  } else {
+    while (fgets(request, sizeof(request), stdin) != NULL) {
+      if (strspn(request, " \t\r\n") == strlen(request))
+        continue; // blank line
+      int result = run(fd, request);
+      if (result > status)
+        status = result;
+      if (result == 2)
+        break;
+    }
+  }
+
+  close(fd);
+  return status;
+}
@@ -0,0 +1,53 @@
+// dwinlog - print dwin's binary log as text
+//
+//   dwinlog [file...]
+//
+// without arguments prints the log of the running (or last) dwin and the
+// one it rotated out. Crash files (crash.log next to it) decode the same
+// way. Exits 1 if a file is missing or was written by another build
+#include "wm_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static void usage(void) {
+  fprintf(stderr, "usage: dwinlog [file...]\n"
+                  "  default: ~/Library/Application Support/dwin/dwin.log\n");
+}
+
+static int decode(const char *path) {
+  if (wm_log_decode(path, stdout) < 0) {
+    fprintf(stderr, "dwinlog: %s: missing or not a log of this build\n",
+            path);
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && argv[1][0] == '-') {
+    usage();
+    return argv[1][1] == 'h' ? 0 : 1;
+  }
+
+  if (argc > 1) {
+    int status = 0;
+    for (int i = 1; i < argc; i++)
+      status |= decode(argv[i]);
+    return status;
+  }
+
+  const char *home = getenv("HOME");
+  if (home == NULL) {
+    usage();
+    return 1;
+  }
+  char path[1024];
+  char old[sizeof(path) + 4];
+  snprintf(path, sizeof(path), "%s/Library/Application Support/dwin/dwin.log",
+           home);
+  snprintf(old, sizeof(old), "%s.old", path);
+
+  // the rotated-out part is older, and may not exist
+  wm_log_decode(old, stdout);
+  return decode(path);
+}
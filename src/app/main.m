@@ -1,12 +1,24 @@
 #import "../platform/macos/AppDelegate.h"
 #import <Cocoa/Cocoa.h>
+#include "wm_config_cache.h"
+#include <stdio.h>
+#include <string.h>
 
 // entrypoint fo macos app
 int main(int argc, const char *argv[]) {
-  (void)argc;
-  (void)argv;
-
   @autoreleasepool {
+    // dwin --compile-config [source] [image]: compile the config and exit
+    if (argc >= 2 && strcmp(argv[1], "--compile-config") == 0) {
+      const char *source = argc >= 3 ? argv[2] : app_config_path();
+      const char *image = argc >= 4 ? argv[3] : app_data_path(@"config.bin");
+      if (!wm_config_compile(source, image)) {
+        fprintf(stderr, "dwin: can't compile %s into %s\n", source, image);
+        return 1;
+      }
+      printf("dwin: compiled %s into %s\n", source, image);
+      return 0;
+    }
+
     // create application instance
     NSApplication *application = [NSApplication sharedApplication];
 
@@ -47,59 +47,94 @@ void wm_effects_add_frame(WMEffects *effects, pid_t pid, WMRect frame) {
 
 bool wm_action_switch_buffer(WMState *state, int target_buffer,
                              WMEffects *effects) {
+  // validate
+  if (target_buffer < 0 || target_buffer >= WM_MAX_BUFFERS) {
+    if (effects)
+      wm_effects_init(effects);
+    return false;
+  }
+
+  return wm_action_switch_view(state, target_buffer,
+                               WM_BUFFER_BIT(target_buffer), effects);
+}
+
+bool wm_action_switch_view(WMState *state, int primary_buffer,
+                           WMBufferMask view_mask, WMEffects *effects) {
   if (state == NULL || effects == NULL)
     return false;
 
   wm_effects_init(effects);
 
   // validate
-  if (target_buffer < 0 || target_buffer >= WM_MAX_BUFFERS)
+  if (primary_buffer < 0 || primary_buffer >= WM_MAX_BUFFERS)
+    return false;
+  if ((view_mask & ~WM_BUFFER_MASK_ALL) != 0 ||
+      (view_mask & WM_BUFFER_BIT(primary_buffer)) == 0)
     return false;
 
-  // no-op if same buffer
-  if (target_buffer == state->active_buffer)
+  // no-op if same view
+  WMBufferMask old_view = wm_state_get_view(state);
+  if (primary_buffer == state->active_buffer && view_mask == old_view)
     return false;
 
-  int old_buffer = state->active_buffer;
+  // update active buffer and view. Buffers taken from another display
+  // stay on screen, the ones it gets in return come on screen
+  WMBufferMask shown_before = wm_state_get_shown(state);
+  wm_state_set_view(state, primary_buffer, view_mask);
+  WMBufferMask shown_after = wm_state_get_shown(state);
 
-  // collect PIDs to show (all apps in new buffer)
+  // collect PIDs to show (apps visible now that weren't before)
   pid_t new_pids[WM_MAX_APPS];
-  int new_count =
-      wm_state_get_buffer_pids(state, target_buffer, new_pids, WM_MAX_APPS);
+  int new_count = wm_state_get_view_pids(state, shown_after, shown_before,
+                                         new_pids, WM_MAX_APPS);
 
   for (int i = 0; i < new_count; i++) {
     wm_effects_add_show(effects, new_pids[i]);
   }
 
-  // collect PIDs to hide (all apps in old buffer)
+  // collect PIDs to hide (apps visible before that aren't anymore)
   pid_t old_pids[WM_MAX_APPS];
-  int old_count =
-      wm_state_get_buffer_pids(state, old_buffer, old_pids, WM_MAX_APPS);
+  int old_count = wm_state_get_view_pids(state, shown_before, shown_after,
+                                         old_pids, WM_MAX_APPS);
 
   for (int i = 0; i < old_count; i++) {
     wm_effects_add_hide(effects, old_pids[i]);
   }
 
   // determine app to raise (use last_focused_pid or first app)
-  WMBuffer *new_buf = &state->buffers[target_buffer];
+  WMBuffer *new_buf = &state->buffers[primary_buffer];
+
+  pid_t primary_pids[WM_MAX_APPS];
+  int primary_count = wm_state_get_buffer_pids(state, primary_buffer,
+                                               primary_pids, WM_MAX_APPS);
 
   if (new_buf->last_focused_pid > 0) {
     // use last focused app
     wm_effects_add_raise(effects, new_buf->last_focused_pid);
-  } else if (new_count > 0) {
+  } else if (primary_count > 0) {
     // fallback use first app
-    wm_effects_add_raise(effects, new_pids[0]);
+    wm_effects_add_raise(effects, primary_pids[0]);
   }
 
   // mark layout needed for new buffer
   effects->needs_layout = true;
-  effects->layout_buffer = target_buffer;
-
-  // update active buffer
-  state->active_buffer = target_buffer;
+  effects->layout_buffer = primary_buffer;
   return true;
 }
 
+// show/hide a single app after its buffers changed under the current view
+static void add_visibility_change(const WMState *state, pid_t pid,
+                                  WMBufferMask old_mask, WMEffects *effects) {
+  WMBufferMask view = wm_state_get_shown(state);
+  bool was_visible = (old_mask & view) != 0;
+  bool is_visible = (wm_state_get_buffer_mask(state, pid) & view) != 0;
+
+  if (was_visible && !is_visible)
+    wm_effects_add_hide(effects, pid);
+  else if (!was_visible && is_visible)
+    wm_effects_add_show(effects, pid);
+}
+
 bool wm_action_process(WMState *state, const WMAction *action,
                        WMEffects *effects) {
   // validate
@@ -136,8 +171,48 @@ bool wm_action_process(WMState *state, const WMAction *action,
 
     return ok;
   }
+  case WM_ACTION_TOGGLE_VIEW: {
+    int primary;
+    WMBufferMask view;
+    if (!wm_state_toggled_view(state, action->target_buffer, &primary,
+                               &view)) {
+      wm_effects_init(effects);
+      return false;
+    }
+
+    return wm_action_switch_view(state, primary, view, effects);
+  }
+  case WM_ACTION_TOGGLE_TAG:
+  case WM_ACTION_TOGGLE_STICKY: {
+    wm_effects_init(effects);
+
+    WMBufferMask old_mask = wm_state_get_buffer_mask(state, action->target_pid);
+    if (old_mask == 0)
+      return false;
+
+    if (action->type == WM_ACTION_TOGGLE_TAG) {
+      wm_state_toggle_buffer(state, action->target_pid, action->target_buffer);
+    } else if (old_mask == WM_BUFFER_MASK_ALL) {
+      // unpin back to the primary buffer of the view
+      if (state->active_buffer < 0)
+        return false;
+      wm_state_assign_to_buffer(state, action->target_pid,
+                                state->active_buffer);
+    } else {
+      wm_state_set_buffer_mask(state, action->target_pid, WM_BUFFER_MASK_ALL);
+    }
+
+    if (wm_state_get_buffer_mask(state, action->target_pid) == old_mask)
+      return false;
+
+    add_visibility_change(state, action->target_pid, old_mask, effects);
+    effects->needs_layout = true;
+    effects->layout_buffer = state->active_buffer;
+    return true;
+  }
   case WM_ACTION_TOGGLE_PASSTHROUGH:
     state->is_passthrough_mode = !state->is_passthrough_mode;
+    state->version++;
     wm_effects_init(effects);
     return true;
   default:
@@ -146,6 +221,63 @@ bool wm_action_process(WMState *state, const WMAction *action,
   }
 }
 
+void wm_action_queue_init(WMActionQueue *queue) {
+  memset(queue, 0, sizeof(WMActionQueue));
+}
+
+static bool is_snap(WMActionType type) {
+  return type >= WM_ACTION_SNAP_LEFT && type <= WM_ACTION_SNAP_BOTTOM_RIGHT;
+}
+
+// whether a newer action makes a pending one pointless
+static bool supersedes(WMActionType newer, WMActionType pending) {
+  // a switch sets the whole view
+  if (newer == WM_ACTION_SWITCH_BUFFER)
+    return pending == WM_ACTION_SWITCH_BUFFER ||
+           pending == WM_ACTION_TOGGLE_VIEW;
+
+  // snaps all move the same focused window
+  return is_snap(newer) && is_snap(pending);
+}
+
+bool wm_action_queue_push(WMActionQueue *queue, const WMAction *action,
+                          bool is_autorepeat) {
+  if (is_autorepeat) {
+    queue->dropped_repeats++;
+    return false;
+  }
+
+  // only the tail is replaced: anything queued after a pending action
+  // (e.g. a snap after a switch) depends on it having run
+  while (queue->count > 0) {
+    int tail = (queue->head + queue->count - 1) % WM_ACTION_QUEUE_SIZE;
+    if (!supersedes(action->type, queue->actions[tail].type))
+      break;
+    queue->count--;
+    queue->superseded++;
+  }
+
+  if (queue->count >= WM_ACTION_QUEUE_SIZE) {
+    queue->overflows++;
+    return false;
+  }
+
+  int slot = (queue->head + queue->count) % WM_ACTION_QUEUE_SIZE;
+  queue->actions[slot] = *action;
+  queue->count++;
+  return true;
+}
+
+bool wm_action_queue_pop(WMActionQueue *queue, WMAction *out_action) {
+  if (queue->count == 0)
+    return false;
+
+  *out_action = queue->actions[queue->head];
+  queue->head = (queue->head + 1) % WM_ACTION_QUEUE_SIZE;
+  queue->count--;
+  return true;
+}
+
 static bool move_app_state(WMState *state, pid_t pid, int target_buffer,
                            int *out_old_buffer) {
   // validate target buffer
@@ -153,14 +285,15 @@ static bool move_app_state(WMState *state, pid_t pid, int target_buffer,
     return false;
 
   // validate app
-  const WMApp *app = wm_state_find_app(state, pid);
-  if (app == NULL)
+  if (wm_state_find_app(state, pid) == NULL)
     return false;
 
-  int current_buffer = app->buffer_index;
-  if (current_buffer == target_buffer)
+  WMBufferMask current_mask = wm_state_get_buffer_mask(state, pid);
+  if (current_mask == WM_BUFFER_BIT(target_buffer))
     return false;
 
+  int current_buffer = wm_state_primary_buffer(state, pid);
+
   // move app to target buffer
   wm_state_assign_to_buffer(state, pid, target_buffer);
 
@@ -13,6 +13,9 @@ typedef enum {
   // buffer actions
   WM_ACTION_SWITCH_BUFFER, // switch to buffer N
   WM_ACTION_MOVE_BUFFER,   // move focused app to buffer N, then switch
+  WM_ACTION_TOGGLE_VIEW,   // show/hide buffer N alongside the current view
+  WM_ACTION_TOGGLE_TAG,    // add/remove focused app to/from buffer N
+  WM_ACTION_TOGGLE_STICKY, // pin focused app to every buffer (or unpin)
 
   // snapping - float a window to a position on the screen
   WM_ACTION_SNAP_LEFT,
@@ -42,6 +45,20 @@ typedef struct {
   char bundle_identifier[128]; // for LAUNCH_BUNDLE
 } WMAction;
 
+#define WM_ACTION_QUEUE_SIZE 32 // actions pending between hotkeys and effects
+
+// actions waiting to run. Hotkeys push, the main loop pops one per turn, so
+// keys pressed while an action runs can still replace what is pending.
+// Single threaded (event tap and main loop share the main run loop)
+typedef struct {
+  WMAction actions[WM_ACTION_QUEUE_SIZE]; // ring
+  uint8_t head;                           // next action to pop
+  uint8_t count;                          // pending actions
+  uint32_t dropped_repeats;               // autorepeat events ignored
+  uint32_t superseded;                    // pending actions replaced
+  uint32_t overflows;                     // actions dropped, queue full
+} WMActionQueue;
+
 // effects to apply after an action is processed
 typedef struct {
   // visibility changes
@@ -80,6 +97,19 @@ void wm_effects_add_raise(WMEffects *effects, pid_t pid);
 // add a frame change
 void wm_effects_add_frame(WMEffects *effects, pid_t pid, WMRect frame);
 
+// initialize an empty action queue
+void wm_action_queue_init(WMActionQueue *queue);
+
+// queue an action. Autorepeat (key held down) is dropped. A buffer switch
+// replaces view changes pending at the tail of the queue and a snap replaces
+// a pending snap, so a burst only runs its final target (nothing else is
+// reordered or merged). Returns false if the action was dropped
+bool wm_action_queue_push(WMActionQueue *queue, const WMAction *action,
+                          bool is_autorepeat);
+
+// take the oldest pending action, returns false if the queue is empty
+bool wm_action_queue_pop(WMActionQueue *queue, WMAction *out_action);
+
 // process an action and compute effects
 bool wm_action_process(struct WMState *state, const WMAction *action,
                        WMEffects *effects);
@@ -88,4 +118,10 @@ bool wm_action_process(struct WMState *state, const WMAction *action,
 bool wm_action_switch_buffer(struct WMState *state, int target_buffer,
                              WMEffects *effects);
 
+// switch to a view of several buffers, primary_buffer gets focus and new apps
+// only apps in the symmetric difference of the old and new view are hidden or
+// shown
+bool wm_action_switch_view(struct WMState *state, int primary_buffer,
+                           WMBufferMask view_mask, WMEffects *effects);
+
 #endif
@@ -1,8 +1,26 @@
 #include "wm_config.h"
+#include "wm_control.h"
+#include "wm_executor.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
 #include <string.h>
 
+_Static_assert(WM_RULE_INDEX_SIZE > WM_MAX_RULES,
+               "rule index needs an empty slot to terminate probes");
+_Static_assert(WM_BINDING_INDEX_SIZE > WM_MAX_BINDINGS,
+               "binding index needs an empty slot to terminate probes");
+
 void wm_config_init(WMConfig *config) {
   memset(config, 0, sizeof(WMConfig));
+  memset(config->rule_index, -1, sizeof(config->rule_index));
+  memset(config->binding_index, -1, sizeof(config->binding_index));
+  config->key_node_count = 1; // root
+  config->key_timeout_ms = WM_KEY_TIMEOUT_MS;
+  config->effect_budget_ms = WM_EFFECT_BUDGET_MS;
+  config->ax_timeout_ms = WM_AX_TIMEOUT_MS;
+  config->hook_timeout_ms = WM_HOOK_TIMEOUT_MS;
 
   // default gaps
   config->gaps_outer =
@@ -36,8 +54,6 @@ void wm_config_init(WMConfig *config) {
                         0, NULL);
   wm_config_add_binding(config, WM_MOD_CMD, WM_KEY_DOWN_ARROW,
                         WM_ACTION_SNAP_BOTTOM, 0, NULL);
-  wm_config_add_binding(config, WM_MOD_CMD, WM_KEY_UP_ARROW, WM_ACTION_SNAP_TOP,
-                        0, NULL);
 
   // snap bindings: CMD+SHIFT+Arrow for corners
   wm_config_add_binding(config, WM_MOD_CMD | WM_MOD_SHIFT, WM_KEY_LEFT_ARROW,
@@ -55,33 +71,619 @@ void wm_config_init(WMConfig *config) {
                         WM_ACTION_RETILE, 0, NULL);
 }
 
+// key names accepted in bindings (macOS ANSI virtual keycodes)
+static const struct {
+  const char *name;
+  int keycode;
+} KEY_NAMES[] = {
+    {"a", 0},
+    {"s", 1},
+    {"d", 2},
+    {"f", 3},
+    {"h", 4},
+    {"g", 5},
+    {"z", 6},
+    {"x", 7},
+    {"c", 8},
+    {"v", 9},
+    {"b", 11},
+    {"q", 12},
+    {"w", 13},
+    {"e", 14},
+    {"r", 15},
+    {"y", 16},
+    {"t", 17},
+    {"1", 18},
+    {"2", 19},
+    {"3", 20},
+    {"4", 21},
+    {"6", 22},
+    {"5", 23},
+    {"equal", 24},
+    {"9", 25},
+    {"7", 26},
+    {"minus", 27},
+    {"8", 28},
+    {"0", 29},
+    {"rightbracket", 30},
+    {"o", 31},
+    {"u", 32},
+    {"leftbracket", 33},
+    {"i", 34},
+    {"p", 35},
+    {"return", 36},
+    {"l", 37},
+    {"j", 38},
+    {"quote", 39},
+    {"k", 40},
+    {"semicolon", 41},
+    {"backslash", 42},
+    {"comma", 43},
+    {"slash", 44},
+    {"n", 45},
+    {"m", 46},
+    {"period", 47},
+    {"tab", 48},
+    {"space", 49},
+    {"grave", 50},
+    {"delete", 51},
+    {"escape", 53},
+    {"left", WM_KEY_LEFT_ARROW},
+    {"right", WM_KEY_RIGHT_ARROW},
+    {"down", WM_KEY_DOWN_ARROW},
+    {"up", WM_KEY_UP_ARROW},
+};
+
+// actions that take no argument
+static const struct {
+  const char *name;
+  WMActionType action;
+} ACTION_NAMES[] = {
+    {"snap_left", WM_ACTION_SNAP_LEFT},
+    {"snap_right", WM_ACTION_SNAP_RIGHT},
+    {"snap_top", WM_ACTION_SNAP_TOP},
+    {"snap_bottom", WM_ACTION_SNAP_BOTTOM},
+    {"snap_maximize", WM_ACTION_SNAP_MAXIMIZE},
+    {"snap_center", WM_ACTION_SNAP_CENTER},
+    {"snap_top_left", WM_ACTION_SNAP_TOP_LEFT},
+    {"snap_top_right", WM_ACTION_SNAP_TOP_RIGHT},
+    {"snap_bottom_left", WM_ACTION_SNAP_BOTTOM_LEFT},
+    {"snap_bottom_right", WM_ACTION_SNAP_BOTTOM_RIGHT},
+    {"retile", WM_ACTION_RETILE},
+    {"passthrough", WM_ACTION_TOGGLE_PASSTHROUGH},
+    {"toggle_floating", WM_ACTION_TOGGLE_FLOATING},
+    {"sticky", WM_ACTION_TOGGLE_STICKY},
+};
+
+// actions that take a buffer number (1-based in the config)
+static const struct {
+  const char *prefix;
+  WMActionType action;
+} BUFFER_ACTION_NAMES[] = {
+    {"buffer_", WM_ACTION_SWITCH_BUFFER},
+    {"move_buffer_", WM_ACTION_MOVE_BUFFER},
+    {"toggle_view_", WM_ACTION_TOGGLE_VIEW},
+    {"toggle_tag_", WM_ACTION_TOGGLE_TAG},
+};
+
+int wm_config_keycode_from_name(const char *name) {
+  for (size_t i = 0; i < sizeof(KEY_NAMES) / sizeof(KEY_NAMES[0]); i++) {
+    if (strcasecmp(name, KEY_NAMES[i].name) == 0)
+      return KEY_NAMES[i].keycode;
+  }
+  return -1;
+}
+
+// strip leading and trailing whitespace in place
+static char *trim(char *text) {
+  while (isspace((unsigned char)*text))
+    text++;
+  char *end = text + strlen(text);
+  while (end > text && isspace((unsigned char)end[-1]))
+    end--;
+  *end = '\0';
+  return text;
+}
+
+// parse a 1-based buffer number, returns the 0-based index or -1
+static int parse_buffer_number(const char *text) {
+  char *end;
+  long number = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || number < 1 || number > WM_MAX_BUFFERS)
+    return -1;
+  return (int)number - 1;
+}
+
+// parse "OPT+SHIFT+1" into modifiers and keycode
+static bool parse_key_combo(char *combo, int *out_modifiers, int *out_keycode) {
+  int modifiers = WM_MOD_NONE;
+  char *save;
+  char *token = strtok_r(combo, "+", &save);
+  while (token != NULL) {
+    token = trim(token);
+    char *next = strtok_r(NULL, "+", &save);
+
+    // the last token is the key
+    if (next == NULL) {
+      int keycode = wm_config_keycode_from_name(token);
+      if (keycode < 0)
+        return false;
+      *out_modifiers = modifiers;
+      *out_keycode = keycode;
+      return true;
+    }
+
+    if (strcasecmp(token, "OPT") == 0 || strcasecmp(token, "ALT") == 0)
+      modifiers |= WM_MOD_OPT;
+    else if (strcasecmp(token, "SHIFT") == 0)
+      modifiers |= WM_MOD_SHIFT;
+    else if (strcasecmp(token, "CMD") == 0 || strcasecmp(token, "SUPER") == 0)
+      modifiers |= WM_MOD_CMD;
+    else if (strcasecmp(token, "CTRL") == 0)
+      modifiers |= WM_MOD_CTRL;
+    else
+      return false;
+
+    token = next;
+  }
+  return false;
+}
+
+// parse an action name, a bundle identifier means launch that app
+static bool parse_action(const char *name, WMActionType *out_action,
+                         int *out_argument, const char **out_bundle) {
+  *out_argument = 0;
+  *out_bundle = NULL;
+
+  for (size_t i = 0; i < sizeof(ACTION_NAMES) / sizeof(ACTION_NAMES[0]); i++) {
+    if (strcmp(name, ACTION_NAMES[i].name) == 0) {
+      *out_action = ACTION_NAMES[i].action;
+      return true;
+    }
+  }
+
+  for (size_t i = 0;
+       i < sizeof(BUFFER_ACTION_NAMES) / sizeof(BUFFER_ACTION_NAMES[0]); i++) {
+    size_t length = strlen(BUFFER_ACTION_NAMES[i].prefix);
+    if (strncmp(name, BUFFER_ACTION_NAMES[i].prefix, length) != 0)
+      continue;
+
+    int buffer = parse_buffer_number(name + length);
+    if (buffer < 0)
+      return false;
+    *out_action = BUFFER_ACTION_NAMES[i].action;
+    *out_argument = buffer;
+    return true;
+  }
+
+  if (strchr(name, '.') != NULL) {
+    *out_action = WM_ACTION_LAUNCH_BUNDLE;
+    *out_bundle = name;
+    return true;
+  }
+
+  return false;
+}
+
+// parse gaps: one value for all sides or four (top right bottom left)
+static bool parse_gap(const char *text, WMGap *out_gap) {
+  WMGap gap;
+  int count =
+      sscanf(text, "%d %d %d %d", &gap.top, &gap.right, &gap.bottom, &gap.left);
+  if (count == 1)
+    gap.right = gap.bottom = gap.left = gap.top;
+  else if (count != 4)
+    return false;
+
+  if (gap.top < 0 || gap.right < 0 || gap.bottom < 0 || gap.left < 0)
+    return false;
+
+  *out_gap = gap;
+  return true;
+}
+
+// index slot of a key pressed in a trie node (high bits of a
+// multiplicative hash, the low ones only see the low bits of the key)
+static uint32_t binding_slot(int node, int modifiers, int keycode) {
+  uint32_t key = ((uint32_t)node << 12) | (((uint32_t)keycode & 0xff) << 4) |
+                 ((uint32_t)modifiers & 0xf);
+  return ((key * 2654435761u) >> 16) % WM_BINDING_INDEX_SIZE;
+}
+
+// append a binding, indexing it unless the key is already bound (the first
+// binding for a key wins). Returns its index or -1 if full
+static int append_binding(WMConfig *config, int node, int modifiers,
+                          int keycode, WMActionType action, int argument,
+                          const char *bundle_identifier, int next_node) {
+  if (config->bindings_count >= WM_MAX_BINDINGS) {
+    return -1;
+  }
+
+  int8_t index = (int8_t)config->bindings_count++;
+  WMBinding *binding = &config->bindings[index];
+  binding->modifiers = modifiers;
+  binding->keycode = keycode;
+  binding->action = action;
+  binding->action_argument = argument;
+  binding->node = (uint8_t)node;
+  binding->next_node = (int8_t)next_node;
+
+  if (bundle_identifier) {
+    strncpy(binding->bundle_identifier, bundle_identifier,
+            sizeof(binding->bundle_identifier) - 1);
+    binding->bundle_identifier[sizeof(binding->bundle_identifier) - 1] = '\0';
+  } else {
+    binding->bundle_identifier[0] = '\0';
+  }
+
+  if (wm_config_find_binding(config, node, modifiers, keycode) < 0) {
+    uint32_t slot = binding_slot(node, modifiers, keycode);
+    for (int probe = 0; probe < WM_BINDING_INDEX_SIZE; probe++) {
+      if (config->binding_index[slot] == -1) {
+        config->binding_index[slot] = index;
+        break;
+      }
+      slot = (slot + 1) % WM_BINDING_INDEX_SIZE;
+    }
+  }
+
+  return index;
+}
+
+// bind a key in a node, replacing its binding if it has one
+static int set_binding(WMConfig *config, int node, int modifiers, int keycode,
+                       WMActionType action, int argument,
+                       const char *bundle_identifier, int next_node) {
+  int index = wm_config_find_binding(config, node, modifiers, keycode);
+  if (index < 0)
+    return append_binding(config, node, modifiers, keycode, action, argument,
+                          bundle_identifier, next_node);
+
+  WMBinding *binding = &config->bindings[index];
+  binding->action = action;
+  binding->action_argument = argument;
+  binding->next_node = (int8_t)next_node;
+  memset(binding->bundle_identifier, 0, sizeof(binding->bundle_identifier));
+  if (bundle_identifier)
+    strncpy(binding->bundle_identifier, bundle_identifier,
+            sizeof(binding->bundle_identifier) - 1);
+  return index;
+}
+
+// follow (creating as needed) the prefix keys of a sequence from the root,
+// returns the node reached or -1 if the trie is full
+static int walk_prefixes(WMConfig *config, const int *modifiers,
+                         const int *keycodes, int count) {
+  int node = 0;
+  for (int i = 0; i < count; i++) {
+    int index = wm_config_find_binding(config, node, modifiers[i], keycodes[i]);
+    if (index >= 0 && config->bindings[index].next_node >= 0) {
+      node = config->bindings[index].next_node;
+      continue;
+    }
+
+    if (config->key_node_count >= WM_MAX_KEY_NODES)
+      return -1;
+    int next = config->key_node_count++;
+    if (set_binding(config, node, modifiers[i], keycodes[i], WM_ACTION_NONE, 0,
+                    NULL, next) < 0)
+      return -1;
+    node = next;
+  }
+  return node;
+}
+
+// split a comma separated list of keys in place, returns count or -1
+static int parse_key_list(char *text, int *out_modifiers, int *out_keycodes,
+                          int max_keys) {
+  int count = 0;
+  char *save;
+  for (char *token = strtok_r(text, ",", &save); token != NULL;
+       token = strtok_r(NULL, ",", &save)) {
+    if (count >= max_keys ||
+        !parse_key_combo(token, &out_modifiers[count], &out_keycodes[count]))
+      return -1;
+    count++;
+  }
+  return count;
+}
+
+// parse "bind = OPT+1, buffer_1" or a sequence "bind = OPT+b, 3, buffer_3",
+// the last item is the action. Replaces an existing binding of the keys
+static bool parse_bind(WMConfig *config, char *value) {
+  char *comma = strrchr(value, ',');
+  if (comma == NULL)
+    return false;
+  *comma = '\0';
+
+  WMActionType action;
+  int argument;
+  const char *bundle;
+  if (!parse_action(trim(comma + 1), &action, &argument, &bundle))
+    return false;
+
+  int modifiers[WM_MAX_KEY_SEQUENCE], keycodes[WM_MAX_KEY_SEQUENCE];
+  int length =
+      parse_key_list(value, modifiers, keycodes, WM_MAX_KEY_SEQUENCE);
+  if (length < 1)
+    return false;
+
+  return wm_config_add_sequence(config, modifiers, keycodes, length, action,
+                                argument, bundle);
+}
+
+// parse "layer = OPT+r" (or a sequence leading to the layer)
+static bool parse_layer(WMConfig *config, char *value) {
+  int modifiers[WM_MAX_KEY_SEQUENCE], keycodes[WM_MAX_KEY_SEQUENCE];
+  int length =
+      parse_key_list(value, modifiers, keycodes, WM_MAX_KEY_SEQUENCE);
+  if (length < 1)
+    return false;
+
+  return wm_config_add_layer(config, modifiers, keycodes, length);
+}
+
+// parse a duration in milliseconds, 1 to max_ms
+static bool parse_milliseconds(const char *value, long max_ms, int *out_ms) {
+  char *end;
+  long ms = strtol(value, &end, 10);
+  if (end == value || *end != '\0' || ms <= 0 || ms > max_ms)
+    return false;
+
+  *out_ms = (int)ms;
+  return true;
+}
+
+// parse "rule = com.jetbrains.CLion, 1"
+static bool parse_rule(WMConfig *config, char *value) {
+  char *comma = strchr(value, ',');
+  if (comma == NULL)
+    return false;
+  *comma = '\0';
+
+  const char *bundle = trim(value);
+  int buffer = parse_buffer_number(trim(comma + 1));
+  if (bundle[0] == '\0' || buffer < 0)
+    return false;
+
+  return wm_config_add_rule(config, bundle, buffer);
+}
+
+// parse "hook = app, ~/bin/bar-refresh", the command keeps its commas
+static bool parse_hook(WMConfig *config, char *value) {
+  char *comma = strchr(value, ',');
+  if (comma == NULL)
+    return false;
+  *comma = '\0';
+
+  int event = wm_control_event_from_name(trim(value));
+  if (event < 0)
+    return false;
+  return wm_config_add_hook(config, event, trim(comma + 1));
+}
+
+// parse "layout_snap = points|pixels|off"
+static bool parse_layout_snap(WMConfig *config, const char *value) {
+  if (strcmp(value, "points") == 0)
+    config->layout_snap = WM_LAYOUT_SNAP_POINTS;
+  else if (strcmp(value, "pixels") == 0)
+    config->layout_snap = WM_LAYOUT_SNAP_PIXELS;
+  else if (strcmp(value, "off") == 0)
+    config->layout_snap = WM_LAYOUT_SNAP_OFF;
+  else
+    return false;
+  return true;
+}
+
+// parse "hide", "park" or "auto", -1 if neither
+static int parse_visibility_mode(const char *value) {
+  if (strcmp(value, "hide") == 0)
+    return WM_VISIBILITY_HIDE;
+  if (strcmp(value, "park") == 0)
+    return WM_VISIBILITY_PARK;
+  if (strcmp(value, "auto") == 0)
+    return WM_VISIBILITY_AUTO;
+  return -1;
+}
+
+// parse "visibility = park" or "visibility = com.spotify.client, hide"
+static bool parse_visibility(WMConfig *config, char *value) {
+  char *comma = strchr(value, ',');
+  if (comma == NULL) {
+    int mode = parse_visibility_mode(value);
+    if (mode < 0)
+      return false;
+    config->visibility = (uint8_t)mode;
+    return true;
+  }
+  *comma = '\0';
+
+  const char *bundle = trim(value);
+  int mode = parse_visibility_mode(trim(comma + 1));
+  if (bundle[0] == '\0' || mode < 0)
+    return false;
+  return wm_config_add_visibility(config, bundle, (WMVisibilityMode)mode);
+}
+
+// parse one "key = value" line, comments and blank lines are valid
+static bool parse_line(WMConfig *config, char *line) {
+  char *comment = strchr(line, '#');
+  if (comment)
+    *comment = '\0';
+
+  line = trim(line);
+  if (line[0] == '\0')
+    return true;
+
+  char *equals = strchr(line, '=');
+  if (equals == NULL)
+    return false;
+  *equals = '\0';
+
+  const char *key = trim(line);
+  char *value = trim(equals + 1);
+
+  if (strcmp(key, "gaps_out") == 0)
+    return parse_gap(value, &config->gaps_outer);
+  if (strcmp(key, "gaps_in") == 0)
+    return parse_gap(value, &config->gaps_inner);
+  if (strcmp(key, "layout_snap") == 0)
+    return parse_layout_snap(config, value);
+  if (strcmp(key, "bind") == 0)
+    return parse_bind(config, value);
+  if (strcmp(key, "rule") == 0)
+    return parse_rule(config, value);
+  if (strcmp(key, "layer") == 0)
+    return parse_layer(config, value);
+  if (strcmp(key, "key_timeout") == 0)
+    return parse_milliseconds(value, 60000, &config->key_timeout_ms);
+  if (strcmp(key, "effect_budget") == 0)
+    return parse_milliseconds(value, WM_MAX_EFFECT_BUDGET_MS,
+                              &config->effect_budget_ms);
+  if (strcmp(key, "ax_timeout") == 0)
+    return parse_milliseconds(value, WM_MAX_AX_TIMEOUT_MS,
+                              &config->ax_timeout_ms);
+  if (strcmp(key, "hook") == 0)
+    return parse_hook(config, value);
+  if (strcmp(key, "hook_timeout") == 0)
+    return parse_milliseconds(value, WM_MAX_HOOK_TIMEOUT_MS,
+                              &config->hook_timeout_ms);
+  if (strcmp(key, "visibility") == 0)
+    return parse_visibility(config, value);
+
+  return false;
+}
+
 bool wm_config_load(WMConfig *config, const char *path) {
-  // @TODO: implement
-  (void)path;
   wm_config_init(config);
+
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return false;
+
+  char line[512];
+  while (fgets(line, sizeof(line), file)) {
+    parse_line(config, line);
+  }
+
+  fclose(file);
+  return true;
+}
+
+uint32_t wm_config_hash_bundle(const char *bundle_identifier) {
+  uint32_t hash = 2166136261u;
+  for (const unsigned char *c = (const unsigned char *)bundle_identifier; *c;
+       c++) {
+    hash ^= *c;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+bool wm_config_add_hook(WMConfig *config, int event, const char *command) {
+  size_t length = strlen(command);
+  if (config->hooks_count >= WM_MAX_HOOKS || event < 0 ||
+      event >= WM_CONTROL_EVENT_COUNT || length == 0 ||
+      length >= WM_HOOK_COMMAND_SIZE)
+    return false;
+
+  WMHook *hook = &config->hooks[config->hooks_count++];
+  hook->event = (uint8_t)event;
+  memcpy(hook->command, command, length + 1);
+  return true;
+}
+
+bool wm_config_add_visibility(WMConfig *config, const char *bundle_identifier,
+                              WMVisibilityMode mode) {
+  if (mode > WM_VISIBILITY_AUTO ||
+      strlen(bundle_identifier) >= sizeof(config->visibility_rules[0]
+                                              .bundle_identifier))
+    return false;
+
+  // the last line for an app wins
+  uint32_t hash = wm_config_hash_bundle(bundle_identifier);
+  for (int i = 0; i < config->visibility_rules_count; i++) {
+    WMVisibilityRule *rule = &config->visibility_rules[i];
+    if (rule->bundle_hash == hash &&
+        strcmp(rule->bundle_identifier, bundle_identifier) == 0) {
+      rule->mode = (uint8_t)mode;
+      return true;
+    }
+  }
+  if (config->visibility_rules_count >= WM_MAX_VISIBILITY_RULES)
+    return false;
+
+  WMVisibilityRule *rule =
+      &config->visibility_rules[config->visibility_rules_count++];
+  strcpy(rule->bundle_identifier, bundle_identifier);
+  rule->bundle_hash = hash;
+  rule->mode = (uint8_t)mode;
   return true;
 }
 
+WMVisibilityMode wm_config_visibility(const WMConfig *config,
+                                      const char *bundle_identifier) {
+  uint32_t hash = wm_config_hash_bundle(bundle_identifier);
+  for (int i = 0; i < config->visibility_rules_count; i++) {
+    const WMVisibilityRule *rule = &config->visibility_rules[i];
+    if (rule->bundle_hash == hash &&
+        strcmp(rule->bundle_identifier, bundle_identifier) == 0)
+      return (WMVisibilityMode)rule->mode;
+  }
+  return (WMVisibilityMode)config->visibility;
+}
+
 bool wm_config_add_rule(WMConfig *config, const char *bundle_identifier,
                         int target_buffer) {
   if (config->rules_count >= WM_MAX_RULES) {
     return false;
   }
 
-  WMRule *rule = &config->rules[config->rules_count++];
+  int8_t index = (int8_t)config->rules_count++;
+  WMRule *rule = &config->rules[index];
   strncpy(rule->bundle_identifier, bundle_identifier,
           sizeof(rule->bundle_identifier) - 1);
   rule->bundle_identifier[sizeof(rule->bundle_identifier) - 1] = '\0';
   rule->target_buffer = (int8_t)target_buffer;
+  rule->bundle_hash = wm_config_hash_bundle(rule->bundle_identifier);
+
+  // index the rule, the first rule for a bundle wins
+  uint32_t slot = rule->bundle_hash % WM_RULE_INDEX_SIZE;
+  for (int probe = 0; probe < WM_RULE_INDEX_SIZE; probe++) {
+    if (config->rule_index[slot] == -1) {
+      config->rule_index[slot] = index;
+      return true;
+    }
+    const WMRule *other = &config->rules[config->rule_index[slot]];
+    if (other->bundle_hash == rule->bundle_hash &&
+        strcmp(other->bundle_identifier, rule->bundle_identifier) == 0)
+      return true;
+    slot = (slot + 1) % WM_RULE_INDEX_SIZE;
+  }
   return true;
 }
 
 int wm_config_match_rule(const WMConfig *config,
                          const char *bundle_identifier) {
-  for (int i = 0; i < config->rules_count; i++) {
-    if (strcmp(config->rules[i].bundle_identifier, bundle_identifier) == 0) {
-      return config->rules[i].target_buffer;
+  return wm_config_match_rule_hashed(config, bundle_identifier,
+                                     wm_config_hash_bundle(bundle_identifier));
+}
+
+int wm_config_match_rule_hashed(const WMConfig *config,
+                                const char *bundle_identifier, uint32_t hash) {
+  // index has 2x slots of max rules, so there is always an empty slot. The
+  // probes are bounded all the same: an index not set up by wm_config_init
+  // (all zero) can only miss
+  uint32_t slot = hash % WM_RULE_INDEX_SIZE;
+  for (int probe = 0;
+       probe < WM_RULE_INDEX_SIZE && config->rule_index[slot] != -1;
+       probe++) {
+    const WMRule *rule = &config->rules[config->rule_index[slot]];
+    if (rule->bundle_hash == hash &&
+        strcmp(rule->bundle_identifier, bundle_identifier) == 0) {
+      return rule->target_buffer;
     }
+    slot = (slot + 1) % WM_RULE_INDEX_SIZE;
   }
   return -1;
 }
@@ -89,41 +691,69 @@ int wm_config_match_rule(const WMConfig *config,
 bool wm_config_add_binding(WMConfig *config, int modifiers, int keycode,
                            WMActionType action, int action_argument,
                            const char *bundle_identifier) {
-  if (config->bindings_count >= WM_MAX_BINDINGS) {
-    return false;
+  return append_binding(config, 0, modifiers, keycode, action,
+                        action_argument, bundle_identifier, -1) >= 0;
+}
+
+int wm_config_find_binding(const WMConfig *config, int node, int modifiers,
+                           int keycode) {
+  // index has 2x slots of max bindings, so there is always an empty slot
+  // (bounded like the rule probe)
+  uint32_t slot = binding_slot(node, modifiers, keycode);
+  for (int probe = 0;
+       probe < WM_BINDING_INDEX_SIZE && config->binding_index[slot] != -1;
+       probe++) {
+    const WMBinding *binding = &config->bindings[config->binding_index[slot]];
+    if (binding->node == node && binding->modifiers == modifiers &&
+        binding->keycode == keycode)
+      return config->binding_index[slot];
+    slot = (slot + 1) % WM_BINDING_INDEX_SIZE;
   }
+  return -1;
+}
 
-  WMBinding *binding = &config->bindings[config->bindings_count++];
-  binding->modifiers = modifiers;
-  binding->keycode = keycode;
-  binding->action = action;
-  binding->action_argument = action_argument;
+bool wm_config_add_sequence(WMConfig *config, const int *modifiers,
+                            const int *keycodes, int length,
+                            WMActionType action, int action_argument,
+                            const char *bundle_identifier) {
+  if (length < 1 || length > WM_MAX_KEY_SEQUENCE)
+    return false;
 
-  if (bundle_identifier) {
-    strncpy(binding->bundle_identifier, bundle_identifier,
-            sizeof(binding->bundle_identifier) - 1);
-    binding->bundle_identifier[sizeof(binding->bundle_identifier) - 1] = '\0';
-  } else {
-    binding->bundle_identifier[0] = '\0';
-  }
+  int node = walk_prefixes(config, modifiers, keycodes, length - 1);
+  if (node < 0)
+    return false;
+
+  return set_binding(config, node, modifiers[length - 1],
+                     keycodes[length - 1], action, action_argument,
+                     bundle_identifier, -1) >= 0;
+}
+
+bool wm_config_add_layer(WMConfig *config, const int *modifiers,
+                         const int *keycodes, int length) {
+  if (length < 1 || length > WM_MAX_KEY_SEQUENCE)
+    return false;
 
+  int node = walk_prefixes(config, modifiers, keycodes, length);
+  if (node < 0)
+    return false;
+
+  config->key_node_flags[node] |= WM_KEY_NODE_LAYER;
   return true;
 }
 
 bool wm_config_match_binding(const WMConfig *config, int modifiers, int keycode,
                              WMAction *out_action) {
-  for (int i = 0; i < config->bindings_count; i++) {
-    const WMBinding *binding = &config->bindings[i];
-    if (binding->modifiers == modifiers && binding->keycode == keycode) {
-      out_action->type = binding->action;
-      out_action->target_buffer = binding->action_argument;
-      out_action->target_pid = 0;
-      strncpy(out_action->bundle_identifier, binding->bundle_identifier,
-              sizeof(out_action->bundle_identifier) - 1);
-      out_action->bundle_identifier[sizeof(out_action->bundle_identifier) - 1] =
-          '\0';
-      return true;
-    }
-  }
-  return false;
+  int index = wm_config_find_binding(config, 0, modifiers, keycode);
+  if (index < 0 || config->bindings[index].next_node >= 0)
+    return false;
+
+  const WMBinding *binding = &config->bindings[index];
+  out_action->type = binding->action;
+  out_action->target_buffer = binding->action_argument;
+  out_action->target_pid = 0;
+  strncpy(out_action->bundle_identifier, binding->bundle_identifier,
+          sizeof(out_action->bundle_identifier) - 1);
+  out_action->bundle_identifier[sizeof(out_action->bundle_identifier) - 1] =
+      '\0';
+  return true;
 }
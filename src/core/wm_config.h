@@ -6,14 +6,28 @@
 #include <stdint.h>
 #include <sys/types.h>
 
-#define WM_MAX_RULES 64    // max rules for auto-assignment
-#define WM_MAX_BINDINGS 64 // max global hotkey bindings
+#define WM_MAX_RULES 64            // max rules for auto-assignment
+#define WM_RULE_INDEX_SIZE 128    // rule hash index slots (2x rules)
+#define WM_MAX_BINDINGS 120       // max hotkey bindings and sequence prefixes
+#define WM_BINDING_INDEX_SIZE 256 // binding hash index slots (2x bindings)
+#define WM_MAX_KEY_NODES 32       // key trie nodes, 0 = root
+#define WM_MAX_KEY_SEQUENCE 4     // keys in one binding
+#define WM_KEY_TIMEOUT_MS 1000    // default sequence/layer timeout
+#define WM_MAX_EFFECT_BUDGET_MS 100 // upper bound of effect_budget
+#define WM_AX_TIMEOUT_MS 500      // default wait for an app's AX answer
+#define WM_MAX_AX_TIMEOUT_MS 6000 // upper bound (the system default)
+#define WM_MAX_HOOKS 16           // event hooks
+#define WM_HOOK_COMMAND_SIZE 256  // shell command of a hook
+#define WM_HOOK_TIMEOUT_MS 5000   // default run time before a hook is killed
+#define WM_MAX_HOOK_TIMEOUT_MS 60000 // upper bound of hook_timeout
+#define WM_MAX_VISIBILITY_RULES 32 // apps with their own visibility
 
 #define WM_KEYCODE_RETILE 17    // keycode for retile
 #define WM_KEY_LEFT_ARROW 0x7B  // left arrow keycode
 #define WM_KEY_RIGHT_ARROW 0x7C // right arrow keycode
 #define WM_KEY_UP_ARROW 0x7E    // up arrow keycode
 #define WM_KEY_DOWN_ARROW 0x7D  // down arrow keycode
+#define WM_KEY_ESCAPE 0x35      // escape keycode, leaves a layer
 
 // gaps - CSS style gaps
 typedef struct {
@@ -27,6 +41,7 @@ typedef struct {
 typedef struct {
   char bundle_identifier[128]; // e.g., com.spotify.client
   int8_t target_buffer;        // e.g., 3 (buffer 4)
+  uint32_t bundle_hash;        // wm_config_hash_bundle(bundle_identifier)
 } WMRule;
 
 // bindings
@@ -38,34 +53,122 @@ typedef enum {
   WM_MOD_CTRL = 1 << 3,  // Control
 } WMModifier;
 
-// bindings - global hotkey bindings
+// key trie node flags
+typedef enum {
+  WM_KEY_NODE_LAYER = 1 << 0, // modal: stay in the node after an action
+} WMKeyNodeFlag;
+
+// bindings - a key pressed in a key trie node (0 = root, plain hotkeys)
+// either fires an action or, for a sequence prefix, leads to another node
 typedef struct {
   int modifiers;               // combined modifier bitmask
   int keycode;                 // keycode
   WMActionType action;         // action to perform
   int action_argument;         // argument for the action
   char bundle_identifier[128]; // bundle identifier for app launch
+  uint8_t node;                // node the key is pressed in
+  int8_t next_node;            // node a prefix leads to, -1 = fires action
 } WMBinding;
 
+// how the apps of hidden buffers leave the screen
+typedef enum {
+  WM_VISIBILITY_HIDE = 0, // hide/unhide the app (default)
+  WM_VISIBILITY_PARK,     // move its window off screen and back
+  WM_VISIBILITY_AUTO,     // park apps that are slow to hide or unhide
+} WMVisibilityMode;
+
+// grid tiled frames are snapped to ("layout_snap = pixels")
+typedef enum {
+  WM_LAYOUT_SNAP_POINTS = 0, // whole points (default)
+  WM_LAYOUT_SNAP_PIXELS,     // backing pixels of the display (half points
+                             // on retina)
+  WM_LAYOUT_SNAP_OFF,        // fractional, as divided
+} WMLayoutSnap;
+
+// visibility of one app ("visibility = com.spotify.client, park")
+typedef struct {
+  char bundle_identifier[128];
+  uint32_t bundle_hash; // wm_config_hash_bundle(bundle_identifier)
+  uint8_t mode;         // WMVisibilityMode
+} WMVisibilityRule;
+
+// hooks - shell command run on an event ("hook = buffer, ~/bin/bar")
+typedef struct {
+  uint8_t event;                      // WMControlEventType
+  char command[WM_HOOK_COMMAND_SIZE]; // run by /bin/sh -c
+} WMHook;
+
 // config - global configuration (default + user overrides)
 typedef struct WMConfig {
   WMGap gaps_outer;
   WMGap gaps_inner;
+  uint8_t layout_snap; // WMLayoutSnap
 
   WMRule rules[WM_MAX_RULES];
   int rules_count;
+  int8_t rule_index[WM_RULE_INDEX_SIZE]; // hash -> rule, -1 = empty slot
 
   WMBinding bindings[WM_MAX_BINDINGS];
   int bindings_count;
+  int8_t binding_index[WM_BINDING_INDEX_SIZE]; // key -> binding, -1 = empty
+
+  uint8_t key_node_count;                   // trie nodes in use, root included
+  uint8_t key_node_flags[WM_MAX_KEY_NODES]; // WMKeyNodeFlag per node
+  int key_timeout_ms; // a pending sequence or layer resets after this
+  int effect_budget_ms; // per run loop turn on deferred switch effects
+  int ax_timeout_ms;    // accessibility calls into an app give up after this
+
+  WMHook hooks[WM_MAX_HOOKS];
+  int hooks_count;
+  int hook_timeout_ms; // a hook still running after this is killed
+
+  uint8_t visibility; // WMVisibilityMode of apps without their own
+  WMVisibilityRule visibility_rules[WM_MAX_VISIBILITY_RULES];
+  int visibility_rules_count;
 } WMConfig;
 
 // initialize the config with defaults
 void wm_config_init(WMConfig *config);
 
-// load config from file. Returns false on error
+// load config from file on top of the defaults. Lines that can't be parsed
+// are skipped, a bind for a key that is already bound replaces it.
+// Returns false if the file can't be read (config keeps the defaults)
 // path is ~/.config/.dwin by default
 bool wm_config_load(WMConfig *config, const char *path);
 
+// keycode of a key name (a, 1, return, left, ...), -1 if unknown
+int wm_config_keycode_from_name(const char *name);
+
+// index of the binding for a key pressed in a trie node, -1 if unbound
+int wm_config_find_binding(const WMConfig *config, int node, int modifiers,
+                           int keycode);
+
+// bind a key sequence (keys[0] first) to an action, creating prefix nodes
+// as needed. A prefix that was bound to an action becomes a prefix. Returns
+// false if the sequence is too long or the trie is full
+bool wm_config_add_sequence(WMConfig *config, const int *modifiers,
+                            const int *keycodes, int length,
+                            WMActionType action, int action_argument,
+                            const char *bundle_identifier);
+
+// make the node reached by a key sequence a modal layer: its bindings keep
+// the matcher in the layer until escape, an unbound key or the timeout
+bool wm_config_add_layer(WMConfig *config, const int *modifiers,
+                         const int *keycodes, int length);
+
+// add a hook for an event class programatically. Returns false if the
+// command is empty or too long or the hooks are full
+bool wm_config_add_hook(WMConfig *config, int event, const char *command);
+
+// set the visibility mode of an app (replacing its previous one). Returns
+// false if the rules are full or the mode is unknown
+bool wm_config_add_visibility(WMConfig *config, const char *bundle_identifier,
+                              WMVisibilityMode mode);
+
+// visibility mode of an app: its own, else the global one
+WMVisibilityMode wm_config_visibility(const WMConfig *config,
+                                      const char *bundle_identifier);
+
 // add a rule programatically
 bool wm_config_add_rule(WMConfig *config, const char *bundle_identifier,
                         int target_buffer);
@@ -73,11 +176,20 @@ bool wm_config_add_rule(WMConfig *config, const char *bundle_identifier,
 // match a bundle identifier against rules. Return buffers index or -1
 int wm_config_match_rule(const WMConfig *config, const char *bundle_identifier);
 
+// same as wm_config_match_rule with the bundle hash already computed
+int wm_config_match_rule_hashed(const WMConfig *config,
+                                const char *bundle_identifier, uint32_t hash);
+
+// hash of a bundle identifier (FNV-1a), used by rules and bulk registration
+uint32_t wm_config_hash_bundle(const char *bundle_identifier);
+
 // add a binding programatically
 bool wm_config_add_binding(WMConfig *config, int modifiers, int keycode,
                            WMActionType action, int action_argument,
                            const char *bundle_identifier);
-// match a keypress against bindings. Return action type
+
+// match a single keypress against root bindings (sequence prefixes don't
+// match). Return action type
 bool wm_config_match_binding(const WMConfig *config, int modifiers, int keycode,
                              WMAction *out_action);
 
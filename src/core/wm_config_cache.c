@@ -0,0 +1,196 @@
+#include "wm_config_cache.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#define MTIME_NSEC(st) ((st).st_mtimespec.tv_nsec)
+#else
+#define MTIME_NSEC(st) ((st).st_mtim.tv_nsec)
+#endif
+
+#define FNV64_BASIS 14695981039346656037u
+#define FNV64_PRIME 1099511628211u
+
+// FNV-1a over 8-byte words (bytes for the tail), both the source and the
+// config are hashed on every start
+static uint64_t hash_words(uint64_t hash, const void *data, size_t size) {
+  const uint8_t *bytes = data;
+  size_t words = size / sizeof(uint64_t);
+  for (size_t i = 0; i < words; i++) {
+    uint64_t word;
+    memcpy(&word, bytes + i * sizeof(word), sizeof(word));
+    hash ^= word;
+    hash *= FNV64_PRIME;
+  }
+  for (size_t i = words * sizeof(uint64_t); i < size; i++) {
+    hash ^= bytes[i];
+    hash *= FNV64_PRIME;
+  }
+  return hash;
+}
+
+static uint32_t fold_hash(uint64_t hash) {
+  return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static uint32_t hash_config(const WMConfig *config) {
+  return fold_hash(hash_words(FNV64_BASIS, config, sizeof(WMConfig)));
+}
+
+// identity of the source file (stat + content hash). With expected set the
+// content is only read if mtime and size match it
+static bool read_source(const char *path, const WMConfigSource *expected,
+                        WMConfigSource *out) {
+  memset(out, 0, sizeof(*out));
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  out->mtime_sec = st.st_mtime;
+  out->mtime_nsec = MTIME_NSEC(st);
+  out->size = st.st_size;
+
+  if (expected && (expected->mtime_sec != out->mtime_sec ||
+                   expected->mtime_nsec != out->mtime_nsec ||
+                   expected->size != out->size)) {
+    close(fd);
+    return false;
+  }
+
+  uint64_t hash = FNV64_BASIS;
+  uint8_t chunk[4096];
+  ssize_t size;
+  while ((size = read(fd, chunk, sizeof(chunk))) > 0) {
+    hash = hash_words(hash, chunk, (size_t)size);
+  }
+  close(fd);
+
+  out->hash = fold_hash(hash);
+  return size == 0;
+}
+
+// write config as an image of source (temporary file, then rename)
+static bool write_image(const WMConfig *config, const WMConfigSource *source,
+                        const char *image_path) {
+  WMConfigCacheImage image;
+  memset(&image.header, 0, sizeof(image.header));
+  image.header.magic = WM_CONFIG_CACHE_MAGIC;
+  image.header.version = WM_CONFIG_CACHE_VERSION;
+  image.header.config_size = sizeof(WMConfig);
+  image.header.source = *source;
+  image.config = *config;
+  image.header.checksum = hash_config(&image.config);
+
+  char tmp_path[PATH_MAX];
+  if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", image_path) >=
+      (int)sizeof(tmp_path))
+    return false;
+
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    return false;
+
+  bool ok = write(fd, &image, sizeof(image)) == (ssize_t)sizeof(image);
+  ok = close(fd) == 0 && ok;
+  if (!ok || rename(tmp_path, image_path) != 0) {
+    unlink(tmp_path);
+    return false;
+  }
+  return true;
+}
+
+bool wm_config_compile(const char *source_path, const char *image_path) {
+  // identity first: if the source changes while parsing, the hash won't
+  // match it next time and the image is rebuilt
+  WMConfigSource source;
+  if (!read_source(source_path, NULL, &source))
+    return false;
+
+  WMConfig config;
+  if (!wm_config_load(&config, source_path))
+    return false;
+
+  return write_image(&config, &source, image_path);
+}
+
+const WMConfig *wm_config_cache_map(WMConfigCache *cache,
+                                    const char *source_path,
+                                    const char *image_path) {
+  cache->image = NULL;
+  cache->config = NULL;
+
+  int fd = open(image_path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size != (off_t)sizeof(WMConfigCacheImage)) {
+    close(fd);
+    return NULL;
+  }
+
+  // the mapping outlives the descriptor
+  void *map =
+      mmap(NULL, sizeof(WMConfigCacheImage), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  const WMConfigCacheImage *image = map;
+  const WMConfigCacheHeader *header = &image->header;
+
+  // cheap checks first, the source is only hashed if its stat matches
+  WMConfigSource source;
+  bool fresh = header->magic == WM_CONFIG_CACHE_MAGIC &&
+               header->version == WM_CONFIG_CACHE_VERSION &&
+               header->config_size == sizeof(WMConfig) &&
+               read_source(source_path, &header->source, &source) &&
+               header->source.hash == source.hash &&
+               header->checksum == hash_config(&image->config);
+
+  if (!fresh) {
+    munmap(map, sizeof(WMConfigCacheImage));
+    return NULL;
+  }
+
+  cache->image = image;
+  cache->config = &image->config;
+  return cache->config;
+}
+
+const WMConfig *wm_config_cache_load(WMConfigCache *cache,
+                                     const char *source_path,
+                                     const char *image_path) {
+  if (wm_config_cache_map(cache, source_path, image_path))
+    return cache->config;
+
+  // stale or missing image: parse and compile it for the next start
+  WMConfigSource source;
+  bool has_source = read_source(source_path, NULL, &source);
+  if (!wm_config_load(&cache->parsed, source_path))
+    has_source = false;
+  if (has_source)
+    write_image(&cache->parsed, &source, image_path);
+
+  cache->config = &cache->parsed;
+  return cache->config;
+}
+
+void wm_config_cache_close(WMConfigCache *cache) {
+  if (cache->image)
+    munmap((void *)cache->image, sizeof(WMConfigCacheImage));
+
+  cache->image = NULL;
+  cache->config = NULL;
+}
@@ -0,0 +1,64 @@
+#ifndef WM_CONFIG_CACHE_H
+#define WM_CONFIG_CACHE_H
+
+#include "wm_config.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WM_CONFIG_CACHE_MAGIC 0x47464344u // "DCFG"
+#define WM_CONFIG_CACHE_VERSION 7
+
+// identifies the source text an image was compiled from
+typedef struct {
+  int64_t mtime_sec;  // source st_mtime
+  int64_t mtime_nsec; // source st_mtime nanoseconds
+  int64_t size;       // source size in bytes
+  uint32_t hash;      // FNV-1a of the source bytes
+  uint32_t reserved;
+} WMConfigSource;
+
+typedef struct {
+  uint32_t magic;        // WM_CONFIG_CACHE_MAGIC
+  uint16_t version;      // WM_CONFIG_CACHE_VERSION
+  uint16_t reserved;
+  uint32_t config_size;  // sizeof(WMConfig), catches layout changes
+  uint32_t checksum;     // FNV-1a of config
+  WMConfigSource source; // source the config was parsed from
+} WMConfigCacheHeader;
+
+// compiled image. WMConfig holds no pointers: strings are stored inline
+// and the rule/binding indexes are array offsets, so the mapped config is
+// used as is, without fixups
+typedef struct {
+  WMConfigCacheHeader header;
+  WMConfig config;
+} WMConfigCacheImage;
+
+// config in use, mapped from an image or parsed as a fallback
+typedef struct {
+  const WMConfigCacheImage *image; // mapped image, NULL = parsed
+  WMConfig parsed;                 // fallback storage
+  const WMConfig *config;          // &image->config or &parsed
+} WMConfigCache;
+
+// parse source_path and write the compiled image to image_path (through a
+// temporary file renamed over it, so readers never see a partial image).
+// Returns false if the source can't be read or the image can't be written
+bool wm_config_compile(const char *source_path, const char *image_path);
+
+// map image_path if it was compiled from source_path as it is now (same
+// mtime, size and content hash). Returns the mapped config or NULL
+const WMConfig *wm_config_cache_map(WMConfigCache *cache,
+                                    const char *source_path,
+                                    const char *image_path);
+
+// get the config: mapped from a fresh image, otherwise parsed from source
+// (defaults if it is missing) and compiled to image_path for the next start
+const WMConfig *wm_config_cache_load(WMConfigCache *cache,
+                                     const char *source_path,
+                                     const char *image_path);
+
+// unmap the image, cache->config is invalid afterwards
+void wm_config_cache_close(WMConfigCache *cache);
+
+#endif
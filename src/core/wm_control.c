@@ -0,0 +1,524 @@
+#include "wm_control.h"
+#include "wm_state.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ARGS (WM_MAX_BUFFERS + 1) // view with every buffer
+
+typedef struct {
+  const char *name;
+  uint8_t op;     // WMControlOp
+  int8_t min;     // arguments
+  int8_t max;
+} CommandSpec;
+
+static const CommandSpec COMMANDS[] = {
+    {"move", WM_CONTROL_MOVE, 2, 2},
+    {"tag", WM_CONTROL_TAG, 2, 2},
+    {"float", WM_CONTROL_FLOAT, 1, 1},
+    {"tile", WM_CONTROL_TILE, 1, 1},
+    {"switch", WM_CONTROL_SWITCH, 1, 1},
+    {"view", WM_CONTROL_VIEW, 1, WM_MAX_BUFFERS},
+    {"retile", WM_CONTROL_RETILE, 0, 0},
+    {"apps", WM_CONTROL_APPS, 0, 0},
+    {"buffers", WM_CONTROL_BUFFERS, 0, 0},
+    {"frames", WM_CONTROL_FRAMES, 0, 0},
+    {"focus", WM_CONTROL_FOCUS, 0, 0},
+    {"subscribe", WM_CONTROL_SUBSCRIBE, 0, WM_CONTROL_EVENT_COUNT},
+};
+
+static const char *EVENT_NAMES[WM_CONTROL_EVENT_COUNT] = {
+    [WM_CONTROL_EVENT_BUFFER] = "buffer",
+    [WM_CONTROL_EVENT_APP] = "app",
+    [WM_CONTROL_EVENT_FOCUS] = "focus",
+    [WM_CONTROL_EVENT_LAYOUT] = "layout",
+};
+
+#define COMMAND_COUNT ((int)(sizeof(COMMANDS) / sizeof(COMMANDS[0])))
+
+static bool fail(char *error, size_t error_size, const char *format,
+                 const char *detail) {
+  if (error_size > 0)
+    snprintf(error, error_size, format, detail);
+  return false;
+}
+
+// parse a 1-based buffer number, returns the 0-based index or -1
+static int parse_buffer(const char *text) {
+  char *end;
+  long number = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || number < 1 || number > WM_MAX_BUFFERS)
+    return -1;
+  return (int)number - 1;
+}
+
+// parse a pid, returns 0 if it isn't one
+static pid_t parse_pid(const char *text) {
+  char *end;
+  long number = strtol(text, &end, 10);
+  if (end == text || *end != '\0' || number < 1 || number > INT32_MAX)
+    return 0;
+  return (pid_t)number;
+}
+
+static const CommandSpec *find_command(const char *name) {
+  for (int i = 0; i < COMMAND_COUNT; i++) {
+    if (strcmp(COMMANDS[i].name, name) == 0)
+      return &COMMANDS[i];
+  }
+  return NULL;
+}
+
+int wm_control_event_from_name(const char *name) {
+  for (int i = 0; i < WM_CONTROL_EVENT_COUNT; i++) {
+    if (strcmp(EVENT_NAMES[i], name) == 0)
+      return i;
+  }
+  return -1;
+}
+
+const char *wm_control_event_name(WMControlEventType type) {
+  return type < WM_CONTROL_EVENT_COUNT ? EVENT_NAMES[type] : "unknown";
+}
+
+// parse the words of one command into the next slot of batch
+static bool parse_command(char **words, int count, WMControlBatch *batch,
+                          char *error, size_t error_size) {
+  WMControlCommand *out = &batch->commands[batch->count];
+  const CommandSpec *spec = find_command(words[0]);
+  if (spec == NULL)
+    return fail(error, error_size, "unknown command '%s'", words[0]);
+  int args = count - 1;
+  if (args < spec->min || args > spec->max)
+    return fail(error, error_size, "wrong number of arguments to '%s'",
+                words[0]);
+
+  memset(out, 0, sizeof(*out));
+  out->op = spec->op;
+  out->buffer = -1;
+
+  switch ((WMControlOp)spec->op) {
+  case WM_CONTROL_MOVE:
+  case WM_CONTROL_TAG:
+  case WM_CONTROL_FLOAT:
+  case WM_CONTROL_TILE:
+    out->pid = parse_pid(words[1]);
+    if (out->pid == 0)
+      return fail(error, error_size, "bad pid '%s'", words[1]);
+    if (args == 2) {
+      out->buffer = (int8_t)parse_buffer(words[2]);
+      if (out->buffer < 0)
+        return fail(error, error_size, "bad buffer '%s'", words[2]);
+    }
+    break;
+  case WM_CONTROL_SWITCH:
+  case WM_CONTROL_VIEW:
+    for (int i = 1; i < count; i++) {
+      int buffer = parse_buffer(words[i]);
+      if (buffer < 0)
+        return fail(error, error_size, "bad buffer '%s'", words[i]);
+      if (i == 1)
+        out->buffer = (int8_t)buffer;
+      out->view |= WM_BUFFER_BIT(buffer);
+    }
+    break;
+  case WM_CONTROL_SUBSCRIBE:
+    batch->subscribe = count == 1 ? WM_CONTROL_EVENT_ALL : 0;
+    for (int i = 1; i < count; i++) {
+      int type = wm_control_event_from_name(words[i]);
+      if (type < 0)
+        return fail(error, error_size, "unknown event class '%s'", words[i]);
+      batch->subscribe |= WM_CONTROL_EVENT_BIT(type);
+    }
+    break;
+  default:
+    break;
+  }
+  return true;
+}
+
+bool wm_control_parse(const char *request, WMControlBatch *out_batch,
+                      char *error, size_t error_size) {
+  memset(out_batch, 0, sizeof(*out_batch));
+
+  char text[WM_CONTROL_MAX_REQUEST];
+  if (strlen(request) >= sizeof(text))
+    return fail(error, error_size, "%s", "request too long");
+  strcpy(text, request);
+
+  char *save_command;
+  for (char *command = strtok_r(text, ";", &save_command); command != NULL;
+       command = strtok_r(NULL, ";", &save_command)) {
+    char *words[MAX_ARGS + 1];
+    int count = 0;
+    char *save_word;
+    for (char *word = strtok_r(command, " \t\r\n", &save_word); word != NULL;
+         word = strtok_r(NULL, " \t\r\n", &save_word)) {
+      if (count > MAX_ARGS)
+        return fail(error, error_size, "too many arguments to '%s'",
+                    words[0]);
+      words[count++] = word;
+    }
+    if (count == 0)
+      continue; // empty command (e.g. a trailing ';')
+
+    if (out_batch->count >= WM_CONTROL_MAX_COMMANDS)
+      return fail(error, error_size, "%s", "too many commands");
+    if (!parse_command(words, count, out_batch, error, error_size))
+      return false;
+    if (out_batch->commands[out_batch->count++].op < WM_CONTROL_APPS)
+      out_batch->has_mutation = true;
+  }
+
+  if (out_batch->count == 0)
+    return fail(error, error_size, "%s", "empty request");
+  if (out_batch->subscribe != 0 && out_batch->count > 1)
+    return fail(error, error_size, "%s", "subscribe must be alone");
+  return true;
+}
+
+static void add_moved(WMControlEffects *out, pid_t pid) {
+  for (int i = 0; i < out->moved_count; i++) {
+    if (out->moved[i] == pid)
+      return;
+  }
+  if (out->moved_count < WM_MAX_APPS)
+    out->moved[out->moved_count++] = pid;
+}
+
+bool wm_control_apply(WMState *state, const WMControlBatch *batch,
+                      WMControlEffects *out, char *error, size_t error_size) {
+  memset(out, 0, sizeof(*out));
+
+  // check every app first, a batch never stops halfway
+  for (int i = 0; i < batch->count; i++) {
+    const WMControlCommand *command = &batch->commands[i];
+    if (command->pid != 0 && wm_state_find_app(state, command->pid) == NULL) {
+      char pid[16];
+      snprintf(pid, sizeof(pid), "%d", (int)command->pid);
+      return fail(error, error_size, "unknown app %s", pid);
+    }
+  }
+
+  WMBufferMask old_view = wm_state_get_view(state);
+  WMBufferMask shown = wm_state_get_shown(state); // on any display
+  WMBufferMask old_masks[WM_MAX_APPS];
+  int primary = state->active_buffer;
+  WMBufferMask view = old_view;
+  bool retile = false;
+
+  for (int i = 0; i < batch->count; i++) {
+    const WMControlCommand *command = &batch->commands[i];
+    WMBufferMask before = wm_state_get_buffer_mask(state, command->pid);
+
+    switch ((WMControlOp)command->op) {
+    case WM_CONTROL_MOVE:
+    case WM_CONTROL_TAG: {
+      // remember the mask from before the batch for visibility
+      int known = out->moved_count;
+      add_moved(out, command->pid);
+      if (out->moved_count > known)
+        old_masks[known] = before;
+
+      if (command->op == WM_CONTROL_MOVE)
+        wm_state_assign_to_buffer(state, command->pid, command->buffer);
+      else
+        wm_state_toggle_buffer(state, command->pid, command->buffer);
+      out->dirty_buffers |=
+          before ^ wm_state_get_buffer_mask(state, command->pid);
+      break;
+    }
+    case WM_CONTROL_FLOAT:
+    case WM_CONTROL_TILE:
+      wm_state_set_floating(state, command->pid,
+                            command->op == WM_CONTROL_FLOAT);
+      out->dirty_buffers |= before;
+      break;
+    case WM_CONTROL_SWITCH:
+    case WM_CONTROL_VIEW:
+      primary = command->buffer;
+      view = command->view;
+      break;
+    case WM_CONTROL_RETILE:
+      retile = true;
+      break;
+    default:
+      break; // queries
+    }
+  }
+
+  out->view_changed = primary != state->active_buffer || view != old_view;
+  out->primary_buffer = primary;
+  out->view = view;
+
+  // a view switch tiles its view anyway
+  out->needs_layout = !out->view_changed &&
+                      (retile || (out->dirty_buffers & shown) != 0);
+
+  // a switch shows and hides apps by their buffers now, apps that were
+  // shown or hidden by their old buffers need it done for them
+  for (int i = 0; i < out->moved_count; i++) {
+    WMBufferMask now = wm_state_get_buffer_mask(state, out->moved[i]);
+    if (((old_masks[i] & shown) != 0) != ((now & shown) != 0))
+      out->visibility[out->visibility_count++] = out->moved[i];
+  }
+  return true;
+}
+
+void wm_control_snapshot(WMControlSnapshot *out, const WMState *state,
+                         const WMFrameChange *frames, int frame_count) {
+  out->version = state->version;
+  out->active_buffer = state->active_buffer;
+  out->view = wm_state_get_view(state);
+  for (int i = 0; i < WM_MAX_BUFFERS; i++)
+    out->focused[i] = state->buffers[i].last_focused_pid;
+
+  const WMAppRegistry *registry = &state->app_registry;
+  out->app_count = registry->app_count;
+  for (int i = 0; i < registry->app_count; i++) {
+    const WMApp *app = &registry->apps[i];
+    WMControlApp *entry = &out->apps[i];
+    entry->pid = app->pid;
+    entry->buffers = registry->buffer_masks[i];
+    entry->is_floating = app->is_floating;
+    entry->has_frame = false;
+    memcpy(entry->bundle_identifier, app->bundle_identifier,
+           sizeof(entry->bundle_identifier));
+
+    for (int j = 0; j < frame_count; j++) {
+      if (frames[j].pid == app->pid) {
+        entry->has_frame = true;
+        entry->frame = frames[j].frame;
+        break;
+      }
+    }
+  }
+}
+
+// append to a reply, false once it no longer fits
+static bool append(char *out, size_t size, size_t *length, const char *format,
+                   ...) {
+  if (*length >= size)
+    return false;
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(out + *length, size - *length, format, args);
+  va_end(args);
+  if (written < 0 || (size_t)written >= size - *length)
+    return false;
+  *length += (size_t)written;
+  return true;
+}
+
+void wm_control_format_buffers(WMBufferMask mask, char *out, size_t size) {
+  size_t length = 0;
+  out[0] = '\0';
+  for (int i = 0; i < WM_MAX_BUFFERS; i++) {
+    if ((mask & WM_BUFFER_BIT(i)) != 0)
+      append(out, size, &length, length == 0 ? "%d" : ",%d", i + 1);
+  }
+  if (length == 0)
+    snprintf(out, size, "-");
+}
+
+static bool reply_query(const WMControlSnapshot *snapshot, WMControlOp op,
+                        char *out, size_t size, size_t *length) {
+  char buffers[2 * WM_MAX_BUFFERS + 1];
+
+  switch (op) {
+  case WM_CONTROL_APPS:
+    // app <pid> <bundle> buffers <n,...> tiled|floating
+    for (int i = 0; i < snapshot->app_count; i++) {
+      const WMControlApp *app = &snapshot->apps[i];
+      wm_control_format_buffers(app->buffers, buffers, sizeof(buffers));
+      if (!append(out, size, length, "app %d %s buffers %s %s\n",
+                  (int)app->pid, app->bundle_identifier, buffers,
+                  app->is_floating ? "floating" : "tiled"))
+        return false;
+    }
+    return true;
+  case WM_CONTROL_BUFFERS:
+    // buffer <n> active|shown|hidden apps <count> focus <pid>
+    for (int b = 0; b < WM_MAX_BUFFERS; b++) {
+      int count = 0;
+      for (int i = 0; i < snapshot->app_count; i++) {
+        if ((snapshot->apps[i].buffers & WM_BUFFER_BIT(b)) != 0)
+          count++;
+      }
+      const char *shown = b == snapshot->active_buffer ? "active"
+                          : (snapshot->view & WM_BUFFER_BIT(b)) != 0 ? "shown"
+                                                                    : "hidden";
+      if (!append(out, size, length, "buffer %d %s apps %d focus %d\n", b + 1,
+                  shown, count, (int)snapshot->focused[b]))
+        return false;
+    }
+    return true;
+  case WM_CONTROL_FRAMES:
+    // frame <pid> <x> <y> <width> <height>, tiled apps of the view
+    for (int i = 0; i < snapshot->app_count; i++) {
+      const WMControlApp *app = &snapshot->apps[i];
+      if (app->has_frame &&
+          !append(out, size, length, "frame %d %.0f %.0f %.0f %.0f\n",
+                  (int)app->pid, app->frame.x, app->frame.y,
+                  app->frame.width, app->frame.height))
+        return false;
+    }
+    return true;
+  case WM_CONTROL_FOCUS: {
+    // focus <pid>, 0 = none
+    int active = snapshot->active_buffer;
+    pid_t pid = 0;
+    if (active >= 0 && active < WM_MAX_BUFFERS)
+      pid = snapshot->focused[active];
+    return append(out, size, length, "focus %d\n", (int)pid);
+  }
+  default:
+    return true; // mutations have no lines
+  }
+}
+
+int wm_control_reply(const WMControlSnapshot *snapshot,
+                     const WMControlBatch *batch, char *out, size_t size) {
+  size_t length = 0;
+  for (int i = 0; i < batch->count; i++) {
+    if (!reply_query(snapshot, (WMControlOp)batch->commands[i].op, out, size,
+                     &length))
+      return wm_control_error("reply too long", out, size);
+  }
+  if (!append(out, size, &length, "ok\n\n"))
+    return wm_control_error("reply too long", out, size);
+  return (int)length;
+}
+
+int wm_control_error(const char *message, char *out, size_t size) {
+  size_t length = 0;
+  if (size > 0)
+    out[0] = '\0';
+  append(out, size, &length, "error %s\n\n", message);
+  return (int)length;
+}
+
+// index of pid in a snapshot, trying where it was first (apps rarely move)
+static int find_snapshot_app(const WMControlSnapshot *snapshot, pid_t pid,
+                             int hint) {
+  if (hint < snapshot->app_count && snapshot->apps[hint].pid == pid)
+    return hint;
+  for (int i = 0; i < snapshot->app_count; i++) {
+    if (snapshot->apps[i].pid == pid)
+      return i;
+  }
+  return -1;
+}
+
+static WMBufferMask occupied_buffers(const WMControlSnapshot *snapshot) {
+  WMBufferMask occupied = 0;
+  for (int i = 0; i < snapshot->app_count; i++)
+    occupied |= snapshot->apps[i].buffers;
+  return occupied;
+}
+
+static pid_t focused_app(const WMControlSnapshot *snapshot) {
+  int active = snapshot->active_buffer;
+  if (active < 0 || active >= WM_MAX_BUFFERS)
+    return 0;
+  return snapshot->focused[active];
+}
+
+int wm_control_diff(const WMControlSnapshot *old,
+                    const WMControlSnapshot *now, WMControlEvent *out,
+                    int max_events) {
+  int count = 0;
+
+  // moved or launched, then quit
+  for (int i = 0; i < now->app_count && count < max_events; i++) {
+    const WMControlApp *app = &now->apps[i];
+    int before = find_snapshot_app(old, app->pid, i);
+    if (before < 0 || old->apps[before].buffers != app->buffers)
+      out[count++] = (WMControlEvent){.type = WM_CONTROL_EVENT_APP,
+                                      .pid = app->pid,
+                                      .buffers = app->buffers};
+  }
+  for (int i = 0; i < old->app_count && count < max_events; i++) {
+    if (find_snapshot_app(now, old->apps[i].pid, i) < 0)
+      out[count++] = (WMControlEvent){.type = WM_CONTROL_EVENT_APP,
+                                      .pid = old->apps[i].pid};
+  }
+
+  WMBufferMask occupied = occupied_buffers(now);
+  if (count < max_events &&
+      (old->active_buffer != now->active_buffer || old->view != now->view ||
+       occupied_buffers(old) != occupied))
+    out[count++] = (WMControlEvent){.type = WM_CONTROL_EVENT_BUFFER,
+                                    .buffer = (int8_t)now->active_buffer,
+                                    .view = now->view,
+                                    .buffers = occupied};
+
+  pid_t focus = focused_app(now);
+  if (count < max_events && focused_app(old) != focus)
+    out[count++] =
+        (WMControlEvent){.type = WM_CONTROL_EVENT_FOCUS, .pid = focus};
+  return count;
+}
+
+int wm_control_format_event(const WMControlEvent *event, char *out,
+                            size_t size) {
+  char view[2 * WM_MAX_BUFFERS + 1];
+  char buffers[2 * WM_MAX_BUFFERS + 1];
+  wm_control_format_buffers(event->view, view, sizeof(view));
+  wm_control_format_buffers(event->buffers, buffers, sizeof(buffers));
+
+  size_t length = 0;
+  bool fits;
+  switch ((WMControlEventType)event->type) {
+  case WM_CONTROL_EVENT_BUFFER:
+    fits = append(out, size, &length, "event buffer %d view %s occupied %s\n",
+                  event->buffer + 1, view, buffers);
+    break;
+  case WM_CONTROL_EVENT_APP:
+    fits = append(out, size, &length, "event app %d buffers %s\n",
+                  (int)event->pid, buffers);
+    break;
+  case WM_CONTROL_EVENT_FOCUS:
+    fits = append(out, size, &length, "event focus %d\n", (int)event->pid);
+    break;
+  case WM_CONTROL_EVENT_LAYOUT:
+    fits = append(out, size, &length, "event layout view %s apps %d\n", view,
+                  event->count);
+    break;
+  default:
+    fits = false;
+    break;
+  }
+  return fits ? (int)length : 0;
+}
+
+int wm_control_format_dropped(uint32_t dropped, char *out, size_t size) {
+  size_t length = 0;
+  return append(out, size, &length, "event dropped %u\n", dropped)
+             ? (int)length
+             : 0;
+}
+
+bool wm_control_ring_push(WMControlEventRing *ring,
+                          const WMControlEvent *event) {
+  bool full = ring->count == WM_CONTROL_EVENT_RING;
+  if (full) {
+    ring->head = (uint16_t)((ring->head + 1) % WM_CONTROL_EVENT_RING);
+    ring->count--;
+    ring->dropped++;
+  }
+  ring->events[(ring->head + ring->count) % WM_CONTROL_EVENT_RING] = *event;
+  ring->count++;
+  return !full;
+}
+
+bool wm_control_ring_pop(WMControlEventRing *ring, WMControlEvent *out) {
+  if (ring->count == 0)
+    return false;
+  *out = ring->events[ring->head];
+  ring->head = (uint16_t)((ring->head + 1) % WM_CONTROL_EVENT_RING);
+  ring->count--;
+  return true;
+}
@@ -0,0 +1,191 @@
+#ifndef WM_CONTROL_H
+#define WM_CONTROL_H
+
+#include "wm_layout.h"
+#include "wm_runtime.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WM_CONTROL_MAX_COMMANDS 32    // commands in one request
+#define WM_CONTROL_MAX_REQUEST 4096   // request line bytes, with terminator
+#define WM_CONTROL_MAX_REPLY 32768    // reply bytes, with terminator
+#define WM_CONTROL_ERROR_SIZE 128     // error message bytes
+#define WM_CONTROL_EVENT_RING 64      // events a subscriber may fall behind
+#define WM_CONTROL_MAX_EVENTS 256     // events from one state change
+
+struct WMState;
+
+// commands of the control protocol. A request is one line of commands
+// separated by ';', buffers are numbered from 1 like the hotkeys:
+//   move <pid> <buffer>    put an app in a buffer (only that one)
+//   tag <pid> <buffer>     add/remove an app to/from a buffer
+//   float <pid>            take an app out of the layout
+//   tile <pid>             put an app back into the layout
+//   switch <buffer>        show a buffer
+//   view <buffer>...       show several buffers, the first gets focus
+//   retile                 re-run the layout of the view
+//   apps | buffers | frames | focus   queries
+//   subscribe [class...]   turn the connection into an event stream
+typedef enum {
+  WM_CONTROL_MOVE = 0,
+  WM_CONTROL_TAG,
+  WM_CONTROL_FLOAT,
+  WM_CONTROL_TILE,
+  WM_CONTROL_SWITCH,
+  WM_CONTROL_VIEW,
+  WM_CONTROL_RETILE,
+
+  // queries (every op from here on needs no main thread), answered in
+  // request order after the whole batch ran
+  WM_CONTROL_APPS,
+  WM_CONTROL_BUFFERS,
+  WM_CONTROL_FRAMES,
+  WM_CONTROL_FOCUS,
+
+  WM_CONTROL_SUBSCRIBE, // alone in its request
+} WMControlOp;
+
+// classes of events a subscriber asks for ("subscribe buffer focus", all of
+// them without arguments). Each event is one line:
+//   event buffer <primary> view <n,...> occupied <n,...>
+//   event app <pid> buffers <n,...>       ("-" once it quit)
+//   event focus <pid>
+//   event layout view <n,...> apps <tiled>
+//   event dropped <count>                 (the subscriber fell behind)
+typedef enum {
+  WM_CONTROL_EVENT_BUFFER = 0, // view switched, buffers got or lost apps
+  WM_CONTROL_EVENT_APP,        // app moved, launched or quit
+  WM_CONTROL_EVENT_FOCUS,      // focused app of the view changed
+  WM_CONTROL_EVENT_LAYOUT,     // layout applied to the view
+  WM_CONTROL_EVENT_COUNT,
+} WMControlEventType;
+
+#define WM_CONTROL_EVENT_BIT(type) ((uint8_t)(1u << (type)))
+#define WM_CONTROL_EVENT_ALL                                                  \
+  ((uint8_t)((1u << WM_CONTROL_EVENT_COUNT) - 1))
+
+// one event, formatted when it's sent
+typedef struct {
+  uint8_t type;         // WMControlEventType
+  int8_t buffer;        // buffer: primary buffer
+  WMBufferMask view;    // buffer/layout: buffers shown
+  WMBufferMask buffers; // buffer: buffers with apps, app: its buffers
+  int16_t count;        // layout: apps tiled
+  pid_t pid;            // app/focus
+} WMControlEvent;
+
+// events waiting for a subscriber. When it falls behind the oldest event
+// makes room, the count of dropped ones goes out before the next event
+typedef struct {
+  WMControlEvent events[WM_CONTROL_EVENT_RING];
+  uint16_t head;
+  uint16_t count;
+  uint32_t dropped; // events lost, the reader clears it once reported
+} WMControlEventRing;
+
+// one parsed command
+typedef struct {
+  uint8_t op;        // WMControlOp
+  int8_t buffer;     // target buffer (0-based), primary buffer of a view
+  WMBufferMask view; // buffers shown by switch/view
+  pid_t pid;         // app of move/tag/float/tile
+} WMControlCommand;
+
+// a parsed request
+typedef struct {
+  WMControlCommand commands[WM_CONTROL_MAX_COMMANDS];
+  int count;         // commands in the request
+  bool has_mutation; // false = queries only (no main thread needed)
+  uint8_t subscribe; // event classes a subscribe asked for, 0 = none
+} WMControlBatch;
+
+// what a batch changed, applied by the platform as one effects pass
+typedef struct {
+  bool view_changed;          // the batch ends on another view
+  int primary_buffer;         // view_changed: buffer that gets focus
+  WMBufferMask view;          // view_changed: buffers shown
+  bool needs_layout;          // tiled apps of the (unchanged) view changed
+  WMBufferMask dirty_buffers; // buffers whose apps changed
+  pid_t moved[WM_MAX_APPS];   // apps whose buffers changed
+  int16_t moved_count;
+  pid_t visibility[WM_MAX_APPS]; // moved apps whose visibility a view switch
+  int16_t visibility_count;      // (if any) won't fix, show/hide directly
+} WMControlEffects;
+
+// an app as queries report it
+typedef struct {
+  pid_t pid;
+  WMBufferMask buffers; // buffers it belongs to
+  bool is_floating;
+  bool has_frame; // tiled in the view, frame holds its layout frame
+  WMRect frame;
+  char bundle_identifier[128];
+} WMControlApp;
+
+// copy of the state queries are answered from, taken on the main thread
+// after each change so readers never touch WMState
+typedef struct WMControlSnapshot {
+  uint32_t version;                // WMState version it was taken at
+  int active_buffer;               // primary buffer, -1 = nothing shown yet
+  WMBufferMask view;               // buffers shown
+  pid_t focused[WM_MAX_BUFFERS];   // last focused app of each buffer
+  int16_t app_count;
+  WMControlApp apps[WM_MAX_APPS];
+} WMControlSnapshot;
+
+// parse a request (a line without its '\n'). Returns false and a message
+// in error if any command is malformed, nothing runs then
+bool wm_control_parse(const char *request, WMControlBatch *out_batch,
+                      char *error, size_t error_size);
+
+// run the mutations of a batch on state in order. Every app is checked
+// before anything changes, so a batch applies whole or not at all. The view
+// is not switched here: the platform switches to out->view with its effects
+bool wm_control_apply(struct WMState *state, const WMControlBatch *batch,
+                      WMControlEffects *out, char *error, size_t error_size);
+
+// take a snapshot of state, frames are the layout of its view
+void wm_control_snapshot(WMControlSnapshot *out, const struct WMState *state,
+                         const WMFrameChange *frames, int frame_count);
+
+// format the reply of a batch: the lines of each query in order, then "ok",
+// then an empty line. Returns the length (an error reply if it doesn't fit)
+int wm_control_reply(const WMControlSnapshot *snapshot,
+                     const WMControlBatch *batch, char *out, size_t size);
+
+// format an error reply ("error <message>", then an empty line)
+int wm_control_error(const char *message, char *out, size_t size);
+
+// event class of a name ("buffer", "app", "focus", "layout"), -1 if unknown
+int wm_control_event_from_name(const char *name);
+
+// name of an event class
+const char *wm_control_event_name(WMControlEventType type);
+
+// format buffers as "1,3" (1-based), "-" if there are none
+void wm_control_format_buffers(WMBufferMask mask, char *out, size_t size);
+
+// the events between two snapshots (apps moved, launched or quit, the view,
+// occupied buffers or focus changed), returns how many were written
+int wm_control_diff(const WMControlSnapshot *old,
+                    const WMControlSnapshot *now, WMControlEvent *out,
+                    int max_events);
+
+// format an event as its line. Returns the length, 0 if it doesn't fit
+int wm_control_format_event(const WMControlEvent *event, char *out,
+                            size_t size);
+
+// format the line telling a subscriber dropped events were lost
+int wm_control_format_dropped(uint32_t dropped, char *out, size_t size);
+
+// queue an event, dropping the oldest if the ring is full. Returns false if
+// one was dropped
+bool wm_control_ring_push(WMControlEventRing *ring,
+                          const WMControlEvent *event);
+
+// take the oldest event, false if none is waiting
+bool wm_control_ring_pop(WMControlEventRing *ring, WMControlEvent *out);
+
+#endif
@@ -0,0 +1,253 @@
+#include "wm_display.h"
+#include "wm_config.h"
+#include "wm_minsize.h"
+#include <pthread.h>
+#include <string.h>
+
+static bool same_rect(WMRect a, WMRect b) {
+  return a.x == b.x && a.y == b.y && a.width == b.width &&
+         a.height == b.height;
+}
+
+WMDisplayMask wm_display_configure(WMState *state, const WMDisplayInfo *infos,
+                                   int count) {
+  if (infos == NULL || count <= 0)
+    return 0;
+  if (count > WM_MAX_DISPLAYS)
+    count = WM_MAX_DISPLAYS;
+
+  // the focused display's view lives in active_buffer/view_mask
+  WMDisplay old[WM_MAX_DISPLAYS];
+  int old_count = state->display_count;
+  memcpy(old, state->displays, sizeof(old));
+  old[state->focused_display].active_buffer = (int8_t)state->active_buffer;
+  old[state->focused_display].view_mask = wm_state_get_view(state);
+  uint32_t focused_id = old[state->focused_display].id;
+
+  WMDisplay next[WM_MAX_DISPLAYS];
+  bool kept[WM_MAX_DISPLAYS] = {false};
+  WMDisplayMask stale = 0;
+  memset(next, 0, sizeof(next));
+  for (int i = 0; i < count; i++) {
+    next[i].id = infos[i].id;
+    next[i].frame = infos[i].frame;
+    next[i].scale = infos[i].scale;
+    next[i].active_buffer = -1;
+
+    // the display of a fresh state has no id yet, it is the first one
+    int match = -1;
+    for (int j = 0; j < old_count && match < 0; j++) {
+      if (!kept[j] && (old[j].id == infos[i].id ||
+                       (old_count == 1 && old[j].id == 0 && i == 0)))
+        match = j;
+    }
+    if (match < 0) {
+      stale |= WM_DISPLAY_BIT(i);
+      continue;
+    }
+
+    kept[match] = true;
+    next[i].active_buffer = old[match].active_buffer;
+    next[i].view_mask = old[match].view_mask;
+    if (match != i || !same_rect(old[match].frame, infos[i].frame) ||
+        old[match].scale != infos[i].scale)
+      stale |= WM_DISPLAY_BIT(i);
+  }
+
+  // apps of a display that went away stay on screen, on the first one
+  for (int j = 0; j < old_count; j++) {
+    if (kept[j] || old[j].view_mask == 0)
+      continue;
+    next[0].view_mask |= old[j].view_mask;
+    if (next[0].active_buffer < 0)
+      next[0].active_buffer = old[j].active_buffer;
+    stale |= WM_DISPLAY_BIT(0);
+  }
+
+  int focused = 0;
+  for (int i = 0; i < count; i++) {
+    if (next[i].id == focused_id)
+      focused = i;
+  }
+  if (old_count == 1 && focused_id == 0)
+    focused = 0;
+
+  bool changed = stale != 0 || count != old_count ||
+                 focused != state->focused_display;
+  memcpy(state->displays, next, sizeof(next));
+  state->display_count = (int8_t)count;
+  state->focused_display = (int8_t)focused;
+  state->active_buffer = next[focused].active_buffer;
+  state->view_mask = next[focused].view_mask;
+  if (changed)
+    state->version++;
+  return stale;
+}
+
+bool wm_display_focus(WMState *state, int display) {
+  if (display < 0 || display >= state->display_count ||
+      display == state->focused_display)
+    return false;
+
+  // the view of the focused display is always in sync (wm_state_set_view)
+  WMDisplay *current = &state->displays[state->focused_display];
+  current->active_buffer = (int8_t)state->active_buffer;
+  current->view_mask = wm_state_get_view(state);
+
+  state->focused_display = (int8_t)display;
+  state->active_buffer = state->displays[display].active_buffer;
+  state->view_mask = state->displays[display].view_mask;
+  state->version++;
+  return true;
+}
+
+int wm_display_at(const WMState *state, double x, double y) {
+  for (int i = 0; i < state->display_count; i++) {
+    WMRect frame = state->displays[i].frame;
+    if (x >= frame.x && x < frame.x + frame.width && y >= frame.y &&
+        y < frame.y + frame.height)
+      return i;
+  }
+  return -1;
+}
+
+int wm_display_of_buffer(const WMState *state, int buffer_index) {
+  if (buffer_index < 0 || buffer_index >= WM_MAX_BUFFERS)
+    return -1;
+  for (int i = 0; i < state->display_count; i++) {
+    if (wm_state_display_view(state, i) & WM_BUFFER_BIT(buffer_index))
+      return i;
+  }
+  return -1;
+}
+
+// layout
+
+int wm_display_tile_view(const WMState *state, int display, WMBufferMask view,
+                         const struct WMConfig *config, WMFrameChange *out,
+                         int max) {
+  if (display < 0 || display >= state->display_count)
+    return 0;
+
+  // apps also shown on an earlier display are tiled there
+  WMBufferMask earlier = 0;
+  for (int i = 0; i < display; i++)
+    earlier |= wm_state_display_view(state, i);
+
+  pid_t pids[WM_MAX_APPS];
+  WMSize min_sizes[WM_MAX_APPS];
+  int count = 0;
+  const WMAppRegistry *registry = &state->app_registry;
+  for (int i = 0; i < registry->app_count; i++) {
+    WMBufferMask mask = registry->buffer_masks[i];
+    if ((mask & view) != 0 && (mask & earlier) == 0 &&
+        !registry->apps[i].is_floating) {
+      min_sizes[count] = wm_minsize_get(state->min_sizes,
+                                        registry->apps[i].bundle_identifier);
+      pids[count++] = registry->apps[i].pid;
+    }
+  }
+
+  const WMDisplay *area = &state->displays[display];
+  return wm_layout_compute_dwindle_fit(pids, min_sizes, count, config,
+                                       area->frame, area->scale, out, max);
+}
+
+int wm_display_compute(const WMState *state, int display,
+                       const struct WMConfig *config, WMDisplayLayout *out) {
+  out->count = 0;
+  out->display_id = 0;
+  out->view = 0;
+  memset(&out->frame, 0, sizeof(out->frame));
+  if (display < 0 || display >= state->display_count)
+    return 0;
+
+  out->display_id = state->displays[display].id;
+  out->frame = state->displays[display].frame;
+  out->view = wm_state_display_view(state, display);
+  out->count = (int16_t)wm_display_tile_view(state, display, out->view, config,
+                                             out->frames, WM_MAX_APPS);
+  return out->count;
+}
+
+typedef struct {
+  const WMState *state;
+  const struct WMConfig *config;
+  int display;
+  WMDisplayLayout *out;
+} ComputeJob;
+
+static void *compute_job(void *argument) {
+  ComputeJob *job = argument;
+  wm_display_compute(job->state, job->display, job->config, job->out);
+  return NULL;
+}
+
+void wm_display_compute_all(const WMState *state, const struct WMConfig *config,
+                            WMDisplayMask mask, WMDisplayLayout *layouts,
+                            bool parallel) {
+  ComputeJob jobs[WM_MAX_DISPLAYS];
+  pthread_t threads[WM_MAX_DISPLAYS];
+  bool started[WM_MAX_DISPLAYS] = {false};
+  int first = -1;
+
+  for (int i = 0; i < state->display_count; i++) {
+    if ((mask & WM_DISPLAY_BIT(i)) == 0)
+      continue;
+    jobs[i] = (ComputeJob){state, config, i, &layouts[i]};
+    if (first < 0) {
+      first = i; // the calling thread takes it
+      continue;
+    }
+    // without a thread it is computed here
+    if (parallel &&
+        pthread_create(&threads[i], NULL, compute_job, &jobs[i]) == 0)
+      started[i] = true;
+    else
+      compute_job(&jobs[i]);
+  }
+
+  if (first >= 0)
+    compute_job(&jobs[first]);
+  for (int i = 0; i < state->display_count; i++) {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+  }
+}
+
+int wm_display_changes(const WMDisplayLayout *previous,
+                       const WMDisplayLayout *next, WMFrameChange *out,
+                       int max) {
+  int count = 0;
+  for (int i = 0; i < next->count && count < max; i++) {
+    const WMFrameChange *frame = &next->frames[i];
+
+    // frames mostly keep their place, look there first
+    bool same = false;
+    if (i < previous->count && previous->frames[i].pid == frame->pid) {
+      same = same_rect(previous->frames[i].frame, frame->frame);
+    } else {
+      for (int j = 0; j < previous->count; j++) {
+        if (previous->frames[j].pid == frame->pid) {
+          same = same_rect(previous->frames[j].frame, frame->frame);
+          break;
+        }
+      }
+    }
+    if (!same)
+      out[count++] = *frame;
+  }
+  return count;
+}
+
+WMRect wm_display_rescale(WMRect rect, WMRect from, WMRect to) {
+  if (!wm_layout_rect_valid(from) || !wm_layout_rect_valid(to))
+    return rect;
+
+  double scale_x = to.width / from.width;
+  double scale_y = to.height / from.height;
+  return (WMRect){.x = to.x + (rect.x - from.x) * scale_x,
+                  .y = to.y + (rect.y - from.y) * scale_y,
+                  .width = rect.width * scale_x,
+                  .height = rect.height * scale_y};
+}
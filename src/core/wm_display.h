@@ -0,0 +1,83 @@
+#ifndef WM_DISPLAY_H
+#define WM_DISPLAY_H
+
+#include "wm_layout.h"
+#include "wm_runtime.h"
+#include "wm_state.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct WMConfig;
+
+// set of displays, bit N = state->displays[N]
+typedef uint8_t WMDisplayMask;
+
+#define WM_DISPLAY_BIT(index) ((WMDisplayMask)(1u << (index)))
+
+_Static_assert(WM_MAX_DISPLAYS <= 8, "WMDisplayMask holds at most 8");
+
+// a display as the platform reports it
+typedef struct {
+  uint32_t id;  // stable across reconfigurations
+  WMRect frame; // usable area, global top-left coordinates
+  double scale; // backing pixels per point, 0 = 1
+} WMDisplayInfo;
+
+// tiling of one display, kept to apply only what changed next time
+typedef struct {
+  WMFrameChange frames[WM_MAX_APPS];
+  int16_t count;
+  uint32_t display_id; // display it was computed for
+  WMRect frame;        // its frame then
+  WMBufferMask view;   // its view then
+} WMDisplayLayout;
+
+// take the displays reported by the platform (monitor plugged, unplugged,
+// resized, rearranged). Displays are matched by id and keep their view,
+// the buffers of a display that went away move to the first one (their
+// apps stay on screen), new displays show nothing until switched. Focus
+// stays on its display, else goes to the first. Returns the displays whose
+// tiling is stale, nothing for an empty report (displays asleep)
+WMDisplayMask wm_display_configure(WMState *state, const WMDisplayInfo *infos,
+                                   int count);
+
+// make display the one switches and hotkeys act on. Returns false if it
+// doesn't exist or already is
+bool wm_display_focus(WMState *state, int display);
+
+// display containing a point (global top-left coordinates), -1 if none
+int wm_display_at(const WMState *state, double x, double y);
+
+// display showing a buffer, -1 if it is hidden
+int wm_display_of_buffer(const WMState *state, int buffer_index);
+
+// tile the apps of view as display would show them (view may not be the
+// one it shows yet), each at least its learned minimum size
+// (state->min_sizes). Returns the frame count
+int wm_display_tile_view(const WMState *state, int display, WMBufferMask view,
+                         const struct WMConfig *config, WMFrameChange *out,
+                         int max);
+
+// tile the apps of a display into its frame. An app in buffers shown on
+// several displays tiles on the first of them. Returns the frame count
+int wm_display_compute(const WMState *state, int display,
+                       const struct WMConfig *config, WMDisplayLayout *out);
+
+// compute the layouts of the displays in mask into layouts[display]. The
+// displays are independent: with parallel set each one past the first is
+// computed on its own thread, joined before returning
+void wm_display_compute_all(const WMState *state, const struct WMConfig *config,
+                            WMDisplayMask mask, WMDisplayLayout *layouts,
+                            bool parallel);
+
+// frames of next that previous doesn't already have (new apps, moved or
+// resized frames). Returns the count
+int wm_display_changes(const WMDisplayLayout *previous,
+                       const WMDisplayLayout *next, WMFrameChange *out,
+                       int max);
+
+// rect moved from one display frame to another, keeping its position and
+// size relative to the frame (floating windows of a resized display)
+WMRect wm_display_rescale(WMRect rect, WMRect from, WMRect to);
+
+#endif
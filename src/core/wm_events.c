@@ -0,0 +1,167 @@
+#include "wm_events.h"
+#include <string.h>
+
+#define NS_PER_MS 1000000ull
+
+void wm_events_init(WMEventCoalescer *events) {
+  memset(events, 0, sizeof(*events));
+}
+
+static WMPendingApp *pending_app(WMEventCoalescer *events, pid_t pid) {
+  for (int i = 0; i < events->app_count; i++) {
+    if (events->apps[i].pid == pid)
+      return &events->apps[i];
+  }
+  if (events->app_count >= WM_MAX_APPS)
+    return NULL;
+
+  WMPendingApp *app = &events->apps[events->app_count++];
+  memset(app, 0, sizeof(*app));
+  app->pid = pid;
+  return app;
+}
+
+static bool is_pending(const WMEventCoalescer *events) {
+  return events->app_count > 0 || events->activation.type != WM_EVENT_NONE;
+}
+
+// dwin caused an activation of pid at at_ns
+static bool is_self_activation(const WMEventCoalescer *events, pid_t pid,
+                               uint64_t at_ns) {
+  if (at_ns < events->suppress_until_ns)
+    return true;
+  for (int i = 0; i < WM_EVENT_MAX_EXPECTED; i++) {
+    const WMExpectedActivation *expected = &events->expected[i];
+    if (expected->pid == pid && at_ns < expected->until_ns)
+      return true;
+  }
+  return false;
+}
+
+void wm_events_push(WMEventCoalescer *events, WMEventType type, pid_t pid,
+                    uint64_t now_ns) {
+  if (pid <= 0 || type == WM_EVENT_NONE)
+    return;
+
+  if (!is_pending(events))
+    events->first_ns = now_ns;
+  events->last_ns = now_ns;
+  events->received++;
+
+  WMEvent *activation = &events->activation;
+  switch (type) {
+  case WM_EVENT_ACTIVATED:
+    // the origin is decided now, the window may be gone by the drain
+    if (activation->type != WM_EVENT_NONE)
+      events->coalesced++;
+    activation->type = WM_EVENT_ACTIVATED;
+    activation->pid = pid;
+    activation->at_ns = now_ns;
+    activation->origin = is_self_activation(events, pid, now_ns)
+                             ? WM_ORIGIN_SELF
+                             : WM_ORIGIN_USER;
+    break;
+  case WM_EVENT_LAUNCHED:
+  case WM_EVENT_TERMINATED: {
+    WMPendingApp *app = pending_app(events, pid);
+    if (app == NULL)
+      break; // more apps than tracked in one burst, drop the event
+    if (app->launched || app->terminated)
+      events->coalesced++;
+    if (type == WM_EVENT_LAUNCHED)
+      app->launched = 1;
+    else
+      app->terminated = 1;
+
+    // a terminated app has nothing left to focus
+    if (type == WM_EVENT_TERMINATED) {
+      if (activation->type != WM_EVENT_NONE && activation->pid == pid)
+        activation->type = WM_EVENT_NONE;
+      if (events->last_activated == pid)
+        events->last_activated = 0;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void wm_events_expect(WMEventCoalescer *events, pid_t pid, uint64_t now_ns) {
+  uint64_t until_ns = now_ns + WM_EVENT_SELF_MS * NS_PER_MS;
+
+  // refresh the pid's window, else take an expired (or the oldest) slot
+  WMExpectedActivation *slot = &events->expected[0];
+  for (int i = 0; i < WM_EVENT_MAX_EXPECTED; i++) {
+    WMExpectedActivation *expected = &events->expected[i];
+    if (expected->pid == pid) {
+      slot = expected;
+      break;
+    }
+    if (expected->until_ns < slot->until_ns)
+      slot = expected;
+  }
+  slot->pid = pid;
+  slot->until_ns = until_ns;
+}
+
+void wm_events_suppress(WMEventCoalescer *events, uint64_t until_ns) {
+  events->suppress_until_ns = until_ns;
+}
+
+uint64_t wm_events_next_deadline(const WMEventCoalescer *events) {
+  if (!is_pending(events))
+    return 0;
+  if (events->held_ns != 0)
+    return events->held_ns; // the burst already went quiet
+
+  uint64_t quiet_ns = events->last_ns + WM_EVENT_QUIET_MS * NS_PER_MS;
+  uint64_t latest_ns = events->first_ns + WM_EVENT_MAX_DELAY_MS * NS_PER_MS;
+  return quiet_ns < latest_ns ? quiet_ns : latest_ns;
+}
+
+int wm_events_drain(WMEventCoalescer *events, uint64_t now_ns, WMEvent *out,
+                    int max_events) {
+  uint64_t deadline = wm_events_next_deadline(events);
+  if (deadline == 0 || now_ns < deadline || out == NULL || max_events <= 0)
+    return 0;
+
+  int count = 0;
+  int kept = 0;
+  for (int i = 0; i < events->app_count; i++) {
+    WMPendingApp app = events->apps[i];
+
+    // launched and gone within the burst: nothing happened
+    if (app.launched && app.terminated) {
+      events->coalesced++;
+      continue;
+    }
+    if (count >= max_events) {
+      events->apps[kept++] = app; // out is full, emit next time
+      continue;
+    }
+    out[count++] = (WMEvent){
+        .type = app.terminated ? WM_EVENT_TERMINATED : WM_EVENT_LAUNCHED,
+        .pid = app.pid,
+        .at_ns = now_ns};
+  }
+  events->app_count = (int16_t)kept;
+
+  WMEvent *activation = &events->activation;
+  if (activation->type != WM_EVENT_NONE && count < max_events) {
+    if (activation->pid == events->last_activated) {
+      events->coalesced++; // already active
+    } else {
+      if (activation->origin == WM_ORIGIN_SELF)
+        events->self_activations++;
+      events->last_activated = activation->pid;
+      out[count++] = *activation;
+    }
+    activation->type = WM_EVENT_NONE;
+  }
+
+  // held back only because out was full: still due, with whatever was
+  // pushed since
+  events->held_ns = is_pending(events) ? now_ns : 0;
+  return count;
+}
@@ -0,0 +1,93 @@
+#ifndef WM_EVENTS_H
+#define WM_EVENTS_H
+
+#include "wm_runtime.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WM_EVENT_QUIET_MS 50      // a storm is over after this long quiet
+#define WM_EVENT_MAX_DELAY_MS 250 // emit at the latest this long after it began
+#define WM_EVENT_SELF_MS 500      // activations of a pid dwin just activated
+#define WM_EVENT_MAX_EXPECTED 16  // pids dwin activated, awaiting their events
+
+typedef enum {
+  WM_EVENT_NONE = 0,
+  WM_EVENT_LAUNCHED,   // app started
+  WM_EVENT_TERMINATED, // app quit
+  WM_EVENT_ACTIVATED,  // app became frontmost
+} WMEventType;
+
+// who caused an activation
+typedef enum {
+  WM_ORIGIN_USER = 0, // clicked, cmd-tabbed, launched by the user
+  WM_ORIGIN_SELF,     // side effect of dwin raising, hiding or switching
+} WMEventOrigin;
+
+// a raw or coalesced app event
+typedef struct {
+  WMEventType type;
+  WMEventOrigin origin; // activations only
+  pid_t pid;
+  uint64_t at_ns; // monotonic time of the (last) raw event
+} WMEvent;
+
+// launch/terminate pending for a pid
+typedef struct {
+  pid_t pid;
+  uint8_t launched;   // launch seen
+  uint8_t terminated; // terminate seen (after the launch if both)
+  uint8_t reserved[2];
+} WMPendingApp;
+
+// pid whose activation dwin asked for
+typedef struct {
+  pid_t pid;
+  uint64_t until_ns; // activations before this are dwin's own
+} WMExpectedActivation;
+
+// collapses bursts of workspace events into their net result: launches and
+// terminations per pid, and only the last activation of a storm. Times come
+// from the caller (monotonic), so it is deterministic and fixed size
+typedef struct {
+  WMPendingApp apps[WM_MAX_APPS]; // pending launches/terminations
+  int16_t app_count;              // number of pending apps
+  WMEvent activation;             // last activation, type NONE = none
+  uint64_t first_ns;              // oldest pending raw event
+  uint64_t last_ns;               // newest pending raw event
+  uint64_t held_ns;               // drain that filled out, rest due since
+  uint64_t suppress_until_ns;     // every activation before this is dwin's
+  WMExpectedActivation expected[WM_EVENT_MAX_EXPECTED]; // per-pid windows
+  pid_t last_activated;           // last activation emitted, 0 = none
+  uint32_t received;              // raw events pushed
+  uint32_t coalesced;             // raw events folded into another
+  uint32_t self_activations;      // activations attributed to dwin
+} WMEventCoalescer;
+
+// initialize an empty coalescer
+void wm_events_init(WMEventCoalescer *events);
+
+// feed a raw event observed at now_ns
+void wm_events_push(WMEventCoalescer *events, WMEventType type, pid_t pid,
+                    uint64_t now_ns);
+
+// dwin is about to activate, raise or unhide pid: its activations during
+// the next WM_EVENT_SELF_MS are dwin's own
+void wm_events_expect(WMEventCoalescer *events, pid_t pid, uint64_t now_ns);
+
+// every activation before until_ns is dwin's own (e.g. a buffer switch in
+// flight). Replaces the previous window, until_ns <= now ends it
+void wm_events_suppress(WMEventCoalescer *events, uint64_t until_ns);
+
+// when wm_events_drain has something to emit, 0 = nothing pending
+uint64_t wm_events_next_deadline(const WMEventCoalescer *events);
+
+// emit the net events once the burst went quiet (or waited too long):
+// terminations and launches first, then the final activation. An app
+// launched and terminated within the burst emits nothing, an activation of
+// the app that was already active is dropped. What did not fit in out stays
+// due for the next drain. Returns the number written
+int wm_events_drain(WMEventCoalescer *events, uint64_t now_ns, WMEvent *out,
+                    int max_events);
+
+#endif
@@ -0,0 +1,159 @@
+#include "wm_executor.h"
+#include <string.h>
+
+#define NS_PER_MS 1000000ull
+
+static uint64_t now(const WMExecutor *executor) {
+  return executor->backend.clock(executor->backend.context);
+}
+
+void wm_executor_init(WMExecutor *executor, const WMExecutorBackend *backend,
+                      uint32_t budget_ms) {
+  memset(executor, 0, sizeof(*executor));
+  executor->backend = *backend;
+  wm_executor_set_budget(executor, budget_ms);
+}
+
+void wm_executor_set_budget(WMExecutor *executor, uint32_t budget_ms) {
+  executor->budget_ns = (uint64_t)budget_ms * NS_PER_MS;
+}
+
+int wm_executor_pending(const WMExecutor *executor,
+                        WMEffectClass effect_class) {
+  if ((int)effect_class >= 0 && effect_class < WM_EFFECT_CLASS_COUNT)
+    return executor->counts[effect_class];
+
+  int count = 0;
+  for (int i = 0; i < WM_EFFECT_CLASS_COUNT; i++)
+    count += executor->counts[i];
+  return count;
+}
+
+static void start_batch(WMExecutor *executor) {
+  executor->begin_ns = now(executor);
+  executor->in_batch = true;
+  memset(&executor->current, 0, sizeof(executor->current));
+}
+
+void wm_executor_begin(WMExecutor *executor) {
+  for (int i = 0; i < WM_EFFECT_CLASS_COUNT; i++) {
+    executor->cancelled += executor->counts[i];
+    executor->heads[i] = 0;
+    executor->counts[i] = 0;
+  }
+  executor->cancelled += executor->deferred_count;
+  executor->deferred_count = 0;
+  start_batch(executor);
+}
+
+bool wm_executor_push(WMExecutor *executor, WMEffectClass effect_class,
+                      const WMEffect *effect) {
+  if ((int)effect_class < 0 || effect_class >= WM_EFFECT_CLASS_COUNT)
+    return false;
+  if (executor->counts[effect_class] >= WM_EXECUTOR_QUEUE_SIZE) {
+    executor->dropped++;
+    return false;
+  }
+
+  // effects queued outside a switch make their own batch
+  if (!executor->in_batch)
+    start_batch(executor);
+
+  int slot = (executor->heads[effect_class] + executor->counts[effect_class]) %
+             WM_EXECUTOR_QUEUE_SIZE;
+  executor->queues[effect_class][slot] = *effect;
+  executor->counts[effect_class]++;
+  return true;
+}
+
+// set an effect aside until its app is ready. A newer effect of the same
+// kind for the app replaces the deferred one (the last frame wins)
+static void defer(WMExecutor *executor, WMEffectClass effect_class,
+                  const WMEffect *effect) {
+  executor->current.deferred++;
+  for (int i = 0; i < executor->deferred_count; i++) {
+    WMDeferredEffect *deferred = &executor->deferred[i];
+    if (deferred->effect.pid == effect->pid &&
+        deferred->effect.kind == effect->kind) {
+      deferred->effect = *effect;
+      deferred->effect_class = effect_class;
+      return;
+    }
+  }
+
+  if (executor->deferred_count >= WM_EXECUTOR_QUEUE_SIZE) {
+    executor->dropped++;
+    return;
+  }
+  executor->deferred[executor->deferred_count++] =
+      (WMDeferredEffect){.effect = *effect, .effect_class = effect_class};
+}
+
+// pop and run the oldest effect of a class
+static void run_one(WMExecutor *executor, WMEffectClass effect_class) {
+  // copy first: run may queue more effects into the same ring
+  WMEffect effect =
+      executor->queues[effect_class][executor->heads[effect_class]];
+  executor->heads[effect_class] =
+      (uint16_t)((executor->heads[effect_class] + 1) % WM_EXECUTOR_QUEUE_SIZE);
+  executor->counts[effect_class]--;
+
+  if (effect.pid > 0 && executor->backend.ready &&
+      !executor->backend.ready(&effect, executor->backend.context)) {
+    defer(executor, effect_class, &effect);
+    return;
+  }
+
+  executor->backend.run(&effect, executor->backend.context);
+  executor->current.effects++;
+}
+
+int wm_executor_requeue(WMExecutor *executor) {
+  int queued = 0;
+  int count = executor->deferred_count;
+  executor->deferred_count = 0;
+  for (int i = 0; i < count; i++) {
+    WMDeferredEffect deferred = executor->deferred[i];
+    if (wm_executor_push(executor, deferred.effect_class, &deferred.effect))
+      queued++;
+  }
+  return queued;
+}
+
+bool wm_executor_run(WMExecutor *executor) {
+  if (wm_executor_pending(executor, WM_EFFECT_CLASS_COUNT) == 0)
+    return false;
+
+  uint64_t turn_ns = now(executor);
+  executor->current.turns++;
+
+  if (executor->counts[WM_EFFECT_CRITICAL] > 0) {
+    while (executor->counts[WM_EFFECT_CRITICAL] > 0)
+      run_one(executor, WM_EFFECT_CRITICAL);
+    executor->current.critical_ns = now(executor) - executor->begin_ns;
+  }
+
+  // lower classes share what is left of the budget, one always runs so a
+  // slow effect can't stall the queue
+  bool ran = false;
+  for (int i = WM_EFFECT_VISIBLE; i < WM_EFFECT_CLASS_COUNT; i++) {
+    while (executor->counts[i] > 0) {
+      if (ran && now(executor) - turn_ns >= executor->budget_ns)
+        return true;
+      run_one(executor, (WMEffectClass)i);
+      ran = true;
+
+      // a critical effect queued by the last one jumps the line next turn
+      if (executor->counts[WM_EFFECT_CRITICAL] > 0)
+        return true;
+    }
+  }
+
+  if (wm_executor_pending(executor, WM_EFFECT_CLASS_COUNT) > 0)
+    return true;
+
+  executor->current.total_ns = now(executor) - executor->begin_ns;
+  executor->last = executor->current;
+  executor->in_batch = false;
+  return false;
+}
@@ -0,0 +1,112 @@
+#ifndef WM_EXECUTOR_H
+#define WM_EXECUTOR_H
+
+#include "wm_layout.h"
+#include "wm_runtime.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WM_EFFECT_BUDGET_MS 4 // default time a turn spends on deferred effects
+#define WM_EXECUTOR_QUEUE_SIZE (WM_MAX_APPS * 4) // effects pending per class
+
+// how urgent an effect is, classes run in this order
+typedef enum {
+  WM_EFFECT_CRITICAL = 0, // gets the focus target on screen, never deferred
+  WM_EFFECT_VISIBLE,      // changes what is on screen (frames, other apps)
+  WM_EFFECT_BACKGROUND,   // off screen work (hiding, cleanup)
+  WM_EFFECT_CLASS_COUNT,
+} WMEffectClass;
+
+typedef enum {
+  WM_EFFECT_UNHIDE = 0, // unhide an app
+  WM_EFFECT_RAISE,      // raise (and unminimize) its window
+  WM_EFFECT_ACTIVATE,   // make it frontmost
+  WM_EFFECT_FRAME,      // move/resize its window
+  WM_EFFECT_HIDE,       // hide an app
+  WM_EFFECT_CLEANUP,    // hide whatever is up outside the view
+  WM_EFFECT_PARK,       // move its window off screen (see wm_park.h)
+  WM_EFFECT_UNPARK,     // move its window back
+} WMEffectKind;
+
+// one platform side effect
+typedef struct {
+  WMEffectKind kind;
+  pid_t pid;    // app, unused by cleanup
+  WMRect frame; // frame effects only
+} WMEffect;
+
+// platform side: run performs one effect, clock gives monotonic nanoseconds.
+// ready (optional) says whether the effect's app can take it now, effects
+// it refuses are deferred until wm_executor_requeue
+typedef struct {
+  void (*run)(const WMEffect *effect, void *context);
+  uint64_t (*clock)(void *context);
+  bool (*ready)(const WMEffect *effect, void *context);
+  void *context;
+} WMExecutorBackend;
+
+// effect waiting for its app to become ready
+typedef struct {
+  WMEffect effect;
+  WMEffectClass effect_class;
+} WMDeferredEffect;
+
+// timing of the last batch that drained
+typedef struct {
+  uint64_t critical_ns; // begin to the last critical effect
+  uint64_t total_ns;    // begin to the last effect of any class
+  uint32_t effects;     // effects run
+  uint32_t deferred;    // effects deferred for an app that wasn't ready
+  uint32_t turns;       // run calls that did work
+} WMExecutorTiming;
+
+// runs queued effects by class: every critical effect as soon as it is run,
+// lower classes in order while the turn's budget lasts (at least one per
+// turn), the rest on later turns. Single threaded, fixed size
+typedef struct WMExecutor {
+  WMExecutorBackend backend;
+  WMEffect queues[WM_EFFECT_CLASS_COUNT][WM_EXECUTOR_QUEUE_SIZE]; // rings
+  uint16_t heads[WM_EFFECT_CLASS_COUNT];  // oldest effect per ring
+  uint16_t counts[WM_EFFECT_CLASS_COUNT]; // effects pending per ring
+  WMDeferredEffect deferred[WM_EXECUTOR_QUEUE_SIZE]; // apps not ready
+  uint16_t deferred_count;                // effects deferred
+  uint64_t budget_ns;                     // per turn, lower classes
+  uint64_t begin_ns;                      // when the batch began
+  bool in_batch;                          // a batch is being timed
+  WMExecutorTiming current;               // timing being collected
+  WMExecutorTiming last;                  // timing of the last drained batch
+  uint32_t dropped;                       // effects lost to a full ring
+  uint32_t cancelled;                     // effects dropped by a new batch
+} WMExecutor;
+
+// initialize an empty executor spending budget_ms per turn on lower classes
+void wm_executor_init(WMExecutor *executor, const WMExecutorBackend *backend,
+                      uint32_t budget_ms);
+
+// change the per turn budget (config reload)
+void wm_executor_set_budget(WMExecutor *executor, uint32_t budget_ms);
+
+// start a new batch (a buffer switch): effects still queued or deferred from
+// the last one are dropped, the new one supersedes them. Timing restarts
+// here
+void wm_executor_begin(WMExecutor *executor);
+
+// queue an effect. Returns false if its class is full
+bool wm_executor_push(WMExecutor *executor, WMEffectClass effect_class,
+                      const WMEffect *effect);
+
+// one turn: run every critical effect, then visible and background ones
+// until the budget is spent. Returns true if effects are left for another
+// turn
+bool wm_executor_run(WMExecutor *executor);
+
+// queue the deferred effects again (their apps may be ready now, else
+// they are deferred again when run). Returns the number queued
+int wm_executor_requeue(WMExecutor *executor);
+
+// effects waiting in a class (or all classes for WM_EFFECT_CLASS_COUNT),
+// deferred ones not included
+int wm_executor_pending(const WMExecutor *executor, WMEffectClass effect_class);
+
+#endif
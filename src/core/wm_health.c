@@ -0,0 +1,161 @@
+#include "wm_health.h"
+#include "wm_timer.h"
+#include <stdio.h>
+#include <string.h>
+
+#define NS_PER_MS 1000000ull
+#define AVG_SHIFT 3 // moving average weight 1/8
+
+static const char *STATE_NAMES[] = {
+    [WM_BREAKER_CLOSED] = "closed",
+    [WM_BREAKER_OPEN] = "open",
+    [WM_BREAKER_HALF_OPEN] = "half-open",
+};
+
+void wm_health_init(WMHealth *health, uint32_t slow_ms) {
+  memset(health, 0, sizeof(*health));
+  health->slow_ns = (uint64_t)slow_ms * NS_PER_MS;
+}
+
+static WMAppHealth *find_app(const WMHealth *health, pid_t pid) {
+  for (int i = 0; i < health->count; i++) {
+    if (health->apps[i].pid == pid)
+      return (WMAppHealth *)&health->apps[i];
+  }
+  return NULL;
+}
+
+// the app's entry, added on its first call. NULL if the table is full
+static WMAppHealth *track_app(WMHealth *health, pid_t pid) {
+  WMAppHealth *app = find_app(health, pid);
+  if (app != NULL || health->count >= WM_MAX_APPS)
+    return app;
+
+  app = &health->apps[health->count++];
+  memset(app, 0, sizeof(*app));
+  app->pid = pid;
+  return app;
+}
+
+static void open_breaker(WMAppHealth *app, uint64_t now_ns) {
+  if (app->state == WM_BREAKER_CLOSED) {
+    app->attempt = 0;
+    app->trips++;
+  } else if (app->attempt < UINT8_MAX) {
+    app->attempt++;
+  }
+  app->state = WM_BREAKER_OPEN;
+  app->retry_ns = now_ns + (uint64_t)wm_timer_backoff_ms(
+                               WM_HEALTH_RETRY_MS, app->attempt,
+                               WM_HEALTH_RETRY_MAX_MS) *
+                               NS_PER_MS;
+}
+
+bool wm_health_allow(WMHealth *health, pid_t pid, uint64_t now_ns) {
+  WMAppHealth *app = find_app(health, pid);
+  if (app == NULL || app->state == WM_BREAKER_CLOSED)
+    return true;
+
+  if (app->state == WM_BREAKER_HALF_OPEN && now_ns >= app->retry_ns) {
+    open_breaker(app, now_ns); // the probe was never recorded
+  } else if (app->state == WM_BREAKER_OPEN && now_ns >= app->retry_ns) {
+    app->state = WM_BREAKER_HALF_OPEN; // this call is the probe
+    app->retry_ns = now_ns + WM_HEALTH_PROBE_MS * NS_PER_MS;
+    return true;
+  }
+  app->skipped++;
+  return false;
+}
+
+WMBreakerState wm_health_record(WMHealth *health, pid_t pid,
+                                WMCallResult result, uint64_t latency_ns,
+                                uint64_t now_ns) {
+  WMAppHealth *app = track_app(health, pid);
+  if (app == NULL)
+    return WM_BREAKER_CLOSED;
+
+  app->calls++;
+  if (app->calls == 1)
+    app->avg_ns = latency_ns;
+  else
+    app->avg_ns = app->avg_ns - (app->avg_ns >> AVG_SHIFT) +
+                  (latency_ns >> AVG_SHIFT);
+  if (latency_ns > app->max_ns)
+    app->max_ns = latency_ns;
+
+  if (result == WM_CALL_TIMEOUT)
+    app->timeouts++;
+  else if (result == WM_CALL_FAILED)
+    app->failures++;
+
+  bool strike = result != WM_CALL_OK || latency_ns >= health->slow_ns;
+  if (!strike) {
+    // a good answer (the probe, or any call) closes the breaker
+    app->strikes = 0;
+    app->state = WM_BREAKER_CLOSED;
+    return WM_BREAKER_CLOSED;
+  }
+
+  if (app->strikes < UINT8_MAX)
+    app->strikes++;
+  if (app->state != WM_BREAKER_CLOSED || result == WM_CALL_TIMEOUT ||
+      app->strikes >= WM_HEALTH_TRIP_STRIKES)
+    open_breaker(app, now_ns);
+  return (WMBreakerState)app->state;
+}
+
+uint64_t wm_health_next_retry(const WMHealth *health) {
+  uint64_t earliest = 0;
+  for (int i = 0; i < health->count; i++) {
+    const WMAppHealth *app = &health->apps[i];
+    if (app->state != WM_BREAKER_CLOSED &&
+        (earliest == 0 || app->retry_ns < earliest))
+      earliest = app->retry_ns;
+  }
+  return earliest;
+}
+
+void wm_health_forget(WMHealth *health, pid_t pid) {
+  WMAppHealth *app = find_app(health, pid);
+  if (app != NULL)
+    *app = health->apps[--health->count];
+}
+
+const WMAppHealth *wm_health_get(const WMHealth *health, pid_t pid) {
+  return find_app(health, pid);
+}
+
+const char *wm_health_state_name(WMBreakerState state) {
+  if ((int)state < WM_BREAKER_CLOSED || state > WM_BREAKER_HALF_OPEN)
+    return "unknown";
+  return STATE_NAMES[state];
+}
+
+int wm_health_describe(const WMHealth *health, char *buffer, size_t size) {
+  size_t length = 0;
+  if (size > 0)
+    buffer[0] = '\0';
+
+  for (int i = 0; i < health->count; i++) {
+    const WMAppHealth *app = &health->apps[i];
+    if (app->state == WM_BREAKER_CLOSED && app->failures == 0 &&
+        app->timeouts == 0)
+      continue;
+
+    int written = snprintf(
+        length < size ? buffer + length : NULL,
+        length < size ? size - length : 0,
+        "pid %d %s: %u calls, %u failed, %u timed out, avg %.1f ms, max "
+        "%.1f ms, %u trips, %u skipped\n",
+        (int)app->pid, wm_health_state_name((WMBreakerState)app->state),
+        app->calls, app->failures, app->timeouts, app->avg_ns / 1e6,
+        app->max_ns / 1e6, app->trips, app->skipped);
+    if (written < 0)
+      break;
+    length += (size_t)written;
+  }
+
+  if (length >= size && size > 0)
+    length = size - 1;
+  return (int)length;
+}
@@ -0,0 +1,92 @@
+#ifndef WM_HEALTH_H
+#define WM_HEALTH_H
+
+#include "wm_runtime.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WM_HEALTH_SLOW_MS 250      // a call this slow counts against the app
+#define WM_HEALTH_TRIP_STRIKES 3   // failed/slow calls in a row open it
+#define WM_HEALTH_RETRY_MS 500     // first retry after opening
+#define WM_HEALTH_RETRY_MAX_MS 8000 // retries back off up to this
+#define WM_HEALTH_PROBE_MS 8000     // a probe not recorded by then failed
+
+// outcome of one platform call into an app
+typedef enum {
+  WM_CALL_OK = 0,  // the app answered
+  WM_CALL_FAILED,  // the app answered with an error
+  WM_CALL_TIMEOUT, // the app didn't answer in time (hung, beachballing)
+} WMCallResult;
+
+// circuit breaker of an app
+typedef enum {
+  WM_BREAKER_CLOSED = 0, // calls go through
+  WM_BREAKER_OPEN,       // calls are skipped until retry_ns
+  WM_BREAKER_HALF_OPEN,  // one probe call is in flight until retry_ns
+} WMBreakerState;
+
+// health of one app
+typedef struct {
+  pid_t pid;
+  uint8_t state;     // WMBreakerState
+  uint8_t strikes;   // failed or slow calls in a row
+  uint8_t attempt;   // retries since the breaker opened
+  uint8_t reserved;
+  uint64_t retry_ns; // open: the next probe is allowed at this time,
+                     // half-open: the probe's deadline
+  uint64_t avg_ns;   // moving average of call latency
+  uint64_t max_ns;   // slowest call
+  uint32_t calls;    // calls recorded
+  uint32_t failures; // calls that failed
+  uint32_t timeouts; // calls that timed out
+  uint32_t trips;    // times the breaker opened
+  uint32_t skipped;  // calls refused while open
+} WMAppHealth;
+
+// per-app call health and circuit breakers. A timeout opens the breaker at
+// once, failed or slow calls after WM_HEALTH_TRIP_STRIKES in a row. An open
+// breaker lets one probe through after a backoff; its success closes it, a
+// failure reopens it for twice as long, as does a probe that isn't recorded
+// within WM_HEALTH_PROBE_MS (the caller skipped it). Times come from the caller
+// (monotonic), fixed size, single threaded
+typedef struct {
+  WMAppHealth apps[WM_MAX_APPS];
+  int16_t count;    // apps tracked
+  uint64_t slow_ns; // latency that counts as a strike
+} WMHealth;
+
+// initialize with no apps tracked, calls of slow_ms or more are strikes
+void wm_health_init(WMHealth *health, uint32_t slow_ms);
+
+// may dwin call into pid now? False while its breaker is open (or a probe
+// is in flight); past the retry time the next call becomes the probe. A
+// caller allowed a call must record it
+bool wm_health_allow(WMHealth *health, pid_t pid, uint64_t now_ns);
+
+// record a call into pid that took latency_ns and ended at now_ns. Returns
+// the breaker state afterwards
+WMBreakerState wm_health_record(WMHealth *health, pid_t pid,
+                                WMCallResult result, uint64_t latency_ns,
+                                uint64_t now_ns);
+
+// earliest time an open breaker lets a probe through or a probe in flight
+// times out, 0 = none
+uint64_t wm_health_next_retry(const WMHealth *health);
+
+// stop tracking pid (terminated)
+void wm_health_forget(WMHealth *health, pid_t pid);
+
+// health of pid, NULL if it made no calls
+const WMAppHealth *wm_health_get(const WMHealth *health, pid_t pid);
+
+// name of a breaker state, for logs
+const char *wm_health_state_name(WMBreakerState state);
+
+// one line per app that has timed out, failed or is not closed:
+// "pid 123 open: 4 calls, 1 failed, 2 timed out, avg 3.1 ms, max 500.0 ms,
+// 1 trips, 7 skipped". Returns the length written (truncated to size)
+int wm_health_describe(const WMHealth *health, char *buffer, size_t size);
+
+#endif
@@ -0,0 +1,386 @@
+#include "wm_hooks.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NS_PER_US 1000ull
+#define NS_PER_MS 1000000ull
+#define HOOK_MAX_ENVIRON 256 // inherited variables passed on
+
+extern char **environ;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// append "NAME=value" and its NUL, false if it doesn't fit
+static bool append_variable(char *out, size_t size, size_t *length,
+                            const char *name, const char *value) {
+  int written = snprintf(out + *length, size - *length, "%s=%s", name, value);
+  if (written < 0 || (size_t)written >= size - *length)
+    return false;
+  *length += (size_t)written + 1; // keep the NUL
+  return true;
+}
+
+int wm_hooks_format_env(const WMControlEvent *event, char *out, size_t size) {
+  char view[2 * WM_MAX_BUFFERS + 1];
+  char buffers[2 * WM_MAX_BUFFERS + 1];
+  char number[16];
+  wm_control_format_buffers(event->view, view, sizeof(view));
+  wm_control_format_buffers(event->buffers, buffers, sizeof(buffers));
+
+  size_t length = 0;
+  bool fits = append_variable(out, size, &length, "DWIN_EVENT",
+                              wm_control_event_name(event->type));
+  switch ((WMControlEventType)event->type) {
+  case WM_CONTROL_EVENT_BUFFER:
+    snprintf(number, sizeof(number), "%d", event->buffer + 1);
+    fits = fits && append_variable(out, size, &length, "DWIN_BUFFER", number);
+    fits = fits && append_variable(out, size, &length, "DWIN_VIEW", view);
+    fits =
+        fits && append_variable(out, size, &length, "DWIN_OCCUPIED", buffers);
+    break;
+  case WM_CONTROL_EVENT_APP:
+    snprintf(number, sizeof(number), "%d", (int)event->pid);
+    fits = fits && append_variable(out, size, &length, "DWIN_PID", number);
+    fits =
+        fits && append_variable(out, size, &length, "DWIN_BUFFERS", buffers);
+    break;
+  case WM_CONTROL_EVENT_FOCUS:
+    snprintf(number, sizeof(number), "%d", (int)event->pid);
+    fits = fits && append_variable(out, size, &length, "DWIN_PID", number);
+    break;
+  case WM_CONTROL_EVENT_LAYOUT:
+    snprintf(number, sizeof(number), "%d", event->count);
+    fits = fits && append_variable(out, size, &length, "DWIN_VIEW", view);
+    fits = fits && append_variable(out, size, &length, "DWIN_APPS", number);
+    break;
+  default:
+    fits = false;
+    break;
+  }
+  return fits ? (int)length : 0;
+}
+
+// runner thread
+
+// /bin/sh -c <command> in its own process group (a timeout kills the whole
+// pipeline), stdin from /dev/null, the event's variables first in the
+// environment. Returns the pid, -1 if it couldn't be spawned
+static pid_t spawn_job(const WMHookRunner *runner, const WMHookJob *job) {
+  char *envp[WM_HOOK_ENV_SIZE / 2 + HOOK_MAX_ENVIRON + 1];
+  int count = 0;
+  for (size_t offset = 0; offset < job->env_length;
+       offset += strlen(job->env + offset) + 1)
+    envp[count++] = (char *)job->env + offset;
+  for (char **variable = environ;
+       variable != NULL && *variable != NULL && count < HOOK_MAX_ENVIRON;
+       variable++)
+    envp[count++] = *variable;
+  envp[count] = NULL;
+
+  char *argv[] = {"/bin/sh", "-c", (char *)runner->hooks[job->hook].command,
+                  NULL};
+
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attributes;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawnattr_init(&attributes);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                   O_RDONLY, 0);
+
+  short flags =
+      POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_CLOEXEC_DEFAULT
+  // macOS: the control socket and other descriptors stay with dwin
+  flags |= POSIX_SPAWN_CLOEXEC_DEFAULT;
+  posix_spawn_file_actions_addinherit_np(&actions, STDOUT_FILENO);
+  posix_spawn_file_actions_addinherit_np(&actions, STDERR_FILENO);
+#endif
+  sigset_t signals;
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attributes, &signals);
+  sigfillset(&signals);
+  posix_spawnattr_setsigdefault(&attributes, &signals);
+  posix_spawnattr_setpgroup(&attributes, 0);
+  posix_spawnattr_setflags(&attributes, flags);
+
+  pid_t pid;
+  int error = posix_spawn(&pid, argv[0], &actions, &attributes, argv, envp);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attributes);
+  return error == 0 ? pid : -1;
+}
+
+// tell the callback about a run, without the lock
+static void notify(WMHookRunner *runner, const WMHookResult *result) {
+  if (runner->finished == NULL)
+    return;
+  pthread_mutex_unlock(&runner->lock);
+  runner->finished(result, runner->context);
+  pthread_mutex_lock(&runner->lock);
+}
+
+static int free_slot(const WMHookRunner *runner) {
+  for (int i = 0; i < WM_HOOK_MAX_RUNNING; i++) {
+    if (runner->processes[i].pid == 0)
+      return i;
+  }
+  return -1;
+}
+
+// spawn waiting runs while there are free slots (spawning unlocked, so
+// dispatch never waits on it)
+static void start_jobs(WMHookRunner *runner) {
+  WMHookJob job;
+  int slot;
+  while (!runner->stopping && runner->count > 0 &&
+         (slot = free_slot(runner)) >= 0) {
+    job = runner->queue[runner->head];
+    runner->head = (uint16_t)((runner->head + 1) % WM_HOOK_QUEUE_SIZE);
+    runner->count--;
+    runner->stats.queue_depth = runner->count;
+
+    pthread_mutex_unlock(&runner->lock);
+    pid_t pid = spawn_job(runner, &job);
+    uint64_t started = now_ns();
+    pthread_mutex_lock(&runner->lock);
+
+    if (pid < 0) {
+      runner->stats.failed++;
+      WMHookResult result = {.hook = job.hook,
+                             .status = -1,
+                             .wait_ns = started - job.queued_ns,
+                             .queue_depth = runner->count};
+      notify(runner, &result);
+      continue;
+    }
+
+    runner->processes[slot] = (WMHookProcess){.pid = pid,
+                                              .hook = job.hook,
+                                              .queued_ns = job.queued_ns,
+                                              .started_ns = started};
+    runner->poll_ns = WM_HOOK_POLL_MIN_US * NS_PER_US; // most exit quickly
+    runner->stats.started++;
+    runner->stats.running++;
+    if (runner->stats.running > runner->stats.max_running)
+      runner->stats.max_running = runner->stats.running;
+  }
+}
+
+// reap exited runs, kill those past the timeout
+static void reap_jobs(WMHookRunner *runner) {
+  uint64_t now = now_ns();
+  for (int i = 0; i < WM_HOOK_MAX_RUNNING; i++) {
+    WMHookProcess *process = &runner->processes[i];
+    if (process->pid == 0)
+      continue;
+
+    int status;
+    pid_t reaped = waitpid(process->pid, &status, WNOHANG);
+    if (reaped == 0) {
+      if (!process->killed && now - process->started_ns > runner->timeout_ns) {
+        kill(-process->pid, SIGKILL);
+        process->killed = true;
+        runner->stats.timed_out++;
+      }
+      continue;
+    }
+    if (reaped < 0 && errno == EINTR)
+      continue;
+
+    // exited (or somebody else reaped it)
+    uint64_t total = now - process->queued_ns;
+    WMHookResult result = {
+        .hook = process->hook,
+        .status = reaped > 0 && WIFEXITED(status) ? WEXITSTATUS(status) : -1,
+        .timed_out = process->killed,
+        .wait_ns = process->started_ns - process->queued_ns,
+        .run_ns = now - process->started_ns,
+        .queue_depth = runner->count};
+    if (result.status != 0)
+      runner->stats.failed++;
+    runner->stats.running--;
+    runner->stats.reaped++;
+    runner->stats.total_ns += total;
+    if (total > runner->stats.max_ns)
+      runner->stats.max_ns = total;
+    process->pid = 0;
+    notify(runner, &result);
+  }
+}
+
+// sleep until dispatch queues something, or the next exit/timeout check
+// while hooks run (checks back off after a spawn)
+static void wait_for_work(WMHookRunner *runner) {
+  if (runner->stats.running == 0) {
+    pthread_cond_wait(&runner->wake, &runner->lock);
+    return;
+  }
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_nsec += (long)runner->poll_ns;
+  runner->poll_ns += runner->poll_ns / 4;
+  if (runner->poll_ns > WM_HOOK_POLL_MS * NS_PER_MS)
+    runner->poll_ns = WM_HOOK_POLL_MS * NS_PER_MS;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  pthread_cond_timedwait(&runner->wake, &runner->lock, &deadline);
+}
+
+static void *run_hooks(void *argument) {
+  WMHookRunner *runner = argument;
+  pthread_mutex_lock(&runner->lock);
+  while (!runner->stopping) {
+    start_jobs(runner);
+    reap_jobs(runner);
+    if (runner->stopping)
+      break;
+    // runs waiting on a full set of slots are started once one exits
+    if (runner->count == 0 || free_slot(runner) < 0)
+      wait_for_work(runner);
+  }
+
+  // stopping: nothing outlives dwin
+  for (int i = 0; i < WM_HOOK_MAX_RUNNING; i++) {
+    WMHookProcess *process = &runner->processes[i];
+    if (process->pid == 0)
+      continue;
+    kill(-process->pid, SIGKILL);
+    while (waitpid(process->pid, NULL, 0) < 0 && errno == EINTR)
+      ;
+    process->pid = 0;
+    runner->stats.running--;
+  }
+  pthread_mutex_unlock(&runner->lock);
+  return NULL;
+}
+
+// main thread
+
+bool wm_hooks_start(WMHookRunner *runner, const WMConfig *config,
+                    void (*finished)(const WMHookResult *result,
+                                     void *context),
+                    void *context) {
+  memset(runner, 0, sizeof(*runner));
+  runner->hook_count = config->hooks_count;
+  memcpy(runner->hooks, config->hooks,
+         sizeof(WMHook) * (size_t)config->hooks_count);
+  for (int i = 0; i < runner->hook_count; i++)
+    runner->events |= WM_CONTROL_EVENT_BIT(runner->hooks[i].event);
+  runner->timeout_ns = (uint64_t)config->hook_timeout_ms * NS_PER_MS;
+  runner->finished = finished;
+  runner->context = context;
+  if (runner->hook_count == 0)
+    return true;
+
+  pthread_mutex_init(&runner->lock, NULL);
+  pthread_cond_init(&runner->wake, NULL);
+  if (pthread_create(&runner->thread, NULL, run_hooks, runner) != 0) {
+    pthread_mutex_destroy(&runner->lock);
+    pthread_cond_destroy(&runner->wake);
+    return false;
+  }
+  runner->running = true;
+  return true;
+}
+
+void wm_hooks_stop(WMHookRunner *runner) {
+  if (!runner->running)
+    return;
+
+  pthread_mutex_lock(&runner->lock);
+  runner->stopping = true;
+  pthread_cond_signal(&runner->wake);
+  pthread_mutex_unlock(&runner->lock);
+  pthread_join(runner->thread, NULL);
+
+  runner->running = false;
+  pthread_mutex_destroy(&runner->lock);
+  pthread_cond_destroy(&runner->wake);
+}
+
+// the run of hook with these variables is still waiting
+static bool is_waiting(const WMHookRunner *runner, const WMHookJob *job) {
+  for (int i = 0; i < runner->count; i++) {
+    const WMHookJob *waiting =
+        &runner->queue[(runner->head + i) % WM_HOOK_QUEUE_SIZE];
+    if (waiting->hook == job->hook &&
+        waiting->env_length == job->env_length &&
+        memcmp(waiting->env, job->env, job->env_length) == 0)
+      return true;
+  }
+  return false;
+}
+
+int wm_hooks_dispatch(WMHookRunner *runner, const WMControlEvent *events,
+                      int count) {
+  if (!runner->running)
+    return 0;
+
+  WMHookJob job;
+  int queued = 0;
+  job.queued_ns = now_ns();
+
+  pthread_mutex_lock(&runner->lock);
+  for (int e = 0; e < count; e++) {
+    if ((runner->events & WM_CONTROL_EVENT_BIT(events[e].type)) == 0)
+      continue;
+    int length = wm_hooks_format_env(&events[e], job.env, sizeof(job.env));
+    if (length == 0)
+      continue;
+    job.env_length = (uint16_t)length;
+
+    for (int h = 0; h < runner->hook_count; h++) {
+      if (runner->hooks[h].event != events[e].type)
+        continue;
+      job.hook = (int8_t)h;
+      if (is_waiting(runner, &job)) {
+        runner->stats.coalesced++;
+        continue;
+      }
+
+      // full: the oldest run makes room
+      if (runner->count == WM_HOOK_QUEUE_SIZE) {
+        runner->head = (uint16_t)((runner->head + 1) % WM_HOOK_QUEUE_SIZE);
+        runner->count--;
+        runner->stats.dropped++;
+      }
+      runner->queue[(runner->head + runner->count) % WM_HOOK_QUEUE_SIZE] =
+          job;
+      runner->count++;
+      runner->stats.queued++;
+      queued++;
+    }
+  }
+
+  runner->stats.queue_depth = runner->count;
+  if (runner->count > runner->stats.max_queue_depth)
+    runner->stats.max_queue_depth = runner->count;
+  if (queued > 0)
+    pthread_cond_signal(&runner->wake);
+  pthread_mutex_unlock(&runner->lock);
+  return queued;
+}
+
+void wm_hooks_stats(WMHookRunner *runner, WMHookStats *out) {
+  if (!runner->running) {
+    *out = runner->stats;
+    return;
+  }
+  pthread_mutex_lock(&runner->lock);
+  *out = runner->stats;
+  pthread_mutex_unlock(&runner->lock);
+}
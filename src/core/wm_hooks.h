@@ -0,0 +1,109 @@
+#ifndef WM_HOOKS_H
+#define WM_HOOKS_H
+
+#include "wm_config.h"
+#include "wm_control.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WM_HOOK_MAX_RUNNING 4    // hooks running at once
+#define WM_HOOK_QUEUE_SIZE 32    // hooks waiting for a free slot
+#define WM_HOOK_ENV_SIZE 192     // DWIN_* variables of one run
+#define WM_HOOK_POLL_MIN_US 500  // first exit/timeout check after a spawn...
+#define WM_HOOK_POLL_MS 5        // ...backing off to this while hooks run
+
+// one run waiting to be spawned. env holds the DWIN_* variables back to
+// back, each ending with its NUL
+typedef struct {
+  int8_t hook;        // index in WMHookRunner.hooks
+  uint16_t env_length;
+  uint64_t queued_ns; // when the event came
+  char env[WM_HOOK_ENV_SIZE];
+} WMHookJob;
+
+// a spawned run
+typedef struct {
+  pid_t pid;          // 0 = free slot
+  int8_t hook;
+  bool killed;        // timed out, SIGKILL sent to its process group
+  uint64_t queued_ns;
+  uint64_t started_ns;
+} WMHookProcess;
+
+// how a run ended, given to the finished callback (runner thread)
+typedef struct {
+  int8_t hook;
+  int status;           // exit status, -1 if it couldn't be spawned or died
+                        // of a signal
+  bool timed_out;       // killed after the hook timeout
+  uint64_t wait_ns;     // event to spawn (queued behind other hooks)
+  uint64_t run_ns;      // spawn to exit
+  uint16_t queue_depth; // runs still waiting
+} WMHookResult;
+
+typedef struct {
+  uint32_t queued;          // runs queued
+  uint32_t coalesced;       // runs dropped, the same one was still waiting
+  uint32_t dropped;         // oldest waiting runs lost to a full queue
+  uint32_t started;         // runs spawned
+  uint32_t failed;          // runs not spawned or exiting non-zero
+  uint32_t timed_out;       // runs killed
+  uint16_t queue_depth;     // runs waiting now
+  uint16_t max_queue_depth; // most runs ever waiting
+  uint8_t running;          // runs spawned and not reaped
+  uint8_t max_running;      // most runs ever running at once
+  uint64_t total_ns;        // sum of event to exit over reaped runs
+  uint64_t max_ns;          // longest event to exit
+  uint32_t reaped;          // runs that exited (or were killed)
+} WMHookStats;
+
+// runs the configured hooks of events off the main thread: dispatch only
+// queues (identical waiting runs coalesce), a thread spawns the commands
+// with posix_spawn, at most WM_HOOK_MAX_RUNNING at a time, and kills those
+// outliving the hook timeout. Event data is passed as DWIN_* variables
+typedef struct WMHookRunner {
+  WMHook hooks[WM_MAX_HOOKS];
+  int hook_count;
+  uint8_t events;      // event classes some hook runs on
+  uint64_t timeout_ns; // per run
+  void (*finished)(const WMHookResult *result, void *context);
+  void *context;
+
+  pthread_t thread;
+  pthread_mutex_t lock; // guards everything below
+  pthread_cond_t wake;
+  bool running;
+  bool stopping;
+  WMHookJob queue[WM_HOOK_QUEUE_SIZE]; // ring
+  uint16_t head;
+  uint16_t count;
+  WMHookProcess processes[WM_HOOK_MAX_RUNNING];
+  uint64_t poll_ns; // next exit check, short right after a spawn
+  WMHookStats stats;
+} WMHookRunner;
+
+// copy the hooks of config and start the thread (none without hooks).
+// finished (optional) is told about every run, on the runner thread.
+// Returns false if the thread can't start
+bool wm_hooks_start(WMHookRunner *runner, const WMConfig *config,
+                    void (*finished)(const WMHookResult *result,
+                                     void *context),
+                    void *context);
+
+// stop the thread, running hooks are killed
+void wm_hooks_stop(WMHookRunner *runner);
+
+// queue the hooks of events, never waits on a spawn. Returns runs queued
+int wm_hooks_dispatch(WMHookRunner *runner, const WMControlEvent *events,
+                      int count);
+
+// copy the counters
+void wm_hooks_stats(WMHookRunner *runner, WMHookStats *out);
+
+// the DWIN_* variables of an event, as stored in WMHookJob.env. Returns the
+// length, 0 if they don't fit
+int wm_hooks_format_env(const WMControlEvent *event, char *out, size_t size);
+
+#endif
@@ -0,0 +1,53 @@
+#include "wm_keys.h"
+
+void wm_keys_init(WMKeyMatcher *matcher, const WMConfig *config) {
+  matcher->config = config;
+  wm_keys_reset(matcher);
+}
+
+void wm_keys_reset(WMKeyMatcher *matcher) {
+  matcher->node = 0;
+  matcher->deadline_ns = 0;
+}
+
+WMKeyResult wm_keys_feed(WMKeyMatcher *matcher, int modifiers, int keycode,
+                         uint64_t now_ns, const WMBinding **out_binding) {
+  const WMConfig *config = matcher->config;
+
+  // a sequence or layer left idle starts over
+  if (matcher->node != 0 && now_ns >= matcher->deadline_ns)
+    wm_keys_reset(matcher);
+
+  int node = matcher->node;
+  int index = wm_config_find_binding(config, node, modifiers, keycode);
+  uint64_t deadline = now_ns + (uint64_t)config->key_timeout_ms * 1000000ull;
+
+  if (index < 0) {
+    wm_keys_reset(matcher);
+
+    // escape leaves a layer without reaching the app
+    bool is_layer = config->key_node_flags[node] & WM_KEY_NODE_LAYER;
+    if (is_layer && keycode == WM_KEY_ESCAPE && modifiers == WM_MOD_NONE)
+      return WM_KEY_CONSUMED;
+    return WM_KEY_PASS;
+  }
+
+  const WMBinding *binding = &config->bindings[index];
+
+  // prefix: move down the trie
+  if (binding->next_node >= 0) {
+    matcher->node = (uint8_t)binding->next_node;
+    matcher->deadline_ns = deadline;
+    return WM_KEY_CONSUMED;
+  }
+
+  // action: layers stay active, sequences start over
+  if (config->key_node_flags[node] & WM_KEY_NODE_LAYER)
+    matcher->deadline_ns = deadline;
+  else
+    wm_keys_reset(matcher);
+
+  if (out_binding)
+    *out_binding = binding;
+  return WM_KEY_ACTION;
+}
@@ -0,0 +1,35 @@
+#ifndef WM_KEYS_H
+#define WM_KEYS_H
+
+#include "wm_config.h"
+#include <stdint.h>
+
+// what the event tap should do with a keypress
+typedef enum {
+  WM_KEY_PASS = 0, // not bound here, deliver the key to the app
+  WM_KEY_CONSUMED, // prefix key or layer exit, swallow without an action
+  WM_KEY_ACTION,   // binding fired, swallow the key
+} WMKeyResult;
+
+// walks the config key trie one keypress at a time. Fixed size and
+// allocation free, meant to live in the event tap
+typedef struct {
+  const WMConfig *config; // bindings (config must outlive the matcher)
+  uint8_t node;           // current trie node, 0 = root
+  uint64_t deadline_ns;   // pending node resets to root at this time
+} WMKeyMatcher;
+
+// initialize the matcher at the root of config
+void wm_keys_init(WMKeyMatcher *matcher, const WMConfig *config);
+
+// feed one keypress (now_ns from a monotonic clock). A single index lookup
+// per key: keys unbound in a pending node reset to the root and pass
+// through without being looked up again. out_binding is set for
+// WM_KEY_ACTION and points into the config
+WMKeyResult wm_keys_feed(WMKeyMatcher *matcher, int modifiers, int keycode,
+                         uint64_t now_ns, const WMBinding **out_binding);
+
+// drop any pending sequence or layer
+void wm_keys_reset(WMKeyMatcher *matcher);
+
+#endif
@@ -0,0 +1,198 @@
+#include "wm_latency.h"
+#include <string.h>
+
+#define NS_PER_US 1000ull
+#define NS_PER_MS 1000000ull
+
+static const char *OP_NAMES[WM_OP_COUNT] = {
+    [WM_OP_UNHIDE] = "unhide", [WM_OP_RAISE] = "raise",
+    [WM_OP_ACTIVATE] = "activate", [WM_OP_FRAME] = "frame",
+    [WM_OP_HIDE] = "hide",
+};
+
+static uint32_t total_samples(const void *slot);
+
+static const WMStoreLayout TABLE_LAYOUT = {
+    .magic = WM_LATENCY_MAGIC,
+    .version = WM_LATENCY_VERSION,
+    .slot_count = WM_LATENCY_SLOTS,
+    .slot_size = sizeof(WMLatencySlot),
+    .worth = total_samples, // the bundle with the fewest samples makes room
+};
+
+_Static_assert((WM_LATENCY_SLOTS & (WM_LATENCY_SLOTS - 1)) == 0,
+               "WM_LATENCY_SLOTS must be a power of two");
+_Static_assert(sizeof(WMLatencyImage) ==
+                   sizeof(WMStoreHeader) +
+                       WM_LATENCY_SLOTS * sizeof(WMLatencySlot),
+               "WMLatencyImage must be a header and its slots");
+
+static bool valid_op(WMLatencyOp op) {
+  return (int)op >= 0 && op < WM_OP_COUNT;
+}
+
+void wm_latency_init(WMLatencyModel *model) {
+  memset(model, 0, sizeof(*model));
+  wm_store_init(&model->table, &TABLE_LAYOUT, &model->image);
+}
+
+static WMLatencySlot *find_slot(const WMLatencyModel *model,
+                                const char *bundle_identifier) {
+  return wm_store_find(&model->table, &model->image, bundle_identifier);
+}
+
+static uint32_t total_samples(const void *slot) {
+  const WMLatencySlot *latency = slot;
+  uint32_t total = 0;
+  for (int op = 0; op < WM_OP_COUNT; op++)
+    total += latency->samples[op];
+  return total;
+}
+
+// an estimate of op moving from before_us to after_us can change the order
+// of bundles by it: it crossed (or met) another bundle's, or it left or
+// joined the unknown ones at 0
+static bool reorders(const WMLatencyModel *model, const WMLatencySlot *slot,
+                     WMLatencyOp op, uint32_t before_us, uint32_t after_us) {
+  if (before_us == after_us || (WM_LATENCY_ORDER_OPS & (1u << op)) == 0)
+    return false;
+  uint32_t low = before_us < after_us ? before_us : after_us;
+  uint32_t high = before_us < after_us ? after_us : before_us;
+  if (low == 0)
+    return true;
+
+  for (int i = 0; i < WM_LATENCY_SLOTS; i++) {
+    const WMLatencySlot *other = &model->image.slots[i];
+    if (other != slot && other->key.bundle_hash != 0 &&
+        other->estimate_us[op] >= low && other->estimate_us[op] <= high)
+      return true;
+  }
+  return false;
+}
+
+bool wm_latency_record(WMLatencyModel *model, const char *bundle_identifier,
+                       WMLatencyOp op, uint64_t latency_ns) {
+  if (!valid_op(op))
+    return false;
+  // claimed on its first sample, an evicted bundle's estimates are gone
+  uint32_t evictions = model->table.evictions;
+  WMLatencySlot *slot =
+      wm_store_claim(&model->table, &model->image, bundle_identifier);
+  if (slot == NULL)
+    return false;
+  if (model->table.evictions != evictions)
+    model->orders++;
+
+  uint64_t sample_us = latency_ns / NS_PER_US;
+  if (sample_us > UINT32_MAX)
+    sample_us = UINT32_MAX;
+  uint64_t estimate_us = slot->estimate_us[op];
+
+  bool regressed = slot->samples[op] >= WM_LATENCY_TRUSTED &&
+                   sample_us > estimate_us * WM_LATENCY_REGRESSION_X &&
+                   sample_us - estimate_us >=
+                       WM_LATENCY_REGRESSION_MS * NS_PER_MS / NS_PER_US;
+  uint8_t bit = (uint8_t)(1u << op);
+  if (regressed) {
+    slot->regressed |= bit;
+    model->regressions++;
+  } else {
+    slot->regressed &= (uint8_t)~bit;
+  }
+
+  // first sample sets the estimate, later ones move it by 1/2^shift
+  if (slot->samples[op] == 0)
+    estimate_us = sample_us;
+  else if (sample_us >= estimate_us)
+    estimate_us += (sample_us - estimate_us) >> WM_LATENCY_WEIGHT_SHIFT;
+  else
+    estimate_us -= (estimate_us - sample_us) >> WM_LATENCY_WEIGHT_SHIFT;
+  if (reorders(model, slot, op, slot->estimate_us[op], (uint32_t)estimate_us))
+    model->orders++;
+  slot->estimate_us[op] = (uint32_t)estimate_us;
+  if (slot->samples[op] < UINT16_MAX)
+    slot->samples[op]++;
+
+  model->dirty = true;
+  model->updates++;
+  return regressed;
+}
+
+uint64_t wm_latency_estimate(const WMLatencyModel *model,
+                             const char *bundle_identifier, WMLatencyOp op) {
+  const WMLatencySlot *slot = find_slot(model, bundle_identifier);
+  if (slot == NULL || !valid_op(op))
+    return 0;
+  return (uint64_t)slot->estimate_us[op] * NS_PER_US;
+}
+
+bool wm_latency_regressed(const WMLatencyModel *model,
+                          const char *bundle_identifier, WMLatencyOp op) {
+  const WMLatencySlot *slot = find_slot(model, bundle_identifier);
+  return slot != NULL && valid_op(op) && (slot->regressed & (1u << op)) != 0;
+}
+
+void wm_latency_start(WMLatencyModel *model, pid_t pid, WMLatencyOp op,
+                      uint64_t now_ns) {
+  if (pid <= 0 || !valid_op(op))
+    return;
+
+  // the same op again, else a free (or the oldest) entry
+  WMLatencyPending *entry = &model->pending[0];
+  for (int i = 0; i < WM_LATENCY_MAX_PENDING; i++) {
+    WMLatencyPending *pending = &model->pending[i];
+    if (pending->pid == pid && pending->op == op) {
+      entry = pending;
+      break;
+    }
+    if (entry->pid != 0 &&
+        (pending->pid == 0 || pending->start_ns < entry->start_ns))
+      entry = pending;
+  }
+  entry->pid = pid;
+  entry->op = (uint8_t)op;
+  entry->start_ns = now_ns;
+}
+
+int wm_latency_finish(WMLatencyModel *model, pid_t pid, WMLatencyOp op,
+                      const char *bundle_identifier, uint64_t now_ns) {
+  for (int i = 0; i < WM_LATENCY_MAX_PENDING; i++) {
+    WMLatencyPending *pending = &model->pending[i];
+    if (pending->pid != pid || pending->op != op)
+      continue;
+
+    uint64_t latency_ns =
+        now_ns > pending->start_ns ? now_ns - pending->start_ns : 0;
+    pending->pid = 0;
+    return wm_latency_record(model, bundle_identifier, op, latency_ns) ? 1
+                                                                       : 0;
+  }
+  return -1;
+}
+
+const char *wm_latency_op_name(WMLatencyOp op) {
+  return valid_op(op) ? OP_NAMES[op] : "unknown";
+}
+
+bool wm_latency_load(WMLatencyModel *model, const char *path) {
+  WMLatencyImage image;
+  int used = wm_store_load(&TABLE_LAYOUT, &image, path);
+  if (used < 0)
+    return false;
+
+  uint32_t updates = model->updates;
+  uint32_t orders = model->orders;
+  wm_latency_init(model);
+  model->image = image;
+  model->table.entry_count = used;
+  model->updates = updates + 1;
+  model->orders = orders + 1;
+  return true;
+}
+
+bool wm_latency_save(WMLatencyModel *model, const char *path) {
+  if (!wm_store_save(&model->table, &model->image, path))
+    return false;
+  model->dirty = false;
+  return true;
+}
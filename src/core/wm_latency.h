@@ -0,0 +1,104 @@
+#ifndef WM_LATENCY_H
+#define WM_LATENCY_H
+
+#include "wm_store.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WM_LATENCY_MAGIC 0x544c4d57u // "WMLT"
+#define WM_LATENCY_VERSION 2
+#define WM_LATENCY_SLOTS 256       // power of two
+#define WM_LATENCY_MAX_PENDING 32  // operations awaiting their completion
+#define WM_LATENCY_WEIGHT_SHIFT 2  // a new sample moves the estimate by 1/4
+#define WM_LATENCY_TRUSTED 4       // samples before regressions are flagged
+#define WM_LATENCY_REGRESSION_X 3  // a sample this many times the estimate...
+#define WM_LATENCY_REGRESSION_MS 50 // ...and at least this much over it
+
+// operations timed per app
+typedef enum {
+  WM_OP_UNHIDE = 0, // unhide request to the app reporting it unhidden
+  WM_OP_RAISE,      // raise (accessibility calls)
+  WM_OP_ACTIVATE,   // activate request to the app becoming frontmost
+  WM_OP_FRAME,      // move/resize (accessibility calls)
+  WM_OP_HIDE,       // hide request to the app reporting it hidden
+  WM_OP_COUNT,
+} WMLatencyOp;
+
+// operations switches order apps by (slowest first)
+#define WM_LATENCY_ORDER_OPS ((1u << WM_OP_UNHIDE) | (1u << WM_OP_HIDE))
+
+// estimates of one bundle
+typedef struct {
+  WMStoreKey key;                      // bundle, empty slot if unused
+  uint32_t estimate_us[WM_OP_COUNT];   // moving average per operation
+  uint16_t samples[WM_OP_COUNT];       // samples seen (saturating)
+  uint8_t regressed;                   // bit per op whose last sample regressed
+  uint8_t reserved;
+} WMLatencySlot;
+
+// whole on-disk file, read and written in one go
+typedef struct {
+  WMStoreHeader header;
+  WMLatencySlot slots[WM_LATENCY_SLOTS];
+} WMLatencyImage;
+
+// operation started, waiting for its completion event
+typedef struct {
+  pid_t pid;         // 0 = free
+  uint8_t op;        // WMLatencyOp
+  uint8_t reserved[3];
+  uint64_t start_ns; // when it was requested
+} WMLatencyPending;
+
+// per bundle and operation latency estimates (exponentially weighted), fed
+// by timing around platform calls. Fixed size, single threaded
+typedef struct WMLatencyModel {
+  WMLatencyImage image;
+  WMStoreTable table; // slots of image by bundle
+  WMLatencyPending pending[WM_LATENCY_MAX_PENDING];
+  bool dirty;           // changed since the last load/save
+  uint32_t updates;     // estimates changed
+  uint32_t orders;      // order changes (orders made before are stale)
+  uint32_t regressions; // samples flagged as regressions
+} WMLatencyModel;
+
+// initialize an empty (cold) model
+void wm_latency_init(WMLatencyModel *model);
+
+// add a sample of op for a bundle. Returns true if it is a regression: a
+// trusted estimate exceeded WM_LATENCY_REGRESSION_X times and by
+// WM_LATENCY_REGRESSION_MS. The sample still moves the estimate
+bool wm_latency_record(WMLatencyModel *model, const char *bundle_identifier,
+                       WMLatencyOp op, uint64_t latency_ns);
+
+// estimated latency of op for a bundle (ns), 0 = never seen
+uint64_t wm_latency_estimate(const WMLatencyModel *model,
+                             const char *bundle_identifier, WMLatencyOp op);
+
+// true if the last sample of op for the bundle was a regression
+bool wm_latency_regressed(const WMLatencyModel *model,
+                          const char *bundle_identifier, WMLatencyOp op);
+
+// op was requested from pid at now_ns, its completion comes as an event. A
+// newer start for the same pid and op replaces the old one
+void wm_latency_start(WMLatencyModel *model, pid_t pid, WMLatencyOp op,
+                      uint64_t now_ns);
+
+// the completion of a started op arrived at now_ns: records the sample for
+// the app's bundle. Returns 1 if it regressed, 0 if recorded, -1 if nothing
+// was started
+int wm_latency_finish(WMLatencyModel *model, pid_t pid, WMLatencyOp op,
+                      const char *bundle_identifier, uint64_t now_ns);
+
+// name of an operation, for logs
+const char *wm_latency_op_name(WMLatencyOp op);
+
+// read estimates saved by wm_latency_save. Returns false (model stays cold)
+// if the file is missing, from another version or corrupt
+bool wm_latency_load(WMLatencyModel *model, const char *path);
+
+// write the estimates (to a temporary file renamed over path)
+bool wm_latency_save(WMLatencyModel *model, const char *path);
+
+#endif
@@ -2,10 +2,168 @@
 #include "wm_config.h"
 #include "wm_runtime.h"
 #include "wm_state.h"
+#include <stddef.h>
+
+// a rect in grid units (1 / unit points): edges are exact, so halves and
+// gaps add up to the whole
+typedef struct {
+  int64_t x;
+  int64_t y;
+  int64_t width;
+  int64_t height;
+} GridRect;
+
+// grid units per point frames snap to, 0 = not snapped
+static double snap_unit(const struct WMConfig *config, double scale) {
+  switch (config->layout_snap) {
+  case WM_LAYOUT_SNAP_OFF:
+    return 0;
+  case WM_LAYOUT_SNAP_PIXELS:
+    return scale > 1 ? scale : 1;
+  default:
+    return 1;
+  }
+}
+
+// nearest grid unit, halves away from zero (no libm)
+static int64_t round_grid(double value) {
+  return value >= 0 ? (int64_t)(value + 0.5) : -(int64_t)(0.5 - value);
+}
+
+// rect snapped edge by edge, a shared edge lands on the same unit
+static GridRect to_grid(WMRect rect, double unit) {
+  int64_t left = round_grid(rect.x * unit);
+  int64_t bottom = round_grid(rect.y * unit);
+  return (GridRect){.x = left,
+                    .y = bottom,
+                    .width = round_grid((rect.x + rect.width) * unit) - left,
+                    .height =
+                        round_grid((rect.y + rect.height) * unit) - bottom};
+}
+
+static WMRect from_grid(GridRect rect, double unit) {
+  return (WMRect){.x = (double)rect.x / unit,
+                  .y = (double)rect.y / unit,
+                  .width = (double)rect.width / unit,
+                  .height = (double)rect.height / unit};
+}
+
+// first of the two halves length leaves around gap, the odd unit to it
+static int64_t first_half(int64_t length, int64_t gap) {
+  int64_t rest = length - gap;
+  return rest - rest / 2;
+}
+
+// whole units at least value (no libm)
+static double ceil_units(double value) {
+  double whole = (double)(int64_t)value;
+  return whole < value ? whole + 1 : whole;
+}
+
+// minimum size of each app and of the apps from it on, in units per point:
+// those after a split fit in what it leaves when every app gets its
+// minimum with the gaps between (even index side by side, odd stacked)
+static void dwindle_needs(const WMSize *min_sizes, int count, double unit,
+                          double gap_x, double gap_y, WMSize *mins,
+                          WMSize *needs) {
+  for (int i = count - 1; i >= 0; i--) {
+    mins[i] = (WMSize){ceil_units(min_sizes[i].width * unit),
+                       ceil_units(min_sizes[i].height * unit)};
+    WMSize need = mins[i];
+    if (i < count - 1 && i % 2 == 0) {
+      WMSize rest = needs[i + 1];
+      need.width += gap_x + rest.width;
+      need.height = rest.height > need.height ? rest.height : need.height;
+    } else if (i < count - 1) {
+      WMSize rest = needs[i + 1];
+      need.width = rest.width > need.width ? rest.width : need.width;
+      need.height += gap_y + rest.height;
+    }
+    needs[i] = need;
+  }
+}
+
+// first part of what length leaves around gap: the half, moved only as far
+// as the first app's minimum and the rest's need it. When both don't fit
+// they share the space in proportion to what they need, a side counted as
+// needing at least a quarter of it (an app without a minimum keeps room)
+static double split_points(double length, double gap, double first_min,
+                           double rest_min) {
+  double space = length - gap;
+  double first = space / 2.0;
+  if (first_min + rest_min > space) {
+    if (space <= 0)
+      return first;
+    double quarter = space / 4;
+    double first_share = first_min > quarter ? first_min : quarter;
+    double rest_share = rest_min > quarter ? rest_min : quarter;
+    return space * first_share / (first_share + rest_share);
+  }
+  if (first < first_min)
+    first = first_min;
+  if (space - first < rest_min)
+    first = space - rest_min;
+  return first;
+}
+
+// split_points on the grid, from the half with the odd unit
+static int64_t split_grid(int64_t length, int64_t gap, int64_t first_min,
+                          int64_t rest_min) {
+  int64_t space = length - gap;
+  int64_t first = first_half(length, gap);
+  if (first_min + rest_min > space) {
+    if (space <= 0)
+      return first;
+    int64_t quarter = space / 4;
+    int64_t first_share = first_min > quarter ? first_min : quarter;
+    int64_t rest_share = rest_min > quarter ? rest_min : quarter;
+    return space * first_share / (first_share + rest_share);
+  }
+  if (first < first_min)
+    first = first_min;
+  if (space - first < rest_min)
+    first = space - rest_min;
+  return first;
+}
+
+// dwindle on the grid, splits as dwindle_recurse does
+static int dwindle_grid(const pid_t *pids, int count, GridRect area,
+                        int64_t gap_x, int64_t gap_y, double unit,
+                        const WMSize *mins, const WMSize *needs,
+                        WMFrameChange *out_frames, int max_frames) {
+  int frame_idx = 0;
+  for (int depth = 0; depth < count && frame_idx < max_frames; depth++) {
+    GridRect first = area;
+    if (depth == count - 1) {
+      // last app fills what is left
+    } else if (depth % 2 == 0) {
+      // first app gets the left half, the rest the right one
+      first.width = needs ? split_grid(area.width, gap_x,
+                                       (int64_t)mins[depth].width,
+                                       (int64_t)needs[depth + 1].width)
+                          : first_half(area.width, gap_x);
+      area.x += first.width + gap_x;
+      area.width -= first.width + gap_x;
+    } else {
+      // first app gets the top half, the rest the bottom one
+      first.height = needs ? split_grid(area.height, gap_y,
+                                        (int64_t)mins[depth].height,
+                                        (int64_t)needs[depth + 1].height)
+                           : first_half(area.height, gap_y);
+      area.height -= first.height + gap_y;
+      first.y = area.y + area.height + gap_y;
+    }
+    out_frames[frame_idx].pid = pids[depth];
+    out_frames[frame_idx].frame = from_grid(first, unit);
+    frame_idx++;
+  }
+  return frame_idx;
+}
 
 // recursive helper for dwindle
-static int dwindle_recurse(pid_t *pids, int count, WMRect area,
+static int dwindle_recurse(const pid_t *pids, int count, WMRect area,
                            const struct WMConfig *config, int depth,
+                           const WMSize *mins, const WMSize *needs,
                            WMFrameChange *out_frames, int frame_idx,
                            int max_frames) {
   if (count <= 0 || frame_idx >= max_frames)
@@ -23,7 +181,9 @@ static int dwindle_recurse(pid_t *pids, int count, WMRect area,
 
   if (horizontal) {
     double gap = config->gaps_inner.left;
-    double half_width = (area.width - gap) / 2.0;
+    double half_width =
+        needs ? split_points(area.width, gap, mins[0].width, needs[1].width)
+              : (area.width - gap) / 2.0;
 
     // first app gets left half
     WMRect left = {
@@ -38,14 +198,17 @@ static int dwindle_recurse(pid_t *pids, int count, WMRect area,
                     .width = area.width - half_width - gap,
                     .height = area.height};
     return dwindle_recurse(pids + 1, count - 1, right, config, depth + 1,
+                           mins ? mins + 1 : NULL, needs ? needs + 1 : NULL,
                            out_frames, frame_idx, max_frames);
   } else {
     double gap = config->gaps_inner.top;
-    double half_height = (area.height - gap) / 2.0;
+    double half_height =
+        needs ? split_points(area.height, gap, mins[0].height, needs[1].height)
+              : (area.height - gap) / 2.0;
 
     // first app gets top half
     WMRect top = {.x = area.x,
-                  .y = area.y + half_height + gap,
+                  .y = area.y + area.height - half_height,
                   .width = area.width,
                   .height = half_height};
     out_frames[frame_idx].pid = pids[0];
@@ -58,6 +221,7 @@ static int dwindle_recurse(pid_t *pids, int count, WMRect area,
                      .width = area.width,
                      .height = area.height - half_height - gap};
     return dwindle_recurse(pids + 1, count - 1, bottom, config, depth + 1,
+                           mins ? mins + 1 : NULL, needs ? needs + 1 : NULL,
                            out_frames, frame_idx, max_frames);
   }
 }
@@ -65,22 +229,47 @@ static int dwindle_recurse(pid_t *pids, int count, WMRect area,
 int wm_layout_compute_dwindle(const struct WMState *state, int8_t buffer_index,
                               const struct WMConfig *config, WMRect screen,
                               WMFrameChange *out_frames, int max_frame) {
-  if (!state || !config || !out_frames || buffer_index < 0 ||
-      buffer_index >= WM_MAX_BUFFERS || max_frame <= 0)
+  if (buffer_index < 0 || buffer_index >= WM_MAX_BUFFERS)
+    return 0;
+
+  return wm_layout_compute_dwindle_view(state, WM_BUFFER_BIT(buffer_index),
+                                        config, screen, out_frames, max_frame);
+}
+
+int wm_layout_compute_dwindle_view(const struct WMState *state,
+                                   WMBufferMask view_mask,
+                                   const struct WMConfig *config, WMRect screen,
+                                   WMFrameChange *out_frames, int max_frame) {
+  if (!state || !config || !out_frames || view_mask == 0 || max_frame <= 0)
     return 0;
 
-  // get non-floating pids in this buffer
+  // get non-floating pids shown in this view
   pid_t pids[WM_MAX_APPS];
   int count = 0;
 
-  for (int i = 0; i < state->app_registry.app_count && count <= WM_MAX_APPS;
-       i++) {
-    const WMApp *app = &state->app_registry.apps[i];
-    if (app->buffer_index == buffer_index && !app->is_floating)
+  const WMAppRegistry *registry = &state->app_registry;
+  for (int i = 0; i < registry->app_count && count < WM_MAX_APPS; i++) {
+    const WMApp *app = &registry->apps[i];
+    if ((registry->buffer_masks[i] & view_mask) != 0 && !app->is_floating)
       pids[count++] = app->pid;
   }
 
-  if (count == 0)
+  return wm_layout_compute_dwindle_pids(pids, count, config, screen,
+                                        out_frames, max_frame);
+}
+
+int wm_layout_compute_dwindle_pids(const pid_t *pids, int count,
+                                   const struct WMConfig *config, WMRect screen,
+                                   WMFrameChange *out_frames, int max_frame) {
+  return wm_layout_compute_dwindle_fit(pids, NULL, count, config, screen, 1,
+                                       out_frames, max_frame);
+}
+
+int wm_layout_compute_dwindle_fit(const pid_t *pids, const WMSize *min_sizes,
+                                  int count, const struct WMConfig *config,
+                                  WMRect screen, double scale,
+                                  WMFrameChange *out_frames, int max_frame) {
+  if (count <= 0 || max_frame <= 0)
     return 0;
 
   // compute usable area
@@ -91,8 +280,94 @@ int wm_layout_compute_dwindle(const struct WMState *state, int8_t buffer_index,
                    .height = screen.height - config->gaps_outer.top -
                              config->gaps_outer.bottom};
 
-  return dwindle_recurse(pids, count, usable, config, 0, out_frames, 0,
-                         max_frame);
+  double unit = snap_unit(config, scale);
+  double gap_x = unit > 0 ? (double)round_grid(config->gaps_inner.left * unit)
+                          : config->gaps_inner.left;
+  double gap_y = unit > 0 ? (double)round_grid(config->gaps_inner.top * unit)
+                          : config->gaps_inner.top;
+
+  // minimums in the units the splits are made in
+  WMSize mins[WM_MAX_APPS];
+  WMSize needs[WM_MAX_APPS];
+  bool fit = min_sizes != NULL && count <= WM_MAX_APPS;
+  if (fit)
+    dwindle_needs(min_sizes, count, unit > 0 ? unit : 1, gap_x, gap_y, mins,
+                  needs);
+
+  if (unit > 0)
+    return dwindle_grid(pids, count, to_grid(usable, unit), (int64_t)gap_x,
+                        (int64_t)gap_y, unit, fit ? mins : NULL,
+                        fit ? needs : NULL, out_frames, max_frame);
+
+  return dwindle_recurse(pids, count, usable, config, 0, fit ? mins : NULL,
+                         fit ? needs : NULL, out_frames, 0, max_frame);
+}
+
+WMRect wm_layout_fit(WMRect frame, WMSize min_size, WMRect area) {
+  // grow away from the area edge the frame is against, stay inside it
+  if (frame.width < min_size.width) {
+    bool right = frame.x + frame.width >= area.x + area.width &&
+                 frame.x > area.x;
+    if (right)
+      frame.x -= min_size.width - frame.width;
+    frame.width = min_size.width;
+  }
+  if (frame.height < min_size.height) {
+    bool top = frame.y + frame.height >= area.y + area.height &&
+               frame.y > area.y;
+    if (top)
+      frame.y -= min_size.height - frame.height;
+    frame.height = min_size.height;
+  }
+  if (frame.x + frame.width > area.x + area.width)
+    frame.x = area.x + area.width - frame.width;
+  if (frame.y + frame.height > area.y + area.height)
+    frame.y = area.y + area.height - frame.height;
+  if (frame.x < area.x)
+    frame.x = area.x;
+  if (frame.y < area.y)
+    frame.y = area.y;
+  return frame;
+}
+
+// snap frame on the grid, the same halves as the fractional one
+static GridRect snap_grid(int snap_action, GridRect screen, GridRect area,
+                          int64_t gap_x, int64_t gap_y) {
+  int64_t left = first_half(area.width, gap_x);
+  int64_t top = first_half(area.height, gap_y);
+  int64_t right_x = area.x + left + gap_x;
+  int64_t right = area.width - left - gap_x;
+  int64_t bottom = area.height - top - gap_y;
+  int64_t top_y = area.y + bottom + gap_y;
+
+  switch (snap_action) {
+  case WM_ACTION_SNAP_LEFT:
+    return (GridRect){area.x, area.y, left, area.height};
+  case WM_ACTION_SNAP_RIGHT:
+    return (GridRect){right_x, area.y, right, area.height};
+  case WM_ACTION_SNAP_TOP:
+    return (GridRect){area.x, top_y, area.width, top};
+  case WM_ACTION_SNAP_BOTTOM:
+    return (GridRect){area.x, area.y, area.width, bottom};
+  case WM_ACTION_SNAP_MAXIMIZE:
+    return area;
+  case WM_ACTION_SNAP_CENTER: {
+    int64_t width = round_grid((double)screen.width * 0.6);
+    int64_t height = round_grid((double)screen.height * 0.7);
+    return (GridRect){screen.x + (screen.width - width) / 2,
+                      screen.y + (screen.height - height) / 2, width, height};
+  }
+  case WM_ACTION_SNAP_TOP_LEFT:
+    return (GridRect){area.x, top_y, left, top};
+  case WM_ACTION_SNAP_TOP_RIGHT:
+    return (GridRect){right_x, top_y, right, top};
+  case WM_ACTION_SNAP_BOTTOM_LEFT:
+    return (GridRect){area.x, area.y, left, bottom};
+  case WM_ACTION_SNAP_BOTTOM_RIGHT:
+    return (GridRect){right_x, area.y, right, bottom};
+  default:
+    return screen;
+  }
 }
 
 WMRect wm_layout_compute_snap(int snap_action, WMRect screen,
@@ -105,6 +380,17 @@ WMRect wm_layout_compute_snap(int snap_action, WMRect screen,
   double height =
       screen.height - config->gaps_outer.top - config->gaps_outer.bottom;
 
+  // whole points: the display of the window isn't known here
+  double unit = snap_unit(config, 1);
+  if (unit > 0) {
+    WMRect area = {.x = x, .y = y, .width = width, .height = height};
+    GridRect snapped =
+        snap_grid(snap_action, to_grid(screen, unit), to_grid(area, unit),
+                  round_grid(config->gaps_inner.left * unit),
+                  round_grid(config->gaps_inner.top * unit));
+    return from_grid(snapped, unit);
+  }
+
   double half_width = (width - config->gaps_inner.left) / 2.0;
   double half_height = (height - config->gaps_inner.top) / 2.0;
 
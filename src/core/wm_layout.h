@@ -1,18 +1,11 @@
 #ifndef WM_LAYOUT_H
 #define WM_LAYOUT_H
 
+#include "wm_runtime.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
 
-// rectangle for frame calculations
-typedef struct {
-  double x;      // x coordinate
-  double y;      // y coordinate
-  double width;  // width of the frame
-  double height; // height of the frame
-} WMRect;
-
 // frame changes to apply after an action is processed
 typedef struct {
   pid_t pid;     // pid to change frame
@@ -27,7 +20,35 @@ int wm_layout_compute_dwindle(const struct WMState *state, int8_t buffer_index,
                               const struct WMConfig *config, WMRect screen,
                               WMFrameChange *out_frames, int max_frame);
 
-// compute snap frame for a single window
+// compute dwindle layout for every app shown in a view of several buffers
+int wm_layout_compute_dwindle_view(const struct WMState *state,
+                                   WMBufferMask view_mask,
+                                   const struct WMConfig *config, WMRect screen,
+                                   WMFrameChange *out_frames, int max_frame);
+
+// compute dwindle layout for a list of apps, in order
+int wm_layout_compute_dwindle_pids(const pid_t *pids, int count,
+                                   const struct WMConfig *config, WMRect screen,
+                                   WMFrameChange *out_frames, int max_frame);
+
+// compute dwindle layout for a list of apps on a display with scale backing
+// pixels per point (0 = 1), which layout_snap = pixels snaps to. Frames
+// are on the snap grid, tile the screen exactly with the configured gaps
+// (an odd grid unit goes to the first of two halves) and are the same
+// bits for the same input. min_sizes (one per app, may be NULL) move each
+// split off the half as far as needed for every app to get its minimum;
+// when the screen can't hold them all they share the shortfall
+int wm_layout_compute_dwindle_fit(const pid_t *pids, const WMSize *min_sizes,
+                                  int count, const struct WMConfig *config,
+                                  WMRect screen, double scale,
+                                  WMFrameChange *out_frames, int max_frame);
+
+// frame grown to min_size, away from the edge of area it is against, and
+// moved back inside area (snapped windows whose app won't shrink further)
+WMRect wm_layout_fit(WMRect frame, WMSize min_size, WMRect area);
+
+// compute snap frame for a single window (snapped to whole points unless
+// layout_snap is off)
 WMRect wm_layout_compute_snap(int snap_action, WMRect screen,
                               const struct WMConfig *config);
 
@@ -0,0 +1,627 @@
+#include "wm_log.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NS_PER_MS 1000000ull
+#define NS_PER_SEC 1000000000ull
+#define RING_MASK (WM_LOG_RING_SIZE - 1)
+#define NO_THREAD WM_LOG_MAX_THREADS // records lost without a ring
+#define SINK_RECORDS 64              // records buffered per write()
+#define CRASH_STACK_SIZE (64 * 1024)
+
+// a record in a ring. The sequence guards the words the way the mirror's
+// does: 2i+1 while record i is written, 2i+2 once it is; a reader keeps a
+// copy only if it read 2i+2 around it, so a wrapped writer is noticed
+typedef struct {
+  _Alignas(64) _Atomic uint64_t sequence;
+  _Atomic uint64_t words[2 + WM_LOG_MAX_ARGS]; // timestamp, meta, args
+} Slot;
+
+_Static_assert(sizeof(Slot) == 64, "a record is one cache line");
+
+typedef struct {
+  Slot slots[WM_LOG_RING_SIZE];
+  _Alignas(64) _Atomic uint64_t head; // records ever written
+  _Atomic bool owned;                 // a live thread writes here
+  uint64_t drained;                   // records handled by the drainer
+} Ring;
+
+static const char *const g_categories[] = {
+#define CATEGORY_NAME(id, name) name,
+    WM_LOG_CATEGORIES(CATEGORY_NAME)
+#undef CATEGORY_NAME
+};
+
+static const char *const g_formats[] = {
+#define FORMAT_TEXT(id, category, format) format,
+    WM_LOG_FORMATS(FORMAT_TEXT)
+#undef FORMAT_TEXT
+};
+
+static const uint8_t g_format_categories[] = {
+#define FORMAT_CATEGORY(id, category, format) WM_LOG_CATEGORY_##category,
+    WM_LOG_FORMATS(FORMAT_CATEGORY)
+#undef FORMAT_CATEGORY
+};
+
+static Ring g_rings[WM_LOG_MAX_THREADS];
+static _Atomic uint32_t g_unlogged; // records of threads without a ring
+static _Thread_local Ring *t_ring;
+static pthread_key_t g_ring_key;
+static pthread_once_t g_ring_key_once = PTHREAD_ONCE_INIT;
+
+// drainer
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER; // guards below
+static pthread_cond_t g_wake = PTHREAD_COND_INITIALIZER;
+static pthread_t g_thread;
+static bool g_running;
+static bool g_stopping;
+static int g_fd = -1;
+static size_t g_file_size;
+static char g_path[1024];
+
+// crash recorder, set before the handlers are
+static char g_crash_path[1024];
+static _Atomic bool g_crashing;
+static void (*volatile g_crash_hook)(void);
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+// rings
+
+static void release_ring(void *value) {
+  Ring *ring = value;
+  atomic_store_explicit(&ring->owned, false, memory_order_release);
+}
+
+static void make_ring_key(void) {
+  pthread_key_create(&g_ring_key, release_ring);
+}
+
+// take a free ring for this thread, given back when it exits
+static Ring *claim_ring(void) {
+  pthread_once(&g_ring_key_once, make_ring_key);
+  for (int i = 0; i < WM_LOG_MAX_THREADS; i++) {
+    bool expected = false;
+    if (atomic_compare_exchange_strong_explicit(
+            &g_rings[i].owned, &expected, true, memory_order_acquire,
+            memory_order_relaxed)) {
+      t_ring = &g_rings[i];
+      pthread_setspecific(g_ring_key, t_ring);
+      return t_ring;
+    }
+  }
+  return NULL;
+}
+
+void wm_log_write(WMLogFormat format, int count, const uint64_t *args) {
+  Ring *ring = t_ring;
+  if (ring == NULL && (ring = claim_ring()) == NULL) {
+    atomic_fetch_add_explicit(&g_unlogged, 1, memory_order_relaxed);
+    return;
+  }
+  if (count > WM_LOG_MAX_ARGS)
+    count = WM_LOG_MAX_ARGS;
+
+  // only this thread writes the ring, the drainer reads head with acquire
+  uint64_t index = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  Slot *slot = &ring->slots[index & RING_MASK];
+  uint64_t meta = (uint64_t)format | (uint64_t)count << 16 |
+                  (uint64_t)(ring - g_rings) << 24;
+
+  atomic_store_explicit(&slot->sequence, 2 * index + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&slot->words[0], now_ns(), memory_order_relaxed);
+  atomic_store_explicit(&slot->words[1], meta, memory_order_relaxed);
+  for (int i = 0; i < count; i++)
+    atomic_store_explicit(&slot->words[2 + i], args[i], memory_order_relaxed);
+  atomic_store_explicit(&slot->sequence, 2 * index + 2, memory_order_release);
+  atomic_store_explicit(&ring->head, index + 1, memory_order_release);
+}
+
+// copy record index of ring, false if its writer already moved past it
+static bool read_slot(Ring *ring, uint64_t index, WMLogRecord *out) {
+  Slot *slot = &ring->slots[index & RING_MASK];
+  uint64_t expected = 2 * index + 2;
+  if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != expected)
+    return false;
+
+  uint64_t words[2 + WM_LOG_MAX_ARGS];
+  for (int i = 0; i < 2 + WM_LOG_MAX_ARGS; i++)
+    words[i] = atomic_load_explicit(&slot->words[i], memory_order_relaxed);
+  atomic_thread_fence(memory_order_acquire);
+  if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) != expected)
+    return false;
+
+  memset(out, 0, sizeof(*out));
+  out->timestamp_ns = words[0];
+  out->format = (uint16_t)words[1];
+  out->count = (uint8_t)(words[1] >> 16);
+  out->thread = (uint8_t)(words[1] >> 24);
+  if (out->count > WM_LOG_MAX_ARGS)
+    return false;
+  // the words past count belong to older records
+  memcpy(out->args, &words[2], out->count * sizeof(uint64_t));
+  return true;
+}
+
+// files
+
+typedef struct {
+  int fd;
+  int count;
+  int written; // records
+  size_t bytes;
+  WMLogRecord records[SINK_RECORDS];
+} Sink;
+
+// write(2) all of it (async-signal-safe)
+static bool write_all(int fd, const void *data, size_t size) {
+  const char *bytes = data;
+  while (size > 0) {
+    ssize_t written = write(fd, bytes, size);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    bytes += written;
+    size -= (size_t)written;
+  }
+  return true;
+}
+
+static void sink_flush(Sink *sink) {
+  size_t size = (size_t)sink->count * sizeof(WMLogRecord);
+  if (sink->count > 0 && write_all(sink->fd, sink->records, size)) {
+    sink->written += sink->count;
+    sink->bytes += size;
+  }
+  sink->count = 0;
+}
+
+static void sink_put(Sink *sink, const WMLogRecord *record) {
+  sink->records[sink->count++] = *record;
+  if (sink->count == SINK_RECORDS)
+    sink_flush(sink);
+}
+
+static uint32_t formats_hash(void) {
+  uint32_t hash = 2166136261u; // FNV-1a
+  for (int i = 0; i < WM_LOG_FORMAT_COUNT; i++) {
+    const char *text[] = {g_categories[g_format_categories[i]],
+                          g_formats[i]};
+    for (int t = 0; t < 2; t++) {
+      for (const char *c = text[t]; *c; c++)
+        hash = (hash ^ (uint8_t)*c) * 16777619u;
+      hash = (hash ^ 0) * 16777619u;
+    }
+  }
+  return hash;
+}
+
+static bool write_header(int fd) {
+  struct timespec realtime;
+  clock_gettime(CLOCK_REALTIME, &realtime);
+  uint64_t wall = (uint64_t)realtime.tv_sec * NS_PER_SEC +
+                  (uint64_t)realtime.tv_nsec;
+  WMLogFileHeader header = {
+      .magic = WM_LOG_MAGIC,
+      .version = WM_LOG_VERSION,
+      .format_count = WM_LOG_FORMAT_COUNT,
+      .formats_hash = formats_hash(),
+      .record_size = sizeof(WMLogRecord),
+      .realtime_offset_ns = wall - now_ns(),
+  };
+  return write_all(fd, &header, sizeof(header));
+}
+
+static void lost_record(WMLogRecord *out, uint32_t count, int thread) {
+  memset(out, 0, sizeof(*out));
+  out->timestamp_ns = now_ns();
+  out->format = WM_LOG_LOST;
+  out->count = 2;
+  out->thread = (uint8_t)thread;
+  out->args[0] = count;
+  out->args[1] = wm_log_integer(thread == NO_THREAD ? -1 : thread);
+}
+
+// next readable record of a ring in [*next, end), skipping (and counting)
+// those overwritten
+static bool next_record(Ring *ring, uint64_t *next, uint64_t end,
+                        WMLogRecord *out, uint64_t *lost) {
+  while (*next < end) {
+    if (read_slot(ring, (*next)++, out))
+      return true;
+    (*lost)++;
+  }
+  return false;
+}
+
+// put the records [begin, end) of every ring into sink, oldest first. Each
+// ring is in time order already, the merge keeps the file in order
+static void merge_rings(const uint64_t *begin, const uint64_t *end,
+                        uint64_t *lost, Sink *sink) {
+  uint64_t next[WM_LOG_MAX_THREADS];
+  WMLogRecord pending[WM_LOG_MAX_THREADS];
+  bool has[WM_LOG_MAX_THREADS];
+  for (int i = 0; i < WM_LOG_MAX_THREADS; i++) {
+    next[i] = begin[i];
+    has[i] = next_record(&g_rings[i], &next[i], end[i], &pending[i], &lost[i]);
+  }
+
+  for (;;) {
+    int oldest = -1;
+    for (int i = 0; i < WM_LOG_MAX_THREADS; i++) {
+      if (has[i] && (oldest < 0 || pending[i].timestamp_ns <
+                                       pending[oldest].timestamp_ns))
+        oldest = i;
+    }
+    if (oldest < 0)
+      return;
+    sink_put(sink, &pending[oldest]);
+    has[oldest] = next_record(&g_rings[oldest], &next[oldest], end[oldest],
+                              &pending[oldest], &lost[oldest]);
+  }
+}
+
+// drainer
+
+// start a file at g_path, the previous one becomes <path>.old
+static bool open_log_file(void) {
+  char old[sizeof(g_path) + 4];
+  snprintf(old, sizeof(old), "%s.old", g_path);
+  rename(g_path, old);
+
+  g_fd = open(g_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (g_fd < 0)
+    return false;
+  if (!write_header(g_fd)) {
+    close(g_fd);
+    g_fd = -1;
+    return false;
+  }
+  g_file_size = sizeof(WMLogFileHeader);
+  return true;
+}
+
+// write what the rings got since the last drain, lock held
+static int drain_locked(void) {
+  if (g_fd < 0)
+    return 0;
+
+  uint64_t begin[WM_LOG_MAX_THREADS];
+  uint64_t end[WM_LOG_MAX_THREADS];
+  uint64_t lost[WM_LOG_MAX_THREADS] = {0};
+  for (int i = 0; i < WM_LOG_MAX_THREADS; i++) {
+    begin[i] = g_rings[i].drained;
+    end[i] = atomic_load_explicit(&g_rings[i].head, memory_order_acquire);
+    // wrapped since the last drain: the oldest are gone
+    if (end[i] - begin[i] > WM_LOG_RING_SIZE) {
+      lost[i] = end[i] - begin[i] - WM_LOG_RING_SIZE;
+      begin[i] = end[i] - WM_LOG_RING_SIZE;
+    }
+  }
+
+  static Sink sink;
+  sink.fd = g_fd;
+  sink.count = 0;
+  sink.written = 0;
+  sink.bytes = 0;
+  merge_rings(begin, end, lost, &sink);
+
+  WMLogRecord record;
+  for (int i = 0; i < WM_LOG_MAX_THREADS; i++) {
+    g_rings[i].drained = end[i];
+    if (lost[i] > 0) {
+      lost_record(&record, (uint32_t)lost[i], i);
+      sink_put(&sink, &record);
+    }
+  }
+  uint32_t unlogged =
+      atomic_exchange_explicit(&g_unlogged, 0, memory_order_relaxed);
+  if (unlogged > 0) {
+    lost_record(&record, unlogged, NO_THREAD);
+    sink_put(&sink, &record);
+  }
+  sink_flush(&sink);
+
+  g_file_size += sink.bytes;
+  if (g_file_size > WM_LOG_MAX_FILE) {
+    close(g_fd);
+    g_fd = -1;
+    open_log_file();
+  }
+  return sink.written;
+}
+
+int wm_log_drain(void) {
+  pthread_mutex_lock(&g_lock);
+  int written = drain_locked();
+  pthread_mutex_unlock(&g_lock);
+  return written;
+}
+
+static void *drain_loop(void *argument) {
+  (void)argument;
+  pthread_mutex_lock(&g_lock);
+  while (!g_stopping) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += (long)(WM_LOG_DRAIN_MS * NS_PER_MS);
+    if (deadline.tv_nsec >= (long)NS_PER_SEC) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= (long)NS_PER_SEC;
+    }
+    pthread_cond_timedwait(&g_wake, &g_lock, &deadline);
+    drain_locked();
+  }
+  pthread_mutex_unlock(&g_lock);
+  return NULL;
+}
+
+bool wm_log_start(const char *path) {
+  pthread_mutex_lock(&g_lock);
+  if (g_running || strlen(path) >= sizeof(g_path)) {
+    pthread_mutex_unlock(&g_lock);
+    return false;
+  }
+  snprintf(g_path, sizeof(g_path), "%s", path);
+  if (!open_log_file()) {
+    pthread_mutex_unlock(&g_lock);
+    return false;
+  }
+
+  g_stopping = false;
+  if (pthread_create(&g_thread, NULL, drain_loop, NULL) != 0) {
+    close(g_fd);
+    g_fd = -1;
+    pthread_mutex_unlock(&g_lock);
+    return false;
+  }
+  g_running = true;
+  pthread_mutex_unlock(&g_lock);
+  return true;
+}
+
+void wm_log_stop(void) {
+  pthread_mutex_lock(&g_lock);
+  if (!g_running) {
+    pthread_mutex_unlock(&g_lock);
+    return;
+  }
+  g_stopping = true;
+  pthread_cond_signal(&g_wake);
+  pthread_mutex_unlock(&g_lock);
+  pthread_join(g_thread, NULL);
+
+  pthread_mutex_lock(&g_lock);
+  drain_locked();
+  if (g_fd >= 0)
+    close(g_fd);
+  g_fd = -1;
+  g_running = false;
+  pthread_mutex_unlock(&g_lock);
+}
+
+// crash recorder
+
+// header, the last records of every ring, then a CRASH record when signal
+// is set. No locks nor allocation, the crash handler calls it
+static int dump(int fd, int signal) {
+  if (!write_header(fd))
+    return 0;
+
+  uint64_t begin[WM_LOG_MAX_THREADS];
+  uint64_t end[WM_LOG_MAX_THREADS];
+  uint64_t lost[WM_LOG_MAX_THREADS] = {0};
+  for (int i = 0; i < WM_LOG_MAX_THREADS; i++) {
+    end[i] = atomic_load_explicit(&g_rings[i].head, memory_order_acquire);
+    begin[i] = end[i] > WM_LOG_RING_SIZE ? end[i] - WM_LOG_RING_SIZE : 0;
+  }
+
+  Sink sink = {.fd = fd};
+  merge_rings(begin, end, lost, &sink);
+  if (signal != 0) {
+    WMLogRecord record = {
+        .timestamp_ns = now_ns(),
+        .format = WM_LOG_CRASH,
+        .count = 1,
+        .thread = (uint8_t)(t_ring ? t_ring - g_rings : NO_THREAD),
+        .args = {wm_log_integer(signal)},
+    };
+    sink_put(&sink, &record);
+  }
+  sink_flush(&sink);
+  return sink.written;
+}
+
+int wm_log_dump(int fd) {
+  return dump(fd, 0);
+}
+
+static void crash_handler(int signal_number) {
+  // the first crashing thread writes the file, the others just die
+  if (!atomic_exchange(&g_crashing, true)) {
+    int fd = open(g_crash_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (fd >= 0) {
+      dump(fd, signal_number);
+      close(fd);
+    }
+    if (g_crash_hook != NULL)
+      g_crash_hook();
+  }
+
+  // die of it as if there was no handler
+  signal(signal_number, SIG_DFL);
+  raise(signal_number);
+}
+
+void wm_log_set_crash_hook(void (*hook)(void)) { g_crash_hook = hook; }
+
+bool wm_log_install_crash_handler(const char *path) {
+  if (strlen(path) >= sizeof(g_crash_path))
+    return false;
+  snprintf(g_crash_path, sizeof(g_crash_path), "%s", path);
+
+  // a stack overflow leaves no stack to run the handler on
+  static char stack[CRASH_STACK_SIZE];
+  stack_t alternate = {.ss_sp = stack, .ss_size = sizeof(stack)};
+  if (sigaltstack(&alternate, NULL) != 0)
+    return false;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = crash_handler;
+  action.sa_flags = SA_ONSTACK | SA_RESETHAND;
+  sigemptyset(&action.sa_mask);
+  const int signals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT, SIGTRAP};
+  for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++) {
+    if (sigaction(signals[i], &action, NULL) != 0)
+      return false;
+  }
+  return true;
+}
+
+// decoder
+
+// append one conversion of a format, spec is "%[flags][width][.precision]"
+static int format_argument(char *out, size_t size, const char *spec,
+                           size_t spec_length, char conversion,
+                           uint64_t value) {
+  char full[32];
+  if (spec_length + 4 > sizeof(full))
+    return snprintf(out, size, "?");
+  memcpy(full, spec, spec_length);
+  size_t length = spec_length;
+
+  switch (conversion) {
+  case 'd':
+  case 'i':
+  case 'o':
+  case 'u':
+  case 'x':
+  case 'X':
+    full[length++] = 'l';
+    full[length++] = 'l';
+    full[length++] = conversion;
+    full[length] = '\0';
+    if (conversion == 'd' || conversion == 'i')
+      return snprintf(out, size, full, (long long)(int64_t)value);
+    return snprintf(out, size, full, (unsigned long long)value);
+  case 'c':
+    full[length++] = 'c';
+    full[length] = '\0';
+    return snprintf(out, size, full, (int)value);
+  case 'f':
+  case 'F':
+  case 'e':
+  case 'E':
+  case 'g':
+  case 'G': {
+    double number;
+    memcpy(&number, &value, sizeof(number));
+    full[length++] = conversion;
+    full[length] = '\0';
+    return snprintf(out, size, full, number);
+  }
+  default:
+    return snprintf(out, size, "?");
+  }
+}
+
+int wm_log_format_record(const WMLogRecord *record, char *out, size_t size) {
+  if (size == 0)
+    return 0;
+  if (record->format >= WM_LOG_FORMAT_COUNT)
+    return snprintf(out, size, "[Log] unknown record %u", record->format);
+
+  int written = snprintf(out, size, "[%s] ",
+                         g_categories[g_format_categories[record->format]]);
+  size_t length = (size_t)written < size ? (size_t)written : size - 1;
+  const char *p = g_formats[record->format];
+  int arg = 0;
+
+  while (*p && length + 1 < size) {
+    if (*p != '%') {
+      out[length++] = *p++;
+      continue;
+    }
+    if (p[1] == '%') {
+      out[length++] = '%';
+      p += 2;
+      continue;
+    }
+
+    const char *spec = p++;
+    while (*p && strchr("-+ #0", *p))
+      p++;
+    while (*p >= '0' && *p <= '9')
+      p++;
+    if (*p == '.') {
+      p++;
+      while (*p >= '0' && *p <= '9')
+        p++;
+    }
+    size_t spec_length = (size_t)(p - spec);
+    char conversion = *p ? *p++ : '\0';
+
+    if (arg < record->count && arg < WM_LOG_MAX_ARGS)
+      written = format_argument(out + length, size - length, spec,
+                                spec_length, conversion, record->args[arg]);
+    else
+      written = snprintf(out + length, size - length, "?");
+    arg++;
+    if (written > 0)
+      length += (size_t)written < size - length ? (size_t)written
+                                                : size - length - 1;
+  }
+  out[length] = '\0';
+  return (int)length;
+}
+
+int wm_log_decode(const char *path, FILE *out) {
+  FILE *file = fopen(path, "rb");
+  if (file == NULL)
+    return -1;
+
+  WMLogFileHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != WM_LOG_MAGIC || header.version != WM_LOG_VERSION ||
+      header.format_count != WM_LOG_FORMAT_COUNT ||
+      header.formats_hash != formats_hash() ||
+      header.record_size != sizeof(WMLogRecord)) {
+    fclose(file);
+    return -1;
+  }
+
+  int count = 0;
+  WMLogRecord record;
+  char message[512];
+  while (fread(&record, sizeof(record), 1, file) == 1) {
+    uint64_t wall = record.timestamp_ns + header.realtime_offset_ns;
+    time_t seconds = (time_t)(wall / NS_PER_SEC);
+    struct tm local;
+    char clock[16] = "??:??:??";
+    if (localtime_r(&seconds, &local))
+      strftime(clock, sizeof(clock), "%H:%M:%S", &local);
+    wm_log_format_record(&record, message, sizeof(message));
+    fprintf(out, "%s.%03u t%u %s\n", clock,
+            (unsigned)(wall % NS_PER_SEC / NS_PER_MS), record.thread,
+            message);
+    count++;
+  }
+  fclose(file);
+  return count;
+}
@@ -0,0 +1,157 @@
+#ifndef WM_LOG_H
+#define WM_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define WM_LOG_MAGIC 0x474c5744u   // "DWLG"
+#define WM_LOG_VERSION 1
+#define WM_LOG_MAX_THREADS 16      // threads logging at once
+#define WM_LOG_RING_SIZE 1024      // last records kept per thread
+#define WM_LOG_MAX_ARGS 5          // arguments of one record
+#define WM_LOG_DRAIN_MS 100        // the drainer writes this often
+#define WM_LOG_MAX_FILE (8u << 20) // the file moves to <path>.old past this
+
+_Static_assert((WM_LOG_RING_SIZE & (WM_LOG_RING_SIZE - 1)) == 0,
+               "ring indexes are masked");
+
+// categories, rendered as the "[Name]" prefix NSLog lines use
+#define WM_LOG_CATEGORIES(X)                                                  \
+  X(LOG, "Log")                                                               \
+  X(SWITCH, "Switch")                                                         \
+  X(EFFECTS, "Effects")                                                       \
+  X(HOOKS, "Hooks")                                                           \
+  X(TIMER, "Timer")                                                           \
+  X(TEST, "Test")
+
+// every message: id, category, printf format. Numbers only (d i u x X o c,
+// f e g with flags, width and precision), the decoder of the same build
+// renders them
+#define WM_LOG_FORMATS(X)                                                     \
+  X(LOST, LOG, "%u records lost by thread %d")                                \
+  X(CRASH, LOG, "crashed with signal %d")                                     \
+  X(SWITCH_DONE, SWITCH,                                                      \
+    "buffer %d focused in %.1f ms, settled in %.1f ms, timed out 0x%02x")     \
+  X(SWITCH_STAGES, SWITCH,                                                    \
+    "unhide %.1f, raise %.1f, activate %.1f, hide %.1f, layout %.1f ms")      \
+  X(EFFECTS_DONE, EFFECTS,                                                    \
+    "%u effects in %u turns, critical %.1f ms, all %.1f ms")                  \
+  X(HOOK_DONE, HOOKS,                                                         \
+    "hook %d exit %d after %.1f ms (timed out %d), waited %.1f ms")           \
+  X(TIMER_FULL, TIMER, "wheel full, dropped a timer")                         \
+  X(TEST_VALUES, TEST, "int %d unsigned %u hex %#x double %.3f char %c")
+
+typedef enum {
+#define WM_LOG_CATEGORY_ENUM(id, name) WM_LOG_CATEGORY_##id,
+  WM_LOG_CATEGORIES(WM_LOG_CATEGORY_ENUM)
+#undef WM_LOG_CATEGORY_ENUM
+  WM_LOG_CATEGORY_COUNT,
+} WMLogCategory;
+
+typedef enum {
+#define WM_LOG_FORMAT_ENUM(id, category, format) WM_LOG_##id,
+  WM_LOG_FORMATS(WM_LOG_FORMAT_ENUM)
+#undef WM_LOG_FORMAT_ENUM
+  WM_LOG_FORMAT_COUNT,
+} WMLogFormat;
+
+// one record as written to the file
+typedef struct {
+  uint64_t timestamp_ns; // CLOCK_MONOTONIC
+  uint16_t format;       // WMLogFormat
+  uint8_t count;         // arguments used
+  uint8_t thread;        // ring it came from
+  uint32_t reserved;
+  uint64_t args[WM_LOG_MAX_ARGS]; // integers, doubles as their bits
+} WMLogRecord;
+
+// start of a log or crash file, records follow
+typedef struct {
+  uint32_t magic;              // WM_LOG_MAGIC
+  uint16_t version;            // WM_LOG_VERSION
+  uint16_t format_count;       // WM_LOG_FORMAT_COUNT
+  uint32_t formats_hash;       // of every format, decoders must match it
+  uint32_t record_size;        // sizeof(WMLogRecord)
+  uint64_t realtime_offset_ns; // CLOCK_REALTIME - CLOCK_MONOTONIC
+} WMLogFileHeader;
+
+static inline uint64_t wm_log_integer(int64_t value) {
+  return (uint64_t)value;
+}
+
+static inline uint64_t wm_log_double(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+#define WM_LOG_ARG(x)                                                         \
+  _Generic((x), float: wm_log_double, double: wm_log_double,                 \
+           default: wm_log_integer)(x)
+
+// log a message: WM_LOG(WM_LOG_SWITCH_DONE, buffer, focus_ms, ...). Never
+// blocks nor formats, the record goes to the calling thread's ring
+#define WM_LOG(...)                                                           \
+  WM_LOG_PICK(__VA_ARGS__, WM_LOG_ARGS_5, WM_LOG_ARGS_4, WM_LOG_ARGS_3,       \
+              WM_LOG_ARGS_2, WM_LOG_ARGS_1, WM_LOG_ARGS_0, )(__VA_ARGS__)
+#define WM_LOG_PICK(_1, _2, _3, _4, _5, _6, name, ...) name
+#define WM_LOG_ARGS_0(id) wm_log_write(id, 0, NULL)
+#define WM_LOG_ARGS_1(id, a)                                                  \
+  wm_log_write(id, 1, (const uint64_t[]){WM_LOG_ARG(a)})
+#define WM_LOG_ARGS_2(id, a, b)                                               \
+  wm_log_write(id, 2, (const uint64_t[]){WM_LOG_ARG(a), WM_LOG_ARG(b)})
+#define WM_LOG_ARGS_3(id, a, b, c)                                            \
+  wm_log_write(id, 3,                                                         \
+               (const uint64_t[]){WM_LOG_ARG(a), WM_LOG_ARG(b),               \
+                                  WM_LOG_ARG(c)})
+#define WM_LOG_ARGS_4(id, a, b, c, d)                                         \
+  wm_log_write(id, 4,                                                         \
+               (const uint64_t[]){WM_LOG_ARG(a), WM_LOG_ARG(b),               \
+                                  WM_LOG_ARG(c), WM_LOG_ARG(d)})
+#define WM_LOG_ARGS_5(id, a, b, c, d, e)                                      \
+  wm_log_write(id, 5,                                                         \
+               (const uint64_t[]){WM_LOG_ARG(a), WM_LOG_ARG(b),               \
+                                  WM_LOG_ARG(c), WM_LOG_ARG(d),               \
+                                  WM_LOG_ARG(e)})
+
+// store a record in the calling thread's ring (any thread, lock-free). A
+// thread gets a ring on its first record and gives it back when it exits;
+// with every ring taken the record is counted as lost
+void wm_log_write(WMLogFormat format, int count, const uint64_t *args);
+
+// write the rings to a new file at path (the last one becomes <path>.old)
+// every WM_LOG_DRAIN_MS on a drainer thread. Records are merged by time,
+// those a thread overwrote before they were written are reported as lost.
+// Returns false if path can't be opened
+bool wm_log_start(const char *path);
+
+// write what is left and stop the drainer
+void wm_log_stop(void);
+
+// write the rings now (the drainer does it on its own). Returns records
+// written, 0 without a file
+int wm_log_drain(void);
+
+// on a crash signal (SEGV, BUS, ILL, FPE, ABRT, TRAP) write the last
+// records of every thread to path, replacing the last crash file, then die
+// of the signal. Returns false if the handlers can't be installed
+bool wm_log_install_crash_handler(const char *path);
+
+// run hook once a crash file is written, before dying (signal context, best
+// effort: what dwin must undo on screen). NULL removes it
+void wm_log_set_crash_hook(void (*hook)(void));
+
+// write the last records of every thread as a log file to fd (what the
+// crash handler does, async-signal-safe). Returns records written
+int wm_log_dump(int fd);
+
+// render a record as "[Category] message". Returns the length
+int wm_log_format_record(const WMLogRecord *record, char *out, size_t size);
+
+// print a log or crash file as "HH:MM:SS.mmm t<thread> [Category] message"
+// lines. Returns records printed, -1 if the file isn't a log of this build
+int wm_log_decode(const char *path, FILE *out);
+
+#endif
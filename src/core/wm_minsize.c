@@ -0,0 +1,136 @@
+#include "wm_minsize.h"
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t refusals(const void *slot) {
+  return ((const WMMinSizeSlot *)slot)->refusals;
+}
+
+static const WMStoreLayout TABLE_LAYOUT = {
+    .magic = WM_MINSIZE_MAGIC,
+    .version = WM_MINSIZE_VERSION,
+    .slot_count = WM_MINSIZE_SLOTS,
+    .slot_size = sizeof(WMMinSizeSlot),
+    .worth = refusals, // the bundle with the fewest refusals makes room
+};
+
+_Static_assert((WM_MINSIZE_SLOTS & (WM_MINSIZE_SLOTS - 1)) == 0,
+               "WM_MINSIZE_SLOTS must be a power of two");
+_Static_assert(sizeof(WMMinSizeImage) ==
+                   sizeof(WMStoreHeader) +
+                       WM_MINSIZE_SLOTS * sizeof(WMMinSizeSlot),
+               "WMMinSizeImage must be a header and its slots");
+
+void wm_minsize_init(WMMinSizeStore *store) {
+  memset(store, 0, sizeof(*store));
+  wm_store_init(&store->table, &TABLE_LAYOUT, &store->image);
+}
+
+static WMMinSizeSlot *find_slot(const WMMinSizeStore *store,
+                                const char *bundle_identifier) {
+  if (store == NULL)
+    return NULL;
+  return wm_store_find(&store->table, &store->image, bundle_identifier);
+}
+
+// points rounded up, a window is never given less than it took
+static uint16_t whole_points(double size) {
+  if (size <= 0)
+    return 0;
+  if (size >= UINT16_MAX)
+    return UINT16_MAX;
+  uint16_t points = (uint16_t)size;
+  return (double)points < size ? (uint16_t)(points + 1) : points;
+}
+
+// size a window took, no more than limit (the usable area) when that is set
+static double capped(double accepted, double limit) {
+  return limit > 0 && accepted > limit ? limit : accepted;
+}
+
+// one dimension of a slot after a window was asked for requested and took
+// accepted. Kept larger, the size is pending until a second refusal within
+// WM_MINSIZE_SLACK confirms it as the minimum (an app resizing
+// asynchronously may still report the size it had). Taken below a pending
+// size or the minimum, that is dropped (the app changed)
+static void learn_dimension(uint16_t *minimum, uint16_t *pending,
+                            double requested, double accepted) {
+  if (accepted > requested + WM_MINSIZE_SLACK) {
+    uint16_t size = whole_points(accepted);
+    if (*pending > 0 && abs((int)size - (int)*pending) <= WM_MINSIZE_SLACK) {
+      *minimum = size > *pending ? size : *pending;
+      *pending = 0;
+    } else {
+      *pending = size;
+    }
+    return;
+  }
+
+  if (*pending > 0 && accepted + WM_MINSIZE_SLACK < *pending)
+    *pending = 0;
+  if (*minimum > 0 && accepted + WM_MINSIZE_SLACK < *minimum)
+    *minimum = 0;
+}
+
+bool wm_minsize_learn(WMMinSizeStore *store, const char *bundle_identifier,
+                      WMSize requested, WMSize accepted, WMSize limit) {
+  double width = capped(accepted.width, limit.width);
+  double height = capped(accepted.height, limit.height);
+  bool refused = width > requested.width + WM_MINSIZE_SLACK ||
+                 height > requested.height + WM_MINSIZE_SLACK;
+
+  // only a refusal is worth a slot
+  WMMinSizeSlot *slot =
+      refused ? wm_store_claim(&store->table, &store->image, bundle_identifier)
+              : find_slot(store, bundle_identifier);
+  if (slot == NULL)
+    return false;
+
+  WMMinSizeSlot before = *slot;
+  learn_dimension(&slot->width, &slot->pending_width, requested.width, width);
+  learn_dimension(&slot->height, &slot->pending_height, requested.height,
+                  height);
+  if (refused && slot->refusals < UINT32_MAX)
+    slot->refusals++;
+  if (memcmp(&before, slot, sizeof(before)) != 0)
+    store->dirty = true;
+  if (slot->width == before.width && slot->height == before.height)
+    return false;
+
+  store->updates++;
+  return true;
+}
+
+bool wm_minsize_tracked(const WMMinSizeStore *store,
+                        const char *bundle_identifier) {
+  return find_slot(store, bundle_identifier) != NULL;
+}
+
+WMSize wm_minsize_get(const WMMinSizeStore *store,
+                      const char *bundle_identifier) {
+  const WMMinSizeSlot *slot = find_slot(store, bundle_identifier);
+  if (slot == NULL)
+    return (WMSize){0, 0};
+  return (WMSize){slot->width, slot->height};
+}
+
+bool wm_minsize_load(WMMinSizeStore *store, const char *path) {
+  WMMinSizeImage image;
+  int used = wm_store_load(&TABLE_LAYOUT, &image, path);
+  if (used < 0)
+    return false;
+
+  uint32_t updates = store->updates;
+  wm_minsize_init(store);
+  store->image = image;
+  store->table.entry_count = used;
+  store->updates = updates + 1;
+  return true;
+}
+
+bool wm_minsize_save(WMMinSizeStore *store, const char *path) {
+  if (!wm_store_save(&store->table, &store->image, path))
+    return false;
+  store->dirty = false;
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef WM_MINSIZE_H
+#define WM_MINSIZE_H
+
+#include "wm_runtime.h"
+#include "wm_store.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WM_MINSIZE_MAGIC 0x5a534d57u // "WMSZ"
+#define WM_MINSIZE_VERSION 3
+#define WM_MINSIZE_SLOTS 128       // power of two
+#define WM_MINSIZE_SLACK 1         // points a size may be off before it counts
+
+// smallest size a bundle's windows accept, 0 = not learned
+typedef struct {
+  WMStoreKey key;          // bundle, empty slot if unused
+  uint16_t width;          // points
+  uint16_t height;         // points
+  uint16_t pending_width;  // refused once, minimum when confirmed, 0 = none
+  uint16_t pending_height; // points, as pending_width
+  uint32_t refusals;       // sizes it didn't take (eviction keeps the most)
+} WMMinSizeSlot;
+
+// whole on-disk file, read and written in one go
+typedef struct {
+  WMStoreHeader header;
+  WMMinSizeSlot slots[WM_MINSIZE_SLOTS];
+} WMMinSizeImage;
+
+// per bundle minimum window sizes, learned from the sizes apps end up with
+// after a resize. Fixed size, single threaded
+typedef struct WMMinSizeStore {
+  WMMinSizeImage image;
+  WMStoreTable table; // slots of image by bundle
+  bool dirty;         // changed since the last load/save
+  uint32_t updates;   // minimums changed (layouts made with them are stale)
+} WMMinSizeStore;
+
+// initialize with nothing learned
+void wm_minsize_init(WMMinSizeStore *store);
+
+// a bundle's window was asked for requested and ended up accepted, both no
+// larger than limit (the usable area of its display, 0 = no limit). A
+// dimension it kept larger twice in a row (within WM_MINSIZE_SLACK) is its
+// minimum, no more than limit; one it took below the minimum learned before
+// drops it (the app changed). Returns true if the minimum changed
+bool wm_minsize_learn(WMMinSizeStore *store, const char *bundle_identifier,
+                      WMSize requested, WMSize accepted, WMSize limit);
+
+// the bundle's windows refused a size before: their sizes are worth reading
+// back after a resize
+bool wm_minsize_tracked(const WMMinSizeStore *store,
+                        const char *bundle_identifier);
+
+// minimum size of a bundle's windows, 0 where not learned (store may be
+// NULL)
+WMSize wm_minsize_get(const WMMinSizeStore *store,
+                      const char *bundle_identifier);
+
+// read minimums saved by wm_minsize_save. Returns false (nothing learned)
+// if the file is missing, from another version or corrupt
+bool wm_minsize_load(WMMinSizeStore *store, const char *path);
+
+// write the minimums (to a temporary file renamed over path)
+bool wm_minsize_save(WMMinSizeStore *store, const char *path);
+
+#endif
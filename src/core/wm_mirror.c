@@ -0,0 +1,210 @@
+#include "wm_mirror.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MIRROR_WORDS (sizeof(WMMirrorState) / sizeof(uint32_t))
+
+_Static_assert(sizeof(WMMirrorState) % sizeof(uint32_t) == 0,
+               "WMMirrorState is copied as 32-bit words");
+_Static_assert(sizeof(pid_t) == sizeof(uint32_t), "pids are mirrored as words");
+
+// the shared image. Words are stored and loaded as relaxed atomics, the
+// sequence orders them: the writer makes it odd, stores, makes it even; a
+// reader keeps a copy only if the sequence was even and unchanged around it
+struct WMMirrorSegment {
+  _Atomic uint32_t magic; // WM_MIRROR_MAGIC while dwin runs, 0 once it quit
+  uint32_t version;       // WM_MIRROR_VERSION
+  _Atomic uint32_t sequence;
+  uint32_t reserved;
+  _Atomic uint32_t words[MIRROR_WORDS];
+};
+
+const char *wm_mirror_default_name(char *buffer, size_t size) {
+  const char *name = getenv("DWIN_MIRROR");
+  if (name != NULL && name[0] != '\0')
+    snprintf(buffer, size, "%s", name);
+  else
+    snprintf(buffer, size, "/dwin-%d", (int)getuid());
+  return buffer;
+}
+
+// build the image of state
+static void build_mirror(const WMState *state, WMMirrorState *out) {
+  memset(out, 0, sizeof(*out));
+  out->state_version = state->version;
+  out->active_buffer = state->active_buffer;
+  out->view_mask = wm_state_get_view(state);
+  out->is_passthrough_mode = state->is_passthrough_mode;
+  if (state->active_buffer >= 0 && state->active_buffer < WM_MAX_BUFFERS)
+    out->focused_pid = state->buffers[state->active_buffer].last_focused_pid;
+  for (int i = 0; i < WM_MAX_BUFFERS; i++)
+    out->app_count[i] =
+        wm_state_get_buffer_pids(state, i, out->apps[i], WM_MAX_APPS);
+}
+
+bool wm_mirror_open(WMMirrorWriter *writer, const char *name) {
+  memset(writer, 0, sizeof(*writer));
+  writer->fd = -1;
+  if (strlen(name) >= sizeof(writer->name))
+    return false;
+
+  // a segment left by a crash is replaced, its size can't be changed on
+  // macOS once set
+  shm_unlink(name);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0)
+    return false;
+  if (ftruncate(fd, sizeof(struct WMMirrorSegment)) != 0) {
+    close(fd);
+    shm_unlink(name);
+    return false;
+  }
+
+  void *map = mmap(NULL, sizeof(struct WMMirrorSegment),
+                   PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    shm_unlink(name);
+    return false;
+  }
+
+  // zero-filled: sequence 0, readers see an empty image until the first
+  // write
+  struct WMMirrorSegment *segment = map;
+  segment->version = WM_MIRROR_VERSION;
+  atomic_store_explicit(&segment->magic, WM_MIRROR_MAGIC,
+                        memory_order_release);
+
+  writer->fd = fd;
+  writer->segment = segment;
+  writer->needs_write = true;
+  snprintf(writer->name, sizeof(writer->name), "%s", name);
+  return true;
+}
+
+void wm_mirror_close(WMMirrorWriter *writer) {
+  if (writer->segment) {
+    // readers still mapping it learn dwin quit
+    atomic_store_explicit(&writer->segment->magic, 0, memory_order_release);
+    munmap(writer->segment, sizeof(struct WMMirrorSegment));
+    shm_unlink(writer->name);
+  }
+  if (writer->fd >= 0)
+    close(writer->fd);
+
+  writer->segment = NULL;
+  writer->fd = -1;
+}
+
+void wm_mirror_store(WMMirrorWriter *writer, const WMMirrorState *mirror) {
+  struct WMMirrorSegment *segment = writer->segment;
+  if (segment == NULL)
+    return;
+
+  uint32_t words[MIRROR_WORDS];
+  memcpy(words, mirror, sizeof(words));
+
+  // odd before any word changes, even once they all did
+  uint32_t sequence =
+      atomic_load_explicit(&segment->sequence, memory_order_relaxed);
+  atomic_store_explicit(&segment->sequence, sequence + 1,
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  for (size_t i = 0; i < MIRROR_WORDS; i++)
+    atomic_store_explicit(&segment->words[i], words[i], memory_order_relaxed);
+  atomic_store_explicit(&segment->sequence, sequence + 2,
+                        memory_order_release);
+}
+
+bool wm_mirror_write(WMMirrorWriter *writer, const WMState *state) {
+  if (writer->segment == NULL)
+    return false;
+
+  // nothing changed since last write
+  if (!writer->needs_write && writer->written_version == state->version)
+    return true;
+
+  WMMirrorState mirror;
+  build_mirror(state, &mirror);
+  wm_mirror_store(writer, &mirror);
+  writer->written_version = state->version;
+  writer->needs_write = false;
+  return true;
+}
+
+// reader
+
+bool wm_mirror_attach(WMMirrorReader *reader, const char *name) {
+  reader->segment = NULL;
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+
+  // a segment of another layout (or still being sized) is not ours to read
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 &&
+      st.st_size >= (off_t)sizeof(struct WMMirrorSegment))
+    map = mmap(NULL, sizeof(struct WMMirrorSegment), PROT_READ, MAP_SHARED,
+               fd, 0);
+  close(fd); // the mapping stays
+  if (map == MAP_FAILED)
+    return false;
+
+  const struct WMMirrorSegment *segment = map;
+  if (atomic_load_explicit(&segment->magic, memory_order_acquire) !=
+          WM_MIRROR_MAGIC ||
+      segment->version != WM_MIRROR_VERSION) {
+    munmap(map, sizeof(struct WMMirrorSegment));
+    return false;
+  }
+  reader->segment = segment;
+  return true;
+}
+
+void wm_mirror_detach(WMMirrorReader *reader) {
+  if (reader->segment)
+    munmap((void *)reader->segment, sizeof(struct WMMirrorSegment));
+  reader->segment = NULL;
+}
+
+bool wm_mirror_read(const WMMirrorReader *reader, WMMirrorState *out) {
+  const struct WMMirrorSegment *segment = reader->segment;
+  if (segment == NULL)
+    return false;
+
+  // the segment is mapped read-only: atomic loads only, no read-modify-write
+  _Atomic uint32_t *sequence = (_Atomic uint32_t *)&segment->sequence;
+  _Atomic uint32_t *magic = (_Atomic uint32_t *)&segment->magic;
+  _Atomic uint32_t *shared = (_Atomic uint32_t *)segment->words;
+  uint32_t words[MIRROR_WORDS];
+
+  for (int attempt = 0; attempt < WM_MIRROR_READ_ATTEMPTS; attempt++) {
+    if (atomic_load_explicit(magic, memory_order_acquire) != WM_MIRROR_MAGIC)
+      return false;
+
+    uint32_t begin = atomic_load_explicit(sequence, memory_order_acquire);
+    if (begin & 1u)
+      continue; // write in progress
+
+    for (size_t i = 0; i < MIRROR_WORDS; i++)
+      words[i] = atomic_load_explicit(&shared[i], memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(sequence, memory_order_relaxed) != begin)
+      continue; // torn, a write went by
+
+    memcpy(out, words, sizeof(words));
+    for (int i = 0; i < WM_MAX_BUFFERS; i++) {
+      if (out->app_count[i] < 0 || out->app_count[i] > WM_MAX_APPS)
+        return false;
+    }
+    return true;
+  }
+  return false;
+}
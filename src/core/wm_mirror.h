@@ -0,0 +1,74 @@
+#ifndef WM_MIRROR_H
+#define WM_MIRROR_H
+
+#include "wm_runtime.h"
+#include "wm_state.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WM_MIRROR_MAGIC 0x524d5744u // "DWMR"
+#define WM_MIRROR_VERSION 1
+#define WM_MIRROR_NAME_SIZE 32      // shm names, macOS takes 31 characters
+#define WM_MIRROR_READ_ATTEMPTS 4096 // reads racing the writer before giving up
+
+// the hot part of WMState as other processes see it. Only 32-bit fields, it
+// is copied word by word
+typedef struct {
+  uint32_t state_version;                  // WMState.version mirrored
+  int32_t active_buffer;                   // primary buffer of the view
+  uint32_t view_mask;                      // buffers shown
+  uint32_t is_passthrough_mode;            // hotkeys disabled
+  pid_t focused_pid;                       // focused app of the view, 0 = none
+  int32_t app_count[WM_MAX_BUFFERS];       // apps in each buffer
+  pid_t apps[WM_MAX_BUFFERS][WM_MAX_APPS]; // their pids, registry order
+} WMMirrorState;
+
+struct WMMirrorSegment;
+
+// dwin's side: a POSIX shared-memory segment rewritten on every state change
+// under a seqlock (odd sequence = write in progress), so readers never take
+// a lock nor make a syscall
+typedef struct {
+  int fd;                          // -1 = closed
+  struct WMMirrorSegment *segment; // mapped segment
+  uint32_t written_version;        // WMState.version last written
+  bool needs_write;                // nothing written yet
+  char name[WM_MIRROR_NAME_SIZE];
+} WMMirrorWriter;
+
+// another process' side, read-only mapping
+typedef struct {
+  const struct WMMirrorSegment *segment; // NULL = detached
+} WMMirrorReader;
+
+// default segment name: $DWIN_MIRROR, else /dwin-<uid>
+const char *wm_mirror_default_name(char *buffer, size_t size);
+
+// create the segment (replacing a stale one) and map it. Returns false if
+// the name is too long or shared memory is unavailable
+bool wm_mirror_open(WMMirrorWriter *writer, const char *name);
+
+// mark the segment closed for its readers, unmap and remove it
+void wm_mirror_close(WMMirrorWriter *writer);
+
+// mirror state if it changed since the last write. Returns false if the
+// writer is not open
+bool wm_mirror_write(WMMirrorWriter *writer, const WMState *state);
+
+// store a mirror image as is (what wm_mirror_write stores)
+void wm_mirror_store(WMMirrorWriter *writer, const WMMirrorState *mirror);
+
+// map the segment of a running dwin, false if there is none
+bool wm_mirror_attach(WMMirrorReader *reader, const char *name);
+
+// unmap the segment
+void wm_mirror_detach(WMMirrorReader *reader);
+
+// copy a consistent image, retrying while the writer is inside. Returns
+// false if dwin quit (attach again once it's back) or kept writing for
+// WM_MIRROR_READ_ATTEMPTS reads (it died mid-write)
+bool wm_mirror_read(const WMMirrorReader *reader, WMMirrorState *out);
+
+#endif
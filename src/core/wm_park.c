@@ -0,0 +1,195 @@
+#include "wm_park.h"
+#include "wm_display.h"
+#include "wm_latency.h"
+#include "wm_state.h"
+#include <string.h>
+
+#define NS_PER_MS 1000000ull
+
+void wm_park_init(WMParkStore *store) { memset(store, 0, sizeof(*store)); }
+
+WMVisibilityMode wm_park_mode(const WMConfig *config,
+                              const WMLatencyModel *latency,
+                              const char *bundle_identifier) {
+  WMVisibilityMode mode = wm_config_visibility(config, bundle_identifier);
+  if (mode != WM_VISIBILITY_AUTO)
+    return mode;
+
+  if (latency == NULL)
+    return WM_VISIBILITY_HIDE;
+  uint64_t slow_ns = WM_PARK_SLOW_MS * NS_PER_MS;
+  if (wm_latency_estimate(latency, bundle_identifier, WM_OP_HIDE) > slow_ns ||
+      wm_latency_estimate(latency, bundle_identifier, WM_OP_UNHIDE) > slow_ns)
+    return WM_VISIBILITY_PARK;
+  return WM_VISIBILITY_HIDE;
+}
+
+// display a window is on: the one under its center, else the focused one
+static int display_of_frame(const WMState *state, WMRect frame) {
+  int display = wm_display_at(state, frame.x + frame.width / 2,
+                              frame.y + frame.height / 2);
+  return display >= 0 ? display : state->focused_display;
+}
+
+static double overlap(WMRect a, WMRect b) {
+  double left = a.x > b.x ? a.x : b.x;
+  double top = a.y > b.y ? a.y : b.y;
+  double right = a.x + a.width < b.x + b.width ? a.x + a.width : b.x + b.width;
+  double bottom =
+      a.y + a.height < b.y + b.height ? a.y + a.height : b.y + b.height;
+  if (right <= left || bottom <= top)
+    return 0;
+  return (right - left) * (bottom - top);
+}
+
+WMRect wm_park_position(const WMState *state, WMRect frame) {
+  int display = display_of_frame(state, frame);
+  WMRect area = state->displays[display].frame;
+  double sliver = WM_PARK_SLIVER;
+
+  // bottom corners first, the menu bar is at the top
+  double right = area.x + area.width - sliver;
+  double left = area.x - frame.width + sliver;
+  double below = area.y + area.height - sliver;
+  double above = area.y - frame.height + sliver;
+  WMRect corners[] = {
+      {right, below, frame.width, frame.height},
+      {left, below, frame.width, frame.height},
+      {right, above, frame.width, frame.height},
+      {left, above, frame.width, frame.height},
+  };
+
+  // the corner covering the least of the other displays, none if possible
+  WMRect best = corners[0];
+  double best_overlap = -1;
+  for (size_t i = 0; i < sizeof(corners) / sizeof(corners[0]); i++) {
+    double covered = 0;
+    for (int j = 0; j < state->display_count; j++) {
+      if (j != display)
+        covered += overlap(corners[i], state->displays[j].frame);
+    }
+    if (best_overlap < 0 || covered < best_overlap) {
+      best = corners[i];
+      best_overlap = covered;
+    }
+    if (covered == 0)
+      break;
+  }
+  return best;
+}
+
+static WMParkedWindow *find(const WMParkStore *store, pid_t pid) {
+  for (int i = 0; i < store->count; i++) {
+    if (store->windows[i].pid == pid)
+      return (WMParkedWindow *)&store->windows[i];
+  }
+  return NULL;
+}
+
+bool wm_park_save(WMParkStore *store, const WMState *state, pid_t pid,
+                  WMRect frame, WMRect *parked) {
+  // parked again (a switch away before it came back): it is off screen, the
+  // frame to return to is the one from before
+  WMParkedWindow *window = find(store, pid);
+  if (window != NULL) {
+    *parked = window->parked;
+    return true;
+  }
+  if (pid <= 0 || store->count >= WM_MAX_APPS)
+    return false;
+
+  int display = display_of_frame(state, frame);
+  const WMApp *app = wm_state_find_app(state, pid);
+  window = &store->windows[store->count++];
+  window->pid = pid;
+  window->bundle_hash =
+      app != NULL ? wm_config_hash_bundle(app->bundle_identifier) : 0;
+  window->display_id = state->displays[display].id;
+  window->display_frame = state->displays[display].frame;
+  window->frame = frame;
+  window->parked = wm_park_position(state, frame);
+  *parked = window->parked;
+  store->dirty = true;
+  return true;
+}
+
+bool wm_park_is_parked(const WMParkStore *store, pid_t pid) {
+  return find(store, pid) != NULL;
+}
+
+bool wm_park_restore(WMParkStore *store, const WMState *state, pid_t pid,
+                     WMRect *frame) {
+  WMParkedWindow *window = find(store, pid);
+  if (window == NULL)
+    return false;
+
+  // its display may have changed while it was away
+  const WMDisplay *display = &state->displays[state->focused_display];
+  for (int i = 0; i < state->display_count; i++) {
+    if (state->displays[i].id == window->display_id)
+      display = &state->displays[i];
+  }
+  if (memcmp(&display->frame, &window->display_frame, sizeof(WMRect)) == 0)
+    *frame = window->frame;
+  else
+    *frame = wm_display_rescale(window->frame, window->display_frame,
+                                display->frame);
+
+  *window = store->windows[--store->count];
+  store->dirty = true;
+  return true;
+}
+
+void wm_park_forget(WMParkStore *store, pid_t pid) {
+  WMParkedWindow *window = find(store, pid);
+  if (window == NULL)
+    return;
+  *window = store->windows[--store->count];
+  store->dirty = true;
+}
+
+static uint32_t windows_checksum(const WMParkImage *image) {
+  return wm_store_hash(image->windows, sizeof(image->windows));
+}
+
+bool wm_park_write(WMParkStore *store, const char *path) {
+  WMParkImage image;
+  memset(&image, 0, sizeof(image));
+  image.header.magic = WM_PARK_MAGIC;
+  image.header.version = WM_PARK_VERSION;
+  image.header.slot_count = WM_MAX_APPS;
+  memcpy(image.windows, store->windows,
+         (size_t)store->count * sizeof(WMParkedWindow));
+  image.header.checksum = windows_checksum(&image);
+
+  if (!wm_store_write_file(path, &image, sizeof(image)))
+    return false;
+  store->dirty = false;
+  return true;
+}
+
+int wm_park_read(WMParkStore *store, const WMState *state, const char *path) {
+  WMParkImage image;
+  if (!wm_store_read_file(path, &image, sizeof(image)) ||
+      image.header.magic != WM_PARK_MAGIC ||
+      image.header.version != WM_PARK_VERSION ||
+      image.header.slot_count != WM_MAX_APPS ||
+      image.header.checksum != windows_checksum(&image))
+    return -1;
+
+  int added = 0;
+  for (int i = 0; i < WM_MAX_APPS; i++) {
+    const WMParkedWindow *window = &image.windows[i];
+    const WMApp *app =
+        window->pid > 0 ? wm_state_find_app(state, window->pid) : NULL;
+    if (app == NULL || find(store, window->pid) != NULL ||
+        store->count >= WM_MAX_APPS ||
+        window->bundle_hash != wm_config_hash_bundle(app->bundle_identifier))
+      continue;
+    store->windows[store->count++] = *window;
+    added++;
+  }
+  if (added > 0)
+    store->dirty = true;
+  return added;
+}
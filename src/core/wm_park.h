@@ -0,0 +1,89 @@
+#ifndef WM_PARK_H
+#define WM_PARK_H
+
+#include "wm_config.h"
+#include "wm_runtime.h"
+#include "wm_store.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WM_PARK_SLIVER 1    // points of a parked window left on its display
+#define WM_PARK_SLOW_MS 150 // auto parks apps hiding or unhiding slower
+#define WM_PARK_MAGIC 0x4b505744u // "DWPK"
+#define WM_PARK_VERSION 1
+
+struct WMLatencyModel;
+struct WMState;
+
+// a window moved off screen, and where it was
+typedef struct {
+  pid_t pid;            // 0 = free
+  uint32_t bundle_hash; // wm_config_hash_bundle of its app, 0 = unknown
+  uint32_t display_id;  // display it was on
+  WMRect display_frame; // that display's frame then
+  WMRect frame;         // its frame before parking
+  WMRect parked;        // where it went
+} WMParkedWindow;
+
+// windows of hidden buffers parked outside the screens instead of hidden
+// (no app-side hide, unhide or activation), with the frames they come back
+// to. Single threaded, fixed size
+typedef struct {
+  WMParkedWindow windows[WM_MAX_APPS];
+  int count;
+  bool dirty; // changed since the last write
+} WMParkStore;
+
+// whole on-disk file, read and written in one go (unused windows zeroed)
+typedef struct {
+  WMStoreHeader header;
+  WMParkedWindow windows[WM_MAX_APPS];
+} WMParkImage;
+
+// initialize with nothing parked
+void wm_park_init(WMParkStore *store);
+
+// whether an app of a hidden buffer is parked or hidden: its own or the
+// global visibility mode; auto parks it once hiding or unhiding it was
+// measured slower than WM_PARK_SLOW_MS (latency may be NULL)
+WMVisibilityMode wm_park_mode(const WMConfig *config,
+                              const struct WMLatencyModel *latency,
+                              const char *bundle_identifier);
+
+// where a window at frame goes: past a corner of the display it is on, a
+// WM_PARK_SLIVER square left on it (macOS keeps part of a window on
+// screen), the corner chosen so it doesn't land on another display. The
+// window keeps its size
+WMRect wm_park_position(const struct WMState *state, WMRect frame);
+
+// park pid's window: remember frame (the display under its center) and
+// return where it goes. Parking a parked window keeps its first frame.
+// Returns false if the store is full
+bool wm_park_save(WMParkStore *store, const struct WMState *state, pid_t pid,
+                  WMRect frame, WMRect *parked);
+
+// pid's window is parked
+bool wm_park_is_parked(const WMParkStore *store, pid_t pid);
+
+// take pid's window back: the frame it had, moved with its display if that
+// was resized or rearranged, onto the focused display if it went away.
+// Returns false if it isn't parked
+bool wm_park_restore(WMParkStore *store, const struct WMState *state,
+                     pid_t pid, WMRect *frame);
+
+// drop pid (app quit)
+void wm_park_forget(WMParkStore *store, pid_t pid);
+
+// write the parked windows to path (a temporary file renamed over it), so
+// a dwin that dies without putting them back can on its next start
+bool wm_park_write(WMParkStore *store, const char *path);
+
+// add the windows a previous run left parked at path, those of apps still
+// running in state as the same pid and bundle (the others went away with
+// their windows). Returns windows added, -1 if the file is missing, from
+// another version or corrupt
+int wm_park_read(WMParkStore *store, const struct WMState *state,
+                 const char *path);
+
+#endif
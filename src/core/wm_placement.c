@@ -0,0 +1,218 @@
+#include "wm_placement.h"
+#include "wm_config.h"
+#include "wm_store.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SLOT_MASK (WM_PLACEMENT_SLOTS - 1)
+
+_Static_assert((WM_PLACEMENT_SLOTS & SLOT_MASK) == 0,
+               "WM_PLACEMENT_SLOTS must be a power of two");
+
+// checksum of a slot, last_used is left out so lookups don't rewrite it
+// (never 0, which marks an empty slot)
+static uint32_t slot_checksum(const WMPlacementSlot *slot) {
+  WMPlacementSlot copy = *slot;
+  copy.checksum = 0;
+  copy.last_used = 0;
+  uint32_t hash = wm_store_hash(&copy, sizeof(copy));
+  return hash == 0 ? 1 : hash;
+}
+
+// distance of slot index from the home slot of hash
+static uint32_t probe_distance(uint32_t hash, int index) {
+  return ((uint32_t)index - hash) & SLOT_MASK;
+}
+
+static bool slot_matches(const WMPlacementSlot *slot, const char *bundle,
+                         uint32_t hash) {
+  return slot->checksum != 0 && slot->bundle_hash == hash &&
+         strncmp(slot->bundle_identifier, bundle,
+                 sizeof(slot->bundle_identifier)) == 0;
+}
+
+// zero the whole table and write a fresh header
+static void reset_image(WMPlacementImage *image) {
+  memset(image, 0, sizeof(*image));
+  image->header.magic = WM_PLACEMENT_MAGIC;
+  image->header.version = WM_PLACEMENT_VERSION;
+  image->header.slot_count = WM_PLACEMENT_SLOTS;
+}
+
+// drop slots that fail their checksum, are unterminated or sit outside their
+// probe window, returns slots dropped
+static int recover_slots(WMPlacementStore *store) {
+  int dropped = 0;
+  store->entry_count = 0;
+
+  for (int i = 0; i < WM_PLACEMENT_SLOTS; i++) {
+    WMPlacementSlot *slot = &store->image->slots[i];
+    const char *key = slot->bundle_identifier;
+
+    if (slot->checksum == 0) {
+      // empty slots must be all zero, clear leftovers of a torn write
+      if (slot->bundle_hash != 0 || slot->buffer_mask != 0 || key[0] != '\0') {
+        memset(slot, 0, sizeof(*slot));
+        dropped++;
+      }
+      continue;
+    }
+
+    if (memchr(key, '\0', sizeof(slot->bundle_identifier)) == NULL ||
+        slot->checksum != slot_checksum(slot) ||
+        slot->bundle_hash != wm_config_hash_bundle(key) ||
+        probe_distance(slot->bundle_hash, i) >= WM_PLACEMENT_MAX_PROBE) {
+      memset(slot, 0, sizeof(*slot));
+      dropped++;
+      continue;
+    }
+
+    store->entry_count++;
+  }
+
+  return dropped;
+}
+
+bool wm_placement_open(WMPlacementStore *store, const char *path) {
+  memset(store, 0, sizeof(*store));
+  store->fd = -1;
+
+  int fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd < 0)
+    return false;
+
+  // a file of the wrong size is from another version (or truncated)
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  bool resized = st.st_size != (off_t)sizeof(WMPlacementImage);
+  if (resized && ftruncate(fd, sizeof(WMPlacementImage)) != 0) {
+    close(fd);
+    return false;
+  }
+
+  void *map = mmap(NULL, sizeof(WMPlacementImage), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  store->fd = fd;
+  store->image = map;
+
+  const WMPlacementHeader *header = &store->image->header;
+  if (resized || header->magic != WM_PLACEMENT_MAGIC ||
+      header->version != WM_PLACEMENT_VERSION ||
+      header->slot_count != WM_PLACEMENT_SLOTS) {
+    reset_image(store->image);
+    return true;
+  }
+
+  store->recovered_slots = recover_slots(store);
+  return true;
+}
+
+void wm_placement_close(WMPlacementStore *store) {
+  if (store->image)
+    munmap(store->image, sizeof(WMPlacementImage));
+  if (store->fd >= 0)
+    close(store->fd);
+
+  store->image = NULL;
+  store->fd = -1;
+}
+
+bool wm_placement_lookup(WMPlacementStore *store, const char *bundle_identifier,
+                         uint32_t bundle_hash, WMBufferMask *out_mask) {
+  if (store == NULL || store->image == NULL || bundle_identifier == NULL)
+    return false;
+
+  // the whole window is scanned, forgotten entries leave holes in it
+  WMPlacementImage *image = store->image;
+  for (int p = 0; p < WM_PLACEMENT_MAX_PROBE; p++) {
+    WMPlacementSlot *slot = &image->slots[(bundle_hash + p) & SLOT_MASK];
+    if (!slot_matches(slot, bundle_identifier, bundle_hash))
+      continue;
+
+    slot->last_used = ++image->header.tick;
+    if (out_mask)
+      *out_mask = slot->buffer_mask;
+    return true;
+  }
+
+  return false;
+}
+
+bool wm_placement_record(WMPlacementStore *store, const char *bundle_identifier,
+                         WMBufferMask buffer_mask) {
+  // keys that don't fit a slot would be stored truncated, under another hash
+  if (store == NULL || store->image == NULL || bundle_identifier == NULL ||
+      bundle_identifier[0] == '\0' ||
+      strlen(bundle_identifier) >= WM_PLACEMENT_KEY_SIZE)
+    return false;
+
+  WMPlacementImage *image = store->image;
+  uint32_t hash = wm_config_hash_bundle(bundle_identifier);
+  buffer_mask &= WM_BUFFER_MASK_ALL;
+
+  // one pass over the window: existing entry, first hole and LRU victim
+  WMPlacementSlot *found = NULL;
+  WMPlacementSlot *hole = NULL;
+  WMPlacementSlot *oldest = NULL;
+  for (int p = 0; p < WM_PLACEMENT_MAX_PROBE; p++) {
+    WMPlacementSlot *slot = &image->slots[(hash + p) & SLOT_MASK];
+    if (slot_matches(slot, bundle_identifier, hash)) {
+      found = slot;
+      break;
+    }
+    if (slot->checksum == 0) {
+      if (hole == NULL)
+        hole = slot;
+    } else if (oldest == NULL || slot->last_used < oldest->last_used) {
+      oldest = slot;
+    }
+  }
+
+  // forget
+  if (buffer_mask == 0) {
+    if (found) {
+      memset(found, 0, sizeof(*found));
+      store->entry_count--;
+    }
+    return true;
+  }
+
+  // same placement, nothing to write
+  if (found && found->buffer_mask == buffer_mask) {
+    found->last_used = ++image->header.tick;
+    return true;
+  }
+
+  WMPlacementSlot *slot = found;
+  if (slot == NULL) {
+    if (hole) {
+      slot = hole;
+      store->entry_count++;
+    } else {
+      slot = oldest;
+      store->evictions++;
+    }
+
+    // invalidate first so a torn key update is dropped on the next open
+    slot->checksum = 0;
+    memset(slot->bundle_identifier, 0, sizeof(slot->bundle_identifier));
+    strcpy(slot->bundle_identifier, bundle_identifier);
+    slot->bundle_hash = hash;
+  }
+
+  slot->buffer_mask = buffer_mask;
+  slot->last_used = ++image->header.tick;
+  slot->checksum = slot_checksum(slot);
+  return true;
+}
@@ -0,0 +1,64 @@
+#ifndef WM_PLACEMENT_H
+#define WM_PLACEMENT_H
+
+#include "wm_runtime.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WM_PLACEMENT_MAGIC 0x4c504d57u // "WMPL"
+#define WM_PLACEMENT_VERSION 1
+#define WM_PLACEMENT_SLOTS 256    // power of two
+#define WM_PLACEMENT_MAX_PROBE 16 // slots a bundle may live in past its home
+#define WM_PLACEMENT_KEY_SIZE 128 // bundle identifier bytes, with terminator
+
+// one learned placement, checksum written last so a torn update is detected
+typedef struct {
+  uint32_t bundle_hash;        // wm_config_hash_bundle(bundle_identifier)
+  uint32_t checksum;           // hash of the slot except last_used, 0 = empty
+  uint32_t last_used;          // store tick of the last record/lookup
+  WMBufferMask buffer_mask;    // buffers the app was last placed in
+  uint8_t reserved[3];
+  char bundle_identifier[WM_PLACEMENT_KEY_SIZE]; // key, one copy per bundle
+} WMPlacementSlot;
+
+typedef struct {
+  uint32_t magic;      // WM_PLACEMENT_MAGIC
+  uint16_t version;    // WM_PLACEMENT_VERSION
+  uint16_t slot_count; // WM_PLACEMENT_SLOTS
+  uint32_t tick;       // LRU clock
+  uint32_t reserved;
+} WMPlacementHeader;
+
+// whole on-disk table, fixed size so it is mapped once and updated in place
+typedef struct {
+  WMPlacementHeader header;
+  WMPlacementSlot slots[WM_PLACEMENT_SLOTS];
+} WMPlacementImage;
+
+// memory-mapped placement table
+typedef struct WMPlacementStore {
+  int fd;                  // -1 = closed
+  WMPlacementImage *image; // mapped file
+  int entry_count;         // used slots
+  int recovered_slots;     // corrupt slots dropped by the last open
+  int evictions;           // entries replaced to make room since open
+} WMPlacementStore;
+
+// open (creating if needed) and map the placement file. A file with a bad
+// header is reset, slots failing their checksum are dropped
+bool wm_placement_open(WMPlacementStore *store, const char *path);
+
+// unmap and close the placement file
+void wm_placement_close(WMPlacementStore *store);
+
+// look up where a bundle was last placed, bundle_hash is
+// wm_config_hash_bundle(bundle_identifier). Returns false if unknown
+bool wm_placement_lookup(WMPlacementStore *store, const char *bundle_identifier,
+                         uint32_t bundle_hash, WMBufferMask *out_mask);
+
+// remember the buffers a bundle was placed in (mask 0 forgets it). When the
+// probe window is full the least recently used entry in it is evicted
+bool wm_placement_record(WMPlacementStore *store, const char *bundle_identifier,
+                         WMBufferMask buffer_mask);
+
+#endif
@@ -0,0 +1,83 @@
+#include "wm_plans.h"
+#include "wm_display.h"
+#include "wm_latency.h"
+#include "wm_state.h"
+#include <string.h>
+
+static uint32_t latency_orders(const WMLatencyModel *latency) {
+  return latency != NULL ? latency->orders : 0;
+}
+
+void wm_plans_init(WMPlanCache *cache) { memset(cache, 0, sizeof(*cache)); }
+
+bool wm_plans_build(const WMState *state, const WMLatencyModel *latency,
+                    const struct WMConfig *config, int buffer,
+                    WMSwitchPlan *out) {
+  if (buffer < 0 || buffer >= WM_MAX_BUFFERS)
+    return false;
+
+  int focused = state->focused_display;
+  int display = wm_display_of_buffer(state, buffer);
+  if (display >= 0 && display != focused)
+    return false;
+
+  // the other displays keep their views: only the focused one's leaves
+  WMBufferMask view = WM_BUFFER_BIT(buffer);
+  WMBufferMask shown = wm_state_get_shown(state);
+  WMBufferMask after = (shown & (WMBufferMask)~wm_state_get_view(state)) | view;
+
+  out->primary_buffer = buffer;
+  out->view = view;
+  out->shown_view = shown;
+  wm_switch_plan(latency, state, shown, after, out);
+  out->frame_count = (int16_t)wm_display_tile_view(
+      state, focused, view, config, out->frames, WM_MAX_APPS);
+  return true;
+}
+
+int wm_plans_refresh(WMPlanCache *cache, const WMState *state,
+                     const WMLatencyModel *latency,
+                     const struct WMConfig *config) {
+  // frames tiled with another config are all stale
+  if (config != cache->config) {
+    for (int i = 0; i < WM_MAX_BUFFERS; i++)
+      cache->buffers[i].built = false;
+    cache->config = config;
+  }
+
+  uint32_t orders = latency_orders(latency);
+  int made = 0;
+  for (int i = 0; i < WM_MAX_BUFFERS; i++) {
+    WMBufferPlan *entry = &cache->buffers[i];
+    if (entry->built && entry->version == state->version &&
+        entry->latency_orders == orders)
+      continue;
+
+    entry->ready = wm_plans_build(state, latency, config, i, &entry->plan);
+    entry->version = state->version;
+    entry->latency_orders = orders;
+    entry->built = true;
+    if (entry->ready)
+      made++;
+  }
+  cache->builds += (uint32_t)made;
+  return made;
+}
+
+const WMSwitchPlan *wm_plans_lookup(WMPlanCache *cache, const WMState *state,
+                                    const WMLatencyModel *latency,
+                                    int primary_buffer, WMBufferMask view) {
+  if (primary_buffer < 0 || primary_buffer >= WM_MAX_BUFFERS)
+    return NULL;
+
+  const WMBufferPlan *entry = &cache->buffers[primary_buffer];
+  if (view != WM_BUFFER_BIT(primary_buffer) || !entry->built ||
+      !entry->ready || entry->version != state->version ||
+      entry->latency_orders != latency_orders(latency)) {
+    cache->misses++;
+    return NULL;
+  }
+
+  cache->hits++;
+  return &entry->plan;
+}
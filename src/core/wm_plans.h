@@ -0,0 +1,59 @@
+#ifndef WM_PLANS_H
+#define WM_PLANS_H
+
+#include "wm_runtime.h"
+#include "wm_switch.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+struct WMConfig;
+struct WMLatencyModel;
+struct WMState;
+
+// switch plan of one buffer, made before its hotkey is pressed
+typedef struct {
+  WMSwitchPlan plan;        // what wm_switch_begin would compute now
+  uint32_t version;         // state version it was made for
+  uint32_t latency_orders;  // latency order it was made by
+  bool built;               // version and latency_orders are set
+  bool ready;               // plan holds (no plan for a swap)
+} WMBufferPlan;
+
+// ready plans of every buffer. A plan holds while the state version (bumped
+// by membership, floating, focus, view and display changes) and the order
+// latency estimates put apps in stay what it was made for. Single threaded,
+// fixed size
+typedef struct WMPlanCache {
+  WMBufferPlan buffers[WM_MAX_BUFFERS];
+  const struct WMConfig *config; // frames were tiled with it
+  uint32_t builds;               // plans made
+  uint32_t hits;                 // switches that ran a ready plan
+  uint32_t misses;               // switches that made their own
+} WMPlanCache;
+
+// initialize with no plan ready
+void wm_plans_init(WMPlanCache *cache);
+
+// make the plan of switching state to buffer alone on the focused display:
+// apps to show and hide in order, focus target and frames. Returns false
+// if it can't be made ahead (the buffer is on another display, the switch
+// swaps them)
+bool wm_plans_build(const struct WMState *state,
+                    const struct WMLatencyModel *latency,
+                    const struct WMConfig *config, int buffer,
+                    WMSwitchPlan *out);
+
+// remake the plans the state, the latency order or the config changed
+// under (call when idle). Returns plans made
+int wm_plans_refresh(WMPlanCache *cache, const struct WMState *state,
+                     const struct WMLatencyModel *latency,
+                     const struct WMConfig *config);
+
+// the plan of a switch to view if one is ready for the state as it is now,
+// else NULL (counted as a hit or a miss)
+const WMSwitchPlan *wm_plans_lookup(WMPlanCache *cache,
+                                    const struct WMState *state,
+                                    const struct WMLatencyModel *latency,
+                                    int primary_buffer, WMBufferMask view);
+
+#endif
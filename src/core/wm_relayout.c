@@ -0,0 +1,49 @@
+#include "wm_relayout.h"
+#include <string.h>
+
+#define NS_PER_MS 1000000ull
+
+void wm_relayout_init(WMRelayout *relayout) {
+  memset(relayout, 0, sizeof(*relayout));
+}
+
+uint64_t wm_relayout_mark(WMRelayout *relayout, WMBufferMask buffers,
+                          WMBufferMask view, uint64_t now_ns) {
+  relayout->requests++;
+  relayout->dirty |= buffers;
+
+  if ((buffers & view) == 0) {
+    relayout->deferred++;
+    return relayout->due_ns;
+  }
+
+  // the first visible change opens the window
+  if (relayout->due_ns == 0)
+    relayout->due_ns = now_ns + WM_RELAYOUT_FRAME_MS * NS_PER_MS;
+  return relayout->due_ns;
+}
+
+uint64_t wm_relayout_next_deadline(const WMRelayout *relayout) {
+  return relayout->due_ns;
+}
+
+bool wm_relayout_take(WMRelayout *relayout, WMBufferMask view,
+                      uint64_t now_ns) {
+  if (relayout->due_ns == 0 || now_ns < relayout->due_ns)
+    return false;
+
+  relayout->due_ns = 0;
+  if ((relayout->dirty & view) == 0)
+    return false; // switched away meanwhile, wait until shown again
+
+  relayout->dirty &= (WMBufferMask)~view;
+  relayout->passes++;
+  return true;
+}
+
+void wm_relayout_done(WMRelayout *relayout, WMBufferMask view) {
+  // whatever is still dirty is hidden, it waits for its switch
+  relayout->dirty &= (WMBufferMask)~view;
+  relayout->due_ns = 0;
+  relayout->passes++;
+}
@@ -0,0 +1,43 @@
+#ifndef WM_RELAYOUT_H
+#define WM_RELAYOUT_H
+
+#include "wm_runtime.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WM_RELAYOUT_FRAME_MS 16 // changes within a frame share one pass
+
+// coalesces tiling work: buffers are marked dirty as apps come and go and
+// the view gets one layout pass per frame window. Hidden buffers stay dirty
+// until they are shown (the switch lays them out then)
+typedef struct {
+  WMBufferMask dirty; // buffers whose tiling is stale
+  uint64_t due_ns;    // pass for the view scheduled at, 0 = none
+  uint32_t requests;  // mark calls
+  uint32_t passes;    // layout passes run (scheduled or immediate)
+  uint32_t deferred;  // requests only touching hidden buffers
+} WMRelayout;
+
+// initialize with nothing dirty
+void wm_relayout_init(WMRelayout *relayout);
+
+// buffers changed at now_ns. If any is in view a pass is due one frame after
+// the first change of the window (later changes join it, they don't push it
+// back). Returns the pending deadline, 0 = nothing to run for the view
+uint64_t wm_relayout_mark(WMRelayout *relayout, WMBufferMask buffers,
+                          WMBufferMask view, uint64_t now_ns);
+
+// when the pending pass is due, 0 = none
+uint64_t wm_relayout_next_deadline(const WMRelayout *relayout);
+
+// at or after the deadline: returns true if the view needs its layout pass
+// now (its buffers are clean afterwards), false if it is not due or the
+// dirty buffers left the view
+bool wm_relayout_take(WMRelayout *relayout, WMBufferMask view,
+                      uint64_t now_ns);
+
+// the view was just laid out outside the scheduler (buffer switch, hotkey),
+// its pending work is done
+void wm_relayout_done(WMRelayout *relayout, WMBufferMask view);
+
+#endif
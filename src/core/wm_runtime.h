@@ -9,14 +9,39 @@
 #define WM_MAX_BUFFERS 5    // only 5 buffers for now
 #define WM_MAX_APPS 128     // max apps tracked
 #define WM_PID_MAP_SIZE 256 // max PIDs to track
+#define WM_MAX_DISPLAYS 4   // monitors, each with its own view
+
+// set of buffers (dwm-style tags), bit N = buffer N
+typedef uint8_t WMBufferMask;
+
+#define WM_BUFFER_BIT(index) ((WMBufferMask)(1u << (index)))
+#define WM_BUFFER_MASK_ALL ((WMBufferMask)((1u << WM_MAX_BUFFERS) - 1))
+
+_Static_assert(WM_MAX_BUFFERS <= 8, "WMBufferMask holds at most 8 buffers");
+
+// rectangle for frame calculations
+typedef struct {
+  double x;      // x coordinate
+  double y;      // y coordinate
+  double width;  // width of the frame
+  double height; // height of the frame
+} WMRect;
+
+// size of a window
+typedef struct {
+  double width;  // width of the window
+  double height; // height of the window
+} WMSize;
 
 // tracked application
 typedef struct {
   pid_t pid;                   // process identifier
   char bundle_identifier[128]; // e.g., com.spotify.client
-  int8_t buffer_index;         // -1 = unassigned, 0-4 = buffer index
   bool is_managed;             // false = WM ignore this app
   bool is_floating; // true = manual position, false = tiled (dwindle)
+  void *backend_handle;        // platform cache (app/window objects), NULL =
+                               // not resolved yet, lifetime owned by WMState
+  uint32_t backend_generation; // changes whenever backend_handle is replaced
 } WMApp;
 
 // hash map entry for pid lookup
@@ -29,6 +54,8 @@ typedef struct {
 typedef struct {
   WMApp apps[WM_MAX_APPS];                // array of apps
   int16_t app_count;                      // number of apps in the array
+  WMBufferMask buffer_masks[WM_MAX_APPS]; // buffers of apps[i], 0 = unassigned
+                                          // (kept apart for dense scans)
   WMPidMapEntry pid_map[WM_PID_MAP_SIZE]; // hash map for O(1) pid lookup
 } WMAppRegistry;
 
@@ -36,4 +63,13 @@ typedef struct {
   pid_t last_focused_pid; // last focused pid in this buffer
 } WMBuffer;
 
+// platform hooks that create/destroy per-app backend handles
+// acquire runs on register (or lazily after invalidation), release runs on
+// unregister and invalidation, so a handle never outlives its app
+typedef struct {
+  void *(*acquire)(pid_t pid, void *context);
+  void (*release)(pid_t pid, void *handle, void *context);
+  void *context;
+} WMBackendHooks;
+
 #endif
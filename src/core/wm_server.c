@@ -0,0 +1,542 @@
+#include "wm_server.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// no SIGPIPE when a peer went away: per send on Linux, per socket on macOS
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+static void set_nosigpipe(int fd) {
+#ifdef SO_NOSIGPIPE
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+  (void)fd;
+#endif
+}
+
+static bool set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 &&
+         fcntl(fd, F_SETFD, FD_CLOEXEC) == 0;
+}
+
+static bool make_address(const char *path, struct sockaddr_un *address) {
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  size_t length = strlen(path);
+  if (length == 0 || length >= sizeof(address->sun_path) ||
+      length >= WM_SERVER_PATH_SIZE)
+    return false;
+  memcpy(address->sun_path, path, length + 1);
+  return true;
+}
+
+const char *wm_server_default_path(char *buffer, size_t size) {
+  const char *path = getenv("DWIN_SOCKET");
+  if (path != NULL && path[0] != '\0')
+    snprintf(buffer, size, "%s", path);
+  else
+    snprintf(buffer, size, "/tmp/dwin-%d.sock", (int)getuid());
+  return buffer;
+}
+
+// server thread
+
+// poke the server thread out of poll, once until it wakes (lock held)
+static void wake_server(WMServer *server) {
+  if (server->woken)
+    return;
+  server->woken = true;
+  char byte = 1;
+  ssize_t written = write(server->wake_fds[1], &byte, 1);
+  (void)written;
+}
+
+static void drain_wake(WMServer *server) {
+  server->woken = false;
+  char bytes[64];
+  while (read(server->wake_fds[0], bytes, sizeof(bytes)) > 0)
+    ;
+}
+
+static void reset_client(WMServerClient *client) {
+  client->fd = -1;
+  client->busy = false;
+  client->queued = false;
+  client->closing = false;
+  client->subscribed = 0;
+  memset(&client->events, 0, sizeof(client->events));
+  client->input_length = 0;
+  client->output_length = 0;
+  client->output_sent = 0;
+}
+
+// a batch the main thread already took replies into the void (serial)
+static void close_client(WMServerClient *client) {
+  close(client->fd);
+  reset_client(client);
+}
+
+static void accept_clients(WMServer *server) {
+  for (;;) {
+    int fd = accept(server->listen_fd, NULL, NULL);
+    if (fd < 0)
+      return; // drained (or an error poll reports again)
+
+    WMServerClient *client = NULL;
+    for (int i = 0; i < WM_SERVER_MAX_CLIENTS; i++) {
+      if (server->clients[i].fd < 0) {
+        client = &server->clients[i];
+        break;
+      }
+    }
+    if (client == NULL || !set_nonblocking(fd)) {
+      close(fd);
+      server->refused++;
+      continue;
+    }
+
+    set_nosigpipe(fd);
+    reset_client(client);
+    client->fd = fd;
+    client->serial = ++server->next_serial;
+  }
+}
+
+// read what arrived, false if the connection is gone
+static bool read_input(WMServerClient *client) {
+  while (client->input_length < sizeof(client->input)) {
+    ssize_t count = recv(client->fd, client->input + client->input_length,
+                         sizeof(client->input) - client->input_length, 0);
+    if (count == 0)
+      return false;
+    if (count < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    client->input_length += (size_t)count;
+  }
+  return true;
+}
+
+// send what the socket takes, false if the connection is gone (or was
+// meant to close after this output)
+static bool flush_output(WMServerClient *client) {
+  while (client->output_sent < client->output_length) {
+    ssize_t sent = send(client->fd, client->output + client->output_sent,
+                        client->output_length - client->output_sent,
+                        SEND_FLAGS);
+    if (sent < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    client->output_sent += (size_t)sent;
+  }
+  client->output_length = 0;
+  client->output_sent = 0;
+  return !client->closing;
+}
+
+// answer a request from the snapshot, or queue it for the main thread.
+// Returns true if it was queued
+static bool handle_request(WMServer *server, WMServerClient *client,
+                           const char *request) {
+  WMControlBatch batch;
+  char error[WM_CONTROL_ERROR_SIZE];
+  int length;
+
+  if (!wm_control_parse(request, &batch, error, sizeof(error))) {
+    length = wm_control_error(error, client->output, sizeof(client->output));
+  } else if (batch.has_mutation) {
+    snprintf(client->job, sizeof(client->job), "%s", request);
+    client->busy = true;
+    client->queued = true;
+    client->queued_at = server->next_job++;
+    server->batches++;
+    return true;
+  } else {
+    length = wm_control_reply(&server->snapshot, &batch, client->output,
+                              sizeof(client->output));
+    client->subscribed = batch.subscribe;
+    server->queries++;
+  }
+
+  client->output_length = (size_t)length;
+  client->output_sent = 0;
+  return false;
+}
+
+// format the waiting events of a subscriber into its output (the count
+// of lost ones first), as many as fit. Returns the output length
+static size_t fill_events(WMServerClient *client) {
+  WMControlEventRing *ring = &client->events;
+  size_t length = 0;
+  if (ring->dropped > 0) {
+    length = (size_t)wm_control_format_dropped(ring->dropped, client->output,
+                                               sizeof(client->output));
+    ring->dropped = 0;
+  }
+
+  WMControlEvent event;
+  while (ring->count > 0) {
+    int written = wm_control_format_event(&ring->events[ring->head],
+                                          client->output + length,
+                                          sizeof(client->output) - length);
+    if (written == 0 && length > 0)
+      break; // full, the rest goes out next round
+    wm_control_ring_pop(ring, &event);
+    length += (size_t)written;
+  }
+
+  client->output_length = length;
+  client->output_sent = 0;
+  return length;
+}
+
+// serve the complete requests buffered by a connection, one at a time:
+// stops at one that waits for the main thread or a reply the socket didn't
+// take yet. Returns true if a job was queued
+static bool serve_requests(WMServer *server, WMServerClient *client) {
+  bool queued = false;
+  while (client->fd >= 0 && !client->busy && !client->closing &&
+         client->subscribed == 0 && client->output_length == 0) {
+    char *end = memchr(client->input, '\n', client->input_length);
+    if (end == NULL) {
+      if (client->input_length < sizeof(client->input))
+        break; // the rest of the line is on its way
+
+      // longer than any request, answer and hang up
+      client->output_length = (size_t)wm_control_error(
+          "request too long", client->output, sizeof(client->output));
+      client->input_length = 0;
+      client->closing = true;
+    } else {
+      *end = '\0';
+      size_t line = (size_t)(end - client->input) + 1;
+      queued |= handle_request(server, client, client->input);
+      memmove(client->input, end + 1, client->input_length - line);
+      client->input_length -= line;
+    }
+
+    if (client->output_length > 0 && !flush_output(client))
+      close_client(client);
+  }
+
+  // a subscriber's requests are ignored, its events go out as fast as the
+  // socket takes them
+  if (client->fd >= 0 && client->subscribed != 0) {
+    client->input_length = 0;
+    if (client->output_length == 0 && fill_events(client) > 0 &&
+        !flush_output(client))
+      close_client(client);
+  }
+  return queued;
+}
+
+static void *serve(void *argument) {
+  WMServer *server = argument;
+  struct pollfd fds[2 + WM_SERVER_MAX_CLIENTS];
+  int slots[2 + WM_SERVER_MAX_CLIENTS];
+
+  pthread_mutex_lock(&server->lock);
+  while (!server->stopping) {
+    int count = 0;
+    fds[count++] =
+        (struct pollfd){.fd = server->wake_fds[0], .events = POLLIN};
+    fds[count++] =
+        (struct pollfd){.fd = server->listen_fd, .events = POLLIN};
+    for (int i = 0; i < WM_SERVER_MAX_CLIENTS; i++) {
+      const WMServerClient *client = &server->clients[i];
+      if (client->fd < 0)
+        continue;
+
+      // a reply being sent or a batch in the works holds the next request
+      short events = client->output_length > 0 ? POLLOUT
+                     : client->busy             ? 0
+                                                : POLLIN;
+      slots[count] = i;
+      fds[count++] = (struct pollfd){.fd = client->fd, .events = events};
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    int ready = poll(fds, (nfds_t)count, -1);
+
+    pthread_mutex_lock(&server->lock);
+    if (ready < 0)
+      continue; // interrupted
+
+    if (fds[0].revents & POLLIN)
+      drain_wake(server);
+    for (int i = 2; i < count; i++) {
+      WMServerClient *client = &server->clients[slots[i]];
+      if (fds[i].revents & POLLIN) {
+        if (!read_input(client))
+          close_client(client);
+      } else if (fds[i].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+        close_client(client);
+      }
+    }
+    if (fds[1].revents & POLLIN)
+      accept_clients(server);
+
+    // send replies (the main thread's arrive through the wake pipe), then
+    // serve the requests that are waiting
+    bool queued = false;
+    for (int i = 0; i < WM_SERVER_MAX_CLIENTS; i++) {
+      WMServerClient *client = &server->clients[i];
+      if (client->fd < 0)
+        continue;
+      if (client->output_length > 0 && !flush_output(client)) {
+        close_client(client);
+        continue;
+      }
+      queued |= serve_requests(server, client);
+    }
+
+    if (queued && server->wake_main != NULL) {
+      pthread_mutex_unlock(&server->lock);
+      server->wake_main(server->context);
+      pthread_mutex_lock(&server->lock);
+    }
+  }
+  pthread_mutex_unlock(&server->lock);
+  return NULL;
+}
+
+// server
+
+static void close_all(WMServer *server) {
+  for (int i = 0; i < WM_SERVER_MAX_CLIENTS; i++) {
+    if (server->clients[i].fd >= 0)
+      close_client(&server->clients[i]);
+  }
+  if (server->listen_fd >= 0)
+    close(server->listen_fd);
+  if (server->path[0] != '\0')
+    unlink(server->path);
+  for (int i = 0; i < 2; i++) {
+    if (server->wake_fds[i] >= 0)
+      close(server->wake_fds[i]);
+  }
+  server->path[0] = '\0';
+  server->listen_fd = -1;
+  server->wake_fds[0] = server->wake_fds[1] = -1;
+}
+
+bool wm_server_start(WMServer *server, const char *path,
+                     void (*wake_main)(void *context), void *context) {
+  memset(server, 0, sizeof(*server));
+  server->listen_fd = -1;
+  server->wake_fds[0] = server->wake_fds[1] = -1;
+  for (int i = 0; i < WM_SERVER_MAX_CLIENTS; i++)
+    reset_client(&server->clients[i]);
+  server->snapshot.active_buffer = -1; // nothing published yet
+  server->wake_main = wake_main;
+  server->context = context;
+
+  struct sockaddr_un address;
+  if (!make_address(path, &address))
+    return false;
+
+  // a live server answers, a dead one left its socket file behind (which
+  // is replaced, anything else at path is left alone)
+  int probe = wm_client_connect(path);
+  if (probe >= 0) {
+    close(probe);
+    return false;
+  }
+  struct stat info;
+  if (lstat(path, &info) == 0 && (!S_ISSOCK(info.st_mode) || unlink(path) != 0))
+    return false;
+
+  server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server->listen_fd < 0 ||
+      bind(server->listen_fd, (struct sockaddr *)&address, sizeof(address)) !=
+          0) {
+    close_all(server);
+    return false;
+  }
+  snprintf(server->path, sizeof(server->path), "%s", path); // ours to remove
+
+  if (chmod(path, 0600) != 0 ||
+      listen(server->listen_fd, WM_SERVER_MAX_CLIENTS) != 0 ||
+      !set_nonblocking(server->listen_fd) || pipe(server->wake_fds) != 0 ||
+      !set_nonblocking(server->wake_fds[0]) ||
+      !set_nonblocking(server->wake_fds[1])) {
+    close_all(server);
+    return false;
+  }
+
+  pthread_mutex_init(&server->lock, NULL);
+  if (pthread_create(&server->thread, NULL, serve, server) != 0) {
+    pthread_mutex_destroy(&server->lock);
+    close_all(server);
+    return false;
+  }
+  server->running = true;
+  return true;
+}
+
+void wm_server_stop(WMServer *server) {
+  if (!server->running)
+    return;
+
+  pthread_mutex_lock(&server->lock);
+  server->stopping = true;
+  wake_server(server);
+  pthread_mutex_unlock(&server->lock);
+  pthread_join(server->thread, NULL);
+
+  server->running = false;
+  close_all(server);
+  pthread_mutex_destroy(&server->lock);
+}
+
+void wm_server_publish(WMServer *server, const WMControlSnapshot *snapshot) {
+  pthread_mutex_lock(&server->lock);
+  server->snapshot = *snapshot;
+  pthread_mutex_unlock(&server->lock);
+}
+
+bool wm_server_take(WMServer *server, WMServerJob *out_job) {
+  pthread_mutex_lock(&server->lock);
+  WMServerClient *oldest = NULL;
+  int slot = -1;
+  for (int i = 0; i < WM_SERVER_MAX_CLIENTS; i++) {
+    WMServerClient *client = &server->clients[i];
+    if (client->fd >= 0 && client->queued &&
+        (oldest == NULL ||
+         (int32_t)(client->queued_at - oldest->queued_at) < 0)) {
+      oldest = client;
+      slot = i;
+    }
+  }
+
+  if (oldest != NULL) {
+    oldest->queued = false;
+    out_job->client = slot;
+    out_job->serial = oldest->serial;
+    memcpy(out_job->request, oldest->job, sizeof(out_job->request));
+  }
+  pthread_mutex_unlock(&server->lock);
+  return oldest != NULL;
+}
+
+void wm_server_reply(WMServer *server, const WMServerJob *job,
+                     const char *reply, size_t length) {
+  if (job->client < 0 || job->client >= WM_SERVER_MAX_CLIENTS)
+    return;
+
+  pthread_mutex_lock(&server->lock);
+  WMServerClient *client = &server->clients[job->client];
+  if (client->fd >= 0 && client->serial == job->serial && client->busy) {
+    if (length > sizeof(client->output))
+      length = (size_t)wm_control_error("reply too long", client->output,
+                                        sizeof(client->output));
+    else
+      memcpy(client->output, reply, length);
+    client->output_length = length;
+    client->output_sent = 0;
+    client->busy = false;
+    wake_server(server);
+  }
+  pthread_mutex_unlock(&server->lock);
+}
+
+void wm_server_emit(WMServer *server, const WMControlEvent *events,
+                    int count) {
+  pthread_mutex_lock(&server->lock);
+  bool queued = false;
+  for (int i = 0; i < WM_SERVER_MAX_CLIENTS; i++) {
+    WMServerClient *client = &server->clients[i];
+    if (client->fd < 0 || client->subscribed == 0)
+      continue;
+
+    for (int e = 0; e < count; e++) {
+      if ((client->subscribed & WM_CONTROL_EVENT_BIT(events[e].type)) == 0)
+        continue;
+      if (!wm_control_ring_push(&client->events, &events[e]))
+        server->events_dropped++;
+      server->events_queued++;
+      queued = true;
+    }
+  }
+  if (queued)
+    wake_server(server);
+  pthread_mutex_unlock(&server->lock);
+}
+
+// client
+
+int wm_client_connect(const char *path) {
+  struct sockaddr_un address;
+  if (!make_address(path, &address))
+    return -1;
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  set_nosigpipe(fd);
+  if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int wm_client_request(int fd, const char *request, char *reply, size_t size) {
+  // the request as one line (a newline inside would make it several)
+  char line[WM_CONTROL_MAX_REQUEST];
+  size_t length = strlen(request);
+  while (length > 0 && request[length - 1] == '\n')
+    length--;
+  if (length + 1 > sizeof(line) || memchr(request, '\n', length) != NULL)
+    return -1;
+  memcpy(line, request, length);
+  line[length++] = '\n';
+
+  for (size_t sent = 0; sent < length;) {
+    ssize_t count = send(fd, line + sent, length - sent, SEND_FLAGS);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count < 0)
+      return -1;
+    sent += (size_t)count;
+  }
+
+  // the reply ends with an empty line, what follows it (the events after a
+  // subscribe) is left on the socket: peek, then take just the reply
+  size_t received = 0;
+  while (received + 1 < size) {
+    ssize_t count =
+        recv(fd, reply + received, size - 1 - received, MSG_PEEK);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      return -1;
+
+    size_t take = (size_t)count;
+    for (size_t i = received; i < received + (size_t)count; i++) {
+      if (i > 0 && reply[i] == '\n' && reply[i - 1] == '\n') {
+        take = i + 1 - received;
+        break;
+      }
+    }
+    if (recv(fd, reply + received, take, 0) != (ssize_t)take)
+      return -1;
+    received += take;
+    reply[received] = '\0';
+    if (received >= 2 && reply[received - 2] == '\n' &&
+        reply[received - 1] == '\n')
+      return (int)received;
+  }
+  return -1;
+}
@@ -0,0 +1,105 @@
+#ifndef WM_SERVER_H
+#define WM_SERVER_H
+
+#include "wm_control.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WM_SERVER_MAX_CLIENTS 64 // connections served at once
+#define WM_SERVER_PATH_SIZE 104  // sun_path on macOS
+
+// a batch with mutations, taken by the main thread
+typedef struct {
+  int client;      // slot of the connection
+  uint32_t serial; // connection serial, the reply is dropped if it closed
+  char request[WM_CONTROL_MAX_REQUEST];
+} WMServerJob;
+
+// one connection. Requests are served in order, one at a time, until a
+// subscribe turns it into an event stream
+typedef struct {
+  int fd;                    // -1 = free slot
+  uint32_t serial;           // changes with every connection in the slot
+  bool busy;                 // its batch waits for the main thread
+  bool queued;               // ...and hasn't been taken yet
+  bool closing;              // close once the output is sent
+  uint8_t subscribed;        // event classes streamed, 0 = serving requests
+  uint32_t queued_at;        // jobs are taken in the order they were queued
+  WMControlEventRing events; // subscribed: events not sent yet
+  size_t input_length;
+  size_t output_length;
+  size_t output_sent;
+  char input[WM_CONTROL_MAX_REQUEST];
+  char output[WM_CONTROL_MAX_REPLY];
+  char job[WM_CONTROL_MAX_REQUEST]; // request of the queued batch
+} WMServerClient;
+
+// control socket server. A thread polls the listening socket and the
+// connections (non-blocking) and answers queries from the last published
+// snapshot, so they never wait on the main thread. Batches with mutations
+// are handed to the main thread as jobs: wake_main is called (from the
+// server thread) when jobs are waiting, the main thread takes them, runs
+// them against WMState and replies. Events emitted by the main thread are
+// queued per subscriber and sent by the server thread, a subscriber that
+// doesn't keep up loses its oldest events instead of slowing the emitter
+typedef struct WMServer {
+  int listen_fd;
+  int wake_fds[2]; // pipe waking the server thread (replies, stop)
+  pthread_t thread;
+  pthread_mutex_t lock; // guards everything below
+  bool running;
+  bool stopping;
+  bool woken; // a wake is pending in the pipe
+  void (*wake_main)(void *context);
+  void *context;
+  uint32_t next_serial;
+  uint32_t next_job;
+  WMServerClient clients[WM_SERVER_MAX_CLIENTS];
+  WMControlSnapshot snapshot; // answers queries
+  uint32_t queries;           // query-only requests answered
+  uint32_t batches;           // requests handed to the main thread
+  uint32_t refused;           // connections closed, no free slot
+  uint32_t events_queued;     // events queued to subscribers
+  uint32_t events_dropped;    // events lost by subscribers falling behind
+  char path[WM_SERVER_PATH_SIZE];
+} WMServer;
+
+// default socket path: $DWIN_SOCKET, else /tmp/dwin-<uid>.sock
+const char *wm_server_default_path(char *buffer, size_t size);
+
+// listen on path and start the server thread. Fails if the path is too
+// long, another server is live on it or it is not a socket (a stale socket
+// file is replaced)
+bool wm_server_start(WMServer *server, const char *path,
+                     void (*wake_main)(void *context), void *context);
+
+// stop the thread, close the connections and remove the socket file
+void wm_server_stop(WMServer *server);
+
+// replace the snapshot queries are answered from (copied)
+void wm_server_publish(WMServer *server, const WMControlSnapshot *snapshot);
+
+// queue events for the subscribers of their classes (any thread, the
+// server thread sends them). Never blocks on a subscriber
+void wm_server_emit(WMServer *server, const WMControlEvent *events,
+                    int count);
+
+// take the oldest waiting job, false if there is none (any thread)
+bool wm_server_take(WMServer *server, WMServerJob *out_job);
+
+// send the reply of a job (any thread), the connection's next request is
+// served after it
+void wm_server_reply(WMServer *server, const WMServerJob *job,
+                     const char *reply, size_t length);
+
+// client side: connect to a server, returns the socket or -1
+int wm_client_connect(const char *path);
+
+// client side: send a request (one line) and wait for its whole reply.
+// Returns the reply length, -1 on errors or if it doesn't fit in size.
+// After a subscribe the events can be read from fd as lines
+int wm_client_request(int fd, const char *request, char *reply, size_t size);
+
+#endif
@@ -0,0 +1,253 @@
+#include "wm_snapshot.h"
+#include "wm_config.h"
+#include "wm_display.h"
+#include "wm_store.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// hash of the header without its checksum field
+static uint32_t header_hash(const WMSnapshotHeader *header) {
+  WMSnapshotHeader copy = *header;
+  copy.checksum = 0;
+  return wm_store_hash(&copy, sizeof(copy));
+}
+
+// build the record of registry slot i (zeroed if unused)
+static void build_record(const WMState *state, int i, WMSnapshotApp *out) {
+  memset(out, 0, sizeof(*out));
+
+  const WMAppRegistry *registry = &state->app_registry;
+  if (i >= registry->app_count)
+    return;
+
+  const WMApp *app = &registry->apps[i];
+  out->pid = app->pid;
+  memcpy(out->bundle_identifier, app->bundle_identifier,
+         sizeof(out->bundle_identifier));
+  out->bundle_hash = wm_config_hash_bundle(out->bundle_identifier);
+  out->buffer_mask = registry->buffer_masks[i];
+  out->is_floating = app->is_floating;
+}
+
+// build the header for state (checksum left to the caller)
+static void build_header(const WMState *state, WMSnapshotHeader *out) {
+  memset(out, 0, sizeof(*out));
+  out->magic = WM_SNAPSHOT_MAGIC;
+  out->version = WM_SNAPSHOT_VERSION;
+  out->app_count = (uint16_t)state->app_registry.app_count;
+  out->is_passthrough_mode = state->is_passthrough_mode;
+  out->display_count = (uint8_t)state->display_count;
+  out->focused_display = state->focused_display;
+  for (int i = 0; i < state->display_count; i++) {
+    const WMDisplay *display = &state->displays[i];
+    out->displays[i].id = display->id;
+    out->displays[i].active_buffer = i == state->focused_display
+                                         ? (int8_t)state->active_buffer
+                                         : display->active_buffer;
+    out->displays[i].view_mask = wm_state_display_view(state, i);
+  }
+  for (int i = 0; i < WM_MAX_BUFFERS; i++) {
+    out->last_focused[i] = state->buffers[i].last_focused_pid;
+  }
+}
+
+// verify magic, version and checksum of an image
+static bool image_valid(const WMSnapshotImage *image) {
+  if (image->header.magic != WM_SNAPSHOT_MAGIC ||
+      image->header.version != WM_SNAPSHOT_VERSION ||
+      image->header.app_count > WM_MAX_APPS ||
+      image->header.display_count > WM_MAX_DISPLAYS)
+    return false;
+
+  uint32_t sum = header_hash(&image->header);
+  for (int i = 0; i < WM_MAX_APPS; i++) {
+    sum += wm_store_hash(&image->apps[i], sizeof(WMSnapshotApp));
+  }
+  return sum == image->header.checksum;
+}
+
+bool wm_snapshot_open(WMSnapshotWriter *writer, const char *path) {
+  memset(writer, 0, sizeof(*writer));
+  writer->fd = -1;
+
+  int fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd < 0)
+    return false;
+
+  // grow (or shrink a stale version) to the image size
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (st.st_size != (off_t)sizeof(WMSnapshotImage) &&
+       ftruncate(fd, sizeof(WMSnapshotImage)) != 0)) {
+    close(fd);
+    return false;
+  }
+
+  void *map = mmap(NULL, sizeof(WMSnapshotImage), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  writer->fd = fd;
+  writer->image = map;
+  writer->needs_full_write = true;
+  return true;
+}
+
+void wm_snapshot_close(WMSnapshotWriter *writer) {
+  if (writer->image)
+    munmap(writer->image, sizeof(WMSnapshotImage));
+  if (writer->fd >= 0)
+    close(writer->fd);
+
+  writer->image = NULL;
+  writer->fd = -1;
+}
+
+bool wm_snapshot_write(WMSnapshotWriter *writer, const WMState *state) {
+  if (writer->image == NULL)
+    return false;
+
+  // nothing changed since last write
+  if (!writer->needs_full_write && writer->written_version == state->version)
+    return true;
+
+  WMSnapshotImage *image = writer->image;
+  int dirty = 0;
+
+  // store only records that differ from the mapping, keep the sum current
+  // (record_hash starts zeroed, so the first full write builds the sum)
+  for (int i = 0; i < WM_MAX_APPS; i++) {
+    WMSnapshotApp record;
+    build_record(state, i, &record);
+
+    if (!writer->needs_full_write &&
+        memcmp(&image->apps[i], &record, sizeof(record)) == 0)
+      continue;
+
+    uint32_t hash = wm_store_hash(&record, sizeof(record));
+    image->apps[i] = record;
+    writer->records_sum += hash - writer->record_hash[i];
+    writer->record_hash[i] = hash;
+    dirty++;
+  }
+
+  WMSnapshotHeader header;
+  build_header(state, &header);
+  header.checksum = header_hash(&header) + writer->records_sum;
+  image->header = header;
+
+  writer->written_version = state->version;
+  writer->needs_full_write = false;
+  writer->last_dirty_records = dirty;
+  return true;
+}
+
+// a saved view that can be switched to
+static bool view_valid(const WMSnapshotDisplay *display) {
+  int active = display->active_buffer;
+  return active >= 0 && active < WM_MAX_BUFFERS &&
+         (display->view_mask & WM_BUFFER_BIT(active)) != 0;
+}
+
+// saved entry of the display with id, -1 if it wasn't saved
+static int saved_display(const WMSnapshotHeader *header, uint32_t id) {
+  for (int i = 0; i < header->display_count; i++) {
+    if (header->displays[i].id == id)
+      return i;
+  }
+  return -1;
+}
+
+int wm_snapshot_restore(const char *path, WMState *state,
+                        WMSnapshotView *out_view) {
+  if (out_view) {
+    out_view->active_buffer = -1;
+    out_view->view_mask = 0;
+  }
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  // single read of the whole image
+  WMSnapshotImage image;
+  ssize_t size = read(fd, &image, sizeof(image));
+  close(fd);
+
+  if (size != (ssize_t)sizeof(image) || !image_valid(&image))
+    return -1;
+
+  const WMAppRegistry *registry = &state->app_registry;
+  bool record_used[WM_MAX_APPS] = {false};
+  bool app_restored[WM_MAX_APPS] = {false};
+  int restored = 0;
+
+  // pass 0: same pid and bundle (dwin restarted, app kept running)
+  // pass 1: same bundle, any unused record (app was relaunched)
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < registry->app_count; i++) {
+      if (app_restored[i])
+        continue;
+
+      const WMApp *app = &registry->apps[i];
+      uint32_t bundle_hash = wm_config_hash_bundle(app->bundle_identifier);
+
+      for (int r = 0; r < image.header.app_count; r++) {
+        const WMSnapshotApp *record = &image.apps[r];
+        if (record_used[r] || record->bundle_hash != bundle_hash ||
+            (pass == 0 && record->pid != app->pid) ||
+            strncmp(record->bundle_identifier, app->bundle_identifier,
+                    sizeof(record->bundle_identifier)) != 0)
+          continue;
+
+        record_used[r] = true;
+        app_restored[i] = true;
+        wm_state_set_buffer_mask(state, app->pid,
+                                 record->buffer_mask & WM_BUFFER_MASK_ALL);
+        wm_state_set_floating(state, app->pid, record->is_floating != 0);
+        restored++;
+        break;
+      }
+    }
+  }
+
+  // focus only points at apps that are still around
+  for (int b = 0; b < WM_MAX_BUFFERS; b++) {
+    pid_t pid = image.header.last_focused[b];
+    if (pid > 0 && (wm_state_get_buffer_mask(state, pid) & WM_BUFFER_BIT(b)))
+      state->buffers[b].last_focused_pid = pid;
+  }
+  state->version++;
+
+  // the other displays show their views again, set through their focus so
+  // a buffer stays on one display
+  const WMSnapshotHeader *header = &image.header;
+  int focused = state->focused_display;
+  for (int d = 0; d < state->display_count; d++) {
+    int saved = saved_display(header, state->displays[d].id);
+    if (d == focused || saved < 0 || !view_valid(&header->displays[saved]))
+      continue;
+    wm_display_focus(state, d);
+    wm_state_set_view(state, header->displays[saved].active_buffer,
+                      header->displays[saved].view_mask & WM_BUFFER_MASK_ALL);
+    wm_display_focus(state, focused);
+  }
+
+  int saved = saved_display(header, state->displays[focused].id);
+  if (saved < 0)
+    saved = header->focused_display;
+  if (out_view && saved >= 0 && saved < header->display_count &&
+      view_valid(&header->displays[saved])) {
+    out_view->active_buffer = header->displays[saved].active_buffer;
+    out_view->view_mask =
+        header->displays[saved].view_mask & WM_BUFFER_MASK_ALL;
+  }
+
+  return restored;
+}
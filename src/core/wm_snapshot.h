@@ -0,0 +1,90 @@
+#ifndef WM_SNAPSHOT_H
+#define WM_SNAPSHOT_H
+
+#include "wm_runtime.h"
+#include "wm_state.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define WM_SNAPSHOT_MAGIC 0x4e495744u // "DWIN"
+#define WM_SNAPSHOT_VERSION 2
+
+// one app as persisted in a snapshot
+typedef struct {
+  pid_t pid;                   // pid when written (0 = unused record)
+  uint32_t bundle_hash;        // wm_config_hash_bundle(bundle_identifier)
+  char bundle_identifier[128]; // e.g., com.spotify.client
+  WMBufferMask buffer_mask;    // buffers the app belongs to
+  uint8_t is_floating;         // 1 = manual position
+  uint8_t reserved[2];
+} WMSnapshotApp;
+
+// view of one display as persisted in a snapshot
+typedef struct {
+  uint32_t id;            // platform display id
+  int8_t active_buffer;   // primary buffer of its view, -1 = none
+  WMBufferMask view_mask; // buffers it shows
+  uint8_t reserved[2];
+} WMSnapshotDisplay;
+
+// fixed header, checksum covers header fields and every app record
+typedef struct {
+  uint32_t magic;                     // WM_SNAPSHOT_MAGIC
+  uint16_t version;                   // WM_SNAPSHOT_VERSION
+  uint16_t app_count;                 // used records
+  uint32_t checksum;                  // header hash + sum of record hashes
+  uint8_t is_passthrough_mode;        // hotkeys disabled
+  uint8_t display_count;              // used display entries
+  int8_t focused_display;             // entry of the focused display
+  uint8_t reserved;
+  WMSnapshotDisplay displays[WM_MAX_DISPLAYS]; // view of every display
+  pid_t last_focused[WM_MAX_BUFFERS]; // per-buffer focus
+} WMSnapshotHeader;
+
+// whole on-disk image, fixed size so it maps and reads in one go
+typedef struct {
+  WMSnapshotHeader header;
+  WMSnapshotApp apps[WM_MAX_APPS];
+} WMSnapshotImage;
+
+// memory-mapped snapshot file, rewritten in place on every state change
+typedef struct {
+  int fd;                            // -1 = closed
+  WMSnapshotImage *image;            // mapped file
+  uint32_t record_hash[WM_MAX_APPS]; // hash of each mapped record
+  uint32_t records_sum;              // sum of record_hash
+  uint32_t written_version;          // WMState.version last written
+  bool needs_full_write;             // mapped content not trusted yet
+  int last_dirty_records;            // records touched by the last write
+} WMSnapshotWriter;
+
+// view of the focused display restored from a snapshot
+typedef struct {
+  int active_buffer;      // -1 if none was saved
+  WMBufferMask view_mask; // buffers shown
+} WMSnapshotView;
+
+// open (creating if needed) and map the snapshot file
+bool wm_snapshot_open(WMSnapshotWriter *writer, const char *path);
+
+// unmap and close the snapshot file
+void wm_snapshot_close(WMSnapshotWriter *writer);
+
+// write state if it changed since the last write. Only records that differ
+// are stored into the mapping and the page cache flushes them, nothing here
+// waits for the disk. Returns false if the writer is not open
+bool wm_snapshot_write(WMSnapshotWriter *writer, const WMState *state);
+
+// read a snapshot in a single read and apply it to the apps already
+// registered in state (the running ones): matched by pid and bundle, or by
+// bundle alone for relaunched apps. Restores buffers, floating and focus.
+// Views are matched to the displays in state by id: the other displays get
+// theirs in state, the focused display's (else the one that was focused) is
+// returned for the caller to switch to (passthrough is not restored so a
+// crash can't leave hotkeys disabled).
+// Returns apps restored or -1 if the file is missing, stale or corrupt
+int wm_snapshot_restore(const char *path, WMState *state,
+                        WMSnapshotView *out_view);
+
+#endif
@@ -1,4 +1,8 @@
 #include "wm_state.h"
+#include "wm_config.h"
+#include "wm_display.h"
+#include "wm_minsize.h"
+#include "wm_placement.h"
 #include "wm_runtime.h"
 #include <assert.h>
 #include <stdint.h>
@@ -30,6 +34,24 @@ static bool pid_map_insert(WMPidMapEntry *map, int16_t app_index, pid_t pid) {
   return false;
 }
 
+// probe pid map once, return slot holding pid or the empty slot it belongs in
+// (-1 if map is full)
+static int32_t pid_map_probe(const WMPidMapEntry *map, pid_t pid) {
+  uint32_t start = pid_hash(pid);
+  uint32_t i = start;
+
+  do {
+    // same pid or empty slot
+    if (map[i].pid == pid || map[i].pid == 0)
+      return (int32_t)i;
+
+    // collision - try next slot
+    i = (i + 1) % WM_PID_MAP_SIZE;
+  } while (i != start);
+
+  return -1;
+}
+
 // search pid in pid map and return app index or -1 not found
 static int16_t pid_map_search(const WMPidMapEntry *map, pid_t pid) {
   if (pid == 0)
@@ -91,11 +113,37 @@ static void pid_map_remove(WMPidMapEntry *map, pid_t pid) {
   } while (i != start);
 }
 
+// acquire a backend handle for a freshly registered app
+static void backend_acquire(WMState *state, WMApp *app) {
+  if (state->backend.acquire == NULL)
+    return;
+
+  app->backend_handle =
+      state->backend.acquire(app->pid, state->backend.context);
+  app->backend_generation = ++state->backend_generation;
+}
+
+// release the backend handle of an app, if any
+static void backend_release(WMState *state, WMApp *app) {
+  if (app->backend_handle == NULL)
+    return;
+
+  if (state->backend.release)
+    state->backend.release(app->pid, app->backend_handle,
+                           state->backend.context);
+  app->backend_handle = NULL;
+  app->backend_generation = ++state->backend_generation;
+}
+
 void wm_state_init(WMState *state) {
   memset(state, 0, sizeof(WMState));
   state->active_buffer = -1; // -1 means no buffer active yet (startup state)
   state->is_passthrough_mode = false;
 
+  // one display until the platform reports them
+  state->display_count = 1;
+  state->displays[0].active_buffer = -1;
+
   // initialize app registry
   for (int i = 0; i < WM_PID_MAP_SIZE; i++) {
     state->app_registry.pid_map[i].app_index = -1;
@@ -122,8 +170,8 @@ int wm_state_register_app(WMState *state, pid_t pid,
   // allocate new app
   int16_t index = registry->app_count;
   WMApp *app = &registry->apps[index];
+  registry->buffer_masks[index] = 0; // unassigned yet
   app->pid = pid;
-  app->buffer_index = -1; // unassigned yet
   app->is_managed = true;
   app->is_floating = false;
 
@@ -137,10 +185,84 @@ int wm_state_register_app(WMState *state, pid_t pid,
   assert(inserted && "pid_map_insert failed - map full?");
 
   registry->app_count++;
+  backend_acquire(state, app);
+  state->version++;
 
   return index;
 }
 
+int wm_state_register_apps(WMState *state, const struct WMConfig *config,
+                           const WMAppSpec *apps, int count, int default_buffer,
+                           WMRegisterDelta *out_delta) {
+  WMRegisterDelta delta;
+  memset(&delta, 0, sizeof(delta));
+
+  if (default_buffer < -1 || default_buffer >= WM_MAX_BUFFERS)
+    default_buffer = -1;
+
+  WMAppRegistry *registry = &state->app_registry;
+
+  // free capacity is checked once, not per app
+  int free_slots = WM_MAX_APPS - registry->app_count;
+
+  for (int i = 0; i < count && free_slots > 0; i++) {
+    pid_t pid = apps[i].pid;
+    const char *bundle_identifier = apps[i].bundle_identifier;
+    if (pid == 0 || bundle_identifier == NULL)
+      continue;
+
+    // single probe finds either the existing entry or the insert slot
+    int32_t slot = pid_map_probe(registry->pid_map, pid);
+    if (slot < 0 || registry->pid_map[slot].pid == pid)
+      continue;
+
+    // match rules, then learned placements, falling back to the default
+    uint32_t bundle_hash = wm_config_hash_bundle(bundle_identifier);
+    WMBufferMask mask = 0;
+    int buffer = -1;
+    if (config != NULL)
+      buffer = wm_config_match_rule_hashed(config, bundle_identifier,
+                                           bundle_hash);
+    if (buffer >= 0 && buffer < WM_MAX_BUFFERS)
+      mask = WM_BUFFER_BIT(buffer);
+    else if (wm_placement_lookup(state->placements, bundle_identifier,
+                                 bundle_hash, &mask))
+      mask &= WM_BUFFER_MASK_ALL;
+    if (mask == 0 && default_buffer >= 0)
+      mask = WM_BUFFER_BIT(default_buffer);
+
+    // allocate new app (free slots are kept zeroed by init/unregister)
+    int16_t index = registry->app_count++;
+    WMApp *app = &registry->apps[index];
+    app->pid = pid;
+    app->is_managed = true;
+    app->is_floating = false;
+    strncpy(app->bundle_identifier, bundle_identifier,
+            sizeof(app->bundle_identifier) - 1);
+    app->bundle_identifier[sizeof(app->bundle_identifier) - 1] = '\0';
+    registry->buffer_masks[index] = mask;
+
+    registry->pid_map[slot].pid = pid;
+    registry->pid_map[slot].app_index = index;
+    free_slots--;
+    backend_acquire(state, app);
+
+    delta.registered++;
+    delta.dirty_buffers |= mask;
+    for (WMBufferMask m = mask; m; m &= m - 1) {
+      delta.added[__builtin_ctz(m)]++;
+    }
+  }
+
+  if (delta.registered > 0)
+    state->version++;
+
+  if (out_delta)
+    *out_delta = delta;
+
+  return delta.registered;
+}
+
 void wm_state_unregister_app(WMState *state, pid_t pid) {
   WMAppRegistry *registry = &state->app_registry;
   int16_t index = pid_map_search(registry->pid_map, pid);
@@ -149,6 +271,9 @@ void wm_state_unregister_app(WMState *state, pid_t pid) {
   if (index < 0)
     return;
 
+  // drop backend handle while the app is still intact
+  backend_release(state, &registry->apps[index]);
+
   // remove from pid map
   pid_map_remove(registry->pid_map, pid);
 
@@ -159,6 +284,7 @@ void wm_state_unregister_app(WMState *state, pid_t pid) {
     // move last app to the empty slot
     WMApp *last_app = &registry->apps[last_index];
     registry->apps[index] = *last_app;
+    registry->buffer_masks[index] = registry->buffer_masks[last_index];
 
     // update pid map for the app moved
     pid_map_remove(registry->pid_map, last_app->pid);
@@ -168,7 +294,9 @@ void wm_state_unregister_app(WMState *state, pid_t pid) {
 
   // clean last slot and decrement app count
   memset(&registry->apps[last_index], 0, sizeof(WMApp));
+  registry->buffer_masks[last_index] = 0;
   registry->app_count--;
+  state->version++;
 }
 
 const WMApp *wm_state_find_app(const WMState *state, pid_t pid) {
@@ -190,12 +318,144 @@ void wm_state_assign_to_buffer(WMState *state, pid_t pid, int buffer_index) {
   if (buffer_index < -1 || buffer_index >= WM_MAX_BUFFERS)
     return;
 
+  wm_state_set_buffer_mask(state, pid,
+                           buffer_index < 0 ? 0 : WM_BUFFER_BIT(buffer_index));
+}
+
+void wm_state_set_buffer_mask(WMState *state, pid_t pid, WMBufferMask mask) {
+  // validate if mask only names existing buffers
+  if ((mask & ~WM_BUFFER_MASK_ALL) != 0)
+    return;
+
   // validate if app exists
   int16_t index = pid_map_search(state->app_registry.pid_map, pid);
   if (index < 0)
     return;
 
-  state->app_registry.apps[index].buffer_index = (int8_t)buffer_index;
+  if (state->app_registry.buffer_masks[index] == mask)
+    return;
+
+  state->app_registry.buffer_masks[index] = mask;
+  state->version++;
+}
+
+void wm_state_toggle_buffer(WMState *state, pid_t pid, int buffer_index) {
+  // validate if buffer index is valid
+  if (buffer_index < 0 || buffer_index >= WM_MAX_BUFFERS)
+    return;
+
+  int16_t index = pid_map_search(state->app_registry.pid_map, pid);
+  if (index < 0)
+    return;
+
+  // an app removed from its last buffer would silently vanish, keep it
+  WMBufferMask mask =
+      state->app_registry.buffer_masks[index] ^ WM_BUFFER_BIT(buffer_index);
+  if (mask == 0)
+    return;
+
+  state->app_registry.buffer_masks[index] = mask;
+  state->version++;
+}
+
+WMBufferMask wm_state_get_buffer_mask(const WMState *state, pid_t pid) {
+  int16_t index = pid_map_search(state->app_registry.pid_map, pid);
+  if (index < 0)
+    return 0;
+
+  return state->app_registry.buffer_masks[index];
+}
+
+int wm_state_primary_buffer(const WMState *state, pid_t pid) {
+  WMBufferMask mask = wm_state_get_buffer_mask(state, pid);
+  if (mask == 0)
+    return -1;
+
+  return __builtin_ctz(mask);
+}
+
+WMBufferMask wm_state_get_view(const WMState *state) {
+  if (state->view_mask != 0)
+    return state->view_mask;
+
+  // no explicit view yet - the view is just the active buffer
+  if (state->active_buffer < 0 || state->active_buffer >= WM_MAX_BUFFERS)
+    return 0;
+
+  return WM_BUFFER_BIT(state->active_buffer);
+}
+
+WMBufferMask wm_state_get_shown(const WMState *state) {
+  WMBufferMask shown = wm_state_get_view(state);
+  for (int i = 0; i < state->display_count; i++) {
+    if (i != state->focused_display)
+      shown |= state->displays[i].view_mask;
+  }
+  return shown;
+}
+
+WMBufferMask wm_state_display_view(const WMState *state, int display) {
+  if (display < 0 || display >= state->display_count)
+    return 0;
+  if (display == state->focused_display)
+    return wm_state_get_view(state);
+  return state->displays[display].view_mask;
+}
+
+void wm_state_set_view(WMState *state, int primary_buffer,
+                       WMBufferMask view_mask) {
+  // validate primary is part of a valid view
+  if (primary_buffer < 0 || primary_buffer >= WM_MAX_BUFFERS ||
+      (view_mask & ~WM_BUFFER_MASK_ALL) != 0 ||
+      (view_mask & WM_BUFFER_BIT(primary_buffer)) == 0)
+    return;
+
+  // take the buffers from the other displays, the first one left empty
+  // gets what this display gives up
+  WMBufferMask given_up = wm_state_get_view(state) & (WMBufferMask)~view_mask;
+  for (int i = 0; i < state->display_count; i++) {
+    WMDisplay *display = &state->displays[i];
+    if (i == state->focused_display || (display->view_mask & view_mask) == 0)
+      continue;
+
+    display->view_mask &= (WMBufferMask)~view_mask;
+    if (display->view_mask == 0) {
+      display->view_mask = given_up;
+      given_up = 0;
+    }
+    if (display->view_mask == 0)
+      display->active_buffer = -1;
+    else if (display->active_buffer < 0 ||
+             (display->view_mask & WM_BUFFER_BIT(display->active_buffer)) == 0)
+      display->active_buffer = (int8_t)__builtin_ctz(display->view_mask);
+  }
+
+  state->active_buffer = primary_buffer;
+  state->view_mask = view_mask;
+  state->displays[state->focused_display].active_buffer =
+      (int8_t)primary_buffer;
+  state->displays[state->focused_display].view_mask = view_mask;
+  state->version++;
+}
+
+bool wm_state_toggled_view(const WMState *state, int buffer_index,
+                           int *out_primary, WMBufferMask *out_view) {
+  if (buffer_index < 0 || buffer_index >= WM_MAX_BUFFERS)
+    return false;
+
+  // the view never becomes empty
+  WMBufferMask view = wm_state_get_view(state) ^ WM_BUFFER_BIT(buffer_index);
+  if (view == 0)
+    return false;
+
+  // keep the primary buffer unless it was toggled away
+  int primary = state->active_buffer;
+  if (primary < 0 || (view & WM_BUFFER_BIT(primary)) == 0)
+    primary = __builtin_ctz(view);
+
+  *out_primary = primary;
+  *out_view = view;
+  return true;
 }
 
 int wm_state_get_buffer_pids(const WMState *state, int buffer_index,
@@ -204,16 +464,30 @@ int wm_state_get_buffer_pids(const WMState *state, int buffer_index,
   if (buffer_index < 0 || buffer_index >= WM_MAX_BUFFERS)
     return 0;
 
+  return wm_state_get_view_pids(state, WM_BUFFER_BIT(buffer_index), 0,
+                                out_pids, max_pids);
+}
+
+int wm_state_get_view_pids(const WMState *state, WMBufferMask view_mask,
+                           WMBufferMask exclude_mask, pid_t *out_pids,
+                           int max_pids) {
   // validate if output array is valid
-  if (out_pids == NULL || max_pids <= 0)
+  if (out_pids == NULL || max_pids <= 0 || view_mask == 0)
     return 0;
 
   const WMAppRegistry *registry = &state->app_registry;
-  int count = 0;
+  int app_count = registry->app_count;
 
-  // linear array scan for pids in the buffer
-  for (int i = 0; i < registry->app_count && count < max_pids; i++) {
-    if (registry->apps[i].buffer_index == buffer_index) {
+  // one dense pass over the masks (no branches, vectorizes), then compact
+  uint8_t visible[WM_MAX_APPS];
+  for (int i = 0; i < app_count; i++) {
+    WMBufferMask mask = registry->buffer_masks[i];
+    visible[i] = ((mask & view_mask) != 0) & ((mask & exclude_mask) == 0);
+  }
+
+  int count = 0;
+  for (int i = 0; i < app_count && count < max_pids; i++) {
+    if (visible[i]) {
       out_pids[count++] = registry->apps[i].pid;
     }
   }
@@ -222,14 +496,26 @@ int wm_state_get_buffer_pids(const WMState *state, int buffer_index,
 }
 
 void wm_state_set_focused(WMState *state, pid_t pid) {
-  // find app buffer
-  const WMApp *app = wm_state_find_app(state, pid);
+  // find app buffers
+  WMBufferMask mask = wm_state_get_buffer_mask(state, pid);
   // check if app exists and is assigned to a buffer
-  if (app == NULL || app->buffer_index < 0)
+  if (mask == 0)
     return;
 
-  // update buffer last focused pid
-  state->buffers[app->buffer_index].last_focused_pid = pid;
+  // record focus in the shown buffers the app is in (a sticky app must not
+  // steal focus of hidden buffers), or in all of its buffers if none is shown
+  WMBufferMask shown = mask & wm_state_get_shown(state);
+  if (shown != 0)
+    mask = shown;
+
+  // update buffers last focused pid
+  for (int i = 0; i < WM_MAX_BUFFERS; i++) {
+    if ((mask & WM_BUFFER_BIT(i)) &&
+        state->buffers[i].last_focused_pid != pid) {
+      state->buffers[i].last_focused_pid = pid;
+      state->version++;
+    }
+  }
 }
 
 void wm_state_set_floating(WMState *state, pid_t pid, bool is_floating) {
@@ -239,7 +525,73 @@ void wm_state_set_floating(WMState *state, pid_t pid, bool is_floating) {
   if (idx < 0)
     return;
 
+  if (state->app_registry.apps[idx].is_floating == is_floating)
+    return;
+
   state->app_registry.apps[idx].is_floating = is_floating;
+  state->version++;
+}
+
+WMSize wm_state_min_size(const WMState *state, pid_t pid) {
+  const WMApp *app = state->min_sizes ? wm_state_find_app(state, pid) : NULL;
+  if (app == NULL)
+    return (WMSize){0, 0};
+  return wm_minsize_get(state->min_sizes, app->bundle_identifier);
+}
+
+bool wm_state_learn_min_size(WMState *state, pid_t pid, WMRect requested,
+                             WMSize accepted) {
+  const WMApp *app = state->min_sizes ? wm_state_find_app(state, pid) : NULL;
+  if (app == NULL)
+    return false;
+
+  // a window is never asked for more than its display has room for
+  int display = wm_display_at(state, requested.x + requested.width / 2,
+                              requested.y + requested.height / 2);
+  WMRect area = state->displays[display >= 0 ? display
+                                             : state->focused_display]
+                    .frame;
+  if (!wm_minsize_learn(state->min_sizes, app->bundle_identifier,
+                        (WMSize){requested.width, requested.height}, accepted,
+                        (WMSize){area.width, area.height}))
+    return false;
+
+  // tilings made with the old minimum are stale
+  state->version++;
+  return true;
+}
+
+void wm_state_set_backend_hooks(WMState *state, const WMBackendHooks *hooks) {
+  if (hooks)
+    state->backend = *hooks;
+  else
+    memset(&state->backend, 0, sizeof(state->backend));
+}
+
+void *wm_state_backend_handle(WMState *state, pid_t pid,
+                              uint32_t *out_generation) {
+  int16_t index = pid_map_search(state->app_registry.pid_map, pid);
+  if (index < 0)
+    return NULL;
+
+  WMApp *app = &state->app_registry.apps[index];
+
+  // lazily re-acquire after invalidation
+  if (app->backend_handle == NULL)
+    backend_acquire(state, app);
+
+  if (out_generation)
+    *out_generation = app->backend_generation;
+
+  return app->backend_handle;
+}
+
+void wm_state_invalidate_backend(WMState *state, pid_t pid) {
+  int16_t index = pid_map_search(state->app_registry.pid_map, pid);
+  if (index < 0)
+    return;
+
+  backend_release(state, &state->app_registry.apps[index]);
 }
 
 void wm_state_check_invariants(const WMState *state) {
@@ -252,9 +604,22 @@ void wm_state_check_invariants(const WMState *state) {
     assert(found_index == i);
   }
 
-  // buffer_index must be valid for all apps
+  // buffer masks must only name existing buffers
   for (int i = 0; i < registry->app_count; i++) {
-    int8_t buffer_index = registry->apps[i].buffer_index;
-    assert(buffer_index >= -1 && buffer_index < WM_MAX_BUFFERS);
+    assert((registry->buffer_masks[i] & ~WM_BUFFER_MASK_ALL) == 0);
+  }
+
+  // view must only name existing buffers
+  assert((state->view_mask & ~WM_BUFFER_MASK_ALL) == 0);
+
+  // displays never share a buffer, the focused one mirrors the view
+  assert(state->display_count >= 1 && state->display_count <= WM_MAX_DISPLAYS);
+  assert(state->focused_display >= 0 &&
+         state->focused_display < state->display_count);
+  WMBufferMask seen = 0;
+  for (int i = 0; i < state->display_count; i++) {
+    WMBufferMask view = wm_state_display_view(state, i);
+    assert((seen & view) == 0);
+    seen |= view;
   }
 }
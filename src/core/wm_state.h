@@ -6,12 +6,50 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+struct WMConfig;
+struct WMMinSizeStore;
+struct WMPlacementStore;
+
+// app to register in bulk
+typedef struct {
+  pid_t pid;                     // process identifier
+  const char *bundle_identifier; // e.g., com.spotify.client
+} WMAppSpec;
+
+// per-buffer membership changes of a bulk registration
+typedef struct {
+  int registered;                // apps newly registered
+  int16_t added[WM_MAX_BUFFERS]; // apps added to each buffer
+  WMBufferMask dirty_buffers;    // buffers whose membership changed
+} WMRegisterDelta;
+
+// a monitor and the buffers it shows. A buffer is shown on one display at
+// a time
+typedef struct {
+  uint32_t id;            // platform display id, 0 = not reported yet
+  WMRect frame;           // usable area, global top-left coordinates
+  double scale;           // backing pixels per point, 0 = 1
+  int8_t active_buffer;   // buffer focused on it, -1 = shows nothing
+  WMBufferMask view_mask; // buffers it shows
+} WMDisplay;
+
 // runtime state of the dwin
 typedef struct WMState {
-  WMAppRegistry app_registry;       // registry of all apps
-  WMBuffer buffers[WM_MAX_BUFFERS]; // array of buffers
-  int active_buffer;                // index of the active buffer
-  bool is_passthrough_mode;         // disable all hotkeys
+  WMAppRegistry app_registry;          // registry of all apps
+  WMBuffer buffers[WM_MAX_BUFFERS];    // array of buffers
+  int active_buffer;                   // active buffer of the focused display
+  WMBufferMask view_mask;              // buffers shown there, 0 = just
+                                       // active_buffer
+  WMDisplay displays[WM_MAX_DISPLAYS]; // monitors (see wm_display.h), the
+                                       // focused one mirrors the two above
+  int8_t display_count;                // at least 1
+  int8_t focused_display;              // display switches act on
+  bool is_passthrough_mode;            // disable all hotkeys
+  uint32_t version;                    // bumped on every mutation
+  WMBackendHooks backend;              // per-app handle lifetime hooks
+  uint32_t backend_generation;         // last generation handed to a handle
+  struct WMPlacementStore *placements; // learned placements, NULL = none
+  struct WMMinSizeStore *min_sizes;    // learned minimum sizes, NULL = none
 } WMState;
 
 // initialization of the dwin state
@@ -21,6 +59,14 @@ void wm_state_init(WMState *state);
 int wm_state_register_app(WMState *state, pid_t pid,
                           const char *bundle_identifier);
 
+// register many apps at once (startup, launch bursts), assigning each to its
+// rule's buffer, else where it was last placed (state->placements), else
+// default_buffer. Already registered pids are skipped.
+// config and out_delta may be NULL. Returns number of apps registered
+int wm_state_register_apps(WMState *state, const struct WMConfig *config,
+                           const WMAppSpec *apps, int count, int default_buffer,
+                           WMRegisterDelta *out_delta);
+
 // unregister an app
 void wm_state_unregister_app(WMState *state, pid_t pid);
 
@@ -33,16 +79,76 @@ int8_t wm_state_find_app_index(const WMState *state, pid_t pid);
 // assign app to buffer, pass -1 to unassign
 void wm_state_assign_to_buffer(WMState *state, pid_t pid, int buffer_index);
 
+// replace the set of buffers an app belongs to, 0 to unassign
+void wm_state_set_buffer_mask(WMState *state, pid_t pid, WMBufferMask mask);
+
+// add/remove an app to/from a buffer, never leaves an assigned app with none
+void wm_state_toggle_buffer(WMState *state, pid_t pid, int buffer_index);
+
+// get the set of buffers an app belongs to, 0 if unknown or unassigned
+WMBufferMask wm_state_get_buffer_mask(const WMState *state, pid_t pid);
+
+// lowest buffer an app belongs to, -1 if unknown or unassigned
+int wm_state_primary_buffer(const WMState *state, pid_t pid);
+
+// buffers shown on the focused display
+WMBufferMask wm_state_get_view(const WMState *state);
+
+// buffers shown on any display (their apps are on screen)
+WMBufferMask wm_state_get_shown(const WMState *state);
+
+// buffers shown on a display, 0 if it shows nothing or doesn't exist
+WMBufferMask wm_state_display_view(const WMState *state, int display);
+
+// set the active (primary) buffer of the focused display and the buffers
+// shown with it. Buffers shown on another display move here; a display left
+// with nothing shows the buffers given up here instead (they swap)
+void wm_state_set_view(WMState *state, int primary_buffer,
+                       WMBufferMask view_mask);
+
+// compute the view with buffer_index toggled in/out and its primary buffer,
+// returns false if the view would become empty
+bool wm_state_toggled_view(const WMState *state, int buffer_index,
+                           int *out_primary, WMBufferMask *out_view);
+
 // get all pids in a buffer, returns count
 int wm_state_get_buffer_pids(const WMState *state, int buffer_index,
                              pid_t *out_pids, int max_pids);
 
+// get pids visible in view_mask but not in exclude_mask, returns count
+// (exclude the old view to get the apps a view switch has to show/hide)
+int wm_state_get_view_pids(const WMState *state, WMBufferMask view_mask,
+                           WMBufferMask exclude_mask, pid_t *out_pids,
+                           int max_pids);
+
 // record that an app was focused in its buffer
 void wm_state_set_focused(WMState *state, pid_t pid);
 
 // set app floating state
 void wm_state_set_floating(WMState *state, pid_t pid, bool is_floating);
 
+// smallest size pid's window accepts (state->min_sizes), 0 where unknown
+WMSize wm_state_min_size(const WMState *state, pid_t pid);
+
+// pid's window was asked for the frame requested and took the size
+// accepted: learn its bundle's minimum (state->min_sizes), no larger than
+// the usable area of the display under requested. Returns true, and bumps
+// the version (tilings made before are stale), if it changed
+bool wm_state_learn_min_size(WMState *state, pid_t pid, WMRect requested,
+                             WMSize accepted);
+
+// install backend hooks, call before registering apps
+void wm_state_set_backend_hooks(WMState *state, const WMBackendHooks *hooks);
+
+// get the backend handle of an app, acquiring it if it was invalidated.
+// out_generation (optional) tells callers caching the handle when it changed
+void *wm_state_backend_handle(WMState *state, pid_t pid,
+                              uint32_t *out_generation);
+
+// release the backend handle of an app (e.g. its window went away), the next
+// wm_state_backend_handle call acquires a fresh one
+void wm_state_invalidate_backend(WMState *state, pid_t pid);
+
 // debug
 void wm_state_check_invariants(const WMState *state);
 
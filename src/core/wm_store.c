@@ -0,0 +1,155 @@
+#include "wm_store.h"
+#include "wm_config.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+uint32_t wm_store_hash(const void *data, size_t size) {
+  const uint8_t *bytes = data;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// bundle hash as stored in slots (never 0, which marks an empty slot)
+static uint32_t bundle_key(const char *bundle_identifier) {
+  uint32_t hash = wm_config_hash_bundle(bundle_identifier);
+  return hash == 0 ? 1 : hash;
+}
+
+static size_t image_size(const WMStoreLayout *layout) {
+  return sizeof(WMStoreHeader) + layout->slot_count * layout->slot_size;
+}
+
+static WMStoreKey *slot_at(const WMStoreLayout *layout, const void *image,
+                           uint32_t index) {
+  const uint8_t *slots = (const uint8_t *)image + sizeof(WMStoreHeader);
+  index &= (uint32_t)layout->slot_count - 1;
+  return (WMStoreKey *)(slots + index * layout->slot_size);
+}
+
+static uint32_t image_checksum(const WMStoreLayout *layout,
+                               const void *image) {
+  return wm_store_hash((const uint8_t *)image + sizeof(WMStoreHeader),
+                       image_size(layout) - sizeof(WMStoreHeader));
+}
+
+void wm_store_init(WMStoreTable *table, const WMStoreLayout *layout,
+                   void *image) {
+  memset(table, 0, sizeof(*table));
+  table->layout = layout;
+  memset(image, 0, image_size(layout));
+  WMStoreHeader *header = image;
+  header->magic = layout->magic;
+  header->version = layout->version;
+  header->slot_count = layout->slot_count;
+}
+
+void *wm_store_find(const WMStoreTable *table, const void *image,
+                    const char *bundle_identifier) {
+  if (table->layout == NULL || bundle_identifier == NULL ||
+      bundle_identifier[0] == '\0')
+    return NULL;
+
+  uint32_t hash = bundle_key(bundle_identifier);
+  for (int i = 0; i < WM_STORE_MAX_PROBE; i++) {
+    WMStoreKey *key = slot_at(table->layout, image, hash + (uint32_t)i);
+    if (key->bundle_hash == hash &&
+        strncmp(key->bundle_identifier, bundle_identifier,
+                WM_STORE_KEY_SIZE) == 0)
+      return key;
+  }
+  return NULL;
+}
+
+void *wm_store_claim(WMStoreTable *table, void *image,
+                     const char *bundle_identifier) {
+  WMStoreKey *key = wm_store_find(table, image, bundle_identifier);
+  if (key != NULL || table->layout == NULL || bundle_identifier == NULL ||
+      bundle_identifier[0] == '\0')
+    return key;
+
+  // a free slot in the probe window, else the one worth least there
+  const WMStoreLayout *layout = table->layout;
+  uint32_t hash = bundle_key(bundle_identifier);
+  WMStoreKey *victim = NULL;
+  for (int i = 0; i < WM_STORE_MAX_PROBE; i++) {
+    WMStoreKey *candidate = slot_at(layout, image, hash + (uint32_t)i);
+    if (candidate->bundle_hash == 0) {
+      victim = candidate;
+      table->entry_count++;
+      break;
+    }
+    if (victim == NULL || layout->worth(candidate) < layout->worth(victim))
+      victim = candidate;
+  }
+  if (victim->bundle_hash != 0)
+    table->evictions++;
+
+  memset(victim, 0, layout->slot_size);
+  victim->bundle_hash = hash;
+  strncpy(victim->bundle_identifier, bundle_identifier,
+          WM_STORE_KEY_SIZE - 1);
+  return victim;
+}
+
+bool wm_store_read_file(const char *path, void *data, size_t size) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  // single read of the whole image
+  ssize_t read_size = read(fd, data, size);
+  close(fd);
+  return read_size == (ssize_t)size;
+}
+
+bool wm_store_write_file(const char *path, const void *data, size_t size) {
+  char temporary[1024];
+  if (snprintf(temporary, sizeof(temporary), "%s.tmp", path) >=
+      (int)sizeof(temporary))
+    return false;
+
+  int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+    return false;
+
+  ssize_t written = write(fd, data, size);
+  close(fd);
+  if (written != (ssize_t)size || rename(temporary, path) != 0) {
+    unlink(temporary);
+    return false;
+  }
+  return true;
+}
+
+int wm_store_load(const WMStoreLayout *layout, void *image, const char *path) {
+  if (!wm_store_read_file(path, image, image_size(layout)))
+    return -1;
+
+  const WMStoreHeader *header = image;
+  if (header->magic != layout->magic ||
+      header->version != layout->version ||
+      header->slot_count != layout->slot_count ||
+      header->checksum != image_checksum(layout, image))
+    return -1;
+
+  int used = 0;
+  for (uint32_t i = 0; i < layout->slot_count; i++) {
+    WMStoreKey *key = slot_at(layout, image, i);
+    key->bundle_identifier[WM_STORE_KEY_SIZE - 1] = '\0';
+    if (key->bundle_hash != 0)
+      used++;
+  }
+  return used;
+}
+
+bool wm_store_save(const WMStoreTable *table, void *image, const char *path) {
+  const WMStoreLayout *layout = table->layout;
+  ((WMStoreHeader *)image)->checksum = image_checksum(layout, image);
+  return wm_store_write_file(path, image, image_size(layout));
+}
@@ -0,0 +1,80 @@
+#ifndef WM_STORE_H
+#define WM_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define WM_STORE_MAX_PROBE 16 // slots a bundle may live in past its home
+#define WM_STORE_KEY_SIZE 128 // bundle identifier bytes, with terminator
+
+// FNV-1a over a byte range (checksums of the persisted stores)
+uint32_t wm_store_hash(const void *data, size_t size);
+
+// first member of every slot of a per-bundle table
+typedef struct {
+  uint32_t bundle_hash; // wm_config_hash_bundle (never 0), 0 = empty
+  char bundle_identifier[WM_STORE_KEY_SIZE];
+} WMStoreKey;
+
+// fixed header of a table image, checksum covers the slots
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t slot_count;
+  uint32_t checksum; // FNV-1a of the slots
+  uint32_t reserved;
+} WMStoreHeader;
+
+// one kind of per-bundle table. Its image (the whole file, read and written
+// in one go) is a WMStoreHeader followed by slot_count slots of slot_size
+// bytes, each starting with its WMStoreKey
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t slot_count; // power of two
+  size_t slot_size;
+  // what a slot is worth keeping: when a bundle's probe window is full the
+  // one worth least makes room
+  uint32_t (*worth)(const void *slot);
+} WMStoreLayout;
+
+// open-addressing table of per-bundle slots in an image owned by its store,
+// probed from the bundle hash. Fixed size, single threaded
+typedef struct {
+  const WMStoreLayout *layout;
+  int entry_count;    // used slots
+  uint32_t evictions; // bundles dropped to make room
+} WMStoreTable;
+
+// initialize an empty table of layout, zeroing image
+void wm_store_init(WMStoreTable *table, const WMStoreLayout *layout,
+                   void *image);
+
+// the bundle's slot, NULL if it has none, the identifier is empty or the
+// table was never initialized
+void *wm_store_find(const WMStoreTable *table, const void *image,
+                    const char *bundle_identifier);
+
+// the bundle's slot, claimed (zeroed but for its key) if it has none. NULL
+// if the identifier is empty
+void *wm_store_claim(WMStoreTable *table, void *image,
+                     const char *bundle_identifier);
+
+// read a table of layout saved by wm_store_save into image (scratch of the
+// store's image size, adopted by the caller). Returns its used slots, -1 if
+// the file is missing, from another version or corrupt
+int wm_store_load(const WMStoreLayout *layout, void *image, const char *path);
+
+// write image (to a temporary file renamed over path)
+bool wm_store_save(const WMStoreTable *table, void *image, const char *path);
+
+// read size bytes of the file at path in one go. False if it is missing or
+// shorter
+bool wm_store_read_file(const char *path, void *data, size_t size);
+
+// write size bytes to a temporary file renamed over path, so a crash leaves
+// the old file or the new one
+bool wm_store_write_file(const char *path, const void *data, size_t size);
+
+#endif
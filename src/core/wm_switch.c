@@ -0,0 +1,250 @@
+#include "wm_switch.h"
+#include "wm_latency.h"
+#include "wm_plans.h"
+#include "wm_state.h"
+#include <string.h>
+
+#define NS_PER_MS 1000000ull
+
+static const uint32_t STAGE_TIMEOUT_MS[WM_SWITCH_STAGE_COUNT] = {
+    [WM_SWITCH_UNHIDE] = WM_SWITCH_UNHIDE_TIMEOUT_MS,
+    [WM_SWITCH_RAISE] = WM_SWITCH_RAISE_TIMEOUT_MS,
+    [WM_SWITCH_ACTIVATE] = WM_SWITCH_ACTIVATE_TIMEOUT_MS,
+    [WM_SWITCH_HIDE] = WM_SWITCH_HIDE_TIMEOUT_MS,
+    [WM_SWITCH_LAYOUT] = WM_SWITCH_LAYOUT_TIMEOUT_MS,
+    [WM_SWITCH_SETTLE] = WM_SWITCH_SETTLE_MS,
+};
+
+static const char *STAGE_NAMES[WM_SWITCH_STAGE_COUNT] = {
+    [WM_SWITCH_IDLE] = "idle",         [WM_SWITCH_UNHIDE] = "unhide",
+    [WM_SWITCH_RAISE] = "raise",       [WM_SWITCH_ACTIVATE] = "activate",
+    [WM_SWITCH_HIDE] = "hide",         [WM_SWITCH_LAYOUT] = "layout",
+    [WM_SWITCH_SETTLE] = "settle",
+};
+
+static uint64_t now(const WMSwitch *sw) {
+  return sw->backend.clock(sw->backend.context);
+}
+
+void wm_switch_init(WMSwitch *sw, const WMSwitchBackend *backend) {
+  memset(sw, 0, sizeof(*sw));
+  sw->backend = *backend;
+  sw->stage = WM_SWITCH_IDLE;
+}
+
+// order pids by their estimated latency of op, slowest first, so slow apps
+// get their request early and overlap with the fast ones. Stable, unknown
+// apps keep their place after the known slow ones
+static void order_slowest_first(const WMLatencyModel *latency,
+                                const WMState *state, pid_t *pids, int count,
+                                WMLatencyOp op) {
+  if (latency == NULL || count < 2)
+    return;
+
+  uint64_t estimates[WM_MAX_APPS];
+  for (int i = 0; i < count; i++) {
+    const WMApp *app = wm_state_find_app(state, pids[i]);
+    estimates[i] =
+        app ? wm_latency_estimate(latency, app->bundle_identifier, op) : 0;
+  }
+
+  for (int i = 1; i < count; i++) {
+    pid_t pid = pids[i];
+    uint64_t estimate = estimates[i];
+    int j = i;
+    for (; j > 0 && estimates[j - 1] < estimate; j--) {
+      pids[j] = pids[j - 1];
+      estimates[j] = estimates[j - 1];
+    }
+    pids[j] = pid;
+    estimates[j] = estimate;
+  }
+}
+
+// the view's apps with the one to focus last (last focused in the primary
+// buffer if it is in the view, else the first one)
+static void plan_show(const WMLatencyModel *latency, const WMState *state,
+                      WMSwitchPlan *plan) {
+  pid_t pids[WM_MAX_APPS];
+  int count = wm_state_get_view_pids(state, plan->view, 0, pids, WM_MAX_APPS);
+
+  plan->focus_pid = count > 0 ? pids[0] : 0;
+  pid_t last_focused = state->buffers[plan->primary_buffer].last_focused_pid;
+  for (int i = 0; i < count && last_focused > 0; i++) {
+    if (pids[i] == last_focused) {
+      plan->focus_pid = last_focused;
+      break;
+    }
+  }
+
+  plan->show_count = 0;
+  for (int i = 0; i < count; i++) {
+    if (pids[i] != plan->focus_pid)
+      plan->show[plan->show_count++] = pids[i];
+  }
+  order_slowest_first(latency, state, plan->show, plan->show_count,
+                      WM_OP_UNHIDE);
+  if (plan->focus_pid > 0)
+    plan->show[plan->show_count++] = plan->focus_pid;
+}
+
+void wm_switch_plan(const WMLatencyModel *latency, const WMState *state,
+                    WMBufferMask visible, WMBufferMask shown,
+                    WMSwitchPlan *plan) {
+  plan_show(latency, state, plan);
+  plan->hide_count = (int16_t)wm_state_get_view_pids(state, visible, shown,
+                                                     plan->hide, WM_MAX_APPS);
+  order_slowest_first(latency, state, plan->hide, plan->hide_count,
+                      WM_OP_HIDE);
+  plan->frame_count = -1;
+}
+
+// run stages from stage on until one has to wait for completions or its
+// deadline
+static void run_stages(WMSwitch *sw, WMSwitchStage stage);
+
+static void finish(WMSwitch *sw, uint64_t end_ns) {
+  sw->current.total_ns = end_ns - sw->begin_ns;
+  sw->last = sw->current;
+  sw->switches++;
+  sw->stage = WM_SWITCH_IDLE;
+  sw->pending_count = 0;
+
+  if (sw->backend.finish)
+    sw->backend.finish(sw, sw->backend.context);
+}
+
+// close the current stage and start the next one
+static void end_stage(WMSwitch *sw, bool timed_out) {
+  WMSwitchStage stage = sw->stage;
+  uint64_t end_ns = now(sw);
+  sw->current.stage_ns[stage] = end_ns - sw->stage_begin_ns;
+  if (timed_out) {
+    sw->current.timed_out |= (uint8_t)(1u << stage);
+    sw->timeouts[stage]++;
+  }
+  if (stage == WM_SWITCH_ACTIVATE)
+    sw->current.focus_ns = end_ns - sw->begin_ns;
+
+  if (stage == WM_SWITCH_SETTLE)
+    finish(sw, end_ns);
+  else
+    run_stages(sw, stage + 1);
+}
+
+static void run_stages(WMSwitch *sw, WMSwitchStage stage) {
+  sw->stage = stage;
+  sw->stage_begin_ns = now(sw);
+  sw->deadline_ns = sw->stage_begin_ns + STAGE_TIMEOUT_MS[stage] * NS_PER_MS;
+  sw->pending_count = 0;
+
+  uint32_t switches = sw->switches + sw->merged;
+  sw->backend.run_stage(sw, stage, sw->backend.context);
+
+  // run_stage began another switch, it is running its own stages
+  if (sw->switches + sw->merged != switches || sw->stage != stage)
+    return;
+
+  // settle only ends at its deadline, other stages end with their last
+  // completion
+  if (stage != WM_SWITCH_SETTLE && sw->pending_count == 0)
+    end_stage(sw, false);
+}
+
+bool wm_switch_begin(WMSwitch *sw, WMState *state, int primary_buffer,
+                     WMBufferMask view_mask) {
+  if (primary_buffer < 0 || primary_buffer >= WM_MAX_BUFFERS ||
+      (view_mask & WM_BUFFER_BIT(primary_buffer)) == 0)
+    return false;
+
+  WMBufferMask old_view = wm_state_get_view(state);
+  if (state->active_buffer == primary_buffer && old_view == view_mask)
+    return false; // no-op if same view (a switch there keeps running)
+
+  // apps on screen: the settled views of every display, plus whatever a
+  // switch in flight may already have shown
+  WMBufferMask shown_view = wm_state_get_shown(state);
+  WMBufferMask visible = shown_view;
+  if (sw->stage != WM_SWITCH_IDLE) {
+    shown_view = sw->plan.shown_view;
+    visible = sw->plan.shown_view | sw->plan.view;
+    sw->merged++;
+  }
+
+  // a plan made ready while idle holds until the state changes
+  const WMSwitchPlan *ready = NULL;
+  if (sw->plans != NULL && sw->stage == WM_SWITCH_IDLE)
+    ready = wm_plans_lookup(sw->plans, state, sw->latency, primary_buffer,
+                            view_mask);
+
+  wm_state_set_view(state, primary_buffer, view_mask);
+
+  WMSwitchPlan *plan = &sw->plan;
+  if (ready != NULL) {
+    *plan = *ready;
+  } else {
+    plan->primary_buffer = primary_buffer;
+    plan->view = wm_state_get_view(state);
+    plan->shown_view = shown_view;
+    wm_switch_plan(sw->latency, state, visible, wm_state_get_shown(state),
+                   plan);
+  }
+  plan->version = state->version;
+
+  sw->begin_ns = now(sw);
+  memset(&sw->current, 0, sizeof(sw->current));
+  run_stages(sw, WM_SWITCH_UNHIDE);
+  return true;
+}
+
+int wm_switch_ready_frames(const WMSwitch *sw, const WMState *state,
+                           const WMFrameChange **frames) {
+  if (sw->stage == WM_SWITCH_IDLE || sw->plan.frame_count < 0 ||
+      sw->plan.version != state->version)
+    return -1;
+  *frames = sw->plan.frames;
+  return sw->plan.frame_count;
+}
+
+void wm_switch_expect(WMSwitch *sw, pid_t pid) {
+  if (sw->stage == WM_SWITCH_IDLE || sw->pending_count >= WM_MAX_APPS)
+    return;
+  sw->pending[sw->pending_count++] = pid;
+}
+
+bool wm_switch_complete(WMSwitch *sw, WMSwitchStage stage, pid_t pid) {
+  if (sw->stage == WM_SWITCH_IDLE || sw->stage != stage)
+    return false;
+
+  for (int i = 0; i < sw->pending_count; i++) {
+    if (sw->pending[i] == pid) {
+      sw->pending[i] = sw->pending[--sw->pending_count];
+      if (sw->pending_count == 0)
+        end_stage(sw, false);
+      return true;
+    }
+  }
+  return false;
+}
+
+void wm_switch_tick(WMSwitch *sw) {
+  if (sw->stage == WM_SWITCH_IDLE || now(sw) < sw->deadline_ns)
+    return;
+
+  // settle is meant to run out, anything else gave up on its completions
+  end_stage(sw, sw->stage != WM_SWITCH_SETTLE);
+}
+
+uint64_t wm_switch_next_deadline(const WMSwitch *sw) {
+  return sw->stage == WM_SWITCH_IDLE ? 0 : sw->deadline_ns;
+}
+
+bool wm_switch_active(const WMSwitch *sw) {
+  return sw->stage != WM_SWITCH_IDLE;
+}
+
+const char *wm_switch_stage_name(WMSwitchStage stage) {
+  if (stage < WM_SWITCH_IDLE || stage >= WM_SWITCH_STAGE_COUNT)
+    return "unknown";
+  return STAGE_NAMES[stage];
+}
@@ -0,0 +1,134 @@
+#ifndef WM_SWITCH_H
+#define WM_SWITCH_H
+
+#include "wm_layout.h"
+#include "wm_runtime.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+struct WMLatencyModel;
+struct WMPlanCache;
+struct WMState;
+
+// stages of a buffer switch, run in this order
+typedef enum {
+  WM_SWITCH_IDLE = 0, // no switch in flight
+  WM_SWITCH_UNHIDE,   // unhide the apps of the new view
+  WM_SWITCH_RAISE,    // raise their windows, focus target last
+  WM_SWITCH_ACTIVATE, // activate the focus target
+  WM_SWITCH_HIDE,     // hide the apps that left the view
+  WM_SWITCH_LAYOUT,   // tile the new view
+  WM_SWITCH_SETTLE,   // quiet window for late activations, then refocus
+  WM_SWITCH_STAGE_COUNT,
+} WMSwitchStage;
+
+// per-stage deadlines: a stage still waiting for completions when its
+// deadline passes is abandoned and the switch moves on
+#define WM_SWITCH_UNHIDE_TIMEOUT_MS 200
+#define WM_SWITCH_RAISE_TIMEOUT_MS 100
+#define WM_SWITCH_ACTIVATE_TIMEOUT_MS 200
+#define WM_SWITCH_HIDE_TIMEOUT_MS 200
+#define WM_SWITCH_LAYOUT_TIMEOUT_MS 100
+#define WM_SWITCH_SETTLE_MS 50 // settle always lasts this long
+
+struct WMSwitch;
+
+// platform side of a switch. run_stage starts a stage and calls
+// wm_switch_expect for each completion event it is waiting for; a stage that
+// expects nothing is done when run_stage returns. finish runs once the last
+// stage is over (not for switches replaced by a newer one)
+typedef struct {
+  void (*run_stage)(struct WMSwitch *sw, WMSwitchStage stage, void *context);
+  void (*finish)(struct WMSwitch *sw, void *context);
+  uint64_t (*clock)(void *context); // monotonic nanoseconds
+  void *context;
+} WMSwitchBackend;
+
+// what a switch has to do, computed from the state when it begins
+typedef struct {
+  int primary_buffer;      // buffer that gets focus
+  WMBufferMask view;       // target view
+  WMBufferMask shown_view; // on screen before (every display), raising
+                           // skips its apps
+  pid_t show[WM_MAX_APPS]; // apps of the view, slowest to unhide first,
+                           // focus target last
+  int16_t show_count;      // number of apps to show
+  pid_t hide[WM_MAX_APPS]; // apps to hide, slowest first
+  int16_t hide_count;      // number of apps to hide
+  pid_t focus_pid;         // app to activate, 0 = empty view
+  uint32_t version;        // state version once the switch began
+  WMFrameChange frames[WM_MAX_APPS]; // tiling of the view, from a ready plan
+  int16_t frame_count;     // -1 = tile it at the layout stage
+} WMSwitchPlan;
+
+// timing of the last finished switch
+typedef struct {
+  uint64_t stage_ns[WM_SWITCH_STAGE_COUNT]; // time spent in each stage
+  uint64_t focus_ns;                        // begin to focus target active
+  uint64_t total_ns;                        // begin to finish
+  uint8_t timed_out;                        // bit per stage that hit deadline
+} WMSwitchTiming;
+
+// buffer switch state machine. Single threaded, fixed size
+typedef struct WMSwitch {
+  WMSwitchBackend backend;
+  WMSwitchStage stage;        // stage in flight, IDLE = none
+  WMSwitchPlan plan;          // switch in flight
+  uint64_t begin_ns;          // when the switch began
+  uint64_t stage_begin_ns;    // when the current stage began
+  uint64_t deadline_ns;       // current stage gives up at this time
+  pid_t pending[WM_MAX_APPS]; // completions the stage waits for
+  int16_t pending_count;      // number of pending completions
+  WMSwitchTiming current;     // timing being collected
+  WMSwitchTiming last;        // timing of the last finished switch
+  uint32_t switches;          // switches finished
+  uint32_t merged;            // switches replaced by a newer one
+  uint32_t timeouts[WM_SWITCH_STAGE_COUNT]; // stages abandoned at deadline
+  const struct WMLatencyModel *latency; // orders the plan, NULL = as listed
+  struct WMPlanCache *plans; // plans made ready when idle, NULL = none
+} WMSwitch;
+
+// initialize an idle switch driving backend
+void wm_switch_init(WMSwitch *sw, const WMSwitchBackend *backend);
+
+// switch state to a view of several buffers (primary_buffer gets focus) and
+// start running its stages. A switch in flight is cancelled: its remaining
+// stages are dropped and the apps it may have left on screen are merged into
+// the new hide list. Returns false for an invalid or unchanged view
+bool wm_switch_begin(WMSwitch *sw, struct WMState *state, int primary_buffer,
+                     WMBufferMask view_mask);
+
+// fill the apps of plan (primary_buffer, view and shown_view set) as
+// wm_switch_begin does: visible is on screen now, shown will be after the
+// switch. Ordered by latency if not NULL, frames are left to the layout stage
+void wm_switch_plan(const struct WMLatencyModel *latency,
+                    const struct WMState *state, WMBufferMask visible,
+                    WMBufferMask shown, WMSwitchPlan *plan);
+
+// the frames of the switch's view if it began from a ready plan and the
+// state didn't change since, else -1 (tile the view)
+int wm_switch_ready_frames(const WMSwitch *sw, const struct WMState *state,
+                           const WMFrameChange **frames);
+
+// called from run_stage: wait for a completion event from pid
+void wm_switch_expect(WMSwitch *sw, pid_t pid);
+
+// a completion event arrived (app unhidden, activated or hidden). Events for
+// another stage or an unexpected pid are ignored. Returns true if it belonged
+// to the switch in flight
+bool wm_switch_complete(WMSwitch *sw, WMSwitchStage stage, pid_t pid);
+
+// advance past a stage whose deadline passed, call when the deadline fires
+void wm_switch_tick(WMSwitch *sw);
+
+// when wm_switch_tick has to run next, 0 = idle
+uint64_t wm_switch_next_deadline(const WMSwitch *sw);
+
+// a switch is in flight (focus changes are its own, not the user's)
+bool wm_switch_active(const WMSwitch *sw);
+
+// name of a stage for logs
+const char *wm_switch_stage_name(WMSwitchStage stage);
+
+#endif
@@ -0,0 +1,251 @@
+#include "wm_timer.h"
+#include <string.h>
+
+#define SLOT_MASK (WM_TIMER_SLOTS - 1)
+#define FIRING_LIST (WM_TIMER_LEVELS * WM_TIMER_SLOTS)
+#define NONE -1
+
+// ticks one slot of a level spans
+#define LEVEL_SHIFT(level) ((level) * WM_TIMER_SLOT_BITS)
+
+// last tick the wheel can hold past current
+#define MAX_DELTA ((1ull << (WM_TIMER_LEVELS * WM_TIMER_SLOT_BITS)) - 1)
+
+static uint64_t to_tick(uint64_t ns) {
+  // round up, a timer never fires early
+  return (ns + WM_TIMER_TICK_NS - 1) / WM_TIMER_TICK_NS;
+}
+
+void wm_timer_init(WMTimerWheel *wheel, uint64_t now_ns) {
+  memset(wheel, 0, sizeof(*wheel));
+  for (int i = 0; i < FIRING_LIST + 1; i++)
+    wheel->heads[i] = NONE;
+  for (int i = 0; i < WM_TIMER_MAX; i++)
+    wheel->timers[i].next = (int16_t)(i + 1 < WM_TIMER_MAX ? i + 1 : NONE);
+  wheel->free_head = 0;
+  wheel->current = now_ns / WM_TIMER_TICK_NS;
+}
+
+static void link_timer(WMTimerWheel *wheel, int index, int list) {
+  WMTimer *timer = &wheel->timers[index];
+  timer->list = (int16_t)list;
+  timer->prev = NONE;
+  timer->next = wheel->heads[list];
+  if (timer->next != NONE)
+    wheel->timers[timer->next].prev = (int16_t)index;
+  wheel->heads[list] = (int16_t)index;
+
+  if (list != FIRING_LIST)
+    wheel->occupied[list / WM_TIMER_SLOTS] |= 1ull << (list & SLOT_MASK);
+}
+
+static void unlink_timer(WMTimerWheel *wheel, int index) {
+  WMTimer *timer = &wheel->timers[index];
+  if (timer->prev != NONE)
+    wheel->timers[timer->prev].next = timer->next;
+  else
+    wheel->heads[timer->list] = timer->next;
+  if (timer->next != NONE)
+    wheel->timers[timer->next].prev = timer->prev;
+
+  int list = timer->list;
+  if (list != FIRING_LIST && wheel->heads[list] == NONE)
+    wheel->occupied[list / WM_TIMER_SLOTS] &= ~(1ull << (list & SLOT_MASK));
+}
+
+// put a timer on the slot of the lowest level that reaches its tick
+static void place_timer(WMTimerWheel *wheel, int index) {
+  WMTimer *timer = &wheel->timers[index];
+  if (timer->expires < wheel->current)
+    timer->expires = wheel->current;
+  uint64_t delta = timer->expires - wheel->current;
+  if (delta > MAX_DELTA) {
+    delta = MAX_DELTA;
+    timer->expires = wheel->current + MAX_DELTA;
+  }
+
+  int level = 0;
+  while (level < WM_TIMER_LEVELS - 1 &&
+         delta >= 1ull << LEVEL_SHIFT(level + 1))
+    level++;
+  int slot = (int)((timer->expires >> LEVEL_SHIFT(level)) & SLOT_MASK);
+  link_timer(wheel, index, level * WM_TIMER_SLOTS + slot);
+}
+
+static void free_timer(WMTimerWheel *wheel, int index) {
+  WMTimer *timer = &wheel->timers[index];
+  timer->callback = NULL;
+  timer->generation++;
+  timer->next = wheel->free_head;
+  wheel->free_head = (int16_t)index;
+  wheel->count--;
+}
+
+WMTimerId wm_timer_add(WMTimerWheel *wheel, uint64_t deadline_ns,
+                       WMTimerCallback callback, void *context,
+                       int64_t argument) {
+  if (callback == NULL || wheel->free_head == NONE)
+    return 0;
+
+  int index = wheel->free_head;
+  WMTimer *timer = &wheel->timers[index];
+  wheel->free_head = timer->next;
+  wheel->count++;
+
+  timer->expires = to_tick(deadline_ns);
+  timer->callback = callback;
+  timer->context = context;
+  timer->argument = argument;
+  place_timer(wheel, index);
+
+  return ((uint32_t)timer->generation << 16) | (uint32_t)(index + 1);
+}
+
+bool wm_timer_cancel(WMTimerWheel *wheel, WMTimerId id) {
+  int index = (int)(id & 0xffff) - 1;
+  if (index < 0 || index >= WM_TIMER_MAX)
+    return false;
+
+  WMTimer *timer = &wheel->timers[index];
+  if (timer->callback == NULL || timer->generation != (uint16_t)(id >> 16))
+    return false;
+
+  unlink_timer(wheel, index);
+  free_timer(wheel, index);
+  return true;
+}
+
+// move the timers of a higher level slot down as the wheel reaches it
+static void cascade(WMTimerWheel *wheel, int level) {
+  int slot = (int)((wheel->current >> LEVEL_SHIFT(level)) & SLOT_MASK);
+  int list = level * WM_TIMER_SLOTS + slot;
+  int index = wheel->heads[list];
+  wheel->heads[list] = NONE;
+  wheel->occupied[level] &= ~(1ull << slot);
+
+  while (index != NONE) {
+    int next = wheel->timers[index].next;
+    place_timer(wheel, index);
+    wheel->cascaded++;
+    index = next;
+  }
+}
+
+// fire the timers of the level 0 slot of tick, current is already past it
+static int fire_slot(WMTimerWheel *wheel, uint64_t tick) {
+  int list = (int)(tick & SLOT_MASK);
+  int index = wheel->heads[list];
+  if (index == NONE)
+    return 0;
+
+  // detach the slot: callbacks adding timers for this tick land on the next
+  wheel->heads[list] = NONE;
+  wheel->occupied[0] &= ~(1ull << list);
+  wheel->heads[FIRING_LIST] = (int16_t)index;
+  for (int i = index; i != NONE; i = wheel->timers[i].next)
+    wheel->timers[i].list = FIRING_LIST;
+
+  // pop one at a time so callbacks can cancel the rest
+  int fired = 0;
+  while ((index = wheel->heads[FIRING_LIST]) != NONE) {
+    WMTimer *timer = &wheel->timers[index];
+    WMTimerCallback callback = timer->callback;
+    void *context = timer->context;
+    int64_t argument = timer->argument;
+    unlink_timer(wheel, index);
+    free_timer(wheel, index);
+
+    callback(context, argument);
+    fired++;
+  }
+  wheel->fired += (uint32_t)fired;
+  return fired;
+}
+
+int wm_timer_advance(WMTimerWheel *wheel, uint64_t now_ns) {
+  uint64_t target = now_ns / WM_TIMER_TICK_NS;
+  int fired = 0;
+
+  while (wheel->current <= target) {
+    // nothing pending: jump straight to the target
+    if (wheel->count == 0) {
+      wheel->current = target + 1;
+      break;
+    }
+
+    // entering a new level 0 rotation, pull the higher levels down (top
+    // first, their timers may land on a lower level reached right now)
+    uint64_t tick = wheel->current;
+    if ((tick & SLOT_MASK) == 0) {
+      for (int level = WM_TIMER_LEVELS - 1; level > 0; level--) {
+        if ((tick & ((1ull << LEVEL_SHIFT(level)) - 1)) == 0)
+          cascade(wheel, level);
+      }
+    }
+
+    wheel->current = tick + 1;
+    fired += fire_slot(wheel, tick);
+
+    // skip empty slots up to the next occupied one, the end of the
+    // rotation or the target
+    uint64_t next = (tick | SLOT_MASK) + 1;
+    if (wheel->current < next) {
+      uint64_t ahead = wheel->occupied[0] >> (wheel->current & SLOT_MASK);
+      if (ahead != 0)
+        next = wheel->current + (uint64_t)__builtin_ctzll(ahead);
+    }
+    if (next > target + 1)
+      next = target + 1;
+    if (next > wheel->current)
+      wheel->current = next;
+  }
+  return fired;
+}
+
+// earliest expiry on the first occupied slot of a level at or after the
+// current position, UINT64_MAX = level empty
+static uint64_t level_min(const WMTimerWheel *wheel, int level) {
+  uint64_t occupied = wheel->occupied[level];
+  if (occupied == 0)
+    return UINT64_MAX;
+
+  // slots are in time order starting at the current position. Past the
+  // start of its span the current slot was cascaded and only holds the next
+  // lap
+  int shift = LEVEL_SHIFT(level);
+  int start = (int)((wheel->current >> shift) & SLOT_MASK);
+  if ((wheel->current & ((1ull << shift) - 1)) != 0)
+    start = (start + 1) & SLOT_MASK;
+  uint64_t rotated = start == 0 ? occupied
+                                : (occupied >> start) |
+                                      (occupied << (WM_TIMER_SLOTS - start));
+  int slot = (start + __builtin_ctzll(rotated)) & SLOT_MASK;
+
+  uint64_t earliest = UINT64_MAX;
+  int list = level * WM_TIMER_SLOTS + slot;
+  for (int i = wheel->heads[list]; i != NONE; i = wheel->timers[i].next) {
+    if (wheel->timers[i].expires < earliest)
+      earliest = wheel->timers[i].expires;
+  }
+  return earliest;
+}
+
+uint64_t wm_timer_next_deadline(const WMTimerWheel *wheel) {
+  if (wheel->count == 0)
+    return 0;
+
+  uint64_t earliest = UINT64_MAX;
+  for (int level = 0; level < WM_TIMER_LEVELS; level++) {
+    uint64_t expires = level_min(wheel, level);
+    if (expires < earliest)
+      earliest = expires;
+  }
+  return earliest * WM_TIMER_TICK_NS;
+}
+
+uint32_t wm_timer_backoff_ms(uint32_t base_ms, int attempt, uint32_t max_ms) {
+  if (attempt < 0)
+    attempt = 0;
+  uint64_t delay = (uint64_t)base_ms << (attempt < 32 ? attempt : 32);
+  return delay > max_ms ? max_ms : (uint32_t)delay;
+}
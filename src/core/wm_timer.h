@@ -0,0 +1,65 @@
+#ifndef WM_TIMER_H
+#define WM_TIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define WM_TIMER_MAX 256      // timers pending at once
+#define WM_TIMER_LEVELS 4     // wheel levels, each 64x coarser than the last
+#define WM_TIMER_SLOT_BITS 6  // 64 slots per level
+#define WM_TIMER_SLOTS (1 << WM_TIMER_SLOT_BITS)
+#define WM_TIMER_TICK_NS 1000000ull // 1 ms resolution, ~4.6 h range
+
+// timer handle, 0 = none. Stale handles (fired or cancelled) are harmless
+typedef uint32_t WMTimerId;
+
+typedef void (*WMTimerCallback)(void *context, int64_t argument);
+
+typedef struct {
+  uint64_t expires;         // tick the timer fires at
+  WMTimerCallback callback; // NULL = free
+  void *context;
+  int64_t argument;
+  int16_t next; // next timer in the same list, -1 = end
+  int16_t prev; // previous timer in the same list, -1 = head
+  int16_t list; // list the timer is on (level * slots + slot)
+  uint16_t generation;
+} WMTimer;
+
+// hierarchical timing wheel: O(1) add and cancel, expiry cost proportional
+// to the timers that fire. Times are monotonic nanoseconds from the caller,
+// fixed size, single threaded
+typedef struct {
+  WMTimer timers[WM_TIMER_MAX];
+  int16_t heads[WM_TIMER_LEVELS * WM_TIMER_SLOTS + 1]; // lists, last=firing
+  uint64_t occupied[WM_TIMER_LEVELS]; // bit per non-empty slot
+  int16_t free_head;                  // free timers, linked through next
+  int16_t count;                      // pending timers
+  uint64_t current;                   // first tick not processed yet
+  uint32_t fired;                     // timers fired since init
+  uint32_t cascaded;                  // timers moved down a level
+} WMTimerWheel;
+
+// initialize an empty wheel starting at now_ns
+void wm_timer_init(WMTimerWheel *wheel, uint64_t now_ns);
+
+// call callback(context, argument) once deadline_ns is reached (a deadline
+// in the past fires on the next advance). Returns 0 if the wheel is full
+WMTimerId wm_timer_add(WMTimerWheel *wheel, uint64_t deadline_ns,
+                       WMTimerCallback callback, void *context,
+                       int64_t argument);
+
+// drop a pending timer, returns false if it already fired or was cancelled
+bool wm_timer_cancel(WMTimerWheel *wheel, WMTimerId id);
+
+// fire every timer due at now_ns, in deadline order. Callbacks may add and
+// cancel timers. Returns the number fired
+int wm_timer_advance(WMTimerWheel *wheel, uint64_t now_ns);
+
+// earliest pending deadline (ns), 0 = none. The one wakeup the host arms
+uint64_t wm_timer_next_deadline(const WMTimerWheel *wheel);
+
+// delay of retry attempt (0-based): base_ms doubled per attempt, capped
+uint32_t wm_timer_backoff_ms(uint32_t base_ms, int attempt, uint32_t max_ms);
+
+#endif
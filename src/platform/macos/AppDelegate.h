@@ -10,4 +10,10 @@
 
 @end
 
+// path of a dwin data file (~/Library/Application Support/dwin/<name>)
+const char *app_data_path(NSString *name);
+
+// path of the user config (~/.config/.dwin)
+const char *app_config_path(void);
+
 #endif
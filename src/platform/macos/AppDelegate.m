@@ -1,16 +1,52 @@
 #import "AppDelegate.h"
+#import "mac_control.h"
 #import "mac_effects.h"
 #import "mac_event_tap.h"
 #import "mac_status_bar.h"
+#import "mac_timer.h"
 #import "wm_actions.h"
 #import "wm_layout.h"
+#include "wm_config_cache.h"
+#include "wm_display.h"
+#include "wm_events.h"
+#include "wm_hooks.h"
+#include "wm_log.h"
+#include "wm_mirror.h"
+#include "wm_placement.h"
+#include "wm_relayout.h"
+#include "wm_snapshot.h"
 #include "wm_state.h"
 #include <AppKit/AppKit.h>
 
 @implementation AppDelegate
 
-static WMConfig g_config;
+static WMConfigCache g_config_cache;
+static const WMConfig *g_config;
 static WMState g_state;
+static WMSnapshotWriter g_snapshot;
+static WMMirrorWriter g_mirror;
+static WMHookRunner g_hooks;
+static WMPlacementStore g_placements;
+
+// workspace events, drained as net results once a burst goes quiet
+static WMEventCoalescer g_events;
+static WMTimerId g_events_timer = 0;
+
+// apps not manageable yet (no bundle id or window right after launch),
+// retried with exponential backoff, one pending retry per pid
+#define REGISTER_RETRY_ATTEMPTS 6
+#define REGISTER_RETRY_BASE_MS 50
+#define REGISTER_RETRY_MAX_MS 1600
+#define REGISTER_RETRY_MAX_PENDING 16
+static pid_t g_retry_pids[REGISTER_RETRY_MAX_PENDING];
+
+// layout passes for app launches/quits, one per frame window
+static WMRelayout g_relayout;
+static WMTimerId g_relayout_timer = 0;
+
+// last tiling of every display, other displays only get what changed
+static WMDisplayLayout g_layouts[WM_MAX_DISPLAYS];
+static WMDisplayLayout g_next_layouts[WM_MAX_DISPLAYS];
 
 // blacklisted apps that we shouldn't manage
 static const char *BLACKLIST[] = {
@@ -55,16 +91,176 @@ static bool is_app_manageable(NSRunningApplication *app) {
   return true;
 }
 
+const char *app_data_path(NSString *name) {
+  NSString *dir = [NSSearchPathForDirectoriesInDomains(
+      NSApplicationSupportDirectory, NSUserDomainMask, YES).firstObject
+      stringByAppendingPathComponent:@"dwin"];
+  [[NSFileManager defaultManager] createDirectoryAtPath:dir
+                            withIntermediateDirectories:YES
+                                             attributes:nil
+                                                  error:nil];
+  return [[dir stringByAppendingPathComponent:name] fileSystemRepresentation];
+}
+
+const char *app_config_path(void) {
+  return [[NSHomeDirectory() stringByAppendingPathComponent:@".config/.dwin"]
+      fileSystemRepresentation];
+}
+
+// persist and publish state after a change, no-op if nothing changed since
+// last time
+static void state_changed(void) {
+  wm_snapshot_write(&g_snapshot, &g_state);
+  wm_mirror_write(&g_mirror, &g_state);
+  mac_control_publish();
+  mac_effects_state_changed();
+}
+
+// config hooks run on the events scripts can subscribe to
+static void dispatch_hooks(const WMControlEvent *events, int count) {
+  wm_hooks_dispatch(&g_hooks, events, count);
+}
+
+// hook diagnostics (runner thread), a record per run
+static void hook_finished(const WMHookResult *result, void *context) {
+  (void)context;
+  WM_LOG(WM_LOG_HOOK_DONE, result->hook + 1, result->status,
+         result->run_ns / 1e6, result->timed_out, result->wait_ns / 1e6);
+}
+
+// remember where the user put an app so its next launch lands there
+static void remember_placement(pid_t pid) {
+  const WMApp *app = wm_state_find_app(&g_state, pid);
+  if (app == NULL)
+    return;
+  wm_placement_record(&g_placements, app->bundle_identifier,
+                      wm_state_get_buffer_mask(&g_state, pid));
+}
+
+// queue the frames of next that differ from what display was last given
+// (all of them for the focused display, where apps may have been moved)
+static int queue_display_frames(int display, const WMDisplayLayout *next) {
+  WMDisplayLayout *previous = &g_layouts[display];
+  if (display == g_state.focused_display ||
+      previous->display_id != next->display_id) {
+    mac_effects_queue_frames(next->frames, next->count);
+    return next->count;
+  }
+
+  WMFrameChange changes[WM_MAX_APPS];
+  int count = wm_display_changes(previous, next, changes, WM_MAX_APPS);
+  mac_effects_queue_frames(changes, count);
+  return count;
+}
+
 static void apply_layout_to_active_buffer(void) {
-  WMRect screen = mac_effects_get_visible_screen_rect();
-  WMFrameChange frame_changes[WM_MAX_APPS];
-  int count =
-      wm_layout_compute_dwindle(&g_state, g_state.active_buffer, &g_config,
-                                screen, frame_changes, WM_MAX_APPS);
+  // serially: a display tiles in well under a microsecond, starting a
+  // thread for one costs tens
+  WMDisplayMask all = (WMDisplayMask)((1u << g_state.display_count) - 1);
+
+  // a switch that ran a ready plan brought the focused display's frames
+  const WMFrameChange *ready;
+  int ready_count = mac_effects_ready_frames(&ready);
+  if (ready_count >= 0) {
+    int focused = g_state.focused_display;
+    WMDisplayLayout *layout = &g_next_layouts[focused];
+    memcpy(layout->frames, ready, ready_count * sizeof(WMFrameChange));
+    layout->count = (int16_t)ready_count;
+    layout->display_id = g_state.displays[focused].id;
+    layout->frame = g_state.displays[focused].frame;
+    layout->view = wm_state_get_view(&g_state);
+    all &= (WMDisplayMask)~WM_DISPLAY_BIT(focused);
+  }
+  wm_display_compute_all(&g_state, g_config, all, g_next_layouts, false);
 
-  for (int i = 0; i < count; i++) {
-    mac_effects_apply_frame(frame_changes[i].pid, frame_changes[i].frame);
+  int count = 0;
+  for (int i = 0; i < g_state.display_count; i++) {
+    count += queue_display_frames(i, &g_next_layouts[i]);
+    g_layouts[i] = g_next_layouts[i];
   }
+
+  WMBufferMask shown = wm_state_get_shown(&g_state);
+  mac_control_layout_applied(shown, count);
+
+  // anything scheduled for the shown buffers is covered
+  mac_timer_cancel(&g_relayout_timer);
+  wm_relayout_done(&g_relayout, shown);
+}
+
+// screens were plugged, unplugged, resized or rearranged
+static void displays_changed(void) {
+  WMDisplay before[WM_MAX_DISPLAYS];
+  memcpy(before, g_state.displays, sizeof(before));
+  int before_count = g_state.display_count;
+
+  WMDisplayInfo infos[WM_MAX_DISPLAYS];
+  int count = mac_effects_get_displays(infos, WM_MAX_DISPLAYS);
+  WMDisplayMask stale = wm_display_configure(&g_state, infos, count);
+  if (stale == 0)
+    return;
+
+  // floating windows keep their place on a display that changed size
+  for (int d = 0; d < g_state.display_count; d++) {
+    const WMDisplay *display = &g_state.displays[d];
+    for (int j = 0; j < before_count; j++) {
+      if (before[j].id != display->id ||
+          memcmp(&before[j].frame, &display->frame, sizeof(WMRect)) == 0)
+        continue;
+      const WMAppRegistry *registry = &g_state.app_registry;
+      for (int i = 0; i < registry->app_count; i++) {
+        WMRect frame;
+        pid_t pid = registry->apps[i].pid;
+        if (registry->apps[i].is_floating &&
+            (registry->buffer_masks[i] & wm_state_display_view(&g_state, d)) &&
+            mac_effects_get_frame(pid, &frame))
+          mac_effects_apply_frame(
+              pid, wm_display_rescale(frame, before[j].frame, display->frame));
+      }
+    }
+  }
+
+  // cached tilings follow their display to its new index
+  WMDisplayLayout *moved = g_next_layouts;
+  for (int d = 0; d < g_state.display_count; d++) {
+    moved[d].display_id = 0;
+    moved[d].count = 0;
+    for (int j = 0; j < before_count; j++) {
+      if (g_layouts[j].display_id == g_state.displays[d].id)
+        moved[d] = g_layouts[j];
+    }
+  }
+  memcpy(g_layouts, moved, sizeof(g_layouts));
+
+  apply_layout_to_active_buffer();
+  state_changed();
+}
+
+// hotkeys act on the display under the mouse
+static void focus_display_under_mouse(void) {
+  double x, y;
+  mac_effects_get_mouse_point(&x, &y);
+  int display = wm_display_at(&g_state, x, y);
+  if (display >= 0)
+    wm_display_focus(&g_state, display);
+}
+
+static void relayout_due(void *context, int64_t argument) {
+  (void)context;
+  (void)argument;
+  g_relayout_timer = 0;
+  if (wm_relayout_take(&g_relayout, wm_state_get_shown(&g_state),
+                       mac_timer_now()))
+    apply_layout_to_active_buffer();
+}
+
+// buffers changed by app events: tile the displays once the burst's frame
+// window ends, hidden buffers wait for their next switch
+static void request_layout(WMBufferMask buffers) {
+  uint64_t deadline = wm_relayout_mark(&g_relayout, buffers,
+                                       wm_state_get_shown(&g_state),
+                                       mac_timer_now());
+  if (deadline != 0 && g_relayout_timer == 0)
+    g_relayout_timer = mac_timer_at(deadline, relayout_due, NULL, 0);
 }
 
 // handle actions from the event tap
@@ -73,11 +269,13 @@ static void handle_action(int action_type, int argument,
   (void)bundle_identifier; // app launch not implemented yet
 
   WMActionType type = (WMActionType)action_type;
+  if (type == WM_ACTION_SWITCH_BUFFER || type == WM_ACTION_MOVE_BUFFER ||
+      type == WM_ACTION_TOGGLE_VIEW)
+    focus_display_under_mouse();
 
   switch (type) {
   case WM_ACTION_SWITCH_BUFFER: {
     mac_switch_buffer(&g_state, argument);
-    apply_layout_to_active_buffer();
     break;
   };
   case WM_ACTION_MOVE_BUFFER: {
@@ -91,11 +289,37 @@ static void handle_action(int action_type, int argument,
 
     // move app to target buffer
     wm_state_assign_to_buffer(&g_state, pid, argument);
+    remember_placement(pid);
 
     // set the moved app as last_focused so it stays on top when we switch
     wm_state_set_focused(&g_state, pid);
 
     mac_switch_buffer(&g_state, argument);
+    break;
+  }
+  case WM_ACTION_TOGGLE_VIEW: {
+    int primary;
+    WMBufferMask view;
+    if (!wm_state_toggled_view(&g_state, argument, &primary, &view))
+      return;
+
+    mac_switch_view(&g_state, primary, view);
+    break;
+  }
+  case WM_ACTION_TOGGLE_TAG:
+  case WM_ACTION_TOGGLE_STICKY: {
+    pid_t pid = mac_effects_get_focused_pid();
+    if (pid <= 0)
+      return;
+
+    WMAction action = {.type = type, .target_buffer = argument,
+                       .target_pid = pid};
+    WMEffects effects;
+    if (!wm_action_process(&g_state, &action, &effects))
+      return;
+    remember_placement(pid);
+
+    mac_effects_update_visibility(&g_state, pid);
     apply_layout_to_active_buffer();
     break;
   }
@@ -118,7 +342,13 @@ static void handle_action(int action_type, int argument,
 
     // apply snap loading
     WMRect screen = mac_effects_get_visible_screen_rect();
-    WMRect frame = wm_layout_compute_snap(type, screen, &g_config);
+    WMRect frame = wm_layout_compute_snap(type, screen, g_config);
+
+    // an app that won't take the half grows into the other one
+    const WMGap *gaps = &g_config->gaps_outer;
+    WMRect area = wm_layout_apply_gaps(screen, gaps->top, gaps->right,
+                                       gaps->bottom, gaps->left);
+    frame = wm_layout_fit(frame, wm_state_min_size(&g_state, pid), area);
     mac_effects_apply_frame(pid, frame);
 
     // re-apply dwindle to remaining non-floating apps
@@ -139,11 +369,104 @@ static void handle_action(int action_type, int argument,
 
   case WM_ACTION_TOGGLE_PASSTHROUGH:
     g_state.is_passthrough_mode = !g_state.is_passthrough_mode;
+    g_state.version++;
     break;
 
   default:
     break;
   }
+
+  state_changed();
+}
+
+// register apps in one batch, the view retiles once with the rest of the burst
+static void register_apps(const WMAppSpec *specs, int count,
+                          int default_buffer) {
+  WMRegisterDelta delta;
+  if (wm_state_register_apps(&g_state, g_config, specs, count, default_buffer,
+                             &delta) == 0)
+    return;
+
+  WMBufferMask view = wm_state_get_shown(&g_state);
+  for (int i = 0; i < count; i++) {
+    WMBufferMask app_buffers = wm_state_get_buffer_mask(&g_state, specs[i].pid);
+
+    // a rule or learned placement may send a new app to a hidden buffer
+    if ((app_buffers & view) != 0)
+      wm_state_set_focused(&g_state, specs[i].pid);
+    else if (view != 0)
+      mac_effects_update_visibility(&g_state, specs[i].pid);
+  }
+
+  request_layout(delta.dirty_buffers);
+  state_changed();
+}
+
+static void retry_register(void *context, int64_t argument);
+
+// register a new app by rule, last placement or into active buffer. Apps
+// not manageable yet are retried later (attempt counts from 0)
+static void register_new_app(pid_t pid, int attempt) {
+  if (wm_state_find_app(&g_state, pid) != NULL)
+    return;
+
+  NSRunningApplication *application =
+      [NSRunningApplication runningApplicationWithProcessIdentifier:pid];
+  if (!application)
+    return;
+
+  if (is_app_manageable(application)) {
+    WMAppSpec spec = {.pid = pid,
+                      .bundle_identifier =
+                          [application.bundleIdentifier UTF8String]};
+    register_apps(&spec, 1, g_state.active_buffer);
+    return;
+  }
+  if (attempt >= REGISTER_RETRY_ATTEMPTS)
+    return;
+
+  // one retry in flight per pid, the first attempt claims a slot
+  int slot = -1;
+  for (int i = 0; i < REGISTER_RETRY_MAX_PENDING; i++) {
+    if (g_retry_pids[i] == pid) {
+      if (attempt == 0)
+        return; // already retrying
+      slot = i;
+      break;
+    }
+    if (g_retry_pids[i] == 0 && slot < 0)
+      slot = i;
+  }
+  if (slot < 0)
+    return;
+  g_retry_pids[slot] = pid;
+
+  uint32_t delay = wm_timer_backoff_ms(REGISTER_RETRY_BASE_MS, attempt,
+                                       REGISTER_RETRY_MAX_MS);
+  if (mac_timer_after(delay, retry_register, NULL,
+                      ((int64_t)(attempt + 1) << 32) | (uint32_t)pid) == 0)
+    g_retry_pids[slot] = 0;
+}
+
+// argument: attempt << 32 | pid
+static void retry_register(void *context, int64_t argument) {
+  (void)context;
+  pid_t pid = (pid_t)(uint32_t)argument;
+  int attempt = (int)(argument >> 32);
+
+  register_new_app(pid, attempt);
+
+  // registered, gone or out of attempts: release the slot
+  bool pending = wm_state_find_app(&g_state, pid) == NULL &&
+                 attempt < REGISTER_RETRY_ATTEMPTS &&
+                 [NSRunningApplication
+                     runningApplicationWithProcessIdentifier:pid] != nil;
+  if (!pending) {
+    for (int i = 0; i < REGISTER_RETRY_MAX_PENDING; i++) {
+      if (g_retry_pids[i] == pid)
+        g_retry_pids[i] = 0;
+    }
+  }
 }
 
 // register currently running GUI apps into state
@@ -151,18 +474,23 @@ static void register_running_apps(void) {
   NSArray<NSRunningApplication *> *runningApps =
       [[NSWorkspace sharedWorkspace] runningApplications];
 
+  WMAppSpec specs[WM_MAX_APPS];
+  int count = 0;
+
   for (NSRunningApplication *app in runningApps) {
+    if (count >= WM_MAX_APPS)
+      break;
     if (!is_app_manageable(app))
       continue;
 
-    pid_t pid = app.processIdentifier;
-    const char *bundle_id = [app.bundleIdentifier UTF8String];
-
-    int idx = wm_state_register_app(&g_state, pid, bundle_id);
-    if (idx >= 0) {
-      wm_state_assign_to_buffer(&g_state, pid, 0);
-    }
+    // UTF8String lives as long as the app object (held by runningApps)
+    specs[count].pid = app.processIdentifier;
+    specs[count].bundle_identifier = [app.bundleIdentifier UTF8String];
+    count++;
   }
+
+  // unmatched apps start in buffer 0, nothing is shown yet so no layout
+  wm_state_register_apps(&g_state, g_config, specs, count, 0, NULL);
 }
 
 // called by macos when app is ready
@@ -175,144 +503,265 @@ static void register_running_apps(void) {
     return;
   }
 
+  // hot paths log binary records, dwinlog prints them; a crash leaves the
+  // last ones of every thread in crash.log
+  if (!wm_log_start(app_data_path(@"dwin.log")))
+    NSLog(@"[Log] log file unavailable, records kept in memory only");
+  if (!wm_log_install_crash_handler(app_data_path(@"crash.log")))
+    NSLog(@"[Log] crash handler unavailable");
+
   // init state and config
   wm_state_init(&g_state);
-  wm_config_init(&g_config);
+  wm_relayout_init(&g_relayout);
+  g_config = wm_config_cache_load(&g_config_cache, app_config_path(),
+                                  app_data_path(@"config.bin"));
+  NSLog(@"[Config] %s", g_config_cache.image ? "mapped compiled image"
+                                              : "parsed ~/.config/.dwin");
+  mac_timer_start();
+  mac_effects_attach(&g_state, &g_events, apply_layout_to_active_buffer);
+  mac_effects_configure(g_config);
+
+  // every screen is a display with its own view, the first switch below
+  // lands on the primary one
+  WMDisplayInfo displays[WM_MAX_DISPLAYS];
+  wm_display_configure(&g_state, displays,
+                       mac_effects_get_displays(displays, WM_MAX_DISPLAYS));
+  mac_effects_load_latency(app_data_path(@"latency.bin"));
+  mac_effects_load_min_sizes(app_data_path(@"minsize.bin"));
 
   // setup menu status bar
   self.statusBar = [[MacStatusBar alloc] init];
   [self.statusBar setup];
 
+  // learned placements, consulted when apps register
+  const char *placement_path = app_data_path(@"placements.bin");
+  if (wm_placement_open(&g_placements, placement_path)) {
+    g_state.placements = &g_placements;
+    if (g_placements.recovered_slots > 0)
+      NSLog(@"[State] dropped %d corrupt placements",
+            g_placements.recovered_slots);
+  } else {
+    NSLog(@"[State] placements unavailable at %s", placement_path);
+  }
+
   // register running apps
   register_running_apps();
-  // switch to buffer 0 (this shows all apps in buffer 0)
-  mac_switch_buffer(&g_state, 0);
-  // apply layout to active buffer
-  apply_layout_to_active_buffer();
 
-  // capture app activation from external sources
+  // windows a killed or crashed run left off screen come back
+  mac_effects_load_parked(app_data_path(@"parked.bin"));
+
+  // restore buffers from the last session (crash or restart)
+  const char *snapshot_path = app_data_path(@"state.bin");
+  WMSnapshotView saved_view;
+  int restored = wm_snapshot_restore(snapshot_path, &g_state, &saved_view);
+  if (!wm_snapshot_open(&g_snapshot, snapshot_path))
+    NSLog(@"[State] snapshot unavailable at %s", snapshot_path);
+
+  // bars read the hot state from shared memory, no round trip
+  char mirror_name[WM_MIRROR_NAME_SIZE];
+  wm_mirror_default_name(mirror_name, sizeof(mirror_name));
+  if (!wm_mirror_open(&g_mirror, mirror_name))
+    NSLog(@"[State] mirror unavailable at %s", mirror_name);
+
+  if (restored >= 0 && saved_view.active_buffer >= 0) {
+    // switch to the saved view
+    mac_switch_view(&g_state, saved_view.active_buffer, saved_view.view_mask);
+  } else {
+    // switch to buffer 0 (this shows all apps in buffer 0)
+    mac_switch_buffer(&g_state, 0);
+  }
+  // the other displays got their saved views back, show their apps
+  WMBufferMask others =
+      wm_state_get_shown(&g_state) & ~wm_state_get_view(&g_state);
+  for (int i = 0; others != 0 && i < g_state.app_registry.app_count; i++) {
+    if ((g_state.app_registry.buffer_masks[i] & others) != 0)
+      mac_effects_update_visibility(&g_state,
+                                    g_state.app_registry.apps[i].pid);
+  }
+  // the switch tiles the view in its layout stage
+  state_changed();
+
+  // capture app launch, activation and termination from external sources,
+  // coalesced into net events
+  wm_events_init(&g_events);
+
   [[[NSWorkspace sharedWorkspace] notificationCenter]
       addObserver:self
          selector:@selector(handleAppActivated:)
              name:NSWorkspaceDidActivateApplicationNotification
            object:nil];
 
+  [[[NSWorkspace sharedWorkspace] notificationCenter]
+      addObserver:self
+         selector:@selector(handleAppLaunched:)
+             name:NSWorkspaceDidLaunchApplicationNotification
+           object:nil];
+
   [[[NSWorkspace sharedWorkspace] notificationCenter]
       addObserver:self
          selector:@selector(handleAppTerminated:)
              name:NSWorkspaceDidTerminateApplicationNotification
            object:nil];
 
+  [[NSNotificationCenter defaultCenter]
+      addObserver:self
+         selector:@selector(handleScreensChanged:)
+             name:NSApplicationDidChangeScreenParametersNotification
+           object:nil];
+
+  // scripts drive dwin through the control socket (dwinctl)
+  if (!wm_hooks_start(&g_hooks, g_config, hook_finished, NULL))
+    NSLog(@"[Hooks] runner unavailable, hooks disabled");
+  mac_control_start(&g_state, g_config, apply_layout_to_active_buffer,
+                    remember_placement, state_changed, dispatch_hooks);
+
   // start event tap for global hotkeys
-  if (!mac_event_tap_start(&g_config, handle_action)) {
+  if (!mac_event_tap_start(g_config, handle_action)) {
     [self showAccessibilityAlert];
     return;
   }
 }
 
-- (void)handleAppTerminated:(NSNotification *)notification {
+- (void)applicationWillTerminate:(NSNotification *)notification {
+  (void)notification;
+  // parked windows would stay off screen without dwin
+  mac_effects_unpark_all();
+  mac_control_stop();
+  wm_mirror_close(&g_mirror);
+
+  WMHookStats stats;
+  wm_hooks_stats(&g_hooks, &stats);
+  if (stats.queued > 0)
+    NSLog(@"[Hooks] %u runs, %u coalesced, %u dropped, %u failed, %u timed "
+          @"out, mean %.1f ms, max %.1f ms, queue peak %d",
+          stats.queued, stats.coalesced, stats.dropped, stats.failed,
+          stats.timed_out,
+          stats.reaped ? stats.total_ns / 1e6 / stats.reaped : 0.0,
+          stats.max_ns / 1e6, stats.max_queue_depth);
+  wm_hooks_stop(&g_hooks);
+  wm_log_stop();
+}
+
+// queue a workspace notification, the timer drains it with its burst
+- (void)pushEvent:(WMEventType)type
+     notification:(NSNotification *)notification {
   NSRunningApplication *application =
       notification.userInfo[NSWorkspaceApplicationKey];
   if (!application)
     return;
 
   pid_t pid = application.processIdentifier;
+  uint64_t now = mac_timer_now();
 
-  // check if app was in active buffer and apply layout if it was
-  const WMApp *app = wm_state_find_app(&g_state, pid);
-  bool was_in_active_buffer =
-      app != NULL && app->buffer_index == g_state.active_buffer;
-  wm_state_unregister_app(&g_state, pid);
+  // a switch in flight waits for its own activation
+  if (type == WM_EVENT_ACTIVATED)
+    mac_effects_note_activation(pid);
 
-  if (was_in_active_buffer) {
-    apply_layout_to_active_buffer();
-  }
+  wm_events_push(&g_events, type, pid, now);
+  [self armEventsTimer];
 }
 
-- (void)handleAppActivated:(NSNotification *)notification {
-  extern bool g_is_switching_buffer;
-
-  NSRunningApplication *application =
-      notification.userInfo[NSWorkspaceApplicationKey];
-  if (!application)
-    return;
+static void events_due(void *context, int64_t argument);
 
-  pid_t pid = application.processIdentifier;
+- (void)armEventsTimer {
+  mac_timer_cancel(&g_events_timer);
 
-  // ignore during buffer switch
-  if (g_is_switching_buffer)
-    return;
+  uint64_t deadline = wm_events_next_deadline(&g_events);
+  if (deadline != 0)
+    g_events_timer =
+        mac_timer_at(deadline, events_due, (__bridge void *)self, 0);
+}
 
-  // debounce activation to prevent multiple activations
-  static NSDate *lastActivation = nil;
-  static pid_t lastActivatedPid = 0;
-  NSDate *now = [NSDate date];
-  if (lastActivation && [now timeIntervalSinceDate:lastActivation] < 0.2)
-    return;
+- (void)handleAppLaunched:(NSNotification *)notification {
+  [self pushEvent:WM_EVENT_LAUNCHED notification:notification];
+}
 
-  // duplicate filter, skip if same pid as last event
-  if (pid == lastActivatedPid && lastActivation &&
-      [now timeIntervalSinceDate:lastActivation] < 1.0)
-    return;
+- (void)handleAppTerminated:(NSNotification *)notification {
+  [self pushEvent:WM_EVENT_TERMINATED notification:notification];
+}
 
-  lastActivatedPid = pid;
+- (void)handleScreensChanged:(NSNotification *)notification {
+  (void)notification;
+  displays_changed();
+}
 
-  // find which buffer this app belongs to
-  const WMApp *app = wm_state_find_app(&g_state, pid);
-  if (app != NULL) {
-    int app_buffer = app->buffer_index;
-    if (app_buffer < 0 || app_buffer >= WM_MAX_BUFFERS)
-      return;
+- (void)handleAppActivated:(NSNotification *)notification {
+  [self pushEvent:WM_EVENT_ACTIVATED notification:notification];
+}
 
-    // only update last focused if app is in the active buffer
-    if (app_buffer == g_state.active_buffer) {
-      wm_state_set_focused(&g_state, pid);
-    } else {
-      // switch to app's buffer if user activated it from another buffer
-      lastActivation = now;
-      mac_switch_buffer(&g_state, app_buffer);
-    }
-  } else {
-    // new app, register and assign to active buffer
-    if (is_app_manageable(application)) {
-      int idx = wm_state_register_app(
-          &g_state, pid, [application.bundleIdentifier UTF8String]);
-      if (idx >= 0) {
-        wm_state_assign_to_buffer(&g_state, pid, g_state.active_buffer);
-        wm_state_set_focused(&g_state, pid);
-        apply_layout_to_active_buffer();
-      }
-    } else {
-      [self retryRegisterApp:pid name:application.localizedName attempt:1];
+- (void)drainEvents {
+  WMEvent events[16];
+  int count;
+  while ((count = wm_events_drain(&g_events, mac_timer_now(), events, 16)) >
+         0) {
+    for (int i = 0; i < count; i++) {
+      [self handleEvent:&events[i]];
     }
   }
+  [self armEventsTimer];
+}
+
+static void events_due(void *context, int64_t argument) {
+  (void)argument;
+  g_events_timer = 0;
+  [(__bridge AppDelegate *)context drainEvents];
+}
+
+- (void)handleEvent:(const WMEvent *)event {
+  pid_t pid = event->pid;
+
+  switch (event->type) {
+  case WM_EVENT_TERMINATED: {
+    // its buffers retile with the rest of the burst
+    WMBufferMask app_buffers = wm_state_get_buffer_mask(&g_state, pid);
+    wm_state_unregister_app(&g_state, pid);
+    mac_effects_forget_app(pid);
+    if (app_buffers != 0)
+      request_layout(app_buffers);
+    state_changed();
+    break;
+  }
+  case WM_EVENT_LAUNCHED:
+    register_new_app(pid, 0);
+    break;
+  case WM_EVENT_ACTIVATED:
+    [self handleActivation:pid origin:event->origin];
+    break;
+  default:
+    break;
+  }
 }
 
-- (void)retryRegisterApp:(pid_t)pid name:(NSString *)name attempt:(int)attempt {
-  int maxAttempts = 5;
-  double delayMs = 100;
-
-  dispatch_after(
-      dispatch_time(DISPATCH_TIME_NOW,
-                    (int64_t)(delayMs / 1000.0 * NSEC_PER_SEC)),
-      dispatch_get_main_queue(), ^{
-        NSRunningApplication *application =
-            [NSRunningApplication runningApplicationWithProcessIdentifier:pid];
-        if (!application)
-          return;
-
-        if (is_app_manageable(application)) {
-          int idx = wm_state_register_app(
-              &g_state, pid, [application.bundleIdentifier UTF8String]);
-          if (idx >= 0) {
-            wm_state_assign_to_buffer(&g_state, pid, g_state.active_buffer);
-            wm_state_set_focused(&g_state, pid);
-            apply_layout_to_active_buffer();
-          }
-        } else if (attempt < maxAttempts) {
-          [self retryRegisterApp:pid name:name attempt:attempt + 1];
-        }
-      });
+- (void)handleActivation:(pid_t)pid origin:(WMEventOrigin)origin {
+  // find which buffer this app belongs to
+  const WMApp *app = wm_state_find_app(&g_state, pid);
+  if (app == NULL) {
+    // activated before (or without) its launch event
+    register_new_app(pid, 0);
+    return;
+  }
+
+  WMBufferMask app_buffers = wm_state_get_buffer_mask(&g_state, pid);
+  int app_buffer = wm_state_primary_buffer(&g_state, pid);
+  if (app_buffer < 0 || app_buffer >= WM_MAX_BUFFERS)
+    return;
+
+  // the user may have switched windows, resolve the main window again
+  if (origin == WM_ORIGIN_USER)
+    wm_state_invalidate_backend(&g_state, pid);
+
+  // only update last focused if app is on screen, its display gets focus
+  WMBufferMask shown = app_buffers & wm_state_get_shown(&g_state);
+  if (shown != 0) {
+    wm_display_focus(&g_state,
+                     wm_display_of_buffer(&g_state, __builtin_ctz(shown)));
+    wm_state_set_focused(&g_state, pid);
+  } else if (origin == WM_ORIGIN_USER) {
+    // switch to app's buffer if user activated it from another buffer,
+    // focus bouncing through apps dwin unhides never switches
+    mac_switch_buffer(&g_state, app_buffer);
+  }
+  state_changed();
 }
 
 // show accessibility permission alert
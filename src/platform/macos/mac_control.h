@@ -0,0 +1,32 @@
+#ifndef MAC_CONTROL_H
+#define MAC_CONTROL_H
+
+#include "wm_config.h"
+#include "wm_control.h"
+#include "wm_state.h"
+#include <stdbool.h>
+
+// serve the control socket ($DWIN_SOCKET, else /tmp/dwin-<uid>.sock).
+// Queries are answered off the main thread from published snapshots,
+// batches run on the main queue as one effects pass: apply_layout tiles the
+// view, app_moved is told about apps whose buffers changed, state_changed
+// runs after each batch. events (optional) gets every event subscribers
+// get, on the main thread, even without the socket. Returns false if the
+// socket is unavailable
+bool mac_control_start(WMState *state, const WMConfig *config,
+                       void (*apply_layout)(void), void (*app_moved)(pid_t),
+                       void (*state_changed)(void),
+                       void (*events)(const WMControlEvent *events,
+                                      int count));
+
+// publish the state for queries and send subscribers what changed, call
+// after every change (no-op if the state didn't change since the last one)
+void mac_control_publish(void);
+
+// tell subscribers the view was tiled (tiled apps laid out)
+void mac_control_layout_applied(WMBufferMask view, int tiled);
+
+// stop serving and remove the socket
+void mac_control_stop(void);
+
+#endif
@@ -0,0 +1,153 @@
+#import "mac_control.h"
+#import "mac_effects.h"
+#import <Foundation/Foundation.h>
+#include "wm_control.h"
+#include "wm_display.h"
+#include "wm_layout.h"
+#include "wm_server.h"
+
+static WMServer g_server;
+static bool g_running = false;  // serving the socket
+static WMState *g_state = NULL; // NULL = not started
+static const WMConfig *g_config = NULL;
+static void (*g_apply_layout)(void) = NULL;
+static void (*g_app_moved)(pid_t) = NULL;
+static void (*g_state_changed)(void) = NULL;
+static void (*g_events)(const WMControlEvent *events, int count) = NULL;
+
+// last snapshot taken (batch replies are formatted from it too) and the
+// one before, subscribers get the difference
+static WMControlSnapshot g_snapshots[2];
+static WMControlSnapshot *g_snapshot = &g_snapshots[0];
+static bool g_published = false;
+
+#pragma mark - Snapshots
+
+// hand events to subscribers and the events callback
+static void emit(const WMControlEvent *events, int count) {
+  if (g_running)
+    wm_server_emit(&g_server, events, count);
+  if (g_events)
+    g_events(events, count);
+}
+
+void mac_control_publish(void) {
+  if (g_state == NULL ||
+      (g_published && g_snapshot->version == g_state->version))
+    return;
+
+  WMControlSnapshot *previous = g_snapshot;
+  g_snapshot = previous == &g_snapshots[0] ? &g_snapshots[1] : &g_snapshots[0];
+
+  // frames of every display, an app is tiled on one of them
+  static WMDisplayLayout layout;
+  WMFrameChange frames[WM_MAX_APPS];
+  int count = 0;
+  for (int d = 0; d < g_state->display_count; d++) {
+    wm_display_compute(g_state, d, g_config, &layout);
+    for (int i = 0; i < layout.count && count < WM_MAX_APPS; i++)
+      frames[count++] = layout.frames[i];
+  }
+  wm_control_snapshot(g_snapshot, g_state, frames, count);
+  if (g_running)
+    wm_server_publish(&g_server, g_snapshot);
+
+  if (g_published) {
+    static WMControlEvent events[WM_CONTROL_MAX_EVENTS];
+    int event_count =
+        wm_control_diff(previous, g_snapshot, events, WM_CONTROL_MAX_EVENTS);
+    if (event_count > 0)
+      emit(events, event_count);
+  }
+  g_published = true;
+}
+
+void mac_control_layout_applied(WMBufferMask view, int tiled) {
+  if (g_state == NULL)
+    return;
+  WMControlEvent event = {.type = WM_CONTROL_EVENT_LAYOUT,
+                          .view = view,
+                          .count = (int16_t)tiled};
+  emit(&event, 1);
+}
+
+#pragma mark - Batches
+
+// the effects of a whole batch: one switch (its layout stage tiles the
+// view) or one layout pass, whatever the batch moved
+static void run_effects(const WMControlEffects *effects) {
+  if (effects->view_changed)
+    mac_switch_view(g_state, effects->primary_buffer, effects->view);
+  for (int i = 0; i < effects->visibility_count; i++)
+    mac_effects_update_visibility(g_state, effects->visibility[i]);
+  if (effects->needs_layout)
+    g_apply_layout();
+
+  for (int i = 0; i < effects->moved_count; i++)
+    g_app_moved(effects->moved[i]);
+  g_state_changed();
+}
+
+// run the batches waiting on the server (main queue)
+static void run_jobs(void *context) {
+  (void)context;
+  static WMServerJob job;
+  static char reply[WM_CONTROL_MAX_REPLY];
+
+  while (wm_server_take(&g_server, &job)) {
+    WMControlBatch batch;
+    WMControlEffects effects;
+    char error[WM_CONTROL_ERROR_SIZE];
+    int length;
+
+    if (!wm_control_parse(job.request, &batch, error, sizeof(error)) ||
+        !wm_control_apply(g_state, &batch, &effects, error, sizeof(error))) {
+      length = wm_control_error(error, reply, sizeof(reply));
+    } else {
+      run_effects(&effects);
+      mac_control_publish(); // queries of the batch see its result
+      length = wm_control_reply(g_snapshot, &batch, reply, sizeof(reply));
+    }
+    wm_server_reply(&g_server, &job, reply, (size_t)length);
+  }
+}
+
+// server thread: batches are waiting
+static void wake_main(void *context) {
+  dispatch_async_f(dispatch_get_main_queue(), context, run_jobs);
+}
+
+#pragma mark - Lifecycle
+
+bool mac_control_start(WMState *state, const WMConfig *config,
+                       void (*apply_layout)(void), void (*app_moved)(pid_t),
+                       void (*state_changed)(void),
+                       void (*events)(const WMControlEvent *events,
+                                      int count)) {
+  g_state = state;
+  g_config = config;
+  g_apply_layout = apply_layout;
+  g_app_moved = app_moved;
+  g_state_changed = state_changed;
+  g_events = events;
+  g_published = false;
+
+  // events still flow without the socket
+  char path[WM_SERVER_PATH_SIZE];
+  wm_server_default_path(path, sizeof(path));
+  g_running = wm_server_start(&g_server, path, wake_main, NULL);
+  mac_control_publish();
+  if (!g_running) {
+    NSLog(@"[Control] socket unavailable at %s", path);
+    return false;
+  }
+  NSLog(@"[Control] listening on %s", path);
+  return true;
+}
+
+void mac_control_stop(void) {
+  if (!g_running)
+    return;
+  g_running = false;
+  wm_server_stop(&g_server);
+}
@@ -1,17 +1,83 @@
 #ifndef MAC_EFFECTS_H
 #define MAC_EFFECTS_H
 
+#include "wm_config.h"
+#include "wm_display.h"
+#include "wm_events.h"
 #include "wm_layout.h"
 #include "wm_state.h"
 #include <stdint.h>
 
+// cache per-app platform objects in state (call after mac_timer_start and
+// before registering apps). events is told about activations dwin causes,
+// apply_layout tiles the view during buffer switches
+void mac_effects_attach(WMState *state, WMEventCoalescer *events,
+                        void (*apply_layout)(void));
+
+// apply the config: effect_budget is the time each run loop turn may spend
+// on deferred (visible and background) effects, ax_timeout how long an
+// accessibility call waits for an app (apps registered from now on)
+void mac_effects_configure(const WMConfig *config);
+
+// drop the health record (and parked window) of an app that quit
+void mac_effects_forget_app(pid_t pid);
+
+// put every parked window back on screen (dwin quitting)
+void mac_effects_unpark_all(void);
+
+// put back the windows a previous run left parked (it was killed or
+// crashed) as saved at path, and save them there as windows are parked
+// (call once the running apps are registered). A crash puts them back too
+void mac_effects_load_parked(const char *path);
+
+// start the latency model from the estimates saved at path (if any) and
+// save them there as they change. Switches issue slow operations first
+void mac_effects_load_latency(const char *path);
+
+// start the learned minimum window sizes from path (if any) and save them
+// there as apps refuse smaller frames. Layouts give each app its minimum
+void mac_effects_load_min_sizes(const char *path);
+
+// move/resize windows as visible effects: as many as the budget allows now,
+// the rest on the next run loop turns
+void mac_effects_queue_frames(const WMFrameChange *changes, int count);
+
 // switch to a new buffer
 void mac_switch_buffer(WMState *state, int new_buffer_index);
 
-// get the visible screen rect
+// switch to a view of several buffers, focus goes to primary_buffer. The
+// switch runs its stages as the apps report back, a newer switch replaces it
+void mac_switch_view(WMState *state, int primary_buffer,
+                     WMBufferMask view_mask);
+
+// the state changed: switch plans are remade once it has been quiet for a
+// while
+void mac_effects_state_changed(void);
+
+// frames of the focused display brought by the switch in flight (made ahead
+// with its plan), -1 if the display has to be tiled
+int mac_effects_ready_frames(const WMFrameChange **frames);
+
+// feed an app activation to the switch in flight (it waits for its own)
+void mac_effects_note_activation(pid_t pid);
+
+// show/hide a single app after its buffers changed under the current view
+void mac_effects_update_visibility(WMState *state, pid_t pid);
+
+// the screens as displays (global top-left coordinates), primary first.
+// Returns the count
+int mac_effects_get_displays(WMDisplayInfo *out, int max);
+
+// get the visible screen rect (of the focused display)
 WMRect mac_effects_get_visible_screen_rect(void);
 
-// apply a frame to a pid
+// mouse position in global top-left coordinates
+void mac_effects_get_mouse_point(double *x, double *y);
+
+// current frame of pid's window, false if it has none
+bool mac_effects_get_frame(pid_t pid, WMRect *frame);
+
+// apply a frame to a pid, false if it failed or the app's breaker is open
 bool mac_effects_apply_frame(pid_t pid, WMRect frame);
 
 // get the currently focused pid
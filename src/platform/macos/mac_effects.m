@@ -1,124 +1,286 @@
 #include "mac_effects.h"
+#include "mac_timer.h"
+#include "wm_events.h"
+#include "wm_executor.h"
+#include "wm_health.h"
+#include "wm_latency.h"
 #include "wm_layout.h"
+#include "wm_log.h"
+#include "wm_minsize.h"
+#include "wm_park.h"
+#include "wm_plans.h"
 #include "wm_runtime.h"
 #include "wm_state.h"
+#include "wm_switch.h"
 #include <AppKit/AppKit.h>
 
-// flag to prevent race conditions during buffer switch
-bool g_is_switching_buffer = false;
+// state owning the per-app backend handles
+static WMState *g_effects_state = NULL;
+
+// buffer switch in flight, driven by workspace notifications and a timer
+// for the current stage deadline
+static WMSwitch g_switch;
+static WMTimerId g_switch_timer = 0;
+static void (*g_apply_layout)(void) = NULL;
+
+// switch and layout side effects by priority: critical ones run right away,
+// the rest on later run loop turns within the configured budget
+static WMExecutor g_executor;
+static bool g_executor_turn_queued = false;
+
+// per-app breakers around accessibility calls, a hung app's effects are
+// deferred and retried instead of blocking the main thread on every call
+static WMHealth g_health;
+static WMTimerId g_health_timer = 0;
+static float g_ax_timeout_s = WM_AX_TIMEOUT_MS / 1000.0f;
+
+// latency estimates per bundle and operation, saved a while after they
+// change so the next start plans warm
+#define LATENCY_SAVE_DELAY_MS 30000
+static WMLatencyModel g_latency;
+static char g_latency_path[1024];
+static WMTimerId g_latency_timer = 0;
+
+// smallest sizes apps' windows accept, learned from what a resize left them
+// with and saved a while after they change; layouts give every app at least
+// its own. Sizes are read back once a resize settled (apps resizing
+// asynchronously report their old size right after it), for apps not
+// measured yet or known to refuse sizes
+#define MIN_SIZE_SETTLE_MS 500
+#define MIN_SIZE_SAVE_DELAY_MS 30000
+typedef struct {
+  pid_t pid;
+  WMRect requested; // frame it was given
+  uint64_t due_ns;  // read back at this time
+} SizeCheck;
+static WMMinSizeStore g_min_sizes;
+static char g_min_sizes_path[1024];
+static bool g_min_sizes_relayout_queued = false;
+static SizeCheck g_size_checks[WM_MAX_APPS];
+static int g_size_check_count = 0;
+static WMTimerId g_size_check_timer = 0;
+static WMTimerId g_min_sizes_timer = 0;
+
+// windows of hidden buffers moved off screen instead of hidden (apps whose
+// visibility mode says so), with the frames they come back to. Written on
+// the turn after they change, so a dwin killed with windows parked puts
+// them back on its next start
+static WMParkStore g_park;
+static char g_park_path[1024];
+static bool g_park_write_queued = false;
+
+// switch plans of every buffer, remade once the state has been quiet a
+// while so a hotkey finds its plan ready
+#define PLANS_IDLE_MS 50
+static WMPlanCache g_plans;
+static WMTimerId g_plans_timer = 0;
+static uint32_t g_plans_orders = 0; // latency order the refresh is armed for
+static const WMConfig *g_effects_config = NULL;
+
+// told about every activation dwin causes, so it isn't taken for the user's
+static WMEventCoalescer *g_events = NULL;
+
+// platform objects cached per registered app (WMApp.backend_handle)
+typedef struct {
+  CFTypeRef app;            // NSRunningApplication, retained
+  AXUIElementRef ax_app;    // accessibility element of the app
+  AXUIElementRef ax_window; // main (or first) window, NULL until resolved
+  bool size_measured;       // a resize was read back since it was acquired
+} MacAppHandle;
+
+#pragma mark - backend handles
+
+static void *handle_acquire(pid_t pid, void *context) {
+  (void)context;
 
-// cleanup timer to hide apps
-static dispatch_source_t g_cleanup_timer = NULL;
-static WMState *g_cleanup_state = NULL;
+  NSRunningApplication *app =
+      [NSRunningApplication runningApplicationWithProcessIdentifier:pid];
+  if (!app)
+    return NULL;
 
-#pragma mark - private functions
+  MacAppHandle *handle = calloc(1, sizeof(MacAppHandle));
+  if (!handle)
+    return NULL;
 
-// get the app for a given pid
-static NSRunningApplication *app_for_pid(pid_t pid) {
-  return [NSRunningApplication runningApplicationWithProcessIdentifier:pid];
+  handle->app = CFBridgingRetain(app);
+  handle->ax_app = AXUIElementCreateApplication(pid);
+  if (handle->ax_app)
+    AXUIElementSetMessagingTimeout(handle->ax_app, g_ax_timeout_s);
+  return handle;
 }
 
-// check if an app should be raised
-static bool should_raise_app(NSRunningApplication *app, pid_t focused_pid) {
-  if (!app)
-    return false;
-
-  pid_t pid = app.processIdentifier;
-  return (pid == focused_pid) || app.isHidden;
+static void handle_release(pid_t pid, void *opaque, void *context) {
+  (void)pid;
+  (void)context;
+
+  MacAppHandle *handle = opaque;
+  if (handle->ax_window)
+    CFRelease(handle->ax_window);
+  if (handle->ax_app)
+    CFRelease(handle->ax_app);
+  if (handle->app)
+    CFRelease(handle->app);
+  free(handle);
 }
 
-// find the app to focus in a buffer
-static pid_t find_app_to_focus(WMState *state, int buffer_index,
-                               pid_t *buffer_pids, int buffer_count) {
-  if (!state || buffer_index < 0 || buffer_index >= WM_MAX_BUFFERS ||
-      !buffer_pids || buffer_count <= 0)
-    return 0;
+// get the cached handle of a registered app, NULL if unregistered
+static MacAppHandle *handle_for_pid(pid_t pid) {
+  if (!g_effects_state)
+    return NULL;
+  return wm_state_backend_handle(g_effects_state, pid, NULL);
+}
 
-  WMBuffer *buffer = &state->buffers[buffer_index];
+// resolve (once) the main window of an app, falling back to its first window
+static AXUIElementRef window_for_handle(MacAppHandle *handle) {
+  if (handle->ax_window || !handle->ax_app)
+    return handle->ax_window;
 
-  // try last focused app (if in buffer)
-  if (buffer->last_focused_pid > 0) {
-    for (int i = 0; i < buffer_count; i++) {
-      if (buffer_pids[i] == buffer->last_focused_pid) {
-        return buffer->last_focused_pid;
-      }
+  AXUIElementRef window = NULL;
+  AXError err = AXUIElementCopyAttributeValue(
+      handle->ax_app, kAXMainWindowAttribute, (CFTypeRef *)&window);
+  if (err != kAXErrorSuccess || window == NULL) {
+    // fallback to first window
+    CFArrayRef windows = NULL;
+    err = AXUIElementCopyAttributeValue(handle->ax_app, kAXWindowsAttribute,
+                                        (CFTypeRef *)&windows);
+    if (err != kAXErrorSuccess || windows == NULL ||
+        CFArrayGetCount(windows) == 0) {
+      if (windows)
+        CFRelease(windows);
+      return NULL;
     }
+    window = (AXUIElementRef)CFRetain(CFArrayGetValueAtIndex(windows, 0));
+    CFRelease(windows);
   }
 
-  // fallback to first app in buffer
-  if (buffer_count > 0)
-    return buffer_pids[0];
+  handle->ax_window = window;
+  return window;
+}
+
+#pragma mark - private functions
+
+// get the app for a given pid
+static NSRunningApplication *app_for_pid(pid_t pid) {
+  MacAppHandle *handle = handle_for_pid(pid);
+  if (handle && handle->app)
+    return (__bridge NSRunningApplication *)handle->app;
+
+  // unregistered app, look it up
+  return [NSRunningApplication runningApplicationWithProcessIdentifier:pid];
+}
 
-  // empty buffer -> no focus target
-  return 0;
+#pragma mark - latency model
+
+static const char *bundle_for_pid(pid_t pid) {
+  const WMApp *app =
+      g_effects_state ? wm_state_find_app(g_effects_state, pid) : NULL;
+  return app ? app->bundle_identifier : NULL;
 }
 
-// reorder apps so focused app is LAST
-static int reorder_apps_for_raise(pid_t *input_pids, int count,
-                                  pid_t focused_pid, pid_t *output_pids) {
-  int output_count = 0;
+static void latency_save_due(void *context, int64_t argument) {
+  (void)context;
+  (void)argument;
+  g_latency_timer = 0;
+  if (g_latency_path[0] != '\0' && g_latency.dirty &&
+      !wm_latency_save(&g_latency, g_latency_path))
+    NSLog(@"[Latency] can't save estimates to %s", g_latency_path);
+}
 
-  // add all non-focused apps first
-  for (int i = 0; i < count; i++) {
-    if (input_pids[i] != focused_pid) {
-      output_pids[output_count++] = input_pids[i];
-    }
+// a sample was recorded (regressed: it was far over the estimate)
+static void latency_recorded(pid_t pid, WMLatencyOp op, bool regressed) {
+  if (regressed) {
+    const char *bundle = bundle_for_pid(pid);
+    NSLog(@"[Latency] %s %s regressed, estimate now %.1f ms", bundle,
+          wm_latency_op_name(op),
+          wm_latency_estimate(&g_latency, bundle, op) / 1e6);
+  }
+  if (g_latency.dirty && g_latency_timer == 0)
+    g_latency_timer =
+        mac_timer_after(LATENCY_SAVE_DELAY_MS, latency_save_due, NULL, 0);
+
+  // apps reordered: the ready plans are stale, remake them when idle
+  if (g_latency.orders != g_plans_orders) {
+    g_plans_orders = g_latency.orders;
+    mac_effects_state_changed();
   }
+}
 
-  // add focused app last
-  if (focused_pid > 0)
-    output_pids[output_count++] = focused_pid;
+// op on pid took latency_ns (synchronous calls)
+static void latency_sample(pid_t pid, WMLatencyOp op, uint64_t latency_ns) {
+  const char *bundle = bundle_for_pid(pid);
+  if (bundle)
+    latency_recorded(pid, op,
+                     wm_latency_record(&g_latency, bundle, op, latency_ns));
+}
 
-  return output_count;
+// op on pid completed (its workspace notification arrived)
+static void latency_finish(pid_t pid, WMLatencyOp op) {
+  const char *bundle = bundle_for_pid(pid);
+  if (bundle == NULL)
+    return;
+  int result =
+      wm_latency_finish(&g_latency, pid, op, bundle, mac_timer_now());
+  if (result >= 0)
+    latency_recorded(pid, op, result > 0);
 }
 
 #pragma mark - atomic operations
 
-// raise an app by pid, unhiding and unminimizing if needed
-static void raise_app(pid_t pid) {
+// the next activation of pid is dwin's doing
+static void expect_activation(pid_t pid) {
+  if (g_events)
+    wm_events_expect(g_events, pid, mac_timer_now());
+}
+
+// raise an app by pid, unhiding and unminimizing if needed. Returns the
+// error of the first accessibility call that failed
+static AXError raise_app(pid_t pid) {
   NSRunningApplication *nsapp = app_for_pid(pid);
 
   // unhide app if needed
   if (nsapp) {
     if (nsapp.isHidden) {
+      expect_activation(pid);
       [nsapp unhide];
     }
   }
 
-  AXUIElementRef ax_app = AXUIElementCreateApplication(pid);
-  if (ax_app == NULL) {
-    return;
+  MacAppHandle *handle = handle_for_pid(pid);
+  if (handle == NULL)
+    return kAXErrorSuccess;
+
+  AXUIElementRef main_window = window_for_handle(handle);
+  if (main_window == NULL)
+    return kAXErrorSuccess;
+
+  // check if window is minimized and unminimize it
+  CFBooleanRef minimized = NULL;
+  AXError err = AXUIElementCopyAttributeValue(
+      main_window, kAXMinimizedAttribute, (CFTypeRef *)&minimized);
+  if (err == kAXErrorInvalidUIElement) {
+    // window went away, drop the cached objects
+    wm_state_invalidate_backend(g_effects_state, pid);
+    return err;
   }
-
-  // get main window
-  AXUIElementRef main_window = NULL;
-  AXError err = AXUIElementCopyAttributeValue(ax_app, kAXMainWindowAttribute,
-                                              (CFTypeRef *)&main_window);
-
-  if (err == kAXErrorSuccess && main_window != NULL) {
-    // check if window is minimized and unminimize it
-    CFBooleanRef minimized = NULL;
-    AXUIElementCopyAttributeValue(main_window, kAXMinimizedAttribute,
-                                  (CFTypeRef *)&minimized);
-    if (minimized == kCFBooleanTrue) {
-      AXUIElementSetAttributeValue(main_window, kAXMinimizedAttribute,
-                                   kCFBooleanFalse);
-      if (minimized)
-        CFRelease(minimized);
-    }
-
-    // raise the window
-    AXUIElementPerformAction(main_window, kAXRaiseAction);
-    CFRelease(main_window);
+  if (err == kAXErrorCannotComplete)
+    return err; // not answering, don't queue more calls behind it
+  if (minimized == kCFBooleanTrue) {
+    AXUIElementSetAttributeValue(main_window, kAXMinimizedAttribute,
+                                 kCFBooleanFalse);
   }
+  if (minimized)
+    CFRelease(minimized);
 
-  CFRelease(ax_app);
+  // raise the window
+  return AXUIElementPerformAction(main_window, kAXRaiseAction);
 }
 
 // activate an app by pid
 static void activate_app(pid_t pid) {
   NSRunningApplication *app = app_for_pid(pid);
   if (app) {
+    expect_activation(pid);
+    wm_latency_start(&g_latency, pid, WM_OP_ACTIVATE, mac_timer_now());
     [app activateWithOptions:NSApplicationActivateAllWindows];
   }
 }
@@ -127,73 +289,210 @@ static void activate_app(pid_t pid) {
 static void hide_app(pid_t pid) {
   NSRunningApplication *app = app_for_pid(pid);
   if (app) {
+    wm_latency_start(&g_latency, pid, WM_OP_HIDE, mac_timer_now());
     [app hide];
   }
 }
 
-#pragma mark - buffer switch phases
-static pid_t show_buffer_apps(WMState *state, int buffer_index,
-                              pid_t *buffer_pids, int buffer_count) {
-
-  if (buffer_count == 0) {
-    // empty buffer -> don't activate anything (leave it empty)
-    return 0;
+// unhide an app by pid if it is hidden
+static void unhide_app(pid_t pid) {
+  NSRunningApplication *app = app_for_pid(pid);
+  if (app && app.isHidden) {
+    expect_activation(pid);
+    wm_latency_start(&g_latency, pid, WM_OP_UNHIDE, mac_timer_now());
+    [app unhide];
   }
+}
 
-  // find app to focus
-  pid_t focused_pid =
-      find_app_to_focus(state, buffer_index, buffer_pids, buffer_count);
+#pragma mark - app health
 
-  // reorder apps so focused app is LAST
-  pid_t ordered_pids[WM_MAX_APPS];
-  int ordered_count = reorder_apps_for_raise(buffer_pids, buffer_count,
-                                             focused_pid, ordered_pids);
+static void health_retry(void *context, int64_t argument);
 
-  // raise apps that need it
-  for (int i = 0; i < ordered_count; i++) {
-    pid_t pid = ordered_pids[i];
-    NSRunningApplication *app = app_for_pid(pid);
-    if (should_raise_app(app, focused_pid)) {
-      raise_app(pid);
-    }
-  }
+// wake up when the earliest open breaker lets a probe through
+static void arm_health_retry(void) {
+  mac_timer_cancel(&g_health_timer);
+  uint64_t retry = wm_health_next_retry(&g_health);
+  if (retry != 0)
+    g_health_timer = mac_timer_at(retry, health_retry, NULL, 0);
+}
 
-  // activate focused app last
-  if (focused_pid > 0) {
-    activate_app(focused_pid);
-  }
+// an accessibility call into pid began at begin_ns and returned err: feed
+// its breaker
+static void record_ax_health(pid_t pid, uint64_t begin_ns, AXError err) {
+  uint64_t now = mac_timer_now();
+  WMCallResult result = WM_CALL_OK;
+  if (err == kAXErrorCannotComplete)
+    result = WM_CALL_TIMEOUT; // messaging timeout, the app is not answering
+  else if (err == kAXErrorFailure)
+    result = WM_CALL_FAILED;
+
+  const WMAppHealth *app = wm_health_get(&g_health, pid);
+  WMBreakerState before =
+      app ? (WMBreakerState)app->state : WM_BREAKER_CLOSED;
+  WMBreakerState after =
+      wm_health_record(&g_health, pid, result, now - begin_ns, now);
+  if (after == before)
+    return;
+
+  char text[1024];
+  wm_health_describe(&g_health, text, sizeof(text));
+  NSLog(@"[Health] pid %d %s -> %s after %.1f ms\n%s", pid,
+        wm_health_state_name(before), wm_health_state_name(after),
+        (now - begin_ns) / 1e6, text);
+  arm_health_retry();
+}
+
+// an accessibility call (op) into pid began at begin_ns and returned err
+static void record_ax_call(pid_t pid, WMLatencyOp op, uint64_t begin_ns,
+                           AXError err) {
+  if (err != kAXErrorCannotComplete) // a timeout isn't a latency
+    latency_sample(pid, op, mac_timer_now() - begin_ns);
+  record_ax_health(pid, begin_ns, err);
+}
+
+// raise through pid's breaker, skipped while it is open
+static void raise_app_guarded(pid_t pid) {
+  uint64_t begin_ns = mac_timer_now();
+  if (!wm_health_allow(&g_health, pid, begin_ns))
+    return;
+  AXError err = raise_app(pid);
+  record_ax_call(pid, WM_OP_RAISE, begin_ns, err);
+}
+
+static void min_sizes_relayout(void *context) {
+  (void)context;
+  g_min_sizes_relayout_queued = false;
+  if (g_apply_layout)
+    g_apply_layout();
+}
 
-  return focused_pid;
+static void min_sizes_save_due(void *context, int64_t argument) {
+  (void)context;
+  (void)argument;
+  g_min_sizes_timer = 0;
+  if (g_min_sizes_path[0] != '\0' && g_min_sizes.dirty &&
+      !wm_minsize_save(&g_min_sizes, g_min_sizes_path))
+    NSLog(@"[Layout] can't save minimum sizes to %s", g_min_sizes_path);
 }
 
-static void hide_buffer_apps(WMState *state, int old_buffer_index,
-                             int new_buffer_index) {
-  // startup state, no old buffer
-  if (old_buffer_index < 0 || old_buffer_index >= WM_MAX_BUFFERS)
+static AXError read_window_size(pid_t pid, WMSize *size);
+
+// pid's window was asked for requested and has settled: read back its size
+// (through its breaker) and learn from it. A new minimum makes the next
+// layout (queued after this turn) leave it room
+static void check_size(pid_t pid, WMRect requested) {
+  uint64_t begin_ns = mac_timer_now();
+  if (handle_for_pid(pid) == NULL || // quit since
+      !wm_health_allow(&g_health, pid, begin_ns))
+    return;
+  WMSize size;
+  AXError err = read_window_size(pid, &size);
+  record_ax_health(pid, begin_ns, err);
+  if (err != kAXErrorSuccess)
     return;
 
-  pid_t old_pids[WM_MAX_APPS];
-  int old_count =
-      wm_state_get_buffer_pids(state, old_buffer_index, old_pids, WM_MAX_APPS);
+  MacAppHandle *handle = handle_for_pid(pid);
+  if (handle)
+    handle->size_measured = true;
+  bool learned = wm_state_learn_min_size(g_effects_state, pid, requested, size);
+  if (g_min_sizes.dirty && g_min_sizes_timer == 0)
+    g_min_sizes_timer =
+        mac_timer_after(MIN_SIZE_SAVE_DELAY_MS, min_sizes_save_due, NULL, 0);
+  if (!learned)
+    return;
 
-  for (int i = 0; i < old_count; i++) {
-    pid_t pid = old_pids[i];
-    const WMApp *app = wm_state_find_app(state, pid);
+  WMSize min = wm_state_min_size(g_effects_state, pid);
+  NSLog(@"[Layout] %s takes at least %.0fx%.0f", bundle_for_pid(pid),
+        min.width, min.height);
+  mac_effects_state_changed();
+  if (!g_min_sizes_relayout_queued) {
+    g_min_sizes_relayout_queued = true;
+    dispatch_async_f(dispatch_get_main_queue(), NULL, min_sizes_relayout);
+  }
+}
 
-    // hide if app is no longer in the new buffer
-    if (!app || app->buffer_index != new_buffer_index) {
-      hide_app(pid);
+// read back the sizes whose resizes settled, wait for the rest
+static void size_checks_due(void *context, int64_t argument) {
+  (void)context;
+  (void)argument;
+  g_size_check_timer = 0;
+
+  uint64_t now = mac_timer_now();
+  uint64_t next = 0;
+  int kept = 0;
+  for (int i = 0; i < g_size_check_count; i++) {
+    SizeCheck check = g_size_checks[i];
+    if (check.due_ns <= now) {
+      check_size(check.pid, check.requested);
+      continue;
     }
+    g_size_checks[kept++] = check;
+    if (next == 0 || check.due_ns < next)
+      next = check.due_ns;
   }
+  g_size_check_count = kept;
+  if (next != 0)
+    g_size_check_timer = mac_timer_at(next, size_checks_due, NULL, 0);
 }
 
-// hide apps not in current buffer
+// pid's window was resized to requested: read its size back once it
+// settled, if its app wasn't measured yet or is known to refuse sizes
+static void check_size_later(pid_t pid, WMRect requested) {
+  MacAppHandle *handle = handle_for_pid(pid);
+  const char *bundle = bundle_for_pid(pid);
+  if (g_effects_state == NULL || g_effects_state->min_sizes == NULL ||
+      handle == NULL || bundle == NULL ||
+      (handle->size_measured && !wm_minsize_tracked(&g_min_sizes, bundle)))
+    return;
+
+  // a newer resize of the window replaces the one waiting
+  int index = 0;
+  while (index < g_size_check_count && g_size_checks[index].pid != pid)
+    index++;
+  if (index == WM_MAX_APPS)
+    return;
+  if (index == g_size_check_count)
+    g_size_check_count++;
+  uint64_t due_ns = mac_timer_now() + MIN_SIZE_SETTLE_MS * 1000000ull;
+  g_size_checks[index] =
+      (SizeCheck){.pid = pid, .requested = requested, .due_ns = due_ns};
+  if (g_size_check_timer == 0)
+    g_size_check_timer = mac_timer_at(due_ns, size_checks_due, NULL, 0);
+}
+
+static AXError apply_frame(pid_t pid, WMRect frame);
+static AXError set_window_frame(AXUIElementRef window, WMRect frame);
+static AXError read_window_frame(pid_t pid, WMRect *frame);
+static AXError count_windows(pid_t pid, CFIndex *count);
+
+static void park_write_due(void *context) {
+  (void)context;
+  g_park_write_queued = false;
+  if (g_park_path[0] != '\0' && g_park.dirty &&
+      !wm_park_write(&g_park, g_park_path))
+    NSLog(@"[Park] can't save parked windows to %s", g_park_path);
+}
+
+// windows were parked or put back, write them once this turn is over
+static void park_changed(void) {
+  if (!g_park.dirty || g_park_path[0] == '\0' || g_park_write_queued)
+    return;
+  g_park_write_queued = true;
+  dispatch_async_f(dispatch_get_main_queue(), NULL, park_write_due);
+}
+
+#pragma mark - effect executor
+
+// hide apps not in current view
 static void hide_apps_not_in_current_buffer(WMState *state) {
+  WMBufferMask view = wm_state_get_shown(state);
+
   for (int i = 0; i < state->app_registry.app_count; i++) {
     WMApp *wm_app = &state->app_registry.apps[i];
 
-    // skip apps in current buffer
-    if (wm_app->buffer_index == state->active_buffer)
+    // skip apps in current view, and parked ones (already off screen)
+    if ((state->app_registry.buffer_masks[i] & view) != 0 ||
+        wm_park_is_parked(&g_park, wm_app->pid))
       continue;
 
     NSRunningApplication *app = app_for_pid(wm_app->pid);
@@ -203,153 +502,672 @@ static void hide_apps_not_in_current_buffer(WMState *state) {
   }
 }
 
-static void cleanup_handler(void) {
-  if (g_cleanup_state)
-    hide_apps_not_in_current_buffer(g_cleanup_state);
-  g_cleanup_timer = NULL;
+// apps of hidden buffers whose windows are parked rather than hidden
+static bool parks_app(pid_t pid) {
+  const WMApp *app = wm_state_find_app(g_effects_state, pid);
+  return app != NULL && g_effects_config != NULL &&
+         wm_park_mode(g_effects_config, &g_latency, app->bundle_identifier) ==
+             WM_VISIBILITY_PARK;
+}
+
+// move pid's window past a corner of its display. Only an app with a single
+// window is parked (the store has one frame per app), one with more or none,
+// or that isn't answering, is hidden instead
+static void park_window(pid_t pid, uint64_t begin_ns) {
+  if (!wm_health_allow(&g_health, pid, begin_ns)) {
+    hide_app(pid);
+    return;
+  }
+
+  // from here on the call is recorded whatever happens, a probe left
+  // unrecorded would keep the breaker half-open
+  CFIndex windows = 0;
+  AXError err = count_windows(pid, &windows);
+  WMRect frame = {0};
+  WMRect parked;
+  bool saved = false;
+  if (err == kAXErrorSuccess && windows == 1) {
+    if (!wm_park_is_parked(&g_park, pid))
+      err = read_window_frame(pid, &frame);
+    saved = err == kAXErrorSuccess &&
+            wm_park_save(&g_park, g_effects_state, pid, frame, &parked);
+    if (saved)
+      err = apply_frame(pid, parked);
+  } else if (err == kAXErrorSuccess &&
+             wm_park_restore(&g_park, g_effects_state, pid, &frame)) {
+    // opened another window while parked: all of them are hidden, the
+    // parked one back where it was
+    err = apply_frame(pid, frame);
+  }
+  record_ax_call(pid, WM_OP_FRAME, begin_ns, err);
+  park_changed();
+  if (saved && err == kAXErrorSuccess)
+    return;
+
+  if (saved)
+    wm_park_forget(&g_park, pid);
+  hide_app(pid);
 }
 
-static void schedule_cleanup(WMState *state) {
-  g_cleanup_state = state;
+// put pid's window back where it was parked from
+static void unpark_window(pid_t pid, uint64_t begin_ns) {
+  WMRect frame;
+  if (!wm_park_restore(&g_park, g_effects_state, pid, &frame))
+    return;
+  AXError err = apply_frame(pid, frame);
+  record_ax_call(pid, WM_OP_FRAME, begin_ns, err);
+  park_changed();
+}
 
-  // cancel existing timer
-  if (g_cleanup_timer != NULL) {
-    dispatch_source_cancel(g_cleanup_timer);
-    g_cleanup_timer = NULL;
+// dwin is dying of a signal: put the parked windows back through the
+// windows already resolved, nothing else (best effort, the process may be
+// broken). If one can't be, the file has it for the next start
+static void unpark_on_crash(void) {
+  bool restored = true;
+  WMRect frame;
+  while (g_park.count > 0) {
+    pid_t pid = g_park.windows[0].pid;
+    MacAppHandle *handle = handle_for_pid(pid);
+    AXUIElementRef window = handle ? handle->ax_window : NULL;
+    if (!wm_park_restore(&g_park, g_effects_state, pid, &frame) ||
+        window == NULL || set_window_frame(window, frame) != kAXErrorSuccess)
+      restored = false;
   }
+  if (restored && g_park_path[0] != '\0')
+    unlink(g_park_path);
+}
 
-  // create and start new timer
-  g_cleanup_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
-                                           dispatch_get_main_queue());
-  dispatch_source_set_timer(
-      g_cleanup_timer,
-      dispatch_time(DISPATCH_TIME_NOW, (int64_t)(0.2 * NSEC_PER_SEC)),
-      DISPATCH_TIME_FOREVER, 0);
+// accessibility effects are deferred while their app's breaker is open.
+// Only those that are sure to make a call ask it (an allowed probe must be
+// recorded): moving a window off screen asks when it runs, putting back one
+// that is no longer off screen makes no call
+static bool executor_effect_ready(const WMEffect *effect, void *context) {
+  (void)context;
+  switch (effect->kind) {
+  case WM_EFFECT_RAISE:
+  case WM_EFFECT_FRAME:
+    break;
+  case WM_EFFECT_UNPARK:
+    if (!wm_park_is_parked(&g_park, effect->pid))
+      return true;
+    break;
+  default:
+    return true;
+  }
+  return wm_health_allow(&g_health, effect->pid, mac_timer_now());
+}
 
-  dispatch_source_set_event_handler(g_cleanup_timer, ^{
-    cleanup_handler();
-  });
-  dispatch_resume(g_cleanup_timer);
+static void executor_run_effect(const WMEffect *effect, void *context) {
+  (void)context;
+  uint64_t begin_ns = mac_timer_now();
+
+  switch (effect->kind) {
+  case WM_EFFECT_UNHIDE:
+    unhide_app(effect->pid);
+    break;
+  case WM_EFFECT_RAISE: {
+    AXError err = raise_app(effect->pid);
+    record_ax_call(effect->pid, WM_OP_RAISE, begin_ns, err);
+    break;
+  }
+  case WM_EFFECT_ACTIVATE:
+    if (mac_effects_get_focused_pid() != effect->pid)
+      activate_app(effect->pid);
+    break;
+  case WM_EFFECT_FRAME: {
+    AXError err = apply_frame(effect->pid, effect->frame);
+    record_ax_call(effect->pid, WM_OP_FRAME, begin_ns, err);
+    if (err == kAXErrorSuccess)
+      check_size_later(effect->pid, effect->frame);
+    break;
+  }
+  case WM_EFFECT_HIDE:
+    hide_app(effect->pid);
+    break;
+  case WM_EFFECT_CLEANUP:
+    hide_apps_not_in_current_buffer(g_effects_state);
+    break;
+  case WM_EFFECT_PARK:
+    park_window(effect->pid, begin_ns);
+    break;
+  case WM_EFFECT_UNPARK:
+    unpark_window(effect->pid, begin_ns);
+    break;
+  }
 }
 
-#pragma mark - public api
+static void executor_turn(void *context);
 
-void mac_switch_buffer(WMState *state, int new_buffer_index) {
-  // validate input
-  if (new_buffer_index < 0 || new_buffer_index >= WM_MAX_BUFFERS)
+// run one executor turn now, deferred effects continue on the next turn of
+// the main run loop (input and notifications get handled in between)
+static void executor_kick(void) {
+  bool in_batch = g_executor.in_batch;
+  if (wm_executor_run(&g_executor)) {
+    if (!g_executor_turn_queued) {
+      g_executor_turn_queued = true;
+      dispatch_async_f(dispatch_get_main_queue(), NULL, executor_turn);
+    }
     return;
+  }
+
+  if (in_batch && !g_executor.in_batch) {
+    const WMExecutorTiming *timing = &g_executor.last;
+    WM_LOG(WM_LOG_EFFECTS_DONE, timing->effects, timing->turns,
+           timing->critical_ns / 1e6, timing->total_ns / 1e6);
+  }
+}
+
+static void executor_turn(void *context) {
+  (void)context;
+  g_executor_turn_queued = false;
+  executor_kick();
+}
+
+// a breaker's backoff ran out: give the deferred effects another go
+static void health_retry(void *context, int64_t argument) {
+  (void)context;
+  (void)argument;
+  g_health_timer = 0;
+  wm_executor_requeue(&g_executor);
+  executor_kick();
+  arm_health_retry();
+}
+
+static void queue_effect(WMEffectClass effect_class, WMEffectKind kind,
+                         pid_t pid) {
+  WMEffect effect = {.kind = kind, .pid = pid};
+  wm_executor_push(&g_executor, effect_class, &effect);
+}
 
-  int old_buffer_index = state->active_buffer;
-  if (old_buffer_index == new_buffer_index)
-    return; // no-op if same buffer
+#pragma mark - buffer switch stages
 
-  // set flag to block focus tracking
-  g_is_switching_buffer = true;
+static uint64_t switch_clock(void *context) {
+  (void)context;
+  return mac_timer_now();
+}
 
-  // update state first
-  state->active_buffer = new_buffer_index;
+static void switch_deadline(void *context, int64_t argument);
+
+// rearm the timer for the deadline of the stage in flight. Activations up to
+// then (or shortly after the last stage) are side effects of the switch
+static void switch_changed(void) {
+  mac_timer_cancel(&g_switch_timer);
+
+  uint64_t deadline = wm_switch_next_deadline(&g_switch);
+  if (deadline == 0) {
+    if (g_events)
+      wm_events_suppress(g_events, mac_timer_now() +
+                                       WM_EVENT_QUIET_MS * NSEC_PER_MSEC);
+    return;
+  }
 
-  // get pids from new buffer
-  pid_t new_pids[WM_MAX_APPS];
-  int new_count =
-      wm_state_get_buffer_pids(state, new_buffer_index, new_pids, WM_MAX_APPS);
+  if (g_events)
+    wm_events_suppress(g_events, deadline);
+  g_switch_timer = mac_timer_at(deadline, switch_deadline, NULL, 0);
+}
 
-  // show new buffer apps (raise and activate)
-  show_buffer_apps(state, new_buffer_index, new_pids, new_count);
+static void switch_deadline(void *context, int64_t argument) {
+  (void)context;
+  (void)argument;
+  g_switch_timer = 0;
+  wm_switch_tick(&g_switch);
+  switch_changed();
+}
 
-  // hide old buffer aps
-  hide_buffer_apps(state, old_buffer_index, new_buffer_index);
+static void plans_due(void *context, int64_t argument) {
+  (void)context;
+  (void)argument;
+  g_plans_timer = 0;
+  if (g_effects_state == NULL || g_effects_config == NULL)
+    return;
 
-  // schedule cleanup
-  schedule_cleanup(state);
+  // not idle yet, the switch changes the state again as it ends
+  if (wm_switch_active(&g_switch)) {
+    g_plans_timer = mac_timer_after(PLANS_IDLE_MS, plans_due, NULL, 0);
+    return;
+  }
+  wm_plans_refresh(&g_plans, g_effects_state, &g_latency, g_effects_config);
+}
 
-  // remember which app should have focus
-  pid_t final_focused_pid = 0;
-  if (new_count > 0) {
-    WMBuffer *new_buffer = &state->buffers[new_buffer_index];
-    if (new_buffer->last_focused_pid > 0) {
-      for (int i = 0; i < new_count; i++) {
-        if (new_pids[i] == new_buffer->last_focused_pid) {
-          final_focused_pid = new_buffer->last_focused_pid;
-          break;
-        }
+static void switch_run_stage(WMSwitch *sw, WMSwitchStage stage,
+                             void *context) {
+  (void)context;
+  const WMSwitchPlan *plan = &sw->plan;
+  pid_t focus_pid = plan->focus_pid;
+
+  switch (stage) {
+  case WM_SWITCH_UNHIDE:
+    // a new switch supersedes what the last one still had queued
+    wm_executor_begin(&g_executor);
+
+    // only the focus target is waited for, the others come up later.
+    // Parked windows move back, their apps never left
+    for (int i = 0; i < plan->show_count; i++) {
+      if (wm_park_is_parked(&g_park, plan->show[i])) {
+        queue_effect(plan->show[i] == focus_pid ? WM_EFFECT_CRITICAL
+                                                : WM_EFFECT_VISIBLE,
+                     WM_EFFECT_UNPARK, plan->show[i]);
+        continue;
       }
+      NSRunningApplication *app = app_for_pid(plan->show[i]);
+      if (!app || !app.isHidden)
+        continue;
+      if (plan->show[i] == focus_pid) {
+        wm_switch_expect(sw, focus_pid);
+        queue_effect(WM_EFFECT_CRITICAL, WM_EFFECT_UNHIDE, focus_pid);
+      } else {
+        queue_effect(WM_EFFECT_VISIBLE, WM_EFFECT_UNHIDE, plan->show[i]);
+      }
+    }
+    break;
+  case WM_SWITCH_RAISE: {
+    // apps shared with the view on screen are already up
+    bool raised = false;
+    for (int i = 0; i < plan->show_count; i++) {
+      pid_t pid = plan->show[i];
+      if (pid == focus_pid || (wm_state_get_buffer_mask(g_effects_state, pid) &
+                               plan->shown_view) != 0)
+        continue;
+      queue_effect(WM_EFFECT_VISIBLE, WM_EFFECT_RAISE, pid);
+      raised = true;
     }
-    if (final_focused_pid == 0 && new_count > 0) {
-      final_focused_pid = new_pids[0];
+    if (focus_pid > 0) {
+      queue_effect(WM_EFFECT_CRITICAL, WM_EFFECT_RAISE, focus_pid);
+      // the others are raised after it, put it back on top
+      if (raised)
+        queue_effect(WM_EFFECT_VISIBLE, WM_EFFECT_RAISE, focus_pid);
     }
+    break;
+  }
+  case WM_SWITCH_ACTIVATE:
+    // empty view -> don't activate anything (leave it empty)
+    if (focus_pid > 0 && mac_effects_get_focused_pid() != focus_pid) {
+      wm_switch_expect(sw, focus_pid);
+      queue_effect(WM_EFFECT_CRITICAL, WM_EFFECT_ACTIVATE, focus_pid);
+    }
+    break;
+  case WM_SWITCH_HIDE:
+    // nothing on screen waits for these
+    for (int i = 0; i < plan->hide_count; i++) {
+      NSRunningApplication *app = app_for_pid(plan->hide[i]);
+      if (!app || app.isHidden)
+        continue;
+      queue_effect(WM_EFFECT_BACKGROUND,
+                   parks_app(plan->hide[i]) ? WM_EFFECT_PARK : WM_EFFECT_HIDE,
+                   plan->hide[i]);
+    }
+    break;
+  case WM_SWITCH_LAYOUT:
+    // frames of the view are queued as visible effects
+    if (g_apply_layout)
+      g_apply_layout();
+    break;
+  default:
+    break;
   }
 
-  // clear flag after delay, then re-activate focused app
-  int clear_delay_ms = (new_count > 0) ? (new_count * 50 + 50) : 50;
-  dispatch_after(
-      dispatch_time(DISPATCH_TIME_NOW,
-                    (int64_t)(clear_delay_ms * NSEC_PER_MSEC)),
-      dispatch_get_main_queue(), ^{
-        g_is_switching_buffer = false;
+  executor_kick();
+}
 
-        // re-activate focused app to override any finder activation
-        if (final_focused_pid > 0) {
-          NSRunningApplication *refocus_app = [NSRunningApplication
-              runningApplicationWithProcessIdentifier:final_focused_pid];
-          if (refocus_app) {
-            [refocus_app activateWithOptions:NSApplicationActivateAllWindows];
-          }
-        }
-      });
+static void switch_finish(WMSwitch *sw, void *context) {
+  (void)context;
+
+  // re-activate focused app to override any finder activation
+  pid_t focus_pid = sw->plan.focus_pid;
+  if (focus_pid > 0)
+    queue_effect(WM_EFFECT_CRITICAL, WM_EFFECT_ACTIVATE, focus_pid);
+
+  // apps launched or retagged during the switch may still be up
+  queue_effect(WM_EFFECT_BACKGROUND, WM_EFFECT_CLEANUP, 0);
+  executor_kick();
+  mac_effects_state_changed();
+
+  const WMSwitchTiming *timing = &sw->last;
+  WM_LOG(WM_LOG_SWITCH_DONE, sw->plan.primary_buffer, timing->focus_ns / 1e6,
+         timing->total_ns / 1e6, timing->timed_out);
+  WM_LOG(WM_LOG_SWITCH_STAGES, timing->stage_ns[WM_SWITCH_UNHIDE] / 1e6,
+         timing->stage_ns[WM_SWITCH_RAISE] / 1e6,
+         timing->stage_ns[WM_SWITCH_ACTIVATE] / 1e6,
+         timing->stage_ns[WM_SWITCH_HIDE] / 1e6,
+         timing->stage_ns[WM_SWITCH_LAYOUT] / 1e6);
 }
 
-WMRect mac_effects_get_visible_screen_rect(void) {
-  NSScreen *screen = [NSScreen mainScreen];
-  NSRect frame = [screen frame];
+// feed hide/unhide notifications to the switch in flight and time them
+static void observe_switch_completions(void) {
+  NSNotificationCenter *center =
+      [[NSWorkspace sharedWorkspace] notificationCenter];
+  NSString *names[] = {NSWorkspaceDidUnhideApplicationNotification,
+                       NSWorkspaceDidHideApplicationNotification};
+  WMSwitchStage stages[] = {WM_SWITCH_UNHIDE, WM_SWITCH_HIDE};
+  WMLatencyOp ops[] = {WM_OP_UNHIDE, WM_OP_HIDE};
+
+  for (int i = 0; i < 2; i++) {
+    WMSwitchStage stage = stages[i];
+    WMLatencyOp op = ops[i];
+    [center addObserverForName:names[i]
+                        object:nil
+                         queue:[NSOperationQueue mainQueue]
+                    usingBlock:^(NSNotification *notification) {
+                      NSRunningApplication *app =
+                          notification.userInfo[NSWorkspaceApplicationKey];
+                      if (!app)
+                        return;
+                      pid_t pid = app.processIdentifier;
+                      latency_finish(pid, op);
+                      if (wm_switch_complete(&g_switch, stage, pid))
+                        switch_changed();
+                    }];
+  }
+}
+
+#pragma mark - public api
+
+void mac_effects_attach(WMState *state, WMEventCoalescer *events,
+                        void (*apply_layout)(void)) {
+  g_effects_state = state;
+  g_events = events;
+  g_apply_layout = apply_layout;
+
+  WMBackendHooks hooks = {
+      .acquire = handle_acquire, .release = handle_release, .context = NULL};
+  wm_state_set_backend_hooks(state, &hooks);
+
+  WMSwitchBackend backend = {.run_stage = switch_run_stage,
+                             .finish = switch_finish,
+                             .clock = switch_clock,
+                             .context = NULL};
+  wm_switch_init(&g_switch, &backend);
+  wm_latency_init(&g_latency);
+  g_switch.latency = &g_latency;
+  wm_plans_init(&g_plans);
+  g_switch.plans = &g_plans;
+  wm_park_init(&g_park);
+  wm_minsize_init(&g_min_sizes);
+  state->min_sizes = &g_min_sizes;
+
+  WMExecutorBackend executor_backend = {.run = executor_run_effect,
+                                        .clock = switch_clock,
+                                        .ready = executor_effect_ready,
+                                        .context = NULL};
+  wm_executor_init(&g_executor, &executor_backend, WM_EFFECT_BUDGET_MS);
+  wm_health_init(&g_health, WM_HEALTH_SLOW_MS);
+
+  observe_switch_completions();
+}
+
+void mac_effects_configure(const WMConfig *config) {
+  g_effects_config = config;
+  wm_executor_set_budget(&g_executor, (uint32_t)config->effect_budget_ms);
+  g_ax_timeout_s = config->ax_timeout_ms / 1000.0f;
+}
+
+void mac_effects_forget_app(pid_t pid) {
+  wm_health_forget(&g_health, pid);
+  wm_park_forget(&g_park, pid);
+  park_changed();
+}
+
+void mac_effects_unpark_all(void) {
+  while (g_park.count > 0)
+    unpark_window(g_park.windows[0].pid, mac_timer_now());
+  if (g_park_path[0] != '\0' && g_park.dirty &&
+      !wm_park_write(&g_park, g_park_path))
+    NSLog(@"[Park] can't save parked windows to %s", g_park_path);
+}
+
+void mac_effects_load_parked(const char *path) {
+  snprintf(g_park_path, sizeof(g_park_path), "%s", path);
+  int count = wm_park_read(&g_park, g_effects_state, path);
+  if (count > 0) {
+    NSLog(@"[Park] putting back %d windows the last run left parked", count);
+    mac_effects_unpark_all();
+  }
+  wm_log_set_crash_hook(unpark_on_crash);
+}
+
+void mac_effects_load_latency(const char *path) {
+  snprintf(g_latency_path, sizeof(g_latency_path), "%s", path);
+  if (wm_latency_load(&g_latency, path))
+    NSLog(@"[Latency] loaded estimates for %d apps",
+          g_latency.table.entry_count);
+}
+
+void mac_effects_load_min_sizes(const char *path) {
+  snprintf(g_min_sizes_path, sizeof(g_min_sizes_path), "%s", path);
+  if (wm_minsize_load(&g_min_sizes, path))
+    NSLog(@"[Layout] loaded minimum sizes of %d apps",
+          g_min_sizes.table.entry_count);
+}
+
+void mac_effects_queue_frames(const WMFrameChange *changes, int count) {
+  for (int i = 0; i < count; i++) {
+    WMEffect effect = {.kind = WM_EFFECT_FRAME,
+                       .pid = changes[i].pid,
+                       .frame = changes[i].frame};
+    wm_executor_push(&g_executor, WM_EFFECT_VISIBLE, &effect);
+  }
+  executor_kick();
+}
+
+void mac_switch_buffer(WMState *state, int new_buffer_index) {
+  // validate input
+  if (new_buffer_index < 0 || new_buffer_index >= WM_MAX_BUFFERS)
+    return;
+
+  mac_switch_view(state, new_buffer_index, WM_BUFFER_BIT(new_buffer_index));
+}
+
+void mac_switch_view(WMState *state, int primary_buffer,
+                     WMBufferMask view_mask) {
+  // a switch in flight is cancelled, its leftovers hidden by this one
+  if (wm_switch_begin(&g_switch, state, primary_buffer, view_mask))
+    switch_changed();
+}
 
+void mac_effects_state_changed(void) {
+  mac_timer_cancel(&g_plans_timer);
+  g_plans_timer = mac_timer_after(PLANS_IDLE_MS, plans_due, NULL, 0);
+}
+
+int mac_effects_ready_frames(const WMFrameChange **frames) {
+  if (g_effects_state == NULL)
+    return -1;
+  return wm_switch_ready_frames(&g_switch, g_effects_state, frames);
+}
+
+void mac_effects_note_activation(pid_t pid) {
+  latency_finish(pid, WM_OP_ACTIVATE);
+  if (wm_switch_complete(&g_switch, WM_SWITCH_ACTIVATE, pid))
+    switch_changed();
+}
+
+void mac_effects_update_visibility(WMState *state, pid_t pid) {
+  bool visible =
+      (wm_state_get_buffer_mask(state, pid) & wm_state_get_shown(state)) != 0;
+  NSRunningApplication *app = app_for_pid(pid);
+  if (!app)
+    return;
+
+  if (visible && wm_park_is_parked(&g_park, pid)) {
+    unpark_window(pid, mac_timer_now());
+    raise_app_guarded(pid);
+  } else if (visible && app.isHidden) {
+    raise_app_guarded(pid);
+  } else if (!visible && !app.isHidden) {
+    // parking again hides a parked app that opened another window
+    if (parks_app(pid) || wm_park_is_parked(&g_park, pid))
+      park_window(pid, mac_timer_now());
+    else
+      [app hide];
+  }
+}
+
+// AppKit frames are bottom-left based on the primary screen, dwin's
+// global coordinates are top-left (as accessibility uses)
+static WMRect rect_from_appkit(NSRect frame) {
+  NSScreen *primary = [[NSScreen screens] firstObject];
+  CGFloat height = primary ? primary.frame.size.height : 0;
   return (WMRect){.x = frame.origin.x,
-                  .y = frame.origin.y,
+                  .y = height - (frame.origin.y + frame.size.height),
                   .width = frame.size.width,
                   .height = frame.size.height};
 }
 
-bool mac_effects_apply_frame(pid_t pid, WMRect frame) {
-  AXUIElementRef app = AXUIElementCreateApplication(pid);
-  if (app == NULL)
-    return false;
+int mac_effects_get_displays(WMDisplayInfo *out, int max) {
+  int count = 0;
+  for (NSScreen *screen in [NSScreen screens]) {
+    if (count >= max)
+      break;
+    NSNumber *number = screen.deviceDescription[@"NSScreenNumber"];
+    out[count].id = number ? number.unsignedIntValue : (uint32_t)count + 1;
+    out[count].frame = rect_from_appkit([screen frame]);
+    out[count].scale = screen.backingScaleFactor;
+    count++;
+  }
+  return count;
+}
 
-  // get main window or first window
-  AXUIElementRef window = NULL;
-  AXError err = AXUIElementCopyAttributeValue(app, kAXMainWindowAttribute,
-                                              (CFTypeRef *)&window);
-  if (err != kAXErrorSuccess || window == NULL) {
-    // fallback to first window
-    CFArrayRef windows = NULL;
-    err = AXUIElementCopyAttributeValue(app, kAXWindowsAttribute,
-                                        (CFTypeRef *)&windows);
-    if (err != kAXErrorSuccess || windows == NULL ||
-        CFArrayGetCount(windows) == 0) {
-      if (windows)
-        CFRelease(windows);
-      if (window)
-        CFRelease(window);
-      CFRelease(app);
-      return false;
-    }
-    window = (AXUIElementRef)CFRetain(CFArrayGetValueAtIndex(windows, 0));
-    CFRelease(windows);
+WMRect mac_effects_get_visible_screen_rect(void) {
+  // the focused display once the screens were reported
+  if (g_effects_state != NULL) {
+    const WMDisplay *display =
+        &g_effects_state->displays[g_effects_state->focused_display];
+    if (display->id != 0)
+      return display->frame;
   }
 
+  NSScreen *screen = [NSScreen mainScreen];
+  return rect_from_appkit([screen frame]);
+}
+
+void mac_effects_get_mouse_point(double *x, double *y) {
+  NSPoint point = [NSEvent mouseLocation];
+  WMRect rect = rect_from_appkit(NSMakeRect(point.x, point.y, 0, 0));
+  *x = rect.x;
+  *y = rect.y;
+}
+
+// set position and size of a window, returns the first error
+static AXError set_window_frame(AXUIElementRef window, WMRect frame) {
   // set position
   CGPoint position = CGPointMake(frame.x, frame.y);
   AXValueRef position_value = AXValueCreate(kAXValueTypeCGPoint, &position);
-  AXUIElementSetAttributeValue(window, kAXPositionAttribute, position_value);
+  AXError err = AXUIElementSetAttributeValue(window, kAXPositionAttribute,
+                                             position_value);
   CFRelease(position_value);
+  if (err != kAXErrorSuccess)
+    return err;
 
   // set size
   CGSize size = CGSizeMake(frame.width, frame.height);
   AXValueRef size_value = AXValueCreate(kAXValueTypeCGSize, &size);
-  AXUIElementSetAttributeValue(window, kAXSizeAttribute, size_value);
+  err = AXUIElementSetAttributeValue(window, kAXSizeAttribute, size_value);
   CFRelease(size_value);
-  CFRelease(window);
-  CFRelease(app);
+  return err;
+}
+
+// set the frame of pid's window, kAXErrorInvalidUIElement if it has none
+static AXError apply_frame(pid_t pid, WMRect frame) {
+  MacAppHandle *handle = handle_for_pid(pid);
+  if (handle == NULL) {
+    // unregistered app (e.g. snapping a blacklisted one), borrow a handle
+    MacAppHandle *temporary = handle_acquire(pid, NULL);
+    if (temporary == NULL)
+      return kAXErrorInvalidUIElement;
+    AXUIElementRef window = window_for_handle(temporary);
+    AXError err = window ? set_window_frame(window, frame)
+                         : kAXErrorInvalidUIElement;
+    handle_release(pid, temporary, NULL);
+    return err;
+  }
+
+  AXUIElementRef window = window_for_handle(handle);
+  if (window) {
+    AXError err = set_window_frame(window, frame);
+    if (err != kAXErrorInvalidUIElement)
+      return err;
+  }
 
+  // cached window is gone (or none yet), resolve a fresh one and retry once
+  wm_state_invalidate_backend(g_effects_state, pid);
+  handle = handle_for_pid(pid);
+  window = handle ? window_for_handle(handle) : NULL;
+  return window ? set_window_frame(window, frame) : kAXErrorInvalidUIElement;
+}
+
+// read the frame of pid's window, kAXErrorInvalidUIElement if it has none
+static AXError read_window_frame(pid_t pid, WMRect *frame) {
+  MacAppHandle *handle = handle_for_pid(pid);
+  AXUIElementRef window = handle ? window_for_handle(handle) : NULL;
+  if (window == NULL)
+    return kAXErrorInvalidUIElement;
+
+  CFTypeRef position_value = NULL;
+  CFTypeRef size_value = NULL;
+  CGPoint position;
+  CGSize size;
+  AXError err = AXUIElementCopyAttributeValue(window, kAXPositionAttribute,
+                                              &position_value);
+  if (err == kAXErrorSuccess)
+    err = AXUIElementCopyAttributeValue(window, kAXSizeAttribute,
+                                        &size_value);
+  if (err == kAXErrorSuccess &&
+      (!AXValueGetValue(position_value, kAXValueTypeCGPoint, &position) ||
+       !AXValueGetValue(size_value, kAXValueTypeCGSize, &size)))
+    err = kAXErrorIllegalArgument;
+  if (position_value)
+    CFRelease(position_value);
+  if (size_value)
+    CFRelease(size_value);
+  if (err == kAXErrorSuccess)
+    *frame = (WMRect){position.x, position.y, size.width, size.height};
+  return err;
+}
+
+// number of windows pid has (minimized ones included)
+static AXError count_windows(pid_t pid, CFIndex *count) {
+  MacAppHandle *handle = handle_for_pid(pid);
+  if (handle == NULL || handle->ax_app == NULL)
+    return kAXErrorInvalidUIElement;
+  return AXUIElementGetAttributeValueCount(handle->ax_app, kAXWindowsAttribute,
+                                           count);
+}
+
+// read the size of pid's window, kAXErrorInvalidUIElement if it has none
+static AXError read_window_size(pid_t pid, WMSize *size) {
+  MacAppHandle *handle = handle_for_pid(pid);
+  AXUIElementRef window = handle ? window_for_handle(handle) : NULL;
+  if (window == NULL)
+    return kAXErrorInvalidUIElement;
+
+  CFTypeRef size_value = NULL;
+  CGSize window_size;
+  AXError err =
+      AXUIElementCopyAttributeValue(window, kAXSizeAttribute, &size_value);
+  if (err == kAXErrorSuccess &&
+      !AXValueGetValue(size_value, kAXValueTypeCGSize, &window_size))
+    err = kAXErrorIllegalArgument;
+  if (size_value)
+    CFRelease(size_value);
+  if (err == kAXErrorSuccess)
+    *size = (WMSize){window_size.width, window_size.height};
+  return err;
+}
+
+bool mac_effects_get_frame(pid_t pid, WMRect *frame) {
+  return read_window_frame(pid, frame) == kAXErrorSuccess;
+}
+
+bool mac_effects_apply_frame(pid_t pid, WMRect frame) {
+  uint64_t begin_ns = mac_timer_now();
+  if (!wm_health_allow(&g_health, pid, begin_ns))
+    return false; // not answering, don't block on it again
+
+  AXError err = apply_frame(pid, frame);
+  record_ax_call(pid, WM_OP_FRAME, begin_ns, err);
+  if (err != kAXErrorSuccess)
+    return false;
+  check_size_later(pid, frame);
   return true;
 }
 
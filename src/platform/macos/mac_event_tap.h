@@ -9,7 +9,7 @@ typedef void (*WMActionCallback)(int action_type, int argument,
                                  const char *bundle_identifier);
 
 // initialize and start the event tap
-bool mac_event_tap_start(WMConfig *config, WMActionCallback callback);
+bool mac_event_tap_start(const WMConfig *config, WMActionCallback callback);
 
 // stop and clean up the event tap
 void mac_event_tap_stop(void);
@@ -1,6 +1,9 @@
 #import "mac_event_tap.h"
 #import "wm_config.h"
+#import "wm_keys.h"
 #import <ApplicationServices/ApplicationServices.h>
+#include <string.h>
+#include <time.h>
 
 // global state for the event tap
 static CFMachPortRef g_event_tap = NULL;
@@ -8,7 +11,10 @@ static CFRunLoopSourceRef g_run_loop_source = NULL;
 static WMActionCallback g_action_callback = NULL;
 static bool g_passthrough_mode = false;
 
-static WMConfig *g_config = NULL;
+static const WMConfig *g_config = NULL;
+static WMKeyMatcher g_matcher;
+static WMActionQueue g_queue;
+static bool g_drain_scheduled = false;
 
 // convert CGEventFlags to WMModifier
 static int flags_to_modifiers(CGEventFlags flags) {
@@ -26,6 +32,42 @@ static int flags_to_modifiers(CGEventFlags flags) {
   return mods;
 }
 
+static void schedule_drain(void);
+
+// run the oldest queued action. One per main loop turn, so keys pressed
+// while it runs reach the queue and can replace what is still pending
+static void drain_queue(void *context) {
+  (void)context;
+  g_drain_scheduled = false;
+
+  WMAction action;
+  if (!wm_action_queue_pop(&g_queue, &action))
+    return;
+
+  if (g_action_callback)
+    g_action_callback(action.type, action.target_buffer,
+                      action.bundle_identifier);
+  schedule_drain();
+}
+
+static void schedule_drain(void) {
+  if (g_drain_scheduled || g_queue.count == 0)
+    return;
+  g_drain_scheduled = true;
+  dispatch_async_f(dispatch_get_main_queue(), NULL, drain_queue);
+}
+
+// queue a fired binding (allocation free: a fixed ring, no block copy)
+static void queue_binding(const WMBinding *binding, bool is_autorepeat) {
+  WMAction action = {.type = binding->action,
+                     .target_buffer = binding->action_argument};
+  memcpy(action.bundle_identifier, binding->bundle_identifier,
+         sizeof(action.bundle_identifier));
+
+  if (wm_action_queue_push(&g_queue, &action, is_autorepeat))
+    schedule_drain();
+}
+
 static CGEventRef event_tap_callback(CGEventTapProxy proxy, CGEventType type,
                                      CGEventRef event, void *user_info) {
   (void)proxy;
@@ -45,49 +87,73 @@ static CGEventRef event_tap_callback(CGEventTapProxy proxy, CGEventType type,
     return event;
   }
 
-  // passthrough mode - all keys pass through
   CGKeyCode keycode =
       (CGKeyCode)CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode);
   CGEventFlags flags = CGEventGetFlags(event);
   int modifiers = flags_to_modifiers(flags);
-  WMAction action;
+  bool is_autorepeat =
+      CGEventGetIntegerValueField(event, kCGKeyboardEventAutorepeat) != 0;
 
-  // no binding found - pass through
-  if (!wm_config_match_binding(g_config, modifiers, keycode, &action)) {
-    return event;
+  // passthrough mode - all keys but the passthrough toggle pass through
+  if (g_passthrough_mode) {
+    int index = wm_config_find_binding(g_config, 0, modifiers, keycode);
+    if (index < 0 ||
+        g_config->bindings[index].action != WM_ACTION_TOGGLE_PASSTHROUGH)
+      return event;
+    if (!is_autorepeat)
+      g_passthrough_mode = false;
+    return NULL;
   }
 
-  // handle passthrough toggle
-  if (action.type == WM_ACTION_TOGGLE_PASSTHROUGH) {
-    g_passthrough_mode = !g_passthrough_mode;
+  // a held key doesn't walk the trie again (holding a leader key must not
+  // cancel its sequence): hotkeys are swallowed, the queue drops the repeat
+  if (is_autorepeat) {
+    int index =
+        wm_config_find_binding(g_config, g_matcher.node, modifiers, keycode);
+    if (index < 0)
+      index = wm_config_find_binding(g_config, 0, modifiers, keycode);
+    if (index < 0)
+      return event;
+    if (g_config->bindings[index].next_node < 0)
+      queue_binding(&g_config->bindings[index], true);
     return NULL;
   }
 
-  // passthrough mode - all keys pass through
-  if (g_passthrough_mode) {
+  const WMBinding *binding = NULL;
+  WMKeyResult result = wm_keys_feed(&g_matcher, modifiers, keycode,
+                                    clock_gettime_nsec_np(CLOCK_UPTIME_RAW),
+                                    &binding);
+
+  // no binding found - pass through
+  if (result == WM_KEY_PASS)
     return event;
-  }
 
-  // dispatch action to main thread
-  if (g_action_callback) {
-    // copy action data to avoid race conditions
-    WMActionType action_type = action.type;
-    int action_argument = action.target_buffer;
-    dispatch_async(dispatch_get_main_queue(), ^{
-      g_action_callback(action_type, action_argument, action.bundle_identifier);
-    });
+  // prefix of a sequence or layer exit - swallow and wait
+  if (result == WM_KEY_CONSUMED)
+    return NULL;
+
+  // handle passthrough toggle
+  if (binding->action == WM_ACTION_TOGGLE_PASSTHROUGH) {
+    g_passthrough_mode = true;
+    wm_keys_reset(&g_matcher);
+    return NULL;
   }
 
+  // queue action for the main loop
+  queue_binding(binding, false);
+
   return NULL;
 }
 
 // start the event tap for global hotkeys
-bool mac_event_tap_start(WMConfig *config, WMActionCallback callback) {
+bool mac_event_tap_start(const WMConfig *config, WMActionCallback callback) {
   if (g_event_tap)
     return true;
 
   g_config = config;
   g_action_callback = callback;
+  wm_keys_init(&g_matcher, config);
+  wm_action_queue_init(&g_queue);
 
   // create event tap for key down events
   CGEventMask event_mask = CGEventMaskBit(kCGEventKeyDown);
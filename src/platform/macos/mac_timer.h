@@ -0,0 +1,25 @@
+#ifndef MAC_TIMER_H
+#define MAC_TIMER_H
+
+#include "wm_timer.h"
+#include <stdint.h>
+
+// monotonic clock the wheel runs on (nanoseconds)
+uint64_t mac_timer_now(void);
+
+// create the host timer, call once before scheduling
+void mac_timer_start(void);
+
+// run callback(context, argument) on the main queue at deadline_ns
+// (mac_timer_now based). Returns 0 if the wheel is full
+WMTimerId mac_timer_at(uint64_t deadline_ns, WMTimerCallback callback,
+                       void *context, int64_t argument);
+
+// run callback after delay_ms
+WMTimerId mac_timer_after(uint32_t delay_ms, WMTimerCallback callback,
+                          void *context, int64_t argument);
+
+// cancel a pending timer and clear the handle (0 is ignored)
+void mac_timer_cancel(WMTimerId *id);
+
+#endif
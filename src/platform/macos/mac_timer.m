@@ -0,0 +1,77 @@
+#import "mac_timer.h"
+#import <Foundation/Foundation.h>
+#include "wm_log.h"
+#include <time.h>
+
+// every deferred job of the app, one dispatch timer armed for the earliest
+static WMTimerWheel g_wheel;
+static dispatch_source_t g_host_timer = NULL;
+static uint64_t g_armed_ns = 0; // deadline the host timer is set to, 0 = none
+
+uint64_t mac_timer_now(void) {
+  return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+// point the host timer at the wheel's next deadline (if it moved)
+static void arm(void) {
+  uint64_t deadline = wm_timer_next_deadline(&g_wheel);
+  if (deadline == g_armed_ns)
+    return;
+  g_armed_ns = deadline;
+
+  if (deadline == 0) {
+    dispatch_source_set_timer(g_host_timer, DISPATCH_TIME_FOREVER,
+                              DISPATCH_TIME_FOREVER, 0);
+    return;
+  }
+
+  uint64_t now = mac_timer_now();
+  int64_t delay = deadline > now ? (int64_t)(deadline - now) : 0;
+  dispatch_source_set_timer(g_host_timer,
+                            dispatch_time(DISPATCH_TIME_NOW, delay),
+                            DISPATCH_TIME_FOREVER, NSEC_PER_MSEC);
+}
+
+static void host_timer_fired(void) {
+  g_armed_ns = 0;
+  wm_timer_advance(&g_wheel, mac_timer_now());
+  arm();
+}
+
+void mac_timer_start(void) {
+  if (g_host_timer != NULL)
+    return;
+
+  wm_timer_init(&g_wheel, mac_timer_now());
+  g_host_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
+                                        dispatch_get_main_queue());
+  dispatch_source_set_timer(g_host_timer, DISPATCH_TIME_FOREVER,
+                            DISPATCH_TIME_FOREVER, 0);
+  dispatch_source_set_event_handler(g_host_timer, ^{
+    host_timer_fired();
+  });
+  dispatch_resume(g_host_timer);
+}
+
+WMTimerId mac_timer_at(uint64_t deadline_ns, WMTimerCallback callback,
+                       void *context, int64_t argument) {
+  WMTimerId id =
+      wm_timer_add(&g_wheel, deadline_ns, callback, context, argument);
+  if (id == 0)
+    WM_LOG(WM_LOG_TIMER_FULL);
+  arm();
+  return id;
+}
+
+WMTimerId mac_timer_after(uint32_t delay_ms, WMTimerCallback callback,
+                          void *context, int64_t argument) {
+  return mac_timer_at(mac_timer_now() + (uint64_t)delay_ms * NSEC_PER_MSEC,
+                      callback, context, argument);
+}
+
+void mac_timer_cancel(WMTimerId *id) {
+  if (*id == 0)
+    return;
+  wm_timer_cancel(&g_wheel, *id);
+  *id = 0;
+}
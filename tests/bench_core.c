@@ -0,0 +1,711 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wm_actions.h"
+#include "wm_config.h"
+#include "wm_config_cache.h"
+#include "wm_control.h"
+#include "wm_display.h"
+#include "wm_hooks.h"
+#include "wm_keys.h"
+#include "wm_layout.h"
+#include "wm_log.h"
+#include "wm_mirror.h"
+#include "wm_plans.h"
+#include "wm_server.h"
+#include "wm_state.h"
+#include "wm_timer.h"
+
+#define BENCH(name) static double bench_##name(int iterations)
+#define RUN_BENCH(name, iterations)                                            \
+  do {                                                                         \
+    printf("    %-40s", #name);                                                \
+    double ns = bench_##name(iterations);                                      \
+    printf("%12.1f ns/op\n", ns);                                              \
+  } while (0)
+
+// keeps the optimizer from dropping benchmarked work
+static volatile long g_sink;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// startup
+
+#define BENCH_APPS 64
+#define BENCH_RULES 24
+
+static char g_bundles[BENCH_APPS][64];
+static WMAppSpec g_specs[BENCH_APPS];
+static WMConfig g_config;
+
+// synthetic running apps: pids spread like a real login, a third have rules
+static void setup_startup(void) {
+  wm_config_init(&g_config);
+  for (int i = 0; i < BENCH_APPS; i++) {
+    snprintf(g_bundles[i], sizeof(g_bundles[i]), "com.vendor%d.app%d", i % 7,
+             i);
+    g_specs[i].pid = 400 + i * 37;
+    g_specs[i].bundle_identifier = g_bundles[i];
+  }
+  for (int i = 0; i < BENCH_RULES; i++) {
+    wm_config_add_rule(&g_config, g_bundles[i * 2], i % WM_MAX_BUFFERS);
+  }
+}
+
+// baseline: state reset cost included in both registration benches
+BENCH(startup_state_init) {
+  WMState state;
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    wm_state_init(&state);
+    g_sink += state.active_buffer;
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// the old per-app path: register, match rules, assign
+BENCH(startup_register_one_by_one) {
+  WMState state;
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    wm_state_init(&state);
+    for (int i = 0; i < BENCH_APPS; i++) {
+      if (wm_state_register_app(&state, g_specs[i].pid,
+                                g_specs[i].bundle_identifier) < 0)
+        continue;
+      int buffer =
+          wm_config_match_rule(&g_config, g_specs[i].bundle_identifier);
+      wm_state_assign_to_buffer(&state, g_specs[i].pid,
+                                buffer < 0 ? 0 : buffer);
+    }
+    g_sink += state.app_registry.app_count;
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+BENCH(startup_register_bulk) {
+  WMState state;
+  WMRegisterDelta delta;
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    wm_state_init(&state);
+    wm_state_register_apps(&state, &g_config, g_specs, BENCH_APPS, 0, &delta);
+    g_sink += delta.dirty_buffers;
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// config
+
+static char g_config_source[256];
+static char g_config_image[256];
+
+// a large user config: every bindable slot and rule used, with comments
+static void setup_config(void) {
+  snprintf(g_config_source, sizeof(g_config_source), "/tmp/dwin_bench_%d.conf",
+           (int)getpid());
+  snprintf(g_config_image, sizeof(g_config_image), "/tmp/dwin_bench_%d.bin",
+           (int)getpid());
+
+  static const char *keys[] = {"a", "b", "c", "d", "e", "f", "g", "h", "i",
+                               "j", "k", "l", "m", "n", "o", "q", "r", "s",
+                               "t", "u", "v", "w", "x", "y", "z", "comma"};
+  FILE *file = fopen(g_config_source, "w");
+  fprintf(file, "# gaps\ngaps_out = 12\ngaps_in = 8\n\n# bindings\n");
+  for (int i = 0; i < WM_MAX_BINDINGS - 20; i++) {
+    fprintf(file, "bind = %s+%s, %s\n", i < 26 ? "CTRL+OPT" : "CTRL+CMD",
+            keys[i % 26], i % 3 ? "snap_left" : "com.example.launch");
+  }
+  fprintf(file, "\n# rules\n");
+  for (int i = 0; i < WM_MAX_RULES; i++) {
+    fprintf(file, "rule = com.vendor%d.app%d, %d\n", i % 7, i,
+            i % WM_MAX_BUFFERS + 1);
+  }
+  fclose(file);
+  wm_config_compile(g_config_source, g_config_image);
+}
+
+static void teardown_config(void) {
+  unlink(g_config_source);
+  unlink(g_config_image);
+}
+
+// fallback path: read, parse and index the text config
+BENCH(config_parse) {
+  WMConfig config;
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    wm_config_load(&config, g_config_source);
+    g_sink += config.bindings_count;
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// cached path: validate the source and map the compiled image
+BENCH(config_map_image) {
+  WMConfigCache cache;
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    const WMConfig *config =
+        wm_config_cache_map(&cache, g_config_source, g_config_image);
+    g_sink += config->bindings_count;
+    wm_config_cache_close(&cache);
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// keys
+
+#define BENCH_KEYSTROKES 1000000
+
+typedef struct {
+  uint8_t modifiers;
+  uint8_t keycode;
+} BenchKey;
+
+static BenchKey g_keys[BENCH_KEYSTROKES];
+static WMConfig g_key_config;
+
+// defaults plus leader sequences and a layer; the stream is mostly typing
+// with some chords, sequences and layer use mixed in
+static void setup_keys(void) {
+  wm_config_init(&g_key_config);
+  int mods[] = {WM_MOD_OPT, WM_MOD_NONE};
+  int keys[] = {11, 0}; // OPT+b, <digit>
+  static const int digits[] = {18, 19, 20, 21, 23};
+  for (int i = 0; i < 5; i++) {
+    keys[1] = digits[i];
+    wm_config_add_sequence(&g_key_config, mods, keys, 2, WM_ACTION_TOGGLE_TAG,
+                           i, NULL);
+  }
+  keys[0] = 15; // OPT+r layer with h/l
+  wm_config_add_layer(&g_key_config, mods, keys, 1);
+  keys[1] = 4;
+  wm_config_add_sequence(&g_key_config, mods, keys, 2, WM_ACTION_SNAP_LEFT, 0,
+                         NULL);
+  keys[1] = 37;
+  wm_config_add_sequence(&g_key_config, mods, keys, 2, WM_ACTION_SNAP_RIGHT,
+                         0, NULL);
+
+  uint32_t seed = 12345;
+  for (int i = 0; i < BENCH_KEYSTROKES; i++) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    int roll = seed % 100;
+    if (roll < 85) // typing
+      g_keys[i] = (BenchKey){WM_MOD_NONE, (uint8_t)(seed >> 8) % 50};
+    else if (roll < 90) // shifted typing
+      g_keys[i] = (BenchKey){WM_MOD_SHIFT, (uint8_t)(seed >> 8) % 50};
+    else if (roll < 95) // OPT+<digit> chord
+      g_keys[i] = (BenchKey){WM_MOD_OPT, (uint8_t)digits[(seed >> 8) % 5]};
+    else if (roll < 98) // leader key (followed by typing or a digit)
+      g_keys[i] = (BenchKey){WM_MOD_OPT, 11};
+    else // layer key
+      g_keys[i] = (BenchKey){WM_MOD_OPT, 15};
+  }
+}
+
+BENCH(keys_matcher_feed) {
+  WMKeyMatcher matcher;
+  wm_keys_init(&matcher, &g_key_config);
+  const WMBinding *binding;
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    for (int i = 0; i < BENCH_KEYSTROKES; i++) {
+      // 10 ms between keys, layers and sequences never time out
+      g_sink += wm_keys_feed(&matcher, g_keys[i].modifiers, g_keys[i].keycode,
+                             (uint64_t)i * 10000000ull, &binding);
+    }
+  }
+  return (double)(now_ns() - start) / ((double)iterations * BENCH_KEYSTROKES);
+}
+
+// timer
+
+static uint64_t g_timer_delays[WM_TIMER_MAX];
+
+static void bench_timer_fired(void *context, int64_t argument) {
+  (void)context;
+  g_sink += argument;
+}
+
+// deadlines like the app's: mostly debounce/settle (tens of ms), some
+// retries and cleanup (seconds)
+static void setup_timer(void) {
+  uint32_t seed = 777;
+  for (int i = 0; i < WM_TIMER_MAX; i++) {
+    seed = seed * 1103515245u + 12345u;
+    uint64_t ms = (seed >> 8) % 8 == 0 ? (seed >> 8) % 5000 : (seed >> 8) % 250;
+    g_timer_delays[i] = (ms + 1) * 1000000ull;
+  }
+}
+
+// add a full wheel of timers, then cancel them all (ns per add + cancel)
+BENCH(timer_insert_cancel) {
+  WMTimerWheel wheel;
+  wm_timer_init(&wheel, 0);
+  WMTimerId ids[WM_TIMER_MAX];
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    for (int i = 0; i < WM_TIMER_MAX; i++)
+      ids[i] = wm_timer_add(&wheel, g_timer_delays[i], bench_timer_fired,
+                            NULL, i);
+    for (int i = 0; i < WM_TIMER_MAX; i++)
+      g_sink += wm_timer_cancel(&wheel, ids[i]);
+  }
+  return (double)(now_ns() - start) / ((double)iterations * WM_TIMER_MAX);
+}
+
+// add a full wheel of timers and run the clock until all fired, waking
+// only at the next deadline like the host (ns per timer)
+BENCH(timer_insert_expire) {
+  WMTimerWheel wheel;
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    wm_timer_init(&wheel, 0);
+    for (int i = 0; i < WM_TIMER_MAX; i++)
+      wm_timer_add(&wheel, g_timer_delays[i], bench_timer_fired, NULL, i);
+    uint64_t deadline;
+    while ((deadline = wm_timer_next_deadline(&wheel)) != 0)
+      wm_timer_advance(&wheel, deadline);
+  }
+  return (double)(now_ns() - start) / ((double)iterations * WM_TIMER_MAX);
+}
+
+// control socket
+
+static WMServer g_server;
+static WMState g_control_state;
+static WMControlSnapshot g_control_snapshot;
+static int g_control_fd = -1;
+static char g_control_path[64];
+static char g_reply[WM_CONTROL_MAX_REPLY];
+
+// the main thread's part of a batch, run right on the server's wake (the
+// app hops to the main queue first)
+static void bench_control_run(void *context) {
+  (void)context;
+  WMServerJob job;
+  while (wm_server_take(&g_server, &job)) {
+    WMControlBatch batch;
+    WMControlEffects effects;
+    char error[WM_CONTROL_ERROR_SIZE];
+    char reply[WM_CONTROL_MAX_REPLY];
+    int length;
+    if (wm_control_parse(job.request, &batch, error, sizeof(error)) &&
+        wm_control_apply(&g_control_state, &batch, &effects, error,
+                         sizeof(error))) {
+      wm_state_set_view(&g_control_state, effects.primary_buffer,
+                        effects.view);
+      wm_control_snapshot(&g_control_snapshot, &g_control_state, NULL, 0);
+      wm_server_publish(&g_server, &g_control_snapshot);
+      length = wm_control_reply(&g_control_snapshot, &batch, reply,
+                                sizeof(reply));
+    } else {
+      length = wm_control_error(error, reply, sizeof(reply));
+    }
+    wm_server_reply(&g_server, &job, reply, (size_t)length);
+  }
+}
+
+// a server with the startup apps registered, one connected client
+static void setup_control(void) {
+  wm_state_init(&g_control_state);
+  wm_state_register_apps(&g_control_state, &g_config, g_specs, BENCH_APPS, 0,
+                         NULL);
+  wm_state_set_view(&g_control_state, 0, WM_BUFFER_BIT(0));
+  wm_control_snapshot(&g_control_snapshot, &g_control_state, NULL, 0);
+
+  snprintf(g_control_path, sizeof(g_control_path), "/tmp/dwin_bench_%d.sock",
+           (int)getpid());
+  if (!wm_server_start(&g_server, g_control_path, bench_control_run, NULL)) {
+    perror("control server");
+    return;
+  }
+  wm_server_publish(&g_server, &g_control_snapshot);
+  g_control_fd = wm_client_connect(g_control_path);
+}
+
+static void teardown_control(void) {
+  if (g_control_fd >= 0)
+    close(g_control_fd);
+  wm_server_stop(&g_server);
+}
+
+// smallest query, answered on the server thread (ns per round trip)
+BENCH(control_query_focus) {
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++)
+    g_sink += wm_client_request(g_control_fd, "focus", g_reply,
+                                sizeof(g_reply));
+  return (double)(now_ns() - start) / iterations;
+}
+
+// every app listed (ns per round trip)
+BENCH(control_query_apps) {
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++)
+    g_sink +=
+        wm_client_request(g_control_fd, "apps", g_reply, sizeof(g_reply));
+  return (double)(now_ns() - start) / iterations;
+}
+
+// "move 6 apps, then switch" as one batch through the main thread's side
+// (ns per round trip)
+BENCH(control_batch_move_switch) {
+  char requests[2][WM_CONTROL_MAX_REQUEST];
+  for (int r = 0; r < 2; r++) {
+    size_t length = 0;
+    for (int i = 0; i < 6; i++)
+      length += (size_t)snprintf(requests[r] + length,
+                                 sizeof(requests[r]) - length, "move %d %d; ",
+                                 (int)g_specs[i].pid, r + 1);
+    snprintf(requests[r] + length, sizeof(requests[r]) - length, "switch %d",
+             r + 1);
+  }
+
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++)
+    g_sink += wm_client_request(g_control_fd, requests[it & 1], g_reply,
+                                sizeof(g_reply));
+  return (double)(now_ns() - start) / iterations;
+}
+
+#define BENCH_SUBSCRIBERS 50
+
+static int g_subscribers[BENCH_SUBSCRIBERS];
+
+// status bars listening to focus changes
+static void setup_subscribers(void) {
+  for (int i = 0; i < BENCH_SUBSCRIBERS; i++) {
+    g_subscribers[i] = wm_client_connect(g_control_path);
+    wm_client_request(g_subscribers[i], "subscribe focus", g_reply,
+                      sizeof(g_reply));
+  }
+}
+
+static void teardown_subscribers(void) {
+  for (int i = 0; i < BENCH_SUBSCRIBERS; i++)
+    close(g_subscribers[i]);
+}
+
+// one focus change until every subscriber read its line (ns per event)
+BENCH(control_fanout_delivered) {
+  char line[64];
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    WMControlEvent event = {.type = WM_CONTROL_EVENT_FOCUS, .pid = it};
+    wm_server_emit(&g_server, &event, 1);
+    for (int i = 0; i < BENCH_SUBSCRIBERS; i++) {
+      ssize_t length = 0;
+      do {
+        ssize_t count = recv(g_subscribers[i], line + length,
+                             sizeof(line) - (size_t)length, 0);
+        if (count <= 0)
+          return 0;
+        length += count;
+      } while (line[length - 1] != '\n');
+      g_sink += length;
+    }
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// what the main thread pays to emit, subscribers not reading (ns per event)
+BENCH(control_fanout_emit) {
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    WMControlEvent event = {.type = WM_CONTROL_EVENT_FOCUS, .pid = it};
+    wm_server_emit(&g_server, &event, 1);
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// state mirror
+
+static WMMirrorWriter g_mirror;
+static WMMirrorReader g_mirror_reader;
+
+static void setup_mirror(void) {
+  char name[WM_MIRROR_NAME_SIZE];
+  snprintf(name, sizeof(name), "/dwin_bench_%d", (int)getpid());
+  if (!wm_mirror_open(&g_mirror, name) ||
+      !wm_mirror_attach(&g_mirror_reader, name))
+    perror("mirror");
+}
+
+static void teardown_mirror(void) {
+  wm_mirror_detach(&g_mirror_reader);
+  wm_mirror_close(&g_mirror);
+}
+
+// dwin's side of a state change (ns per write)
+BENCH(mirror_write) {
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    g_control_state.version++;
+    g_sink += wm_mirror_write(&g_mirror, &g_control_state);
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// a bar reading the whole state, compare with control_query_focus (ns per
+// read)
+BENCH(mirror_read) {
+  static WMMirrorState mirror;
+  wm_mirror_write(&g_mirror, &g_control_state);
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    g_sink += wm_mirror_read(&g_mirror_reader, &mirror);
+    g_sink += mirror.focused_pid;
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// hooks
+
+static WMHookRunner g_hooks;
+static _Atomic int g_hooks_finished;
+
+static void count_hook(const WMHookResult *result, void *context) {
+  (void)result;
+  (void)context;
+  atomic_fetch_add(&g_hooks_finished, 1);
+}
+
+static void setup_hooks(void) {
+  WMConfig config;
+  wm_config_init(&config);
+  wm_config_add_hook(&config, WM_CONTROL_EVENT_FOCUS, "true");
+  wm_hooks_start(&g_hooks, &config, count_hook, NULL);
+}
+
+// what the main thread pays per event while the runner spawns (ns per
+// dispatch)
+BENCH(hooks_dispatch) {
+  WMControlEvent event = {.type = WM_CONTROL_EVENT_FOCUS, .pid = 812};
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++)
+    g_sink += wm_hooks_dispatch(&g_hooks, &event, 1);
+  return (double)(now_ns() - start) / iterations;
+}
+
+// event to the hook's exit, spawn and reap included (ns per run)
+BENCH(hooks_run_true) {
+  // let the dispatch bench's runs finish
+  WMHookStats stats;
+  do {
+    usleep(10000);
+    wm_hooks_stats(&g_hooks, &stats);
+  } while (stats.queue_depth > 0 || stats.running > 0);
+  atomic_store(&g_hooks_finished, 0);
+
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    WMControlEvent event = {.type = WM_CONTROL_EVENT_FOCUS, .pid = it};
+    wm_hooks_dispatch(&g_hooks, &event, 1);
+    while (atomic_load(&g_hooks_finished) <= it)
+      ;
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// log
+
+static char g_log_path[64];
+
+static void setup_log(void) {
+  snprintf(g_log_path, sizeof(g_log_path), "/tmp/dwin_bench_%d.log",
+           (int)getpid());
+  wm_log_start(g_log_path);
+}
+
+static void teardown_log(void) {
+  wm_log_stop();
+  unlink(g_log_path);
+}
+
+// the switch line as it's logged, the drainer writing behind (ns per
+// record)
+BENCH(log_write) {
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++)
+    WM_LOG(WM_LOG_SWITCH_DONE, it % WM_MAX_BUFFERS, it / 1e6, it / 5e5, 0);
+  return (double)(now_ns() - start) / iterations;
+}
+
+BENCH(log_write_no_args) {
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++)
+    WM_LOG(WM_LOG_TIMER_FULL);
+  return (double)(now_ns() - start) / iterations;
+}
+
+// baseline: formatting the same line, what a text logger pays before any
+// I/O (ns per line)
+BENCH(log_snprintf_baseline) {
+  char line[128];
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++)
+    g_sink += snprintf(line, sizeof(line),
+                       "[Switch] buffer %d focused in %.1f ms, settled in "
+                       "%.1f ms, timed out 0x%02x",
+                       it % WM_MAX_BUFFERS, it / 1e6, it / 5e5, 0);
+  return (double)(now_ns() - start) / iterations;
+}
+
+// display
+
+#define BENCH_DISPLAYS 3
+
+static WMState g_display_state;
+static WMDisplayLayout g_display_layouts[WM_MAX_DISPLAYS];
+
+// three displays, each showing its own buffer of BENCH_APPS / 3 apps
+static void setup_displays(void) {
+  wm_config_init(&g_config);
+  WMState *state = &g_display_state;
+  wm_state_init(state);
+  WMDisplayInfo infos[BENCH_DISPLAYS];
+  for (int d = 0; d < BENCH_DISPLAYS; d++)
+    infos[d] = (WMDisplayInfo){.id = 1 + d,
+                               .frame = {d * 2560.0, 0, 2560, 1415}};
+  wm_display_configure(state, infos, BENCH_DISPLAYS);
+  for (int i = 0; i < BENCH_APPS; i++) {
+    wm_state_register_app(state, g_specs[i].pid, g_specs[i].bundle_identifier);
+    wm_state_assign_to_buffer(state, g_specs[i].pid, i % BENCH_DISPLAYS);
+  }
+  for (int d = 0; d < BENCH_DISPLAYS; d++) {
+    wm_display_focus(state, d);
+    wm_state_set_view(state, d, WM_BUFFER_BIT(d));
+  }
+}
+
+// every display tiled on the calling thread (ns per relayout of all)
+BENCH(display_compute_serial) {
+  WMDisplayMask all = (WMDisplayMask)((1u << BENCH_DISPLAYS) - 1);
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    wm_display_compute_all(&g_display_state, &g_config, all,
+                           g_display_layouts, false);
+    g_sink += g_display_layouts[it % BENCH_DISPLAYS].count;
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// displays past the first on their own threads, thread start included
+BENCH(display_compute_parallel) {
+  WMDisplayMask all = (WMDisplayMask)((1u << BENCH_DISPLAYS) - 1);
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    wm_display_compute_all(&g_display_state, &g_config, all,
+                           g_display_layouts, true);
+    g_sink += g_display_layouts[it % BENCH_DISPLAYS].count;
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// plans
+
+static WMPlanCache g_plans;
+static WMSwitchPlan g_plan;
+
+// half the display apps move to hidden buffers 3 and 4, the plans switch
+// there
+static void setup_plans(void) {
+  for (int i = 1; i < BENCH_APPS; i += 2)
+    wm_state_assign_to_buffer(&g_display_state, g_specs[i].pid,
+                              3 + (i / 2) % 2);
+}
+
+// what a switch computes when no plan is ready: pid lists, focus target,
+// frames of the focused display (ns per plan)
+BENCH(plans_build_fresh) {
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    wm_plans_build(&g_display_state, NULL, &g_config, 3 + it % 2, &g_plan);
+    g_sink += g_plan.frame_count;
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+// what it does with one: check and copy (ns per plan)
+BENCH(plans_lookup_ready) {
+  wm_plans_init(&g_plans);
+  wm_plans_refresh(&g_plans, &g_display_state, NULL, &g_config);
+  uint64_t start = now_ns();
+  for (int it = 0; it < iterations; it++) {
+    int buffer = 3 + it % 2;
+    const WMSwitchPlan *ready = wm_plans_lookup(
+        &g_plans, &g_display_state, NULL, buffer, WM_BUFFER_BIT(buffer));
+    g_plan = *ready;
+    g_sink += g_plan.frame_count;
+  }
+  return (double)(now_ns() - start) / iterations;
+}
+
+int main(void) {
+  printf("Running core benchmarks...\n");
+  printf("\nStartup (%d apps, %d rules):\n", BENCH_APPS, BENCH_RULES);
+  setup_startup();
+  RUN_BENCH(startup_state_init, 200000);
+  RUN_BENCH(startup_register_one_by_one, 200000);
+  RUN_BENCH(startup_register_bulk, 200000);
+  printf("\nConfig (%d bindings, %d rules):\n", WM_MAX_BINDINGS, WM_MAX_RULES);
+  setup_config();
+  RUN_BENCH(config_parse, 20000);
+  RUN_BENCH(config_map_image, 20000);
+  teardown_config();
+  printf("\nKeys (%d keystrokes per run, ns per key):\n", BENCH_KEYSTROKES);
+  setup_keys();
+  RUN_BENCH(keys_matcher_feed, 10);
+  printf("\nTimer (%d timers per run, ns per timer):\n", WM_TIMER_MAX);
+  setup_timer();
+  RUN_BENCH(timer_insert_cancel, 20000);
+  RUN_BENCH(timer_insert_expire, 2000);
+  printf("\nControl (%d apps, round trips over the socket):\n", BENCH_APPS);
+  setup_control();
+  RUN_BENCH(control_query_focus, 20000);
+  RUN_BENCH(control_query_apps, 20000);
+  RUN_BENCH(control_batch_move_switch, 20000);
+  printf("\nEvents (%d subscribers):\n", BENCH_SUBSCRIBERS);
+  setup_subscribers();
+  RUN_BENCH(control_fanout_delivered, 2000);
+  RUN_BENCH(control_fanout_emit, 200000);
+  teardown_subscribers();
+  printf("\nMirror (%d apps, shared memory):\n", BENCH_APPS);
+  setup_mirror();
+  RUN_BENCH(mirror_write, 200000);
+  RUN_BENCH(mirror_read, 200000);
+  teardown_mirror();
+  teardown_control();
+  printf("\nHooks (posix_spawn of /bin/sh -c true):\n");
+  setup_hooks();
+  RUN_BENCH(hooks_dispatch, 200000);
+  RUN_BENCH(hooks_run_true, 200);
+  wm_hooks_stop(&g_hooks);
+  printf("\nLog (per-thread ring, drained every %d ms):\n", WM_LOG_DRAIN_MS);
+  setup_log();
+  RUN_BENCH(log_write, 2000000);
+  RUN_BENCH(log_write_no_args, 2000000);
+  RUN_BENCH(log_snprintf_baseline, 2000000);
+  teardown_log();
+  printf("\nDisplay (%d displays, %d apps):\n", BENCH_DISPLAYS, BENCH_APPS);
+  setup_displays();
+  RUN_BENCH(display_compute_serial, 200000);
+  RUN_BENCH(display_compute_parallel, 20000);
+  printf("\nPlans (%d apps, switches to hidden buffers):\n", BENCH_APPS);
+  setup_plans();
+  RUN_BENCH(plans_build_fresh, 200000);
+  RUN_BENCH(plans_lookup_ready, 2000000);
+  return 0;
+}
@@ -1,11 +1,43 @@
 #include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "wm_actions.h"
 #include "wm_config.h"
+#include "wm_config_cache.h"
+#include "wm_control.h"
+#include "wm_display.h"
+#include "wm_events.h"
+#include "wm_executor.h"
+#include "wm_health.h"
+#include "wm_hooks.h"
+#include "wm_keys.h"
+#include "wm_latency.h"
 #include "wm_layout.h"
+#include "wm_log.h"
+#include "wm_minsize.h"
+#include "wm_mirror.h"
+#include "wm_park.h"
+#include "wm_placement.h"
+#include "wm_plans.h"
+#include "wm_relayout.h"
+#include "wm_server.h"
+#include "wm_snapshot.h"
 #include "wm_state.h"
+#include "wm_store.h"
+#include "wm_switch.h"
+#include "wm_timer.h"
 
 #define TEST(name) static void test_##name(void)
 #define RUN_TEST(name)                                                         \
@@ -15,10 +47,26 @@
     printf("✓ OK\n");                                                          \
   } while (0)
 
+// unique scratch file for tests that persist to disk
+static const char *test_path(const char *name) {
+  static char path[256];
+  snprintf(path, sizeof(path), "/tmp/dwin_test_%d_%s", (int)getpid(), name);
+  unlink(path);
+  return path;
+}
+
+// write text to a scratch file
+static void write_file(const char *path, const char *text) {
+  FILE *file = fopen(path, "w");
+  assert(file);
+  fputs(text, file);
+  fclose(file);
+}
+
 TEST(state_init) {
   WMState state;
   wm_state_init(&state);
-  assert(state.active_buffer == 0);
+  assert(state.active_buffer == -1); // nothing shown until the first switch
   assert(state.is_passthrough_mode == false);
   assert(state.app_registry.app_count == 0);
 }
@@ -37,7 +85,7 @@ TEST(state_register_app) {
   assert(app != NULL);
   assert(app->pid == 1234);
   assert(strcmp(app->bundle_identifier, "com.apple.Terminal") == 0);
-  assert(app->buffer_index == -1);
+  assert(wm_state_get_buffer_mask(&state, 1234) == 0);
   assert(app->is_managed == true);
 
   // regist second app
@@ -91,21 +139,21 @@ TEST(state_assign_to_buffer) {
   wm_state_assign_to_buffer(&state, 9012, 1);
 
   // verify assignments
-  assert(wm_state_find_app(&state, 1234)->buffer_index == 0);
-  assert(wm_state_find_app(&state, 5678)->buffer_index == 0);
-  assert(wm_state_find_app(&state, 9012)->buffer_index == 1);
+  assert(wm_state_get_buffer_mask(&state, 1234) == WM_BUFFER_BIT(0));
+  assert(wm_state_get_buffer_mask(&state, 5678) == WM_BUFFER_BIT(0));
+  assert(wm_state_get_buffer_mask(&state, 9012) == WM_BUFFER_BIT(1));
 
   // reassign
   wm_state_assign_to_buffer(&state, 5678, 2);
-  assert(wm_state_find_app(&state, 5678)->buffer_index == 2);
+  assert(wm_state_get_buffer_mask(&state, 5678) == WM_BUFFER_BIT(2));
 
   // unassign
   wm_state_assign_to_buffer(&state, 5678, -1);
-  assert(wm_state_find_app(&state, 5678)->buffer_index == -1);
+  assert(wm_state_get_buffer_mask(&state, 5678) == 0);
 
   // invalid buffer index (should be no-op)
   wm_state_assign_to_buffer(&state, 5678, 99);
-  assert(wm_state_find_app(&state, 5678)->buffer_index == -1);
+  assert(wm_state_get_buffer_mask(&state, 5678) == 0);
 }
 
 TEST(state_get_buffer_pids) {
@@ -221,6 +269,258 @@ TEST(state_pid_map_collision) {
   assert(wm_state_find_app(&state, 100) != NULL);
 }
 
+TEST(state_buffer_mask_tags) {
+  WMState state;
+  wm_state_init(&state);
+
+  wm_state_register_app(&state, 1234, "com.apple.Terminal");
+  wm_state_assign_to_buffer(&state, 1234, 0);
+
+  // tag app into buffer 2 as well
+  wm_state_toggle_buffer(&state, 1234, 2);
+  assert(wm_state_get_buffer_mask(&state, 1234) ==
+         (WM_BUFFER_BIT(0) | WM_BUFFER_BIT(2)));
+  assert(wm_state_primary_buffer(&state, 1234) == 0);
+
+  // visible from both buffers
+  pid_t pids[WM_MAX_APPS];
+  assert(wm_state_get_buffer_pids(&state, 0, pids, WM_MAX_APPS) == 1);
+  assert(wm_state_get_buffer_pids(&state, 2, pids, WM_MAX_APPS) == 1);
+
+  // untag buffer 0
+  wm_state_toggle_buffer(&state, 1234, 0);
+  assert(wm_state_get_buffer_mask(&state, 1234) == WM_BUFFER_BIT(2));
+  assert(wm_state_primary_buffer(&state, 1234) == 2);
+
+  // removing the last buffer is refused
+  wm_state_toggle_buffer(&state, 1234, 2);
+  assert(wm_state_get_buffer_mask(&state, 1234) == WM_BUFFER_BIT(2));
+
+  // sticky = every buffer
+  wm_state_set_buffer_mask(&state, 1234, WM_BUFFER_MASK_ALL);
+  for (int i = 0; i < WM_MAX_BUFFERS; i++)
+    assert(wm_state_get_buffer_pids(&state, i, pids, WM_MAX_APPS) == 1);
+
+  // mask naming non-existent buffers is rejected
+  wm_state_set_buffer_mask(&state, 1234, (WMBufferMask)0x80);
+  assert(wm_state_get_buffer_mask(&state, 1234) == WM_BUFFER_MASK_ALL);
+
+  // masks follow apps through swap-remove
+  wm_state_register_app(&state, 5678, "com.google.Chrome");
+  wm_state_assign_to_buffer(&state, 5678, 3);
+  wm_state_unregister_app(&state, 1234);
+  assert(wm_state_get_buffer_mask(&state, 5678) == WM_BUFFER_BIT(3));
+  wm_state_check_invariants(&state);
+}
+
+TEST(state_view_pids_symmetric_difference) {
+  WMState state;
+  wm_state_init(&state);
+
+  wm_state_register_app(&state, 1, "com.test.only0");
+  wm_state_register_app(&state, 2, "com.test.shared");
+  wm_state_register_app(&state, 3, "com.test.only1");
+  wm_state_assign_to_buffer(&state, 1, 0);
+  wm_state_set_buffer_mask(&state, 2, WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1));
+  wm_state_assign_to_buffer(&state, 3, 1);
+
+  pid_t pids[WM_MAX_APPS];
+
+  // union view shows all three
+  int count = wm_state_get_view_pids(
+      &state, WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1), 0, pids, WM_MAX_APPS);
+  assert(count == 3);
+
+  // 0 -> 1: show only app 3, hide only app 1, shared app untouched
+  count = wm_state_get_view_pids(&state, WM_BUFFER_BIT(1), WM_BUFFER_BIT(0),
+                                 pids, WM_MAX_APPS);
+  assert(count == 1 && pids[0] == 3);
+  count = wm_state_get_view_pids(&state, WM_BUFFER_BIT(0), WM_BUFFER_BIT(1),
+                                 pids, WM_MAX_APPS);
+  assert(count == 1 && pids[0] == 1);
+
+  // empty view shows nothing
+  assert(wm_state_get_view_pids(&state, 0, 0, pids, WM_MAX_APPS) == 0);
+}
+
+TEST(state_view_default) {
+  WMState state;
+  wm_state_init(&state);
+
+  // startup: nothing shown
+  assert(wm_state_get_view(&state) == 0);
+
+  // implicit view follows the active buffer
+  state.active_buffer = 2;
+  assert(wm_state_get_view(&state) == WM_BUFFER_BIT(2));
+
+  // toggle buffer 4 in, primary stays
+  int primary;
+  WMBufferMask view;
+  assert(wm_state_toggled_view(&state, 4, &primary, &view));
+  assert(primary == 2);
+  assert(view == (WM_BUFFER_BIT(2) | WM_BUFFER_BIT(4)));
+
+  // toggling the only shown buffer away is refused
+  assert(!wm_state_toggled_view(&state, 2, &primary, &view));
+
+  // toggling the primary away moves primary to the remaining buffer
+  state.view_mask = WM_BUFFER_BIT(2) | WM_BUFFER_BIT(4);
+  assert(wm_state_toggled_view(&state, 2, &primary, &view));
+  assert(primary == 4);
+  assert(view == WM_BUFFER_BIT(4));
+}
+
+TEST(state_set_focused_sticky) {
+  WMState state;
+  wm_state_init(&state);
+
+  wm_state_register_app(&state, 1234, "com.apple.Music");
+  wm_state_set_buffer_mask(&state, 1234, WM_BUFFER_MASK_ALL);
+  state.active_buffer = 1;
+
+  // focus is recorded only in the shown buffer
+  wm_state_set_focused(&state, 1234);
+  assert(state.buffers[1].last_focused_pid == 1234);
+  assert(state.buffers[0].last_focused_pid == 0);
+  assert(state.buffers[3].last_focused_pid == 0);
+}
+
+TEST(state_register_apps_bulk) {
+  WMState state;
+  wm_state_init(&state);
+  WMConfig config;
+  wm_config_init(&config);
+  wm_config_add_rule(&config, "com.tinyspeck.slackmacgap", 3);
+  wm_config_add_rule(&config, "net.kovidgoyal.kitty", 1);
+
+  // one app already known
+  wm_state_register_app(&state, 100, "com.apple.Terminal");
+
+  WMAppSpec apps[] = {
+      {.pid = 100, .bundle_identifier = "com.apple.Terminal"},
+      {.pid = 200, .bundle_identifier = "com.tinyspeck.slackmacgap"},
+      {.pid = 300, .bundle_identifier = "net.kovidgoyal.kitty"},
+      {.pid = 400, .bundle_identifier = "com.google.Chrome"},
+      {.pid = 400, .bundle_identifier = "com.google.Chrome"}, // duplicate
+      {.pid = 0, .bundle_identifier = "com.invalid.pid"},
+      {.pid = 500, .bundle_identifier = NULL},
+  };
+
+  WMRegisterDelta delta;
+  int registered = wm_state_register_apps(
+      &state, &config, apps, sizeof(apps) / sizeof(apps[0]), 0, &delta);
+
+  assert(registered == 3);
+  assert(delta.registered == 3);
+  assert(state.app_registry.app_count == 4);
+
+  // rules win, the rest go to the default buffer
+  assert(wm_state_get_buffer_mask(&state, 200) == WM_BUFFER_BIT(3));
+  assert(wm_state_get_buffer_mask(&state, 300) == WM_BUFFER_BIT(1));
+  assert(wm_state_get_buffer_mask(&state, 400) == WM_BUFFER_BIT(0));
+
+  // already registered app is untouched
+  assert(wm_state_get_buffer_mask(&state, 100) == 0);
+
+  // per-buffer deltas
+  assert(delta.added[0] == 1);
+  assert(delta.added[1] == 1);
+  assert(delta.added[3] == 1);
+  assert(delta.added[2] == 0);
+  assert(delta.dirty_buffers ==
+         (WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1) | WM_BUFFER_BIT(3)));
+
+  assert(strcmp(wm_state_find_app(&state, 200)->bundle_identifier,
+                "com.tinyspeck.slackmacgap") == 0);
+  wm_state_check_invariants(&state);
+}
+
+TEST(state_register_apps_capacity) {
+  WMState state;
+  wm_state_init(&state);
+
+  // more apps than the registry holds
+  WMAppSpec apps[WM_MAX_APPS + 10];
+  for (int i = 0; i < WM_MAX_APPS + 10; i++) {
+    apps[i].pid = 1000 + i;
+    apps[i].bundle_identifier = "com.test.app";
+  }
+
+  int registered =
+      wm_state_register_apps(&state, NULL, apps, WM_MAX_APPS + 10, -1, NULL);
+  assert(registered == WM_MAX_APPS);
+  assert(state.app_registry.app_count == WM_MAX_APPS);
+
+  // no rules and no default buffer leaves apps unassigned
+  assert(wm_state_get_buffer_mask(&state, 1000) == 0);
+  assert(wm_state_find_app(&state, 1000 + WM_MAX_APPS) == NULL);
+  wm_state_check_invariants(&state);
+}
+
+// stand-in backend counting handle lifetimes
+typedef struct {
+  int acquired;
+  int released;
+  pid_t last_released;
+} FakeBackend;
+
+static void *fake_backend_acquire(pid_t pid, void *context) {
+  FakeBackend *backend = context;
+  backend->acquired++;
+  return (void *)(intptr_t)(pid * 10); // any non-NULL token
+}
+
+static void fake_backend_release(pid_t pid, void *handle, void *context) {
+  FakeBackend *backend = context;
+  assert(handle == (void *)(intptr_t)(pid * 10));
+  backend->released++;
+  backend->last_released = pid;
+}
+
+TEST(state_backend_handles) {
+  WMState state;
+  wm_state_init(&state);
+  FakeBackend backend = {0};
+  WMBackendHooks hooks = {.acquire = fake_backend_acquire,
+                          .release = fake_backend_release,
+                          .context = &backend};
+  wm_state_set_backend_hooks(&state, &hooks);
+
+  // set on register
+  wm_state_register_app(&state, 1, "com.test.app1");
+  wm_state_register_app(&state, 2, "com.test.app2");
+  assert(backend.acquired == 2);
+
+  uint32_t gen1 = 0;
+  assert(wm_state_backend_handle(&state, 1, &gen1) == (void *)10);
+  assert(backend.acquired == 2); // cached, no new lookup
+
+  // invalidation releases now and re-acquires lazily with a new generation
+  wm_state_invalidate_backend(&state, 1);
+  assert(backend.released == 1 && backend.last_released == 1);
+  assert(wm_state_find_app(&state, 1)->backend_handle == NULL);
+  uint32_t gen2 = 0;
+  assert(wm_state_backend_handle(&state, 1, &gen2) == (void *)10);
+  assert(backend.acquired == 3);
+  assert(gen2 != gen1);
+
+  // handle follows the app through swap-remove, released on unregister
+  wm_state_unregister_app(&state, 1);
+  assert(backend.released == 2 && backend.last_released == 1);
+  assert(wm_state_backend_handle(&state, 2, NULL) == (void *)20);
+  assert(wm_state_backend_handle(&state, 1, NULL) == NULL);
+
+  // bulk registration acquires too
+  WMAppSpec apps[] = {{.pid = 3, .bundle_identifier = "com.test.app3"}};
+  wm_state_register_apps(&state, NULL, apps, 1, 0, NULL);
+  assert(backend.acquired == 4);
+
+  // invalidating an unknown pid is a no-op
+  wm_state_invalidate_backend(&state, 99);
+  assert(backend.released == 2);
+}
+
 TEST(config_init) {
   WMConfig config;
   wm_config_init(&config);
@@ -243,6 +543,38 @@ TEST(config_add_rule) {
   assert(buffer == -1);
 }
 
+TEST(config_rule_index) {
+  WMConfig config;
+  wm_config_init(&config);
+
+  // fill every rule slot
+  char bundle[64];
+  for (int i = 0; i < WM_MAX_RULES; i++) {
+    snprintf(bundle, sizeof(bundle), "com.test.app%d", i);
+    assert(wm_config_add_rule(&config, bundle, i % WM_MAX_BUFFERS));
+  }
+  assert(!wm_config_add_rule(&config, "com.test.overflow", 0));
+
+  for (int i = 0; i < WM_MAX_RULES; i++) {
+    snprintf(bundle, sizeof(bundle), "com.test.app%d", i);
+    assert(wm_config_match_rule(&config, bundle) == i % WM_MAX_BUFFERS);
+  }
+  assert(wm_config_match_rule(&config, "com.test.app") == -1);
+
+  // first rule for a bundle wins
+  WMConfig dup;
+  wm_config_init(&dup);
+  wm_config_add_rule(&dup, "com.apple.Terminal", 1);
+  wm_config_add_rule(&dup, "com.apple.Terminal", 2);
+  assert(wm_config_match_rule(&dup, "com.apple.Terminal") == 1);
+
+  // a zeroed config (no wm_config_init) misses instead of probing forever
+  WMConfig zeroed;
+  memset(&zeroed, 0, sizeof(zeroed));
+  assert(wm_config_match_rule(&zeroed, "com.apple.Terminal") == -1);
+  assert(wm_config_find_binding(&zeroed, 0, WM_MOD_OPT, 18) == -1);
+}
+
 TEST(config_add_binding) {
   WMConfig config;
   wm_config_init(&config);
@@ -299,6 +631,147 @@ TEST(config_default_bindings) {
   assert(!found);
 }
 
+TEST(config_load) {
+  const char *path = test_path("config");
+  write_file(path, "# Gaps\n"
+                   "gaps_out = 20\n"
+                   "gaps_in = 4 6 8 10\n"
+                   "\n"
+                   "bind = OPT+1, buffer_3   # override a default\n"
+                   "bind = OPT+h, snap_left\n"
+                   "bind = CMD+SHIFT+p, toggle_tag_2\n"
+                   "bind = OPT+return, net.kovidgoyal.kitty\n"
+                   "bind = OPT+nope, buffer_1\n"
+                   "bind = OPT+2, buffer_9\n"
+                   "rule = com.jetbrains.CLion, 2\n"
+                   "rule = broken\n"
+                   "garbage\n");
+
+  WMConfig config;
+  assert(wm_config_load(&config, path));
+  assert(config.gaps_outer.top == 20 && config.gaps_outer.left == 20);
+  assert(config.gaps_inner.top == 4 && config.gaps_inner.right == 6);
+  assert(config.gaps_inner.bottom == 8 && config.gaps_inner.left == 10);
+
+  // the default Opt+1 was replaced, not shadowed
+  WMAction action;
+  assert(config.bindings_count == 20 + 3);
+  assert(wm_config_match_binding(&config, WM_MOD_OPT, 18, &action));
+  assert(action.type == WM_ACTION_SWITCH_BUFFER && action.target_buffer == 2);
+
+  assert(wm_config_match_binding(&config, WM_MOD_OPT, 4, &action));
+  assert(action.type == WM_ACTION_SNAP_LEFT);
+  assert(wm_config_match_binding(&config, WM_MOD_CMD | WM_MOD_SHIFT, 35,
+                                 &action));
+  assert(action.type == WM_ACTION_TOGGLE_TAG && action.target_buffer == 1);
+  assert(wm_config_match_binding(&config, WM_MOD_OPT, 36, &action));
+  assert(action.type == WM_ACTION_LAUNCH_BUNDLE);
+  assert(strcmp(action.bundle_identifier, "net.kovidgoyal.kitty") == 0);
+
+  // invalid lines are skipped, Opt+2 keeps its default
+  assert(wm_config_match_binding(&config, WM_MOD_OPT, 19, &action));
+  assert(action.target_buffer == 1);
+  assert(config.rules_count == 1);
+  assert(wm_config_match_rule(&config, "com.jetbrains.CLion") == 1);
+
+  // a missing file leaves the defaults
+  unlink(path);
+  assert(!wm_config_load(&config, path));
+  assert(config.bindings_count == 20);
+}
+
+TEST(config_binding_index) {
+  WMConfig config;
+  wm_config_init(&config);
+
+  // every modifier combination of every key resolves to its own binding
+  for (int i = 0; i < WM_MAX_BINDINGS - 20; i++) {
+    assert(wm_config_add_binding(&config, i % 16, 60 + i / 16,
+                                 WM_ACTION_SWITCH_BUFFER, i, NULL));
+  }
+  assert(!wm_config_add_binding(&config, 0, 99, WM_ACTION_RETILE, 0, NULL));
+
+  WMAction action;
+  for (int i = 0; i < WM_MAX_BINDINGS - 20; i++) {
+    assert(wm_config_match_binding(&config, i % 16, 60 + i / 16, &action));
+    assert(action.target_buffer == i);
+  }
+  assert(!wm_config_match_binding(&config, WM_MOD_CTRL, 0, &action));
+  assert(wm_config_keycode_from_name("RETURN") == 36);
+  assert(wm_config_keycode_from_name("f13") == -1);
+}
+
+TEST(config_cache_round_trip) {
+  char source[256];
+  snprintf(source, sizeof(source), "%s", test_path("config_source"));
+  const char *image = test_path("config_image");
+  write_file(source, "gaps_out = 5\n"
+                     "bind = OPT+h, snap_left\n"
+                     "rule = com.apple.Terminal, 3\n");
+  assert(wm_config_compile(source, image));
+
+  WMConfig parsed;
+  wm_config_load(&parsed, source);
+
+  WMConfigCache cache;
+  const WMConfig *config = wm_config_cache_map(&cache, source, image);
+  assert(config != NULL && cache.image != NULL);
+  assert(memcmp(config, &parsed, sizeof(parsed)) == 0);
+
+  // indexes work straight off the mapping
+  WMAction action;
+  assert(wm_config_match_binding(config, WM_MOD_OPT, 4, &action));
+  assert(action.type == WM_ACTION_SNAP_LEFT);
+  assert(wm_config_match_rule(config, "com.apple.Terminal") == 2);
+  wm_config_cache_close(&cache);
+
+  unlink(source);
+  unlink(image);
+}
+
+TEST(config_cache_stale) {
+  char source[256];
+  snprintf(source, sizeof(source), "%s", test_path("config_stale"));
+  const char *image = test_path("config_stale_image");
+  write_file(source, "gaps_out = 5\n");
+
+  // first start parses and compiles
+  WMConfigCache cache;
+  const WMConfig *config = wm_config_cache_load(&cache, source, image);
+  assert(cache.image == NULL && config->gaps_outer.top == 5);
+  wm_config_cache_close(&cache);
+
+  // second start maps
+  config = wm_config_cache_load(&cache, source, image);
+  assert(cache.image != NULL && config->gaps_outer.top == 5);
+  wm_config_cache_close(&cache);
+
+  // edited source (same size) is detected and reparsed
+  write_file(source, "gaps_out = 7\n");
+  assert(wm_config_cache_map(&cache, source, image) == NULL);
+  config = wm_config_cache_load(&cache, source, image);
+  assert(cache.image == NULL && config->gaps_outer.top == 7);
+  wm_config_cache_close(&cache);
+
+  // corrupt image falls back to parsing
+  FILE *file = fopen(image, "r+b");
+  assert(file);
+  fseek(file, sizeof(WMConfigCacheHeader) + 4, SEEK_SET);
+  fputc(0x55, file);
+  fclose(file);
+  assert(wm_config_cache_map(&cache, source, image) == NULL);
+  config = wm_config_cache_load(&cache, source, image);
+  assert(config->gaps_outer.top == 7);
+  wm_config_cache_close(&cache);
+
+  // no source: defaults, nothing mapped
+  unlink(source);
+  config = wm_config_cache_load(&cache, source, image);
+  assert(cache.image == NULL && config->gaps_outer.top == 12);
+  wm_config_cache_close(&cache);
+  unlink(image);
+}
+
 TEST(effects_init) {
   WMEffects effects;
   wm_effects_init(&effects);
@@ -422,7 +895,7 @@ TEST(action_process_move_buffer) {
 
   // state checks
   assert(state.active_buffer == 1);
-  assert(wm_state_find_app(&state, 1234)->buffer_index == 1);
+  assert(wm_state_get_buffer_mask(&state, 1234) == WM_BUFFER_BIT(1));
 
   // effects checks
   assert(effects.to_show_count == 2);
@@ -442,6 +915,97 @@ TEST(action_process_move_buffer) {
   assert(effects.layout_buffer == 1);
 }
 
+TEST(action_switch_buffer_shared_app) {
+  WMState state;
+  wm_state_init(&state);
+
+  wm_state_register_app(&state, 1234, "com.apple.Terminal");
+  wm_state_register_app(&state, 5678, "com.tinyspeck.slackmacgap");
+  wm_state_register_app(&state, 9012, "com.google.Chrome");
+  wm_state_assign_to_buffer(&state, 1234, 0);
+  wm_state_set_buffer_mask(&state, 5678, WM_BUFFER_MASK_ALL); // sticky
+  wm_state_assign_to_buffer(&state, 9012, 1);
+  state.active_buffer = 0;
+
+  WMEffects effects;
+  bool ok = wm_action_switch_buffer(&state, 1, &effects);
+  assert(ok);
+
+  // sticky app is neither hidden nor shown
+  assert(effects.to_show_count == 1);
+  assert(effects.to_show[0] == 9012);
+  assert(effects.to_hide_count == 1);
+  assert(effects.to_hide[0] == 1234);
+  assert(state.view_mask == WM_BUFFER_BIT(1));
+}
+
+TEST(action_process_toggle_view) {
+  WMState state;
+  wm_state_init(&state);
+
+  wm_state_register_app(&state, 1, "com.test.app1");
+  wm_state_register_app(&state, 2, "com.test.app2");
+  wm_state_assign_to_buffer(&state, 1, 0);
+  wm_state_assign_to_buffer(&state, 2, 1);
+  state.active_buffer = 0;
+
+  // show buffer 1 next to buffer 0: nothing hidden
+  WMAction action = {.type = WM_ACTION_TOGGLE_VIEW, .target_buffer = 1};
+  WMEffects effects;
+  assert(wm_action_process(&state, &action, &effects));
+  assert(state.active_buffer == 0);
+  assert(state.view_mask == (WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1)));
+  assert(effects.to_show_count == 1 && effects.to_show[0] == 2);
+  assert(effects.to_hide_count == 0);
+
+  // toggle it away again: only app 2 is hidden
+  assert(wm_action_process(&state, &action, &effects));
+  assert(state.view_mask == WM_BUFFER_BIT(0));
+  assert(effects.to_show_count == 0);
+  assert(effects.to_hide_count == 1 && effects.to_hide[0] == 2);
+
+  // switching to a buffer collapses the view
+  state.view_mask = WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1);
+  assert(wm_action_switch_buffer(&state, 0, &effects));
+  assert(state.view_mask == WM_BUFFER_BIT(0));
+  assert(effects.to_hide_count == 1 && effects.to_hide[0] == 2);
+}
+
+TEST(action_process_toggle_tag_and_sticky) {
+  WMState state;
+  wm_state_init(&state);
+
+  wm_state_register_app(&state, 1234, "com.apple.Music");
+  wm_state_assign_to_buffer(&state, 1234, 0);
+  state.active_buffer = 0;
+
+  // tag into buffer 2: still visible, no show/hide
+  WMAction action = {
+      .type = WM_ACTION_TOGGLE_TAG, .target_pid = 1234, .target_buffer = 2};
+  WMEffects effects;
+  assert(wm_action_process(&state, &action, &effects));
+  assert(wm_state_get_buffer_mask(&state, 1234) ==
+         (WM_BUFFER_BIT(0) | WM_BUFFER_BIT(2)));
+  assert(effects.to_show_count == 0 && effects.to_hide_count == 0);
+  assert(effects.needs_layout);
+
+  // untag the shown buffer: app leaves the view
+  action.target_buffer = 0;
+  assert(wm_action_process(&state, &action, &effects));
+  assert(effects.to_hide_count == 1 && effects.to_hide[0] == 1234);
+
+  // sticky brings it back into every buffer
+  WMAction sticky = {.type = WM_ACTION_TOGGLE_STICKY, .target_pid = 1234};
+  assert(wm_action_process(&state, &sticky, &effects));
+  assert(wm_state_get_buffer_mask(&state, 1234) == WM_BUFFER_MASK_ALL);
+  assert(effects.to_show_count == 1 && effects.to_show[0] == 1234);
+
+  // unsticky pins to the active buffer
+  assert(wm_action_process(&state, &sticky, &effects));
+  assert(wm_state_get_buffer_mask(&state, 1234) == WM_BUFFER_BIT(0));
+  assert(effects.to_show_count == 0 && effects.to_hide_count == 0);
+}
+
 TEST(action_process_switch) {
   WMState state;
   wm_state_init(&state);
@@ -473,6 +1037,111 @@ TEST(action_process_passthrough) {
   assert(state.is_passthrough_mode == false);
 }
 
+// queued action of a type and argument
+static WMAction queued(WMActionType type, int argument) {
+  WMAction action = {.type = type, .target_buffer = argument};
+  return action;
+}
+
+TEST(action_queue_switch_burst) {
+  WMActionQueue queue;
+  wm_action_queue_init(&queue);
+
+  // Opt+1/2/3... tapped 100 times before the main loop runs
+  for (int i = 0; i < 100; i++) {
+    WMAction action = queued(WM_ACTION_SWITCH_BUFFER, i % WM_MAX_BUFFERS);
+    assert(wm_action_queue_push(&queue, &action, false));
+  }
+  assert(queue.count == 1);
+  assert(queue.superseded == 99);
+
+  WMAction action;
+  assert(wm_action_queue_pop(&queue, &action));
+  assert(action.type == WM_ACTION_SWITCH_BUFFER);
+  assert(action.target_buffer == 99 % WM_MAX_BUFFERS);
+  assert(!wm_action_queue_pop(&queue, &action));
+}
+
+TEST(action_queue_autorepeat_burst) {
+  WMActionQueue queue;
+  wm_action_queue_init(&queue);
+
+  // Opt+2 held down: one press, 99 repeats
+  WMAction action = queued(WM_ACTION_SWITCH_BUFFER, 1);
+  assert(wm_action_queue_push(&queue, &action, false));
+  for (int i = 0; i < 99; i++) {
+    assert(!wm_action_queue_push(&queue, &action, true));
+  }
+  assert(queue.count == 1);
+  assert(queue.dropped_repeats == 99);
+  assert(queue.superseded == 0);
+}
+
+TEST(action_queue_snap_burst) {
+  WMActionQueue queue;
+  wm_action_queue_init(&queue);
+
+  for (int i = 0; i < 100; i++) {
+    WMAction action =
+        queued(i % 2 ? WM_ACTION_SNAP_LEFT : WM_ACTION_SNAP_MAXIMIZE, 0);
+    wm_action_queue_push(&queue, &action, false);
+  }
+  assert(queue.count == 1);
+
+  WMAction action;
+  wm_action_queue_pop(&queue, &action);
+  assert(action.type == WM_ACTION_SNAP_LEFT);
+}
+
+TEST(action_queue_keeps_order) {
+  WMActionQueue queue;
+  wm_action_queue_init(&queue);
+
+  // a snap after a switch depends on the switch, nothing collapses across it
+  WMAction actions[] = {
+      queued(WM_ACTION_SWITCH_BUFFER, 1), queued(WM_ACTION_SNAP_LEFT, 0),
+      queued(WM_ACTION_SWITCH_BUFFER, 2), queued(WM_ACTION_TOGGLE_VIEW, 3),
+      queued(WM_ACTION_SWITCH_BUFFER, 4), // replaces switch 2 + toggle 3
+  };
+  for (int i = 0; i < 5; i++) {
+    wm_action_queue_push(&queue, &actions[i], false);
+  }
+  assert(queue.count == 3);
+  assert(queue.superseded == 2);
+
+  WMAction action;
+  wm_action_queue_pop(&queue, &action);
+  assert(action.type == WM_ACTION_SWITCH_BUFFER && action.target_buffer == 1);
+  wm_action_queue_pop(&queue, &action);
+  assert(action.type == WM_ACTION_SNAP_LEFT);
+  wm_action_queue_pop(&queue, &action);
+  assert(action.type == WM_ACTION_SWITCH_BUFFER && action.target_buffer == 4);
+}
+
+TEST(action_queue_overflow_burst) {
+  WMActionQueue queue;
+  wm_action_queue_init(&queue);
+
+  // moves each act on a different focused app, none is superseded
+  for (int i = 0; i < 100; i++) {
+    WMAction action = queued(WM_ACTION_MOVE_BUFFER, i % WM_MAX_BUFFERS);
+    wm_action_queue_push(&queue, &action, false);
+  }
+  assert(queue.count == WM_ACTION_QUEUE_SIZE);
+  assert(queue.overflows == 100 - WM_ACTION_QUEUE_SIZE);
+
+  // oldest first, across the ring wrap
+  WMAction action;
+  for (int i = 0; i < WM_ACTION_QUEUE_SIZE; i++) {
+    assert(wm_action_queue_pop(&queue, &action));
+    assert(action.target_buffer == i % WM_MAX_BUFFERS);
+    WMAction next = queued(WM_ACTION_RETILE, 0);
+    if (i < 10)
+      assert(wm_action_queue_push(&queue, &next, false));
+  }
+  assert(queue.count == 10);
+}
+
 TEST(layout_apply_gaps) {
   WMRect rect = {.x = 0, .y = 0, .width = 100, .height = 100};
   WMRect result = wm_layout_apply_gaps(rect, 10, 10, 10, 10);
@@ -803,6 +1472,3671 @@ TEST(layout_dwindle_after_snap_retile) {
   assert(count == 3);
 }
 
+TEST(layout_dwindle_view) {
+  WMState state;
+  wm_state_init(&state);
+  WMConfig config;
+  wm_config_init(&config);
+  config.gaps_outer = (WMGap){.top = 0, .right = 0, .bottom = 0, .left = 0};
+  config.gaps_inner = (WMGap){.top = 0, .right = 0, .bottom = 0, .left = 0};
+
+  wm_state_register_app(&state, 1, "com.test.app1");
+  wm_state_register_app(&state, 2, "com.test.app2");
+  wm_state_register_app(&state, 3, "com.test.app3");
+  wm_state_assign_to_buffer(&state, 1, 0);
+  wm_state_assign_to_buffer(&state, 2, 1);
+  wm_state_set_buffer_mask(&state, 3, WM_BUFFER_MASK_ALL);
+
+  WMRect screen = {.x = 0, .y = 0, .width = 1000, .height = 1000};
+  WMFrameChange frames[WM_MAX_APPS];
+
+  // sticky app tiles with each buffer
+  int count =
+      wm_layout_compute_dwindle(&state, 0, &config, screen, frames, WM_MAX_APPS);
+  assert(count == 2);
+
+  // union view tiles apps of both buffers once
+  count = wm_layout_compute_dwindle_view(&state,
+                                         WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1),
+                                         &config, screen, frames, WM_MAX_APPS);
+  assert(count == 3);
+  assert(frames[0].pid == 1 && frames[1].pid == 2 && frames[2].pid == 3);
+}
+
+static bool same_frame(WMRect a, WMRect b) {
+  return a.x == b.x && a.y == b.y && a.width == b.width &&
+         a.height == b.height;
+}
+
+// v is a whole number of grid units
+static bool on_grid(double v, double unit) {
+  return v * unit == (double)(int64_t)(v * unit);
+}
+
+// a snapped edge is the nearest grid unit to the exact one
+static bool near_edge(double snapped, double exact, double unit) {
+  double d = snapped - exact;
+  return d <= 0.5 / unit && -d <= 0.5 / unit;
+}
+
+static WMRect bounds(const WMFrameChange *frames, int count) {
+  double left = frames[0].frame.x, bottom = frames[0].frame.y;
+  double right = left + frames[0].frame.width;
+  double top = bottom + frames[0].frame.height;
+  for (int i = 1; i < count; i++) {
+    WMRect f = frames[i].frame;
+    left = f.x < left ? f.x : left;
+    bottom = f.y < bottom ? f.y : bottom;
+    right = f.x + f.width > right ? f.x + f.width : right;
+    top = f.y + f.height > top ? f.y + f.height : top;
+  }
+  return (WMRect){left, bottom, right - left, top - bottom};
+}
+
+// frames[first] and the frames after it split area exactly around a gap,
+// the first half at most one unit larger
+static void check_split(const WMFrameChange *frames, int first, int count,
+                        WMRect area, double gap_x, double gap_y,
+                        double unit) {
+  WMRect tile = frames[first].frame;
+  if (first == count - 1) {
+    assert(same_frame(tile, area));
+    return;
+  }
+  WMRect rest = bounds(frames + first + 1, count - first - 1);
+  if (first % 2 == 0) {
+    assert(tile.x == area.x && tile.y == area.y &&
+           tile.height == area.height);
+    assert(rest.y == area.y && rest.height == area.height);
+    assert(rest.x == tile.x + tile.width + gap_x);
+    assert(rest.x + rest.width == area.x + area.width);
+    assert(tile.width >= rest.width && tile.width - rest.width <= 1 / unit);
+  } else {
+    assert(tile.x == area.x && tile.width == area.width);
+    assert(rest.x == area.x && rest.width == area.width);
+    assert(rest.y == area.y && tile.y == rest.y + rest.height + gap_y);
+    assert(tile.y + tile.height == area.y + area.height);
+    assert(tile.height >= rest.height &&
+           tile.height - rest.height <= 1 / unit);
+  }
+  check_split(frames, first + 1, count, rest, gap_x, gap_y, unit);
+}
+
+TEST(layout_snap_exact) {
+  WMConfig config;
+  wm_config_init(&config);
+  pid_t pids[16];
+  for (int i = 0; i < 16; i++)
+    pids[i] = 100 + i;
+
+  uint32_t seed = 49;
+  for (int it = 0; it < 3000; it++) {
+    seed = seed * 1103515245u + 12345u;
+    int count = 1 + (int)((seed >> 8) % 16);
+    double scale = (seed >> 16) % 2 ? 2 : 1;
+    config.layout_snap =
+        (seed >> 20) % 2 ? WM_LAYOUT_SNAP_PIXELS : WM_LAYOUT_SNAP_POINTS;
+    seed = seed * 1103515245u + 12345u;
+    int gap = (int)((seed >> 8) % 21);
+    int outer = (int)((seed >> 16) % 25);
+    config.gaps_inner = (WMGap){gap, gap, gap, gap};
+    config.gaps_outer = (WMGap){outer, outer + 1, outer, outer + 1};
+
+    // odd sizes and origins off the grid, wide enough for count tiles
+    seed = seed * 1103515245u + 12345u;
+    double min_width = 40 << (count / 2);
+    double min_height = 40 << ((count - 1) / 2);
+    WMRect screen = {
+        .x = (double)((seed >> 8) % 3000) + 0.25,
+        .y = (double)((seed >> 4) % 200) + 0.75,
+        .width = min_width + (double)((seed >> 12) % 3500) + 0.5,
+        .height = min_height + (double)((seed >> 18) % 2000) + 0.3};
+
+    WMFrameChange frames[16], again[16];
+    int n = wm_layout_compute_dwindle_fit(pids, NULL, count, &config, screen,
+                                          scale, frames, 16);
+    assert(n == count);
+
+    // the same bits for the same input
+    assert(wm_layout_compute_dwindle_fit(pids, NULL, count, &config, screen,
+                                         scale, again, 16) == n);
+    assert(memcmp(frames, again, sizeof(frames[0]) * (size_t)n) == 0);
+
+    // every edge on the grid, within the screen, tiled exactly
+    double unit =
+        config.layout_snap == WM_LAYOUT_SNAP_PIXELS ? scale : 1;
+    for (int i = 0; i < n; i++) {
+      WMRect f = frames[i].frame;
+      assert(frames[i].pid == pids[i]);
+      assert(on_grid(f.x, unit) && on_grid(f.y, unit));
+      assert(on_grid(f.width, unit) && on_grid(f.height, unit));
+      assert(f.width > 0 && f.height > 0);
+    }
+    WMRect usable = bounds(frames, n);
+    WMRect expected = {screen.x + outer + 1, screen.y + outer,
+                       screen.width - 2 * outer - 2,
+                       screen.height - 2 * outer};
+    assert(near_edge(usable.x, expected.x, unit));
+    assert(near_edge(usable.y, expected.y, unit));
+    assert(near_edge(usable.x + usable.width, expected.x + expected.width,
+                     unit));
+    assert(near_edge(usable.y + usable.height, expected.y + expected.height,
+                     unit));
+    check_split(frames, 0, n, usable, gap, gap, unit);
+  }
+}
+
+TEST(layout_snap_modes) {
+  WMConfig config;
+  wm_config_init(&config);
+  config.gaps_outer = (WMGap){0, 0, 0, 0};
+  config.gaps_inner = (WMGap){8, 8, 8, 8};
+  pid_t pids[] = {1, 2, 3};
+  WMFrameChange frames[3];
+  WMRect screen = {.x = 0, .y = 0, .width = 1001, .height = 801};
+
+  // whole points by default: the odd point goes to the first half
+  assert(config.layout_snap == WM_LAYOUT_SNAP_POINTS);
+  assert(wm_layout_compute_dwindle_fit(pids, NULL, 3, &config, screen, 2,
+                                       frames, 3) == 3);
+  assert(same_frame(frames[0].frame, (WMRect){0, 0, 497, 801}));
+  assert(same_frame(frames[1].frame, (WMRect){505, 404, 496, 397}));
+  assert(same_frame(frames[2].frame, (WMRect){505, 0, 496, 396}));
+
+  // backing pixels split it evenly on a retina display
+  config.layout_snap = WM_LAYOUT_SNAP_PIXELS;
+  wm_layout_compute_dwindle_fit(pids, NULL, 3, &config, screen, 2, frames, 3);
+  assert(same_frame(frames[0].frame, (WMRect){0, 0, 496.5, 801}));
+  assert(same_frame(frames[1].frame,
+                          (WMRect){504.5, 404.5, 496.5, 396.5}));
+  assert(same_frame(frames[2].frame, (WMRect){504.5, 0, 496.5, 396.5}));
+  wm_layout_compute_dwindle_fit(pids, NULL, 1, &config, screen, 1, frames, 3);
+  assert(same_frame(frames[0].frame, screen));
+
+  // off divides as before
+  config.layout_snap = WM_LAYOUT_SNAP_OFF;
+  wm_layout_compute_dwindle_fit(pids, NULL, 2, &config, screen, 2, frames, 3);
+  assert(same_frame(frames[0].frame, (WMRect){0, 0, 496.5, 801}));
+  assert(same_frame(frames[1].frame, (WMRect){504.5, 0, 496.5, 801}));
+
+  // a display tiles on its own backing pixels, a new scale makes it stale
+  WMState state;
+  wm_state_init(&state);
+  wm_state_register_app(&state, 1, "com.apple.Terminal");
+  wm_state_register_app(&state, 2, "com.google.Chrome");
+  wm_state_assign_to_buffer(&state, 1, 0);
+  wm_state_assign_to_buffer(&state, 2, 0);
+  WMDisplayInfo info = {.id = 7, .frame = screen, .scale = 2};
+  assert(wm_display_configure(&state, &info, 1) == WM_DISPLAY_BIT(0));
+  config.layout_snap = WM_LAYOUT_SNAP_PIXELS;
+  assert(wm_display_tile_view(&state, 0, WM_BUFFER_BIT(0), &config, frames,
+                              3) == 2);
+  assert(frames[0].frame.width == 496.5);
+  assert(wm_display_configure(&state, &info, 1) == 0);
+  info.scale = 1;
+  assert(wm_display_configure(&state, &info, 1) == WM_DISPLAY_BIT(0));
+  wm_display_tile_view(&state, 0, WM_BUFFER_BIT(0), &config, frames, 3);
+  assert(frames[0].frame.width == 497);
+
+  // snaps: halves and gap fill the screen
+  config.layout_snap = WM_LAYOUT_SNAP_POINTS;
+  config.gaps_outer = (WMGap){10, 10, 10, 10};
+  screen = (WMRect){.x = 0.5, .y = 0, .width = 1921, .height = 1081};
+  WMRect left = wm_layout_compute_snap(WM_ACTION_SNAP_LEFT, screen, &config);
+  WMRect right = wm_layout_compute_snap(WM_ACTION_SNAP_RIGHT, screen, &config);
+  WMRect top = wm_layout_compute_snap(WM_ACTION_SNAP_TOP, screen, &config);
+  WMRect bottom =
+      wm_layout_compute_snap(WM_ACTION_SNAP_BOTTOM, screen, &config);
+  assert(left.x == 11 && left.width == 947 && right.width == 946);
+  assert(right.x == left.x + left.width + 8);
+  assert(right.x + right.width == 1912);
+  assert(top.height == 527 && bottom.height == 526);
+  assert(top.y == bottom.y + bottom.height + 8 && top.y + top.height == 1071);
+  WMRect center =
+      wm_layout_compute_snap(WM_ACTION_SNAP_CENTER, screen, &config);
+  assert(on_grid(center.x, 1) && on_grid(center.width, 1));
+
+  // config key
+  const char *path = test_path("config_snap");
+  write_file(path, "layout_snap = pixels\n");
+  assert(wm_config_load(&config, path));
+  assert(config.layout_snap == WM_LAYOUT_SNAP_PIXELS);
+  write_file(path, "layout_snap = off\nlayout_snap = sometimes\n");
+  assert(wm_config_load(&config, path));
+  assert(config.layout_snap == WM_LAYOUT_SNAP_OFF);
+  unlink(path);
+}
+
+TEST(snapshot_round_trip) {
+  const char *path = test_path("snapshot");
+
+  WMState state;
+  wm_state_init(&state);
+  wm_state_register_app(&state, 100, "com.apple.Terminal");
+  wm_state_register_app(&state, 200, "com.tinyspeck.slackmacgap");
+  wm_state_register_app(&state, 300, "com.google.Chrome");
+  wm_state_assign_to_buffer(&state, 100, 0);
+  wm_state_set_buffer_mask(&state, 200, WM_BUFFER_MASK_ALL);
+  wm_state_assign_to_buffer(&state, 300, 2);
+  wm_state_set_floating(&state, 300, true);
+  wm_state_set_view(&state, 2, WM_BUFFER_BIT(2) | WM_BUFFER_BIT(0));
+  wm_state_set_focused(&state, 300);
+
+  WMSnapshotWriter writer;
+  assert(wm_snapshot_open(&writer, path));
+  assert(wm_snapshot_write(&writer, &state));
+  wm_snapshot_close(&writer);
+
+  // restart: the same apps run in another order, Chrome got relaunched
+  WMState restored;
+  wm_state_init(&restored);
+  wm_state_register_app(&restored, 310, "com.google.Chrome");
+  wm_state_register_app(&restored, 200, "com.tinyspeck.slackmacgap");
+  wm_state_register_app(&restored, 100, "com.apple.Terminal");
+  wm_state_register_app(&restored, 400, "com.new.App");
+
+  WMSnapshotView view;
+  int count = wm_snapshot_restore(path, &restored, &view);
+  assert(count == 3);
+  assert(wm_state_get_buffer_mask(&restored, 100) == WM_BUFFER_BIT(0));
+  assert(wm_state_get_buffer_mask(&restored, 200) == WM_BUFFER_MASK_ALL);
+  assert(wm_state_get_buffer_mask(&restored, 310) == WM_BUFFER_BIT(2));
+  assert(wm_state_find_app(&restored, 310)->is_floating);
+  assert(wm_state_get_buffer_mask(&restored, 400) == 0); // unknown, untouched
+  assert(view.active_buffer == 2);
+  assert(view.view_mask == (WM_BUFFER_BIT(2) | WM_BUFFER_BIT(0)));
+
+  // focus of the relaunched app had its old pid, it's dropped
+  assert(restored.buffers[2].last_focused_pid == 0);
+  unlink(path);
+}
+
+TEST(snapshot_display_views) {
+  const char *path = test_path("snapshot_displays");
+
+  // every display shows its own view, the last one is focused
+  WMState state;
+  wm_state_init(&state);
+  WMDisplayInfo infos[] = {
+      {.id = 11, .frame = {0, 0, 1000, 800}},
+      {.id = 22, .frame = {1000, 0, 1000, 800}},
+      {.id = 33, .frame = {2000, 100, 800, 600}},
+  };
+  wm_display_configure(&state, infos, 3);
+  wm_state_set_view(&state, 0, WM_BUFFER_BIT(0));
+  assert(wm_display_focus(&state, 1));
+  wm_state_set_view(&state, 1, WM_BUFFER_BIT(1));
+  assert(wm_display_focus(&state, 2));
+  wm_state_set_view(&state, 4, WM_BUFFER_BIT(3) | WM_BUFFER_BIT(4));
+
+  WMSnapshotWriter writer;
+  assert(wm_snapshot_open(&writer, path));
+  assert(wm_snapshot_write(&writer, &state));
+  wm_snapshot_close(&writer);
+
+  // restart: 33 is gone, 44 is new and the others come in another order
+  WMState restored;
+  wm_state_init(&restored);
+  WMDisplayInfo next[] = {
+      {.id = 22, .frame = {0, 0, 1000, 800}},
+      {.id = 44, .frame = {1000, 0, 1000, 800}},
+      {.id = 11, .frame = {2000, 0, 1000, 800}},
+  };
+  wm_display_configure(&restored, next, 3);
+  assert(restored.focused_display == 0);
+
+  WMSnapshotView view;
+  assert(wm_snapshot_restore(path, &restored, &view) == 0);
+  assert(restored.focused_display == 0);
+  assert(view.active_buffer == 1); // 22's view, for the caller to switch
+  assert(view.view_mask == WM_BUFFER_BIT(1));
+  assert(wm_state_display_view(&restored, 1) == 0);
+  assert(wm_state_display_view(&restored, 2) == WM_BUFFER_BIT(0));
+  assert(restored.displays[2].active_buffer == 0);
+
+  // none of the saved displays is left: the focused one's view is used
+  WMState moved;
+  wm_state_init(&moved);
+  WMDisplayInfo other = {.id = 55, .frame = {0, 0, 1000, 800}};
+  wm_display_configure(&moved, &other, 1);
+  assert(wm_snapshot_restore(path, &moved, &view) == 0);
+  assert(view.active_buffer == 4);
+  assert(view.view_mask == (WM_BUFFER_BIT(3) | WM_BUFFER_BIT(4)));
+  unlink(path);
+}
+
+TEST(snapshot_pid_reuse) {
+  const char *path = test_path("snapshot_reuse");
+
+  WMState state;
+  wm_state_init(&state);
+  wm_state_register_app(&state, 100, "com.apple.Terminal");
+  wm_state_assign_to_buffer(&state, 100, 3);
+
+  WMSnapshotWriter writer;
+  assert(wm_snapshot_open(&writer, path));
+  wm_snapshot_write(&writer, &state);
+  wm_snapshot_close(&writer);
+
+  // pid 100 now belongs to a different app
+  WMState restored;
+  wm_state_init(&restored);
+  wm_state_register_app(&restored, 100, "com.other.App");
+  assert(wm_snapshot_restore(path, &restored, NULL) == 0);
+  assert(wm_state_get_buffer_mask(&restored, 100) == 0);
+  unlink(path);
+}
+
+TEST(snapshot_dirty_records) {
+  const char *path = test_path("snapshot_dirty");
+
+  WMState state;
+  wm_state_init(&state);
+  for (int i = 0; i < 20; i++) {
+    char bundle[64];
+    snprintf(bundle, sizeof(bundle), "com.test.app%d", i);
+    wm_state_register_app(&state, 1000 + i, bundle);
+    wm_state_assign_to_buffer(&state, 1000 + i, i % WM_MAX_BUFFERS);
+  }
+
+  WMSnapshotWriter writer;
+  assert(wm_snapshot_open(&writer, path));
+  wm_snapshot_write(&writer, &state);
+  assert(writer.last_dirty_records == WM_MAX_APPS); // first write is full
+
+  // unchanged state is skipped entirely
+  writer.last_dirty_records = -1;
+  wm_snapshot_write(&writer, &state);
+  assert(writer.last_dirty_records == -1);
+
+  // one app moved = one record rewritten
+  wm_state_assign_to_buffer(&state, 1005, 4);
+  wm_snapshot_write(&writer, &state);
+  assert(writer.last_dirty_records == 1);
+
+  // swap-remove touches the hole and the old last slot
+  wm_state_unregister_app(&state, 1003);
+  wm_snapshot_write(&writer, &state);
+  assert(writer.last_dirty_records == 2);
+  wm_snapshot_close(&writer);
+
+  // incremental checksum still validates
+  WMState restored;
+  wm_state_init(&restored);
+  wm_state_register_app(&restored, 1005, "com.test.app5");
+  assert(wm_snapshot_restore(path, &restored, NULL) == 1);
+  assert(wm_state_get_buffer_mask(&restored, 1005) == WM_BUFFER_BIT(4));
+  unlink(path);
+}
+
+TEST(snapshot_corrupt) {
+  const char *path = test_path("snapshot_corrupt");
+
+  WMState state;
+  wm_state_init(&state);
+  wm_state_register_app(&state, 100, "com.apple.Terminal");
+  wm_state_assign_to_buffer(&state, 100, 1);
+
+  WMSnapshotWriter writer;
+  assert(wm_snapshot_open(&writer, path));
+  wm_snapshot_write(&writer, &state);
+  wm_snapshot_close(&writer);
+
+  // flip one byte of the first record
+  FILE *file = fopen(path, "r+b");
+  assert(file);
+  fseek(file, sizeof(WMSnapshotHeader) + 8, SEEK_SET);
+  fputc('X', file);
+  fclose(file);
+
+  WMState restored;
+  wm_state_init(&restored);
+  wm_state_register_app(&restored, 100, "com.apple.Terminal");
+  assert(wm_snapshot_restore(path, &restored, NULL) == -1);
+  assert(wm_state_get_buffer_mask(&restored, 100) == 0);
+
+  // truncated and missing files are rejected too
+  assert(truncate(path, 16) == 0);
+  assert(wm_snapshot_restore(path, &restored, NULL) == -1);
+  unlink(path);
+  assert(wm_snapshot_restore(path, &restored, NULL) == -1);
+}
+
+TEST(placement_record_lookup) {
+  const char *path = test_path("placements");
+
+  WMPlacementStore store;
+  assert(wm_placement_open(&store, path));
+  assert(store.entry_count == 0);
+
+  const char *bundle = "com.spotify.client";
+  uint32_t hash = wm_config_hash_bundle(bundle);
+  WMBufferMask mask = 0;
+  assert(!wm_placement_lookup(&store, bundle, hash, &mask));
+
+  assert(wm_placement_record(&store, bundle, WM_BUFFER_BIT(3)));
+  assert(wm_placement_record(&store, "com.apple.Terminal", WM_BUFFER_BIT(1)));
+  assert(wm_placement_lookup(&store, bundle, hash, &mask));
+  assert(mask == WM_BUFFER_BIT(3));
+
+  // updated in place, not duplicated
+  assert(wm_placement_record(&store, bundle,
+                             WM_BUFFER_BIT(0) | WM_BUFFER_BIT(4)));
+  assert(store.entry_count == 2);
+  wm_placement_close(&store);
+
+  // survives a restart
+  assert(wm_placement_open(&store, path));
+  assert(store.entry_count == 2);
+  assert(store.recovered_slots == 0);
+  assert(wm_placement_lookup(&store, bundle, hash, &mask));
+  assert(mask == (WM_BUFFER_BIT(0) | WM_BUFFER_BIT(4)));
+
+  // mask 0 forgets
+  assert(wm_placement_record(&store, bundle, 0));
+  assert(!wm_placement_lookup(&store, bundle, hash, &mask));
+  assert(store.entry_count == 1);
+  assert(wm_placement_lookup(&store, "com.apple.Terminal",
+                             wm_config_hash_bundle("com.apple.Terminal"),
+                             &mask));
+  wm_placement_close(&store);
+  unlink(path);
+}
+
+TEST(placement_eviction) {
+  const char *path = test_path("placements_evict");
+
+  // bundles that all hash to the same home slot
+  char bundles[WM_PLACEMENT_MAX_PROBE + 1][32];
+  int found = 0;
+  uint32_t home = 0;
+  for (int i = 0; found < WM_PLACEMENT_MAX_PROBE + 1; i++) {
+    char bundle[32];
+    snprintf(bundle, sizeof(bundle), "com.test.app%d", i);
+    uint32_t slot = wm_config_hash_bundle(bundle) & (WM_PLACEMENT_SLOTS - 1);
+    if (found == 0)
+      home = slot;
+    if (slot == home)
+      memcpy(bundles[found++], bundle, sizeof(bundle));
+  }
+
+  WMPlacementStore store;
+  assert(wm_placement_open(&store, path));
+  for (int i = 0; i < WM_PLACEMENT_MAX_PROBE; i++) {
+    assert(wm_placement_record(&store, bundles[i], WM_BUFFER_BIT(1)));
+  }
+  assert(store.entry_count == WM_PLACEMENT_MAX_PROBE);
+  assert(store.evictions == 0);
+
+  // touch the oldest, the second oldest becomes the victim
+  WMBufferMask mask;
+  assert(wm_placement_lookup(&store, bundles[0],
+                             wm_config_hash_bundle(bundles[0]), &mask));
+  assert(wm_placement_record(&store, bundles[WM_PLACEMENT_MAX_PROBE],
+                             WM_BUFFER_BIT(2)));
+  assert(store.evictions == 1);
+  assert(store.entry_count == WM_PLACEMENT_MAX_PROBE);
+  assert(wm_placement_lookup(&store, bundles[0],
+                             wm_config_hash_bundle(bundles[0]), &mask));
+  assert(!wm_placement_lookup(&store, bundles[1],
+                              wm_config_hash_bundle(bundles[1]), &mask));
+  assert(wm_placement_lookup(
+      &store, bundles[WM_PLACEMENT_MAX_PROBE],
+      wm_config_hash_bundle(bundles[WM_PLACEMENT_MAX_PROBE]), &mask));
+  assert(mask == WM_BUFFER_BIT(2));
+  wm_placement_close(&store);
+  unlink(path);
+}
+
+TEST(placement_corruption_recovery) {
+  const char *path = test_path("placements_corrupt");
+
+  WMPlacementStore store;
+  assert(wm_placement_open(&store, path));
+  wm_placement_record(&store, "com.apple.Terminal", WM_BUFFER_BIT(1));
+  wm_placement_record(&store, "com.google.Chrome", WM_BUFFER_BIT(2));
+
+  // find the slot of Terminal
+  long offset = -1;
+  for (int i = 0; i < WM_PLACEMENT_SLOTS; i++) {
+    if (strcmp(store.image->slots[i].bundle_identifier,
+               "com.apple.Terminal") == 0)
+      offset = (long)((char *)&store.image->slots[i].buffer_mask -
+                      (char *)store.image);
+  }
+  assert(offset > 0);
+  wm_placement_close(&store);
+
+  // flip its mask on disk
+  FILE *file = fopen(path, "r+b");
+  assert(file);
+  fseek(file, offset, SEEK_SET);
+  fputc(0x7f, file);
+  fclose(file);
+
+  // the bad slot is dropped, the other survives
+  WMBufferMask mask = 0;
+  assert(wm_placement_open(&store, path));
+  assert(store.recovered_slots == 1);
+  assert(store.entry_count == 1);
+  assert(!wm_placement_lookup(&store, "com.apple.Terminal",
+                              wm_config_hash_bundle("com.apple.Terminal"),
+                              &mask));
+  assert(wm_placement_lookup(&store, "com.google.Chrome",
+                             wm_config_hash_bundle("com.google.Chrome"),
+                             &mask));
+  assert(mask == WM_BUFFER_BIT(2));
+  wm_placement_close(&store);
+
+  // a truncated file is reset to an empty table
+  assert(truncate(path, 8) == 0);
+  assert(wm_placement_open(&store, path));
+  assert(store.entry_count == 0);
+  assert(!wm_placement_lookup(&store, "com.google.Chrome",
+                              wm_config_hash_bundle("com.google.Chrome"),
+                              &mask));
+  assert(wm_placement_record(&store, "com.google.Chrome", WM_BUFFER_BIT(2)));
+  wm_placement_close(&store);
+  unlink(path);
+}
+
+TEST(placement_register_apps) {
+  const char *path = test_path("placements_register");
+
+  WMConfig config;
+  wm_config_init(&config);
+  wm_config_add_rule(&config, "com.apple.Terminal", 1);
+
+  WMPlacementStore store;
+  assert(wm_placement_open(&store, path));
+  wm_placement_record(&store, "com.apple.Terminal", WM_BUFFER_BIT(4));
+  wm_placement_record(&store, "com.spotify.client",
+                      WM_BUFFER_BIT(2) | WM_BUFFER_BIT(3));
+
+  WMState state;
+  wm_state_init(&state);
+  state.placements = &store;
+
+  WMAppSpec specs[] = {
+      {100, "com.apple.Terminal"}, // rule wins over placement
+      {200, "com.spotify.client"}, // learned placement, tags kept
+      {300, "com.new.App"},        // unknown, default buffer
+  };
+  WMRegisterDelta delta;
+  assert(wm_state_register_apps(&state, &config, specs, 3, 0, &delta) == 3);
+  assert(wm_state_get_buffer_mask(&state, 100) == WM_BUFFER_BIT(1));
+  assert(wm_state_get_buffer_mask(&state, 200) ==
+         (WM_BUFFER_BIT(2) | WM_BUFFER_BIT(3)));
+  assert(wm_state_get_buffer_mask(&state, 300) == WM_BUFFER_BIT(0));
+  assert(delta.added[0] == 1 && delta.added[1] == 1);
+  assert(delta.added[2] == 1 && delta.added[3] == 1 && delta.added[4] == 0);
+  assert(delta.dirty_buffers == 0x0f);
+  wm_placement_close(&store);
+  unlink(path);
+}
+
+#define KEY_B 11
+#define KEY_H 4
+#define KEY_L 37
+#define KEY_R 15
+#define KEY_X 7
+#define KEY_3 20
+#define MS 1000000ull
+
+TEST(keys_single_chord) {
+  WMConfig config;
+  wm_config_init(&config);
+  WMKeyMatcher matcher;
+  wm_keys_init(&matcher, &config);
+
+  const WMBinding *binding = NULL;
+  assert(wm_keys_feed(&matcher, WM_MOD_OPT, 18, 0, &binding) == WM_KEY_ACTION);
+  assert(binding->action == WM_ACTION_SWITCH_BUFFER);
+  assert(binding->action_argument == 0);
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, KEY_X, 0, &binding) ==
+         WM_KEY_PASS);
+}
+
+TEST(keys_sequence) {
+  WMConfig config;
+  wm_config_init(&config);
+  int mods[] = {WM_MOD_OPT, WM_MOD_NONE};
+  int keys[] = {KEY_B, KEY_3};
+  assert(wm_config_add_sequence(&config, mods, keys, 2, WM_ACTION_TOGGLE_TAG,
+                                2, NULL));
+
+  // OPT+b alone is not an action
+  WMAction action;
+  assert(!wm_config_match_binding(&config, WM_MOD_OPT, KEY_B, &action));
+
+  WMKeyMatcher matcher;
+  wm_keys_init(&matcher, &config);
+  const WMBinding *binding = NULL;
+  assert(wm_keys_feed(&matcher, WM_MOD_OPT, KEY_B, 0, &binding) ==
+         WM_KEY_CONSUMED);
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, KEY_3, 10 * MS, &binding) ==
+         WM_KEY_ACTION);
+  assert(binding->action == WM_ACTION_TOGGLE_TAG);
+  assert(binding->action_argument == 2);
+
+  // back at the root, a plain 3 is typing
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, KEY_3, 20 * MS, &binding) ==
+         WM_KEY_PASS);
+
+  // a key unbound after the prefix falls through and resets
+  assert(wm_keys_feed(&matcher, WM_MOD_OPT, KEY_B, 30 * MS, &binding) ==
+         WM_KEY_CONSUMED);
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, KEY_X, 40 * MS, &binding) ==
+         WM_KEY_PASS);
+  assert(matcher.node == 0);
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, KEY_3, 50 * MS, &binding) ==
+         WM_KEY_PASS);
+
+  // the sequence times out
+  assert(wm_keys_feed(&matcher, WM_MOD_OPT, KEY_B, 100 * MS, &binding) ==
+         WM_KEY_CONSUMED);
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, KEY_3,
+                      (100 + WM_KEY_TIMEOUT_MS) * MS, &binding) ==
+         WM_KEY_PASS);
+}
+
+TEST(keys_layer) {
+  WMConfig config;
+  wm_config_init(&config);
+  int mods[] = {WM_MOD_OPT, WM_MOD_NONE};
+  int keys[] = {KEY_R, KEY_H};
+  assert(wm_config_add_layer(&config, mods, keys, 1));
+  assert(wm_config_add_sequence(&config, mods, keys, 2, WM_ACTION_SNAP_LEFT,
+                                0, NULL));
+  keys[1] = KEY_L;
+  assert(wm_config_add_sequence(&config, mods, keys, 2, WM_ACTION_SNAP_RIGHT,
+                                0, NULL));
+  assert(config.key_node_count == 2); // both share the layer node
+
+  WMKeyMatcher matcher;
+  wm_keys_init(&matcher, &config);
+  const WMBinding *binding = NULL;
+  assert(wm_keys_feed(&matcher, WM_MOD_OPT, KEY_R, 0, &binding) ==
+         WM_KEY_CONSUMED);
+
+  // actions keep the layer active
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, KEY_H, 1 * MS, &binding) ==
+         WM_KEY_ACTION);
+  assert(binding->action == WM_ACTION_SNAP_LEFT);
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, KEY_L, 2 * MS, &binding) ==
+         WM_KEY_ACTION);
+  assert(binding->action == WM_ACTION_SNAP_RIGHT);
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, KEY_H, 3 * MS, &binding) ==
+         WM_KEY_ACTION);
+
+  // escape leaves without reaching the app
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, WM_KEY_ESCAPE, 4 * MS,
+                      &binding) == WM_KEY_CONSUMED);
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, KEY_H, 5 * MS, &binding) ==
+         WM_KEY_PASS);
+
+  // escape outside a layer is the app's
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, WM_KEY_ESCAPE, 6 * MS,
+                      &binding) == WM_KEY_PASS);
+}
+
+TEST(keys_parse_sequences) {
+  const char *path = test_path("config_keys");
+  write_file(path, "key_timeout = 500\n"
+                   "bind = OPT+b, 3, toggle_tag_3\n"
+                   "bind = OPT+b, SHIFT+3, move_buffer_3\n"
+                   "layer = OPT+r\n"
+                   "bind = OPT+r, h, snap_left\n"
+                   "bind = OPT+1, g, buffer_2   # OPT+1 becomes a prefix\n"
+                   "bind = a, b, c, d, e, retile\n");
+
+  WMConfig config;
+  assert(wm_config_load(&config, path));
+  assert(config.key_timeout_ms == 500);
+  assert(config.key_node_count == 4); // root, OPT+b, OPT+r, OPT+1
+
+  WMKeyMatcher matcher;
+  wm_keys_init(&matcher, &config);
+  const WMBinding *binding = NULL;
+  assert(wm_keys_feed(&matcher, WM_MOD_OPT, KEY_B, 0, &binding) ==
+         WM_KEY_CONSUMED);
+  assert(wm_keys_feed(&matcher, WM_MOD_SHIFT, KEY_3, 0, &binding) ==
+         WM_KEY_ACTION);
+  assert(binding->action == WM_ACTION_MOVE_BUFFER);
+
+  assert(wm_keys_feed(&matcher, WM_MOD_OPT, 18, 0, &binding) ==
+         WM_KEY_CONSUMED);
+  assert(wm_keys_feed(&matcher, WM_MOD_NONE, 5, 0, &binding) ==
+         WM_KEY_ACTION);
+  assert(binding->action == WM_ACTION_SWITCH_BUFFER);
+  assert(binding->action_argument == 1);
+
+  assert(config.key_node_flags[2] & WM_KEY_NODE_LAYER);
+  unlink(path);
+}
+
+// switch
+
+// stand-in platform with a hand-driven clock: hidden apps unhide and shown
+// apps hide asynchronously, raising and layout are synchronous and take 1 ms
+typedef struct {
+  WMState *state;
+  uint64_t now;
+  WMSwitchStage stages[32]; // stages run, in order
+  int stage_count;
+  int finished;
+} FakeSwitchBackend;
+
+static uint64_t fake_switch_clock(void *context) {
+  return ((FakeSwitchBackend *)context)->now;
+}
+
+static void fake_switch_run_stage(WMSwitch *sw, WMSwitchStage stage,
+                                  void *context) {
+  FakeSwitchBackend *fake = context;
+  fake->stages[fake->stage_count++] = stage;
+
+  const WMSwitchPlan *plan = &sw->plan;
+  switch (stage) {
+  case WM_SWITCH_UNHIDE:
+    for (int i = 0; i < plan->show_count; i++) {
+      if ((wm_state_get_buffer_mask(fake->state, plan->show[i]) &
+           plan->shown_view) == 0)
+        wm_switch_expect(sw, plan->show[i]);
+    }
+    break;
+  case WM_SWITCH_ACTIVATE:
+    if (plan->focus_pid > 0)
+      wm_switch_expect(sw, plan->focus_pid);
+    break;
+  case WM_SWITCH_HIDE:
+    for (int i = 0; i < plan->hide_count; i++)
+      wm_switch_expect(sw, plan->hide[i]);
+    break;
+  case WM_SWITCH_RAISE:
+  case WM_SWITCH_LAYOUT:
+    fake->now += 1 * MS;
+    break;
+  default:
+    break;
+  }
+}
+
+static void fake_switch_finish(WMSwitch *sw, void *context) {
+  (void)sw;
+  ((FakeSwitchBackend *)context)->finished++;
+}
+
+// buffer 0: 100, 101, 102; buffer 1: 200, 201 (200 focused); buffer 2: 300.
+// Buffer 0 is on screen
+static void setup_switch(WMState *state, WMSwitch *sw,
+                         FakeSwitchBackend *fake) {
+  wm_state_init(state);
+  pid_t pids[] = {100, 101, 102, 200, 201, 300};
+  int buffers[] = {0, 0, 0, 1, 1, 2};
+  for (int i = 0; i < 6; i++) {
+    char bundle[32];
+    snprintf(bundle, sizeof(bundle), "com.test.%d", (int)pids[i]);
+    wm_state_register_app(state, pids[i], bundle);
+    wm_state_assign_to_buffer(state, pids[i], buffers[i]);
+  }
+  wm_state_set_focused(state, 200);
+  wm_state_set_view(state, 0, WM_BUFFER_BIT(0));
+
+  memset(fake, 0, sizeof(*fake));
+  fake->state = state;
+  WMSwitchBackend backend = {.run_stage = fake_switch_run_stage,
+                             .finish = fake_switch_finish,
+                             .clock = fake_switch_clock,
+                             .context = fake};
+  wm_switch_init(sw, &backend);
+}
+
+TEST(switch_stages_in_order) {
+  WMState state;
+  WMSwitch sw;
+  FakeSwitchBackend fake;
+  setup_switch(&state, &sw, &fake);
+
+  assert(wm_switch_begin(&sw, &state, 1, WM_BUFFER_BIT(1)));
+  assert(state.active_buffer == 1);
+  assert(wm_switch_active(&sw));
+  assert(sw.stage == WM_SWITCH_UNHIDE);
+  assert(sw.plan.show_count == 2);
+  assert(sw.plan.show[1] == 200); // last focused is raised last
+  assert(sw.plan.focus_pid == 200);
+  assert(sw.plan.hide_count == 3);
+
+  // completions advance the stages, strangers are ignored
+  fake.now = 5 * MS;
+  assert(wm_switch_complete(&sw, WM_SWITCH_UNHIDE, 200));
+  assert(!wm_switch_complete(&sw, WM_SWITCH_UNHIDE, 999));
+  assert(!wm_switch_complete(&sw, WM_SWITCH_HIDE, 100));
+  assert(sw.stage == WM_SWITCH_UNHIDE);
+  fake.now = 8 * MS;
+  assert(wm_switch_complete(&sw, WM_SWITCH_UNHIDE, 201));
+  assert(sw.stage == WM_SWITCH_ACTIVATE); // raise ran synchronously
+
+  fake.now = 12 * MS;
+  assert(wm_switch_complete(&sw, WM_SWITCH_ACTIVATE, 200));
+  assert(sw.stage == WM_SWITCH_HIDE);
+  fake.now = 20 * MS;
+  for (pid_t pid = 100; pid <= 102; pid++)
+    assert(wm_switch_complete(&sw, WM_SWITCH_HIDE, pid));
+  assert(sw.stage == WM_SWITCH_SETTLE);
+
+  // settle runs out its window
+  assert(wm_switch_next_deadline(&sw) == (21 + WM_SWITCH_SETTLE_MS) * MS);
+  fake.now = 40 * MS;
+  wm_switch_tick(&sw);
+  assert(sw.stage == WM_SWITCH_SETTLE);
+  fake.now = (21 + WM_SWITCH_SETTLE_MS) * MS;
+  wm_switch_tick(&sw);
+  assert(!wm_switch_active(&sw));
+  assert(wm_switch_next_deadline(&sw) == 0);
+  assert(fake.finished == 1);
+  assert(sw.switches == 1);
+
+  WMSwitchStage order[] = {WM_SWITCH_UNHIDE, WM_SWITCH_RAISE,
+                           WM_SWITCH_ACTIVATE, WM_SWITCH_HIDE,
+                           WM_SWITCH_LAYOUT, WM_SWITCH_SETTLE};
+  assert(fake.stage_count == 6);
+  assert(memcmp(fake.stages, order, sizeof(order)) == 0);
+
+  // per-stage timing from the fake clock
+  assert(sw.last.stage_ns[WM_SWITCH_UNHIDE] == 8 * MS);
+  assert(sw.last.stage_ns[WM_SWITCH_RAISE] == 1 * MS);
+  assert(sw.last.stage_ns[WM_SWITCH_ACTIVATE] == 3 * MS);
+  assert(sw.last.stage_ns[WM_SWITCH_HIDE] == 8 * MS);
+  assert(sw.last.stage_ns[WM_SWITCH_LAYOUT] == 1 * MS);
+  assert(sw.last.stage_ns[WM_SWITCH_SETTLE] == WM_SWITCH_SETTLE_MS * MS);
+  assert(sw.last.focus_ns == 12 * MS); // focus target active
+  assert(sw.last.total_ns == (21 + WM_SWITCH_SETTLE_MS) * MS);
+  assert(sw.last.timed_out == 0);
+}
+
+TEST(switch_stage_deadline) {
+  WMState state;
+  WMSwitch sw;
+  FakeSwitchBackend fake;
+  setup_switch(&state, &sw, &fake);
+
+  // 201 never reports being unhidden
+  assert(wm_switch_begin(&sw, &state, 1, WM_BUFFER_BIT(1)));
+  assert(wm_switch_complete(&sw, WM_SWITCH_UNHIDE, 200));
+  fake.now = (WM_SWITCH_UNHIDE_TIMEOUT_MS - 1) * MS;
+  wm_switch_tick(&sw);
+  assert(sw.stage == WM_SWITCH_UNHIDE);
+  fake.now = WM_SWITCH_UNHIDE_TIMEOUT_MS * MS;
+  wm_switch_tick(&sw);
+  assert(sw.stage == WM_SWITCH_ACTIVATE);
+  assert(sw.timeouts[WM_SWITCH_UNHIDE] == 1);
+
+  // the late completion no longer counts
+  assert(!wm_switch_complete(&sw, WM_SWITCH_UNHIDE, 201));
+
+  assert(wm_switch_complete(&sw, WM_SWITCH_ACTIVATE, 200));
+  for (pid_t pid = 100; pid <= 102; pid++)
+    assert(wm_switch_complete(&sw, WM_SWITCH_HIDE, pid));
+  fake.now = wm_switch_next_deadline(&sw);
+  wm_switch_tick(&sw);
+  assert(fake.finished == 1);
+  assert(sw.last.timed_out == 1u << WM_SWITCH_UNHIDE);
+  assert(sw.last.stage_ns[WM_SWITCH_UNHIDE] ==
+         WM_SWITCH_UNHIDE_TIMEOUT_MS * MS);
+}
+
+TEST(switch_cancel_merge) {
+  WMState state;
+  WMSwitch sw;
+  FakeSwitchBackend fake;
+  setup_switch(&state, &sw, &fake);
+
+  // same view and invalid views don't start anything
+  assert(!wm_switch_begin(&sw, &state, 0, WM_BUFFER_BIT(0)));
+  assert(!wm_switch_begin(&sw, &state, 1, WM_BUFFER_BIT(2)));
+  assert(!wm_switch_active(&sw));
+
+  // buffer 1 is half shown when buffer 2 is asked for
+  assert(wm_switch_begin(&sw, &state, 1, WM_BUFFER_BIT(1)));
+  assert(wm_switch_complete(&sw, WM_SWITCH_UNHIDE, 200));
+  assert(wm_switch_complete(&sw, WM_SWITCH_UNHIDE, 201));
+  assert(sw.stage == WM_SWITCH_ACTIVATE);
+  assert(!wm_switch_begin(&sw, &state, 1, WM_BUFFER_BIT(1))); // same target
+
+  fake.now = 30 * MS;
+  assert(wm_switch_begin(&sw, &state, 2, WM_BUFFER_BIT(2)));
+  assert(sw.merged == 1);
+  assert(sw.stage == WM_SWITCH_UNHIDE);
+  assert(sw.plan.shown_view == WM_BUFFER_BIT(0));
+  assert(sw.plan.focus_pid == 300);
+
+  // the new switch hides both the old view and the half shown one
+  assert(sw.plan.hide_count == 5);
+  for (int i = 0; i < sw.plan.hide_count; i++)
+    assert(sw.plan.hide[i] != 300);
+
+  // the cancelled switch's activation is stale
+  assert(!wm_switch_complete(&sw, WM_SWITCH_ACTIVATE, 200));
+  assert(wm_switch_complete(&sw, WM_SWITCH_UNHIDE, 300));
+  assert(wm_switch_complete(&sw, WM_SWITCH_ACTIVATE, 300));
+  pid_t hidden[] = {100, 101, 102, 200, 201};
+  for (int i = 0; i < 5; i++)
+    assert(wm_switch_complete(&sw, WM_SWITCH_HIDE, hidden[i]));
+  fake.now = wm_switch_next_deadline(&sw);
+  wm_switch_tick(&sw);
+
+  // one finish, timed from the newer switch
+  assert(fake.finished == 1);
+  assert(sw.switches == 1);
+  assert(sw.last.total_ns == fake.now - 30 * MS);
+  assert(state.active_buffer == 2);
+}
+
+TEST(switch_slowest_first) {
+  WMState state;
+  WMSwitch sw;
+  FakeSwitchBackend fake;
+  setup_switch(&state, &sw, &fake);
+
+  static WMLatencyModel latency;
+  wm_latency_init(&latency);
+  wm_latency_record(&latency, "com.test.102", WM_OP_UNHIDE, 300 * MS);
+  wm_latency_record(&latency, "com.test.201", WM_OP_UNHIDE, 40 * MS);
+  wm_latency_record(&latency, "com.test.101", WM_OP_HIDE, 200 * MS);
+  wm_latency_record(&latency, "com.test.100", WM_OP_HIDE, 5 * MS);
+  sw.latency = &latency;
+
+  // showing buffers 0 and 1: slow unhides first, unknown after them, the
+  // focus target stays last
+  assert(wm_switch_begin(&sw, &state, 1, WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1)));
+  pid_t show[] = {102, 201, 100, 101, 200};
+  assert(sw.plan.show_count == 5);
+  assert(memcmp(sw.plan.show, show, sizeof(show)) == 0);
+
+  // then buffer 2 alone: hides slowest first
+  assert(wm_switch_begin(&sw, &state, 2, WM_BUFFER_BIT(2)));
+  pid_t hide[] = {101, 100, 102, 200, 201};
+  assert(sw.plan.hide_count == 5);
+  assert(memcmp(sw.plan.hide, hide, sizeof(hide)) == 0);
+}
+
+// events
+
+TEST(events_activation_storm) {
+  WMEventCoalescer events;
+  wm_events_init(&events);
+
+  // unhiding a batch of apps bounces focus through each of them
+  for (int i = 0; i < 10; i++)
+    wm_events_push(&events, WM_EVENT_ACTIVATED, 100 + i, i * MS);
+  assert(wm_events_next_deadline(&events) == (9 + WM_EVENT_QUIET_MS) * MS);
+
+  WMEvent out[8];
+  assert(wm_events_drain(&events, 20 * MS, out, 8) == 0); // still storming
+  assert(wm_events_drain(&events, (9 + WM_EVENT_QUIET_MS) * MS, out, 8) == 1);
+  assert(out[0].type == WM_EVENT_ACTIVATED);
+  assert(out[0].pid == 109);
+  assert(out[0].origin == WM_ORIGIN_USER);
+  assert(events.coalesced == 9);
+  assert(wm_events_next_deadline(&events) == 0);
+
+  // the app that is already active activating again is no news
+  wm_events_push(&events, WM_EVENT_ACTIVATED, 109, 100 * MS);
+  assert(wm_events_drain(&events, 200 * MS, out, 8) == 0);
+  assert(wm_events_next_deadline(&events) == 0);
+}
+
+TEST(events_storm_max_delay) {
+  WMEventCoalescer events;
+  wm_events_init(&events);
+  WMEvent out[8];
+
+  // a storm that never goes quiet is emitted after WM_EVENT_MAX_DELAY_MS
+  uint64_t now = 0;
+  for (int i = 0;; i++) {
+    now = (uint64_t)i * 10 * MS;
+    wm_events_push(&events, WM_EVENT_ACTIVATED, 100 + i % 3, now);
+    if (wm_events_drain(&events, now, out, 8) > 0)
+      break;
+  }
+  assert(now == WM_EVENT_MAX_DELAY_MS * MS);
+}
+
+TEST(events_self_vs_user) {
+  WMEventCoalescer events;
+  wm_events_init(&events);
+  WMEvent out[8];
+
+  // dwin activates 200, its activation is dwin's own
+  wm_events_expect(&events, 200, 0);
+  wm_events_push(&events, WM_EVENT_ACTIVATED, 200, 10 * MS);
+  assert(wm_events_drain(&events, 100 * MS, out, 8) == 1);
+  assert(out[0].origin == WM_ORIGIN_SELF);
+  assert(events.self_activations == 1);
+
+  // a switch in flight: everything is dwin's until the window ends, but the
+  // activation is still emitted (focus bookkeeping needs it)
+  wm_events_suppress(&events, 200 * MS);
+  wm_events_suppress(&events, 300 * MS); // next stage, later deadline
+  wm_events_push(&events, WM_EVENT_ACTIVATED, 300, 250 * MS);
+  assert(wm_events_drain(&events, 400 * MS, out, 8) == 1);
+  assert(out[0].pid == 300);
+  assert(out[0].origin == WM_ORIGIN_SELF);
+
+  // the user clicking afterwards is the user's, also for an expected pid
+  // once its window ran out
+  wm_events_suppress(&events, 0);
+  wm_events_push(&events, WM_EVENT_ACTIVATED, 200,
+                 (WM_EVENT_SELF_MS + 1) * MS);
+  assert(wm_events_drain(&events, (WM_EVENT_SELF_MS + 100) * MS, out, 8) == 1);
+  assert(out[0].pid == 200);
+  assert(out[0].origin == WM_ORIGIN_USER);
+}
+
+TEST(events_launch_terminate) {
+  WMEventCoalescer events;
+  wm_events_init(&events);
+  WMEvent out[8];
+
+  wm_events_push(&events, WM_EVENT_LAUNCHED, 100, 0);  // short lived
+  wm_events_push(&events, WM_EVENT_ACTIVATED, 100, 1 * MS);
+  wm_events_push(&events, WM_EVENT_TERMINATED, 100, 2 * MS);
+  wm_events_push(&events, WM_EVENT_LAUNCHED, 200, 3 * MS);
+  wm_events_push(&events, WM_EVENT_ACTIVATED, 200, 4 * MS);
+  wm_events_push(&events, WM_EVENT_ACTIVATED, 300, 5 * MS);
+  wm_events_push(&events, WM_EVENT_TERMINATED, 300, 6 * MS); // quit on focus
+
+  // net: 200 launched, 300 gone, nobody left to focus but what came before
+  assert(wm_events_drain(&events, 100 * MS, out, 8) == 2);
+  assert(out[0].type == WM_EVENT_LAUNCHED && out[0].pid == 200);
+  assert(out[1].type == WM_EVENT_TERMINATED && out[1].pid == 300);
+
+  // terminations and launches come before the activation
+  wm_events_push(&events, WM_EVENT_ACTIVATED, 400, 200 * MS);
+  wm_events_push(&events, WM_EVENT_TERMINATED, 200, 201 * MS);
+  assert(wm_events_drain(&events, 300 * MS, out, 8) == 2);
+  assert(out[0].type == WM_EVENT_TERMINATED && out[0].pid == 200);
+  assert(out[1].type == WM_EVENT_ACTIVATED && out[1].pid == 400);
+
+  // a full output keeps the rest due for the next drain, at once
+  wm_events_push(&events, WM_EVENT_LAUNCHED, 500, 400 * MS);
+  wm_events_push(&events, WM_EVENT_LAUNCHED, 501, 400 * MS);
+  wm_events_push(&events, WM_EVENT_ACTIVATED, 501, 401 * MS);
+  assert(wm_events_drain(&events, 500 * MS, out, 1) == 1);
+  assert(out[0].pid == 500);
+  assert(wm_events_next_deadline(&events) == 500 * MS);
+  assert(wm_events_drain(&events, 500 * MS, out, 1) == 1);
+  assert(out[0].type == WM_EVENT_LAUNCHED && out[0].pid == 501);
+  assert(wm_events_drain(&events, 500 * MS, out, 1) == 1);
+  assert(out[0].type == WM_EVENT_ACTIVATED && out[0].pid == 501);
+  assert(wm_events_next_deadline(&events) == 0);
+
+  // a later burst gets its own quiet window
+  wm_events_push(&events, WM_EVENT_LAUNCHED, 600, 700 * MS);
+  assert(wm_events_next_deadline(&events) == (700 + WM_EVENT_QUIET_MS) * MS);
+}
+
+// timer
+
+typedef struct {
+  WMTimerWheel *wheel;
+  uint64_t now;       // fake clock
+  int64_t fired[256]; // arguments in firing order
+  uint64_t at[256];   // clock at each firing
+  int count;
+  WMTimerId cancel[2]; // cancelled by the next callback
+  bool rearm;         // callback adds a timer due right away
+} FakeTimerHost;
+
+static void fake_timer_fired(void *context, int64_t argument) {
+  FakeTimerHost *host = context;
+  host->fired[host->count] = argument;
+  host->at[host->count++] = host->now;
+  for (int i = 0; i < 2; i++) {
+    if (host->cancel[i])
+      wm_timer_cancel(host->wheel, host->cancel[i]); // stale for itself
+    host->cancel[i] = 0;
+  }
+  if (host->rearm) {
+    host->rearm = false;
+    wm_timer_add(host->wheel, host->now, fake_timer_fired, host, -1);
+  }
+}
+
+TEST(timer_fire_order) {
+  WMTimerWheel wheel;
+  FakeTimerHost host = {.wheel = &wheel};
+  wm_timer_init(&wheel, 0);
+  assert(wm_timer_next_deadline(&wheel) == 0);
+
+  // one per level and on the level boundaries, added out of order
+  uint64_t deadlines[] = {300000, 65, 1, 4097, 63, 500, 64, 70000, 5, 4095};
+  for (int i = 0; i < 10; i++)
+    assert(wm_timer_add(&wheel, deadlines[i] * MS, fake_timer_fired, &host,
+                        (int64_t)deadlines[i]) != 0);
+
+  // the host only wakes at the next deadline, which is exact
+  uint64_t sorted[] = {1, 5, 63, 64, 65, 500, 4095, 4097, 70000, 300000};
+  for (int i = 0; i < 10; i++) {
+    assert(wm_timer_next_deadline(&wheel) == sorted[i] * MS);
+    host.now = sorted[i] * MS - 1;
+    assert(wm_timer_advance(&wheel, host.now) == 0); // never early
+    host.now = sorted[i] * MS;
+    assert(wm_timer_advance(&wheel, host.now) == 1);
+    assert(host.fired[i] == (int64_t)sorted[i]);
+  }
+  assert(wm_timer_next_deadline(&wheel) == 0);
+  assert(wheel.count == 0);
+  assert(wheel.cascaded > 0);
+}
+
+TEST(timer_random_steps) {
+  WMTimerWheel wheel;
+  FakeTimerHost host = {.wheel = &wheel};
+  wm_timer_init(&wheel, 1234 * MS);
+
+  uint64_t deadlines[200];
+  uint32_t seed = 99;
+  for (int i = 0; i < 200; i++) {
+    seed = seed * 1103515245u + 12345u;
+    deadlines[i] = 1234 * MS + (uint64_t)(seed >> 8) % (20000 * MS);
+    wm_timer_add(&wheel, deadlines[i], fake_timer_fired, &host, i);
+  }
+
+  // advance in uneven steps, every timer fires at the first step past it
+  uint64_t previous = 1234 * MS;
+  while (wheel.count > 0) {
+    seed = seed * 1103515245u + 12345u;
+    host.now = previous + (seed >> 8) % (300 * MS);
+    wm_timer_advance(&wheel, host.now);
+    for (int i = 0; i < host.count; i++) {
+      uint64_t deadline = deadlines[host.fired[i]];
+      if (host.at[i] == host.now) {
+        assert(deadline <= host.now);
+        assert(deadline + MS > previous); // not late by a whole step
+      }
+    }
+    previous = host.now;
+  }
+  assert(host.count == 200);
+  for (int i = 1; i < 200; i++)
+    assert(deadlines[host.fired[i - 1]] / MS <= deadlines[host.fired[i]] / MS);
+}
+
+TEST(timer_cancel) {
+  WMTimerWheel wheel;
+  FakeTimerHost host = {.wheel = &wheel};
+  wm_timer_init(&wheel, 0);
+
+  WMTimerId a = wm_timer_add(&wheel, 10 * MS, fake_timer_fired, &host, 1);
+  WMTimerId b = wm_timer_add(&wheel, 10 * MS, fake_timer_fired, &host, 2);
+  WMTimerId c = wm_timer_add(&wheel, 9000 * MS, fake_timer_fired, &host, 3);
+  assert(wm_timer_cancel(&wheel, c));
+  assert(!wm_timer_cancel(&wheel, c)); // stale
+  assert(wm_timer_next_deadline(&wheel) == 10 * MS);
+
+  // a and b are due together, the first to fire cancels the other
+  host.cancel[0] = a;
+  host.cancel[1] = b;
+  host.now = 10 * MS;
+  assert(wm_timer_advance(&wheel, host.now) == 1);
+  assert(!wm_timer_cancel(&wheel, a)); // fired
+  assert(wheel.count == 0);
+
+  // a callback rescheduling itself for now fires on the next advance
+  host.rearm = true;
+  wm_timer_add(&wheel, 20 * MS, fake_timer_fired, &host, 4);
+  host.now = 20 * MS;
+  assert(wm_timer_advance(&wheel, host.now) == 1);
+  assert(wm_timer_next_deadline(&wheel) == 21 * MS);
+  host.now = 21 * MS;
+  assert(wm_timer_advance(&wheel, host.now) == 1);
+  assert(host.fired[host.count - 1] == -1);
+
+  // a full wheel refuses more
+  wm_timer_init(&wheel, 0);
+  for (int i = 0; i < WM_TIMER_MAX; i++)
+    assert(wm_timer_add(&wheel, MS, fake_timer_fired, &host, i) != 0);
+  assert(wm_timer_add(&wheel, MS, fake_timer_fired, &host, 0) == 0);
+}
+
+TEST(timer_backoff) {
+  assert(wm_timer_backoff_ms(50, 0, 2000) == 50);
+  assert(wm_timer_backoff_ms(50, 3, 2000) == 400);
+  assert(wm_timer_backoff_ms(50, 6, 2000) == 2000);
+  assert(wm_timer_backoff_ms(50, 60, 2000) == 2000);
+}
+
+// relayout
+
+TEST(relayout_burst) {
+  WMRelayout relayout;
+  wm_relayout_init(&relayout);
+  WMBufferMask view = WM_BUFFER_BIT(0);
+
+  // five apps in view quit within a frame: one pass
+  for (int i = 0; i < 5; i++)
+    assert(wm_relayout_mark(&relayout, WM_BUFFER_BIT(0), view, i * 2 * MS) ==
+           WM_RELAYOUT_FRAME_MS * MS);
+  assert(!wm_relayout_take(&relayout, view, 10 * MS));
+  assert(wm_relayout_take(&relayout, view, WM_RELAYOUT_FRAME_MS * MS));
+  assert(!wm_relayout_take(&relayout, view, 100 * MS));
+  assert(relayout.passes == 1);
+  assert(relayout.requests == 5);
+  assert(relayout.dirty == 0);
+}
+
+TEST(relayout_launch_storm) {
+  WMRelayout relayout;
+  wm_relayout_init(&relayout);
+  WMBufferMask view = WM_BUFFER_BIT(0);
+
+  // login: 12 apps launching 8 ms apart, the host runs due passes before
+  // handling each event and at the last deadline
+  int events = 12;
+  for (int i = 0; i < events; i++) {
+    uint64_t now = (uint64_t)i * 8 * MS;
+    wm_relayout_take(&relayout, view, now);
+    wm_relayout_mark(&relayout, WM_BUFFER_BIT(0), view, now);
+  }
+  assert(wm_relayout_take(&relayout, view,
+                          wm_relayout_next_deadline(&relayout)));
+
+  // one pass per frame instead of one per launch
+  assert(relayout.passes == 6);
+  assert(relayout.dirty == 0);
+  assert(wm_relayout_next_deadline(&relayout) == 0);
+}
+
+TEST(relayout_hidden_deferred) {
+  WMRelayout relayout;
+  wm_relayout_init(&relayout);
+  WMBufferMask view = WM_BUFFER_BIT(0);
+
+  // changes to a hidden buffer schedule nothing
+  assert(wm_relayout_mark(&relayout, WM_BUFFER_BIT(2), view, 0) == 0);
+  assert(wm_relayout_mark(&relayout, WM_BUFFER_BIT(2), view, MS) == 0);
+  assert(relayout.deferred == 2);
+  assert(relayout.dirty == WM_BUFFER_BIT(2));
+
+  // a visible change doesn't lay out the hidden buffer
+  wm_relayout_mark(&relayout, WM_BUFFER_BIT(0), view, 2 * MS);
+  assert(wm_relayout_take(&relayout, view, 100 * MS));
+  assert(relayout.dirty == WM_BUFFER_BIT(2));
+
+  // showing it lays it out once (the switch's layout stage)
+  wm_relayout_done(&relayout, WM_BUFFER_BIT(2));
+  assert(relayout.dirty == 0);
+  assert(relayout.passes == 2);
+
+  // dirty, then switched away before the pass: nothing to run
+  view = WM_BUFFER_BIT(1);
+  wm_relayout_mark(&relayout, WM_BUFFER_BIT(1), view, 200 * MS);
+  view = WM_BUFFER_BIT(3);
+  assert(!wm_relayout_take(&relayout, view, 300 * MS));
+  assert(relayout.dirty == WM_BUFFER_BIT(1));
+  assert(wm_relayout_next_deadline(&relayout) == 0);
+}
+
+// executor
+
+// records effects in run order, each one takes cost of fake time
+typedef struct {
+  uint64_t now;
+  uint64_t cost;
+  WMEffect ran[64];
+  int ran_count;
+  WMExecutor *executor;
+  pid_t chain_pid; // running an effect for this pid queues a critical one
+} FakeExecutorBackend;
+
+static void fake_executor_run(const WMEffect *effect, void *context) {
+  FakeExecutorBackend *fake = context;
+  fake->ran[fake->ran_count++] = *effect;
+  fake->now += fake->cost;
+
+  if (effect->pid == fake->chain_pid && effect->kind != WM_EFFECT_ACTIVATE) {
+    WMEffect activate = {.kind = WM_EFFECT_ACTIVATE, .pid = effect->pid};
+    wm_executor_push(fake->executor, WM_EFFECT_CRITICAL, &activate);
+  }
+}
+
+static uint64_t fake_executor_clock(void *context) {
+  return ((FakeExecutorBackend *)context)->now;
+}
+
+static void setup_executor(WMExecutor *executor, FakeExecutorBackend *fake,
+                           uint32_t budget_ms) {
+  memset(fake, 0, sizeof(*fake));
+  fake->cost = 1 * MS;
+  fake->executor = executor;
+  WMExecutorBackend backend = {.run = fake_executor_run,
+                               .clock = fake_executor_clock,
+                               .context = fake};
+  wm_executor_init(executor, &backend, budget_ms);
+}
+
+static void push_effect(WMExecutor *executor, WMEffectClass effect_class,
+                        WMEffectKind kind, pid_t pid) {
+  WMEffect effect = {.kind = kind, .pid = pid};
+  assert(wm_executor_push(executor, effect_class, &effect));
+}
+
+TEST(executor_priority_order) {
+  WMExecutor executor;
+  FakeExecutorBackend fake;
+  setup_executor(&executor, &fake, 100);
+
+  // queued the way a switch would, most urgent last
+  wm_executor_begin(&executor);
+  push_effect(&executor, WM_EFFECT_BACKGROUND, WM_EFFECT_HIDE, 100);
+  push_effect(&executor, WM_EFFECT_VISIBLE, WM_EFFECT_FRAME, 201);
+  push_effect(&executor, WM_EFFECT_VISIBLE, WM_EFFECT_FRAME, 200);
+  push_effect(&executor, WM_EFFECT_CRITICAL, WM_EFFECT_UNHIDE, 200);
+  push_effect(&executor, WM_EFFECT_CRITICAL, WM_EFFECT_ACTIVATE, 200);
+  assert(wm_executor_pending(&executor, WM_EFFECT_CLASS_COUNT) == 5);
+
+  assert(!wm_executor_run(&executor));
+  WMEffectKind kinds[] = {WM_EFFECT_UNHIDE, WM_EFFECT_ACTIVATE,
+                          WM_EFFECT_FRAME, WM_EFFECT_FRAME, WM_EFFECT_HIDE};
+  pid_t pids[] = {200, 200, 201, 200, 100};
+  assert(fake.ran_count == 5);
+  for (int i = 0; i < 5; i++) {
+    assert(fake.ran[i].kind == kinds[i]);
+    assert(fake.ran[i].pid == pids[i]);
+  }
+
+  // focus after the critical effects, not after the whole batch
+  assert(executor.last.critical_ns == 2 * MS);
+  assert(executor.last.total_ns == 5 * MS);
+  assert(executor.last.effects == 5);
+  assert(executor.last.turns == 1);
+  assert(!wm_executor_run(&executor)); // nothing left
+}
+
+TEST(executor_budget_spreads) {
+  WMExecutor executor;
+  FakeExecutorBackend fake;
+  setup_executor(&executor, &fake, 4);
+  fake.now = 50 * MS;
+
+  wm_executor_begin(&executor);
+  for (pid_t pid = 0; pid < 10; pid++)
+    push_effect(&executor, WM_EFFECT_VISIBLE, WM_EFFECT_FRAME, 100 + pid);
+  for (pid_t pid = 0; pid < 5; pid++)
+    push_effect(&executor, WM_EFFECT_BACKGROUND, WM_EFFECT_HIDE, 300 + pid);
+  push_effect(&executor, WM_EFFECT_CRITICAL, WM_EFFECT_UNHIDE, 200);
+  push_effect(&executor, WM_EFFECT_CRITICAL, WM_EFFECT_ACTIVATE, 200);
+
+  // first turn: both critical effects, then what is left of the budget
+  assert(wm_executor_run(&executor));
+  assert(fake.ran_count == 4);
+  assert(executor.current.critical_ns == 2 * MS);
+
+  // later turns: the budget each, visible before background
+  int turns = 1;
+  while (wm_executor_run(&executor)) {
+    turns++;
+    assert(fake.ran_count == 4 + (turns - 1) * 4);
+  }
+  turns++;
+  assert(turns == 5);
+  assert(fake.ran_count == 17);
+  for (int i = 2; i < 12; i++)
+    assert(fake.ran[i].kind == WM_EFFECT_FRAME);
+  for (int i = 12; i < 17; i++)
+    assert(fake.ran[i].kind == WM_EFFECT_HIDE);
+  assert(executor.last.critical_ns == 2 * MS);
+  assert(executor.last.total_ns == 17 * MS);
+  assert(executor.last.turns == 5);
+
+  // an effect slower than the budget still makes progress, one per turn
+  fake.cost = 10 * MS;
+  push_effect(&executor, WM_EFFECT_BACKGROUND, WM_EFFECT_HIDE, 400);
+  push_effect(&executor, WM_EFFECT_BACKGROUND, WM_EFFECT_HIDE, 401);
+  assert(wm_executor_run(&executor));
+  assert(!wm_executor_run(&executor));
+  assert(fake.ran_count == 19);
+}
+
+TEST(executor_begin_supersedes) {
+  WMExecutor executor;
+  FakeExecutorBackend fake;
+  setup_executor(&executor, &fake, 1);
+  fake.now = 1 * MS;
+
+  // a switch leaves deferred work, the next one drops it
+  wm_executor_begin(&executor);
+  for (pid_t pid = 0; pid < 4; pid++)
+    push_effect(&executor, WM_EFFECT_BACKGROUND, WM_EFFECT_HIDE, 100 + pid);
+  assert(wm_executor_run(&executor));
+  assert(fake.ran_count == 1);
+  wm_executor_begin(&executor);
+  assert(executor.cancelled == 3);
+  assert(wm_executor_pending(&executor, WM_EFFECT_CLASS_COUNT) == 0);
+
+  // a critical effect queued by a deferred one runs first on the next turn
+  fake.chain_pid = 200;
+  push_effect(&executor, WM_EFFECT_VISIBLE, WM_EFFECT_RAISE, 200);
+  push_effect(&executor, WM_EFFECT_VISIBLE, WM_EFFECT_FRAME, 201);
+  assert(wm_executor_run(&executor));
+  assert(wm_executor_pending(&executor, WM_EFFECT_CRITICAL) == 1);
+  assert(!wm_executor_run(&executor));
+  assert(fake.ran[2].kind == WM_EFFECT_ACTIVATE);
+  assert(fake.ran[3].pid == 201);
+
+  // full ring: the push fails and is counted
+  for (int i = 0; i < WM_EXECUTOR_QUEUE_SIZE; i++)
+    push_effect(&executor, WM_EFFECT_BACKGROUND, WM_EFFECT_CLEANUP, 0);
+  WMEffect extra = {.kind = WM_EFFECT_CLEANUP};
+  assert(!wm_executor_push(&executor, WM_EFFECT_BACKGROUND, &extra));
+  assert(executor.dropped == 1);
+}
+
+TEST(executor_config_budget) {
+  const char *path = test_path("config_budget");
+  write_file(path, "effect_budget = 8\nax_timeout = 250\n");
+  WMConfig config;
+  assert(wm_config_load(&config, path));
+  assert(config.effect_budget_ms == 8);
+  assert(config.ax_timeout_ms == 250);
+
+  // out of range keeps the default
+  write_file(path, "effect_budget = 0\neffect_budget = 1000\n");
+  assert(wm_config_load(&config, path));
+  assert(config.effect_budget_ms == WM_EFFECT_BUDGET_MS);
+  unlink(path);
+}
+
+// health
+
+TEST(health_breaker_backoff) {
+  WMHealth health;
+  wm_health_init(&health, WM_HEALTH_SLOW_MS);
+
+  // unknown apps are allowed, a timeout opens the breaker at once
+  assert(wm_health_allow(&health, 100, 0));
+  assert(wm_health_record(&health, 100, WM_CALL_TIMEOUT, 500 * MS,
+                          500 * MS) == WM_BREAKER_OPEN);
+  assert(!wm_health_allow(&health, 100, 600 * MS));
+  assert(wm_health_next_retry(&health) == (500 + WM_HEALTH_RETRY_MS) * MS);
+
+  // one probe at the retry time, the rest wait for its answer
+  uint64_t now = (500 + WM_HEALTH_RETRY_MS) * MS;
+  assert(wm_health_allow(&health, 100, now));
+  assert(!wm_health_allow(&health, 100, now));
+  assert(wm_health_next_retry(&health) == now + WM_HEALTH_PROBE_MS * MS);
+
+  // the probe hangs too: open again for twice as long
+  now += 500 * MS;
+  assert(wm_health_record(&health, 100, WM_CALL_TIMEOUT, 500 * MS, now) ==
+         WM_BREAKER_OPEN);
+  assert(wm_health_next_retry(&health) == now + 2 * WM_HEALTH_RETRY_MS * MS);
+
+  // a good probe closes it
+  now += 2 * WM_HEALTH_RETRY_MS * MS;
+  assert(wm_health_allow(&health, 100, now));
+  assert(wm_health_record(&health, 100, WM_CALL_OK, 2 * MS, now) ==
+         WM_BREAKER_CLOSED);
+  assert(wm_health_allow(&health, 100, now));
+
+  const WMAppHealth *app = wm_health_get(&health, 100);
+  assert(app->calls == 3);
+  assert(app->timeouts == 2);
+  assert(app->trips == 1);
+  assert(app->skipped == 2);
+  assert(app->max_ns == 500 * MS);
+}
+
+TEST(health_probe_deadline) {
+  WMHealth health;
+  wm_health_init(&health, WM_HEALTH_SLOW_MS);
+  wm_health_record(&health, 100, WM_CALL_TIMEOUT, 500 * MS, 0);
+
+  // the probe is allowed but its caller never records it
+  uint64_t now = WM_HEALTH_RETRY_MS * MS;
+  assert(wm_health_allow(&health, 100, now));
+  assert(wm_health_get(&health, 100)->state == WM_BREAKER_HALF_OPEN);
+  uint64_t deadline = now + WM_HEALTH_PROBE_MS * MS;
+  assert(wm_health_next_retry(&health) == deadline);
+  assert(!wm_health_allow(&health, 100, deadline - 1));
+
+  // past its deadline it counts as failed: open again, backed off
+  assert(!wm_health_allow(&health, 100, deadline));
+  assert(wm_health_get(&health, 100)->state == WM_BREAKER_OPEN);
+  uint64_t retry = deadline + 2 * WM_HEALTH_RETRY_MS * MS;
+  assert(wm_health_next_retry(&health) == retry);
+
+  // the next probe goes through and is recorded this time
+  assert(wm_health_allow(&health, 100, retry));
+  assert(wm_health_record(&health, 100, WM_CALL_OK, MS, retry) ==
+         WM_BREAKER_CLOSED);
+  assert(wm_health_next_retry(&health) == 0);
+  assert(wm_health_get(&health, 100)->trips == 1);
+}
+
+TEST(health_strikes) {
+  WMHealth health;
+  wm_health_init(&health, WM_HEALTH_SLOW_MS);
+
+  // failures and slow answers need a streak, a good answer resets it
+  for (int i = 0; i < WM_HEALTH_TRIP_STRIKES - 1; i++)
+    assert(wm_health_record(&health, 100, WM_CALL_FAILED, MS, 0) ==
+           WM_BREAKER_CLOSED);
+  assert(wm_health_record(&health, 100, WM_CALL_OK, MS, 0) ==
+         WM_BREAKER_CLOSED);
+  for (int i = 0; i < WM_HEALTH_TRIP_STRIKES - 1; i++)
+    assert(wm_health_record(&health, 100, WM_CALL_OK,
+                            WM_HEALTH_SLOW_MS * MS, 0) == WM_BREAKER_CLOSED);
+  assert(wm_health_record(&health, 100, WM_CALL_FAILED, MS, 0) ==
+         WM_BREAKER_OPEN);
+
+  // diagnostics list the troubled app only
+  wm_health_record(&health, 200, WM_CALL_OK, MS, 0);
+  char text[256];
+  int length = wm_health_describe(&health, text, sizeof(text));
+  assert(length == (int)strlen(text));
+  assert(strncmp(text, "pid 100 open: 6 calls, 3 failed", 31) == 0);
+  assert(strstr(text, "pid 200") == NULL);
+
+  // truncated, still terminated
+  assert(wm_health_describe(&health, text, 10) == 9);
+  assert(strcmp(text, "pid 100 o") == 0);
+
+  wm_health_forget(&health, 100);
+  assert(wm_health_get(&health, 100) == NULL);
+  assert(wm_health_allow(&health, 100, 0));
+}
+
+// stand-in platform: effects into hung apps take the AX timeout
+typedef struct {
+  uint64_t now;
+  WMHealth health;
+  pid_t hung;
+  pid_t ran[32];
+  int ran_count;
+} FakeHungBackend;
+
+static void fake_hung_run(const WMEffect *effect, void *context) {
+  FakeHungBackend *fake = context;
+  bool hung = effect->pid == fake->hung;
+  uint64_t latency = hung ? WM_AX_TIMEOUT_MS * MS : 1 * MS;
+  fake->now += latency;
+  fake->ran[fake->ran_count++] = effect->pid;
+  wm_health_record(&fake->health, effect->pid,
+                   hung ? WM_CALL_TIMEOUT : WM_CALL_OK, latency, fake->now);
+}
+
+static uint64_t fake_hung_clock(void *context) {
+  return ((FakeHungBackend *)context)->now;
+}
+
+static bool fake_hung_ready(const WMEffect *effect, void *context) {
+  FakeHungBackend *fake = context;
+  return wm_health_allow(&fake->health, effect->pid, fake->now);
+}
+
+TEST(health_hung_app_switch) {
+  FakeHungBackend fake = {.now = 1 * MS, .hung = 201};
+  wm_health_init(&fake.health, WM_HEALTH_SLOW_MS);
+  WMExecutor executor;
+  WMExecutorBackend backend = {.run = fake_hung_run,
+                               .clock = fake_hung_clock,
+                               .ready = fake_hung_ready,
+                               .context = &fake};
+  wm_executor_init(&executor, &backend, 100);
+
+  // a switch touching the hung app four times
+  wm_executor_begin(&executor);
+  push_effect(&executor, WM_EFFECT_CRITICAL, WM_EFFECT_ACTIVATE, 200);
+  pid_t view[] = {200, 201, 202};
+  for (int i = 0; i < 3; i++)
+    push_effect(&executor, WM_EFFECT_VISIBLE, WM_EFFECT_RAISE, view[i]);
+  for (int i = 0; i < 3; i++)
+    push_effect(&executor, WM_EFFECT_VISIBLE, WM_EFFECT_FRAME, view[i]);
+  push_effect(&executor, WM_EFFECT_BACKGROUND, WM_EFFECT_HIDE, 201);
+  push_effect(&executor, WM_EFFECT_BACKGROUND, WM_EFFECT_HIDE, 100);
+  while (wm_executor_run(&executor))
+    ;
+
+  // only the first call waited for it, the rest of the switch went ahead
+  assert(fake.ran_count == 7);
+  assert(executor.last.total_ns == WM_AX_TIMEOUT_MS * MS + 6 * MS);
+  assert(executor.last.deferred == 2);
+  assert(executor.deferred_count == 2);
+  assert(wm_health_get(&fake.health, 201)->state == WM_BREAKER_OPEN);
+
+  // still hung at the first retry: the probe times out, the other waits
+  fake.now = wm_health_next_retry(&fake.health);
+  assert(wm_executor_requeue(&executor) == 2);
+  while (wm_executor_run(&executor))
+    ;
+  assert(fake.ran_count == 8);
+  assert(executor.deferred_count == 1);
+
+  // recovered by the next retry: the deferred effect goes through
+  fake.hung = 0;
+  fake.now = wm_health_next_retry(&fake.health);
+  wm_executor_requeue(&executor);
+  while (wm_executor_run(&executor))
+    ;
+  assert(fake.ran_count == 9);
+  assert(fake.ran[8] == 201);
+  assert(executor.deferred_count == 0);
+  assert(wm_health_get(&fake.health, 201)->state == WM_BREAKER_CLOSED);
+}
+
+// per-bundle store
+
+typedef struct {
+  WMStoreKey key;
+  uint32_t uses;
+} TestStoreSlot;
+
+static uint32_t test_store_uses(const void *slot) {
+  return ((const TestStoreSlot *)slot)->uses;
+}
+
+TEST(store_table) {
+  // one probe window spans the whole table
+  static const WMStoreLayout layout = {
+      .magic = 0x54534554u,
+      .version = 1,
+      .slot_count = WM_STORE_MAX_PROBE,
+      .slot_size = sizeof(TestStoreSlot),
+      .worth = test_store_uses,
+  };
+  struct {
+    WMStoreHeader header;
+    TestStoreSlot slots[WM_STORE_MAX_PROBE];
+  } image, loaded;
+  WMStoreTable table;
+  wm_store_init(&table, &layout, &image);
+
+  char bundle[32];
+  for (int i = 0; i < WM_STORE_MAX_PROBE; i++) {
+    snprintf(bundle, sizeof(bundle), "com.test.app%d", i);
+    TestStoreSlot *slot = wm_store_claim(&table, &image, bundle);
+    assert(slot != NULL && slot->uses == 0);
+    slot->uses = (uint32_t)i + 1;
+    assert(wm_store_claim(&table, &image, bundle) == slot);
+  }
+  assert(table.entry_count == WM_STORE_MAX_PROBE && table.evictions == 0);
+
+  // full: the slot worth least makes room, zeroed but for its key
+  TestStoreSlot *slot = wm_store_claim(&table, &image, "com.test.new");
+  assert(slot != NULL && slot->uses == 0);
+  assert(strcmp(slot->key.bundle_identifier, "com.test.new") == 0);
+  assert(table.entry_count == WM_STORE_MAX_PROBE && table.evictions == 1);
+  assert(wm_store_find(&table, &image, "com.test.app0") == NULL);
+  assert(wm_store_find(&table, &image, "com.test.app1") != NULL);
+  assert(wm_store_claim(&table, &image, "") == NULL);
+
+  // round trip, a file of another layout version doesn't load
+  const char *path = test_path("store");
+  assert(wm_store_save(&table, &image, path));
+  assert(wm_store_load(&layout, &loaded, path) == WM_STORE_MAX_PROBE);
+  assert(memcmp(loaded.slots, image.slots, sizeof(image.slots)) == 0);
+  WMStoreLayout other = layout;
+  other.version = 2;
+  assert(wm_store_load(&other, &loaded, path) == -1);
+  unlink(path);
+  assert(wm_store_load(&layout, &loaded, path) == -1);
+
+  // a table never initialized only misses
+  WMStoreTable zeroed = {0};
+  assert(wm_store_find(&zeroed, &image, "com.test.app1") == NULL);
+  assert(wm_store_claim(&zeroed, &image, "com.test.app1") == NULL);
+  assert(wm_store_hash("a", 1) == 0xe40c292cu); // FNV-1a
+}
+
+// latency
+
+TEST(latency_estimate_regression) {
+  static WMLatencyModel model;
+  wm_latency_init(&model);
+  const char *bundle = "com.jetbrains.CLion";
+
+  // estimates are per bundle and op
+  assert(wm_latency_estimate(&model, bundle, WM_OP_UNHIDE) == 0);
+  for (int i = 0; i < WM_LATENCY_TRUSTED; i++)
+    assert(!wm_latency_record(&model, bundle, WM_OP_UNHIDE, 40 * MS));
+  assert(wm_latency_estimate(&model, bundle, WM_OP_UNHIDE) == 40 * MS);
+  assert(wm_latency_estimate(&model, bundle, WM_OP_FRAME) == 0);
+  assert(wm_latency_estimate(&model, "com.apple.Terminal", WM_OP_UNHIDE) ==
+         0);
+
+  // far over a trusted estimate: flagged, and the estimate follows a quarter
+  assert(wm_latency_record(&model, bundle, WM_OP_UNHIDE, 400 * MS));
+  assert(wm_latency_regressed(&model, bundle, WM_OP_UNHIDE));
+  assert(wm_latency_estimate(&model, bundle, WM_OP_UNHIDE) == 130 * MS);
+  assert(model.regressions == 1);
+
+  // back to normal clears the flag, small absolute jumps are noise
+  assert(!wm_latency_record(&model, bundle, WM_OP_UNHIDE, 100 * MS));
+  assert(!wm_latency_regressed(&model, bundle, WM_OP_UNHIDE));
+  for (int i = 0; i < WM_LATENCY_TRUSTED; i++)
+    wm_latency_record(&model, "com.apple.Terminal", WM_OP_FRAME, 1 * MS);
+  assert(!wm_latency_record(&model, "com.apple.Terminal", WM_OP_FRAME,
+                            10 * MS));
+  assert(model.table.entry_count == 2);
+  assert(model.dirty);
+}
+
+TEST(latency_start_finish) {
+  static WMLatencyModel model;
+  wm_latency_init(&model);
+
+  // unhide is timed from the request to the app's notification
+  wm_latency_start(&model, 100, WM_OP_UNHIDE, 10 * MS);
+  wm_latency_start(&model, 100, WM_OP_HIDE, 10 * MS);
+  wm_latency_start(&model, 100, WM_OP_UNHIDE, 20 * MS); // replaces
+  assert(wm_latency_finish(&model, 100, WM_OP_UNHIDE, "com.test.a",
+                           140 * MS) == 0);
+  assert(wm_latency_estimate(&model, "com.test.a", WM_OP_UNHIDE) ==
+         120 * MS);
+  assert(wm_latency_finish(&model, 100, WM_OP_UNHIDE, "com.test.a",
+                           150 * MS) == -1);
+  assert(wm_latency_finish(&model, 200, WM_OP_HIDE, "com.test.b", 0) == -1);
+
+  // more in flight than tracked: the oldest is dropped
+  for (int i = 0; i < WM_LATENCY_MAX_PENDING; i++)
+    wm_latency_start(&model, 1000 + i, WM_OP_RAISE, (uint64_t)(20 + i) * MS);
+  assert(wm_latency_finish(&model, 100, WM_OP_HIDE, "com.test.a", 0) == -1);
+  assert(wm_latency_finish(&model, 1000, WM_OP_RAISE, "com.test.c",
+                           100 * MS) == 0);
+}
+
+TEST(latency_persist) {
+  const char *path = test_path("latency");
+  static WMLatencyModel model;
+  static WMLatencyModel loaded;
+  wm_latency_init(&model);
+  wm_latency_record(&model, "com.jetbrains.CLion", WM_OP_UNHIDE, 350 * MS);
+  wm_latency_record(&model, "com.apple.Terminal", WM_OP_FRAME, 3 * MS);
+  assert(wm_latency_save(&model, path));
+  assert(!model.dirty);
+
+  // starts warm
+  assert(wm_latency_load(&loaded, path));
+  assert(loaded.table.entry_count == 2);
+  assert(!loaded.dirty);
+  assert(wm_latency_estimate(&loaded, "com.jetbrains.CLion", WM_OP_UNHIDE) ==
+         350 * MS);
+  assert(wm_latency_estimate(&loaded, "com.apple.Terminal", WM_OP_FRAME) ==
+         3 * MS);
+
+  // a corrupt file leaves the model cold
+  FILE *file = fopen(path, "r+b");
+  fseek(file, (long)sizeof(WMStoreHeader) + 8, SEEK_SET);
+  fputc(0x5a, file);
+  fclose(file);
+  wm_latency_init(&loaded);
+  assert(!wm_latency_load(&loaded, path));
+  assert(loaded.table.entry_count == 0);
+  unlink(path);
+  assert(!wm_latency_load(&loaded, path));
+}
+
+// control
+
+// apps 101-103 in buffer 1, 104 in buffer 2, buffer 1 shown
+static void setup_control(WMState *state) {
+  wm_state_init(state);
+  pid_t pids[] = {101, 102, 103, 104};
+  int buffers[] = {0, 0, 0, 1};
+  for (int i = 0; i < 4; i++) {
+    char bundle[32];
+    snprintf(bundle, sizeof(bundle), "com.test.%d", (int)pids[i]);
+    wm_state_register_app(state, pids[i], bundle);
+    wm_state_assign_to_buffer(state, pids[i], buffers[i]);
+  }
+  wm_state_set_view(state, 0, WM_BUFFER_BIT(0));
+  wm_state_set_focused(state, 101);
+}
+
+TEST(control_parse) {
+  WMControlBatch batch;
+  char error[WM_CONTROL_ERROR_SIZE];
+
+  assert(wm_control_parse("move 101 2; move 102 2 ;switch 2", &batch, error,
+                          sizeof(error)));
+  assert(batch.count == 3);
+  assert(batch.has_mutation);
+  assert(batch.commands[0].op == WM_CONTROL_MOVE);
+  assert(batch.commands[0].pid == 101);
+  assert(batch.commands[0].buffer == 1); // buffers count from 1
+  assert(batch.commands[2].op == WM_CONTROL_SWITCH);
+  assert(batch.commands[2].view == WM_BUFFER_BIT(1));
+
+  // the first buffer of a view gets focus
+  assert(wm_control_parse("view 3 1", &batch, error, sizeof(error)));
+  assert(batch.commands[0].buffer == 2);
+  assert(batch.commands[0].view == (WM_BUFFER_BIT(0) | WM_BUFFER_BIT(2)));
+
+  // queries alone never need the main thread
+  assert(wm_control_parse("apps; focus;", &batch, error, sizeof(error)));
+  assert(batch.count == 2);
+  assert(!batch.has_mutation);
+
+  assert(!wm_control_parse("move 101 0", &batch, error, sizeof(error)));
+  assert(strcmp(error, "bad buffer '0'") == 0);
+  assert(!wm_control_parse("apps; jump 2", &batch, error, sizeof(error)));
+  assert(strcmp(error, "unknown command 'jump'") == 0);
+  assert(!wm_control_parse("float abc", &batch, error, sizeof(error)));
+  assert(!wm_control_parse("retile now", &batch, error, sizeof(error)));
+  assert(!wm_control_parse("view 1 2 3 4 5 1", &batch, error, sizeof(error)));
+  assert(!wm_control_parse(" ; ", &batch, error, sizeof(error)));
+  assert(strcmp(error, "empty request") == 0);
+
+  char request[WM_CONTROL_MAX_REQUEST];
+  request[0] = '\0';
+  for (int i = 0; i <= WM_CONTROL_MAX_COMMANDS; i++)
+    strcat(request, "focus;");
+  assert(!wm_control_parse(request, &batch, error, sizeof(error)));
+  assert(strcmp(error, "too many commands") == 0);
+}
+
+TEST(control_apply_batch) {
+  WMState state;
+  setup_control(&state);
+  WMControlBatch batch;
+  WMControlEffects effects;
+  char error[WM_CONTROL_ERROR_SIZE];
+
+  // move two apps, then switch: one effects pass for the lot
+  assert(wm_control_parse("move 101 2; move 102 2; switch 2; focus", &batch,
+                          error, sizeof(error)));
+  assert(wm_control_apply(&state, &batch, &effects, error, sizeof(error)));
+  assert(wm_state_get_buffer_mask(&state, 101) == WM_BUFFER_BIT(1));
+  assert(wm_state_get_buffer_mask(&state, 102) == WM_BUFFER_BIT(1));
+  assert(effects.view_changed);
+  assert(effects.primary_buffer == 1);
+  assert(effects.view == WM_BUFFER_BIT(1));
+  assert(state.active_buffer == 0); // the platform switches
+  assert(!effects.needs_layout);    // the switch tiles
+  assert(effects.moved_count == 2);
+  assert(effects.dirty_buffers == (WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1)));
+  // they left the shown buffer under the switch's feet
+  assert(effects.visibility_count == 2);
+
+  // a tag within the view retiles it, nothing to show or hide
+  wm_state_set_view(&state, 1, WM_BUFFER_BIT(1));
+  assert(wm_control_parse("tag 104 1", &batch, error, sizeof(error)));
+  assert(wm_control_apply(&state, &batch, &effects, error, sizeof(error)));
+  assert(!effects.view_changed);
+  assert(!effects.needs_layout); // buffer 1 isn't shown
+  assert(effects.visibility_count == 0);
+  assert(wm_control_parse("tile 104; switch 2", &batch, error, sizeof(error)));
+  assert(wm_control_apply(&state, &batch, &effects, error, sizeof(error)));
+  assert(!effects.view_changed); // already there
+  assert(effects.needs_layout);
+
+  // moving a hidden app into the view shows it
+  assert(wm_control_parse("move 103 2", &batch, error, sizeof(error)));
+  assert(wm_control_apply(&state, &batch, &effects, error, sizeof(error)));
+  assert(effects.needs_layout);
+  assert(effects.visibility_count == 1 && effects.visibility[0] == 103);
+
+  // one unknown app and nothing runs
+  uint32_t version = state.version;
+  assert(wm_control_parse("move 104 3; move 999 3", &batch, error,
+                          sizeof(error)));
+  assert(!wm_control_apply(&state, &batch, &effects, error, sizeof(error)));
+  assert(strcmp(error, "unknown app 999") == 0);
+  assert(state.version == version);
+  assert(wm_state_get_buffer_mask(&state, 104) ==
+         (WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1)));
+}
+
+TEST(control_reply_queries) {
+  WMState state;
+  setup_control(&state);
+  wm_state_set_floating(&state, 103, true);
+  WMFrameChange frames[] = {{101, {0, 0, 500, 800}}, {102, {500, 0, 500, 800}}};
+  static WMControlSnapshot snapshot;
+  wm_control_snapshot(&snapshot, &state, frames, 2);
+  assert(snapshot.version == state.version);
+
+  WMControlBatch batch;
+  char error[WM_CONTROL_ERROR_SIZE];
+  char reply[WM_CONTROL_MAX_REPLY];
+  assert(wm_control_parse("focus; apps; buffers; frames", &batch, error,
+                          sizeof(error)));
+  int length = wm_control_reply(&snapshot, &batch, reply, sizeof(reply));
+  assert(length == (int)strlen(reply));
+  assert(strncmp(reply, "focus 101\napp 101 com.test.101 buffers 1 tiled\n",
+                 47) == 0);
+  assert(strstr(reply, "app 103 com.test.103 buffers 1 floating\n"));
+  assert(strstr(reply, "buffer 1 active apps 3 focus 101\n"));
+  assert(strstr(reply, "buffer 2 hidden apps 1 focus 0\n"));
+  assert(strstr(reply, "frame 102 500 0 500 800\n"));
+  assert(!strstr(reply, "frame 103"));
+  assert(strcmp(reply + length - 4, "ok\n\n") == 0);
+
+  // mutations have no lines of their own
+  assert(wm_control_parse("retile", &batch, error, sizeof(error)));
+  assert(wm_control_reply(&snapshot, &batch, reply, sizeof(reply)) == 4);
+  assert(strcmp(reply, "ok\n\n") == 0);
+
+  // a reply that can't fit is an error instead of a cut-off list
+  assert(wm_control_parse("apps", &batch, error, sizeof(error)));
+  wm_control_reply(&snapshot, &batch, reply, 64);
+  assert(strcmp(reply, "error reply too long\n\n") == 0);
+}
+
+// the main thread of the socket tests: runs batches as they are queued
+typedef struct {
+  WMServer *server;
+  WMState *state;
+  WMControlSnapshot snapshot;
+  int batches;
+} FakeControlMain;
+
+static void fake_control_run(void *context) {
+  FakeControlMain *fake = context;
+  static WMServerJob job;
+  static char reply[WM_CONTROL_MAX_REPLY];
+  while (wm_server_take(fake->server, &job)) {
+    WMControlBatch batch;
+    WMControlEffects effects;
+    char error[WM_CONTROL_ERROR_SIZE];
+    int length;
+    if (!wm_control_parse(job.request, &batch, error, sizeof(error)) ||
+        !wm_control_apply(fake->state, &batch, &effects, error,
+                          sizeof(error))) {
+      length = wm_control_error(error, reply, sizeof(reply));
+    } else {
+      if (effects.view_changed)
+        wm_state_set_view(fake->state, effects.primary_buffer, effects.view);
+      wm_control_snapshot(&fake->snapshot, fake->state, NULL, 0);
+      wm_server_publish(fake->server, &fake->snapshot);
+      length = wm_control_reply(&fake->snapshot, &batch, reply, sizeof(reply));
+    }
+    fake->batches++;
+    wm_server_reply(fake->server, &job, reply, (size_t)length);
+  }
+}
+
+TEST(control_socket_roundtrip) {
+  const char *path = test_path("control.sock");
+  static WMServer server;
+  static WMServer second;
+  static FakeControlMain fake;
+  WMState state;
+  setup_control(&state);
+  memset(&fake, 0, sizeof(fake));
+  fake.server = &server;
+  fake.state = &state;
+
+  assert(wm_server_start(&server, path, fake_control_run, &fake));
+  wm_control_snapshot(&fake.snapshot, &state, NULL, 0);
+  wm_server_publish(&server, &fake.snapshot);
+
+  // one server per path
+  assert(!wm_server_start(&second, path, fake_control_run, &fake));
+
+  int fd = wm_client_connect(path);
+  assert(fd >= 0);
+  char reply[WM_CONTROL_MAX_REPLY];
+
+  // queries come from the snapshot, the main thread isn't involved
+  assert(wm_client_request(fd, "focus", reply, sizeof(reply)) > 0);
+  assert(strcmp(reply, "focus 101\nok\n\n") == 0);
+  assert(fake.batches == 0);
+
+  // a batch runs whole on the main thread, its queries see the result
+  assert(wm_client_request(fd, "move 101 2; move 102 2; switch 2; buffers\n",
+                           reply, sizeof(reply)) > 0);
+  assert(fake.batches == 1);
+  assert(strstr(reply, "buffer 2 active apps 3 focus 0\n"));
+  assert(wm_client_request(fd, "apps", reply, sizeof(reply)) > 0);
+  assert(strstr(reply, "app 101 com.test.101 buffers 2 tiled\n"));
+
+  assert(wm_client_request(fd, "move 999 1", reply, sizeof(reply)) > 0);
+  assert(strcmp(reply, "error unknown app 999\n\n") == 0);
+  assert(wm_client_request(fd, "bogus", reply, sizeof(reply)) > 0);
+  assert(strcmp(reply, "error unknown command 'bogus'\n\n") == 0);
+  assert(fake.batches == 2); // bad syntax never leaves the server thread
+
+  // pipelined requests are answered in order
+  const char *pipelined = "tile 104; focus\nfocus\n";
+  assert(send(fd, pipelined, strlen(pipelined), 0) ==
+         (ssize_t)strlen(pipelined));
+  size_t received = 0;
+  const char *expected = "focus 0\nok\n\nfocus 0\nok\n\n";
+  while (received < strlen(expected)) {
+    ssize_t count = recv(fd, reply + received, sizeof(reply) - received, 0);
+    assert(count > 0);
+    received += (size_t)count;
+  }
+  reply[received] = '\0';
+  assert(strcmp(reply, expected) == 0);
+  close(fd);
+
+  // a second connection is served the same way
+  fd = wm_client_connect(path);
+  assert(fd >= 0);
+  assert(wm_client_request(fd, "frames", reply, sizeof(reply)) > 0);
+  assert(strcmp(reply, "ok\n\n") == 0);
+  close(fd);
+
+  wm_server_stop(&server);
+  assert(access(path, F_OK) != 0);
+  assert(wm_client_connect(path) < 0);
+
+  // a stale socket is replaced, anything else is left alone
+  write_file(path, "not a socket");
+  assert(!wm_server_start(&server, path, fake_control_run, &fake));
+  unlink(path);
+}
+
+TEST(control_event_diff) {
+  WMState state;
+  setup_control(&state);
+  static WMControlSnapshot old;
+  static WMControlSnapshot now;
+  WMControlEvent events[WM_CONTROL_MAX_EVENTS];
+  char line[128];
+
+  // nothing changed, nothing to say
+  wm_control_snapshot(&old, &state, NULL, 0);
+  wm_control_snapshot(&now, &state, NULL, 0);
+  assert(wm_control_diff(&old, &now, events, WM_CONTROL_MAX_EVENTS) == 0);
+
+  // a move and a switch: the app, then the buffers, then the focus
+  wm_state_assign_to_buffer(&state, 102, 1);
+  wm_state_set_view(&state, 1, WM_BUFFER_BIT(1));
+  wm_control_snapshot(&now, &state, NULL, 0);
+  int count = wm_control_diff(&old, &now, events, WM_CONTROL_MAX_EVENTS);
+  assert(count == 3);
+  assert(wm_control_format_event(&events[0], line, sizeof(line)) > 0);
+  assert(strcmp(line, "event app 102 buffers 2\n") == 0);
+  wm_control_format_event(&events[1], line, sizeof(line));
+  assert(strcmp(line, "event buffer 2 view 2 occupied 1,2\n") == 0);
+  wm_control_format_event(&events[2], line, sizeof(line));
+  assert(strcmp(line, "event focus 0\n") == 0);
+
+  // launched and quit apps, one empties its buffer
+  wm_control_snapshot(&old, &state, NULL, 0);
+  wm_state_unregister_app(&state, 104);
+  wm_state_unregister_app(&state, 102);
+  wm_state_register_app(&state, 105, "com.test.105");
+  wm_state_assign_to_buffer(&state, 105, 0);
+  wm_control_snapshot(&now, &state, NULL, 0);
+  count = wm_control_diff(&old, &now, events, WM_CONTROL_MAX_EVENTS);
+  assert(count == 4);
+  wm_control_format_event(&events[0], line, sizeof(line));
+  assert(strcmp(line, "event app 105 buffers 1\n") == 0);
+  wm_control_format_event(&events[1], line, sizeof(line));
+  assert(strcmp(line, "event app 102 buffers -\n") == 0);
+  wm_control_format_event(&events[2], line, sizeof(line));
+  assert(strcmp(line, "event app 104 buffers -\n") == 0);
+  wm_control_format_event(&events[3], line, sizeof(line));
+  assert(strcmp(line, "event buffer 2 view 2 occupied 1\n") == 0);
+
+  // focus alone, and the limit is kept
+  wm_control_snapshot(&old, &state, NULL, 0);
+  wm_state_set_view(&state, 0, WM_BUFFER_BIT(0));
+  wm_state_set_focused(&state, 103);
+  wm_control_snapshot(&now, &state, NULL, 0);
+  assert(wm_control_diff(&old, &now, events, 1) == 1);
+  assert(events[0].type == WM_CONTROL_EVENT_BUFFER);
+  assert(wm_control_diff(&old, &now, events, WM_CONTROL_MAX_EVENTS) == 2);
+  wm_control_format_event(&events[1], line, sizeof(line));
+  assert(strcmp(line, "event focus 103\n") == 0);
+
+  WMControlEvent layout = {.type = WM_CONTROL_EVENT_LAYOUT,
+                           .view = WM_BUFFER_BIT(0) | WM_BUFFER_BIT(2),
+                           .count = 3};
+  wm_control_format_event(&layout, line, sizeof(line));
+  assert(strcmp(line, "event layout view 1,3 apps 3\n") == 0);
+  assert(wm_control_format_event(&layout, line, 8) == 0);
+}
+
+TEST(control_event_ring) {
+  static WMControlEventRing ring;
+  memset(&ring, 0, sizeof(ring));
+  WMControlEvent event = {.type = WM_CONTROL_EVENT_APP};
+  WMControlEvent out;
+
+  assert(!wm_control_ring_pop(&ring, &out));
+  for (int i = 1; i <= WM_CONTROL_EVENT_RING; i++) {
+    event.pid = i;
+    assert(wm_control_ring_push(&ring, &event));
+  }
+  assert(ring.dropped == 0);
+
+  // full: the oldest make room
+  for (int i = 1; i <= 10; i++) {
+    event.pid = WM_CONTROL_EVENT_RING + i;
+    assert(!wm_control_ring_push(&ring, &event));
+  }
+  assert(ring.count == WM_CONTROL_EVENT_RING);
+  assert(ring.dropped == 10);
+
+  for (int i = 11; i <= WM_CONTROL_EVENT_RING + 10; i++) {
+    assert(wm_control_ring_pop(&ring, &out));
+    assert(out.pid == i);
+  }
+  assert(!wm_control_ring_pop(&ring, &out));
+
+  char line[64];
+  assert(wm_control_format_dropped(10, line, sizeof(line)) > 0);
+  assert(strcmp(line, "event dropped 10\n") == 0);
+
+  WMControlBatch batch;
+  char error[WM_CONTROL_ERROR_SIZE];
+  assert(wm_control_parse("subscribe", &batch, error, sizeof(error)));
+  assert(batch.subscribe == WM_CONTROL_EVENT_ALL && !batch.has_mutation);
+  assert(wm_control_parse("subscribe focus app", &batch, error,
+                          sizeof(error)));
+  assert(batch.subscribe == (WM_CONTROL_EVENT_BIT(WM_CONTROL_EVENT_FOCUS) |
+                             WM_CONTROL_EVENT_BIT(WM_CONTROL_EVENT_APP)));
+  assert(!wm_control_parse("subscribe windows", &batch, error,
+                           sizeof(error)));
+  assert(strcmp(error, "unknown event class 'windows'") == 0);
+  assert(!wm_control_parse("subscribe; focus", &batch, error, sizeof(error)));
+  assert(strcmp(error, "subscribe must be alone") == 0);
+}
+
+// read event lines until one starts with last, returns the lines read
+static int read_events(int fd, const char *last, char *lines, size_t size) {
+  size_t received = 0;
+  int count = 0;
+  for (;;) {
+    assert(received + 1 < size);
+    ssize_t got = recv(fd, lines + received, size - 1 - received, 0);
+    assert(got > 0);
+    for (ssize_t i = 0; i < got; i++)
+      count += lines[received + (size_t)i] == '\n';
+    received += (size_t)got;
+    lines[received] = '\0';
+
+    const char *tail = lines;
+    for (const char *p = lines; *p != '\0'; p++) {
+      if (p[0] == '\n' && p[1] != '\0')
+        tail = p + 1;
+    }
+    if (lines[received - 1] == '\n' && strncmp(tail, last, strlen(last)) == 0)
+      return count;
+  }
+}
+
+TEST(control_subscribe_stream) {
+  const char *path = test_path("events.sock");
+  static WMServer server;
+  static FakeControlMain fake;
+  static char lines[1 << 20];
+  WMState state;
+  setup_control(&state);
+  memset(&fake, 0, sizeof(fake));
+  fake.server = &server;
+  fake.state = &state;
+  assert(wm_server_start(&server, path, fake_control_run, &fake));
+
+  char reply[WM_CONTROL_MAX_REPLY];
+  int watcher = wm_client_connect(path);
+  int slow = wm_client_connect(path);
+  assert(watcher >= 0 && slow >= 0);
+  assert(wm_client_request(watcher, "subscribe focus", reply,
+                           sizeof(reply)) > 0);
+  assert(strcmp(reply, "ok\n\n") == 0);
+  assert(wm_client_request(slow, "subscribe app", reply, sizeof(reply)) > 0);
+
+  // only the classes asked for
+  WMControlEvent events[] = {
+      {.type = WM_CONTROL_EVENT_APP, .pid = 101, .buffers = 2},
+      {.type = WM_CONTROL_EVENT_LAYOUT, .view = 1, .count = 2},
+      {.type = WM_CONTROL_EVENT_FOCUS, .pid = 102},
+  };
+  wm_server_emit(&server, events, 3);
+  assert(read_events(watcher, "event focus 102", lines, sizeof(lines)) == 1);
+  assert(strcmp(lines, "event focus 102\n") == 0);
+
+  // a subscriber that stops reading loses its oldest events, the emitter
+  // never waits for it and it hears how many it missed
+  const int total = 100000;
+  for (int i = 1; i <= total; i++) {
+    WMControlEvent event = {.type = WM_CONTROL_EVENT_APP, .pid = 1000 + i};
+    wm_server_emit(&server, &event, 1);
+  }
+  char last[32];
+  snprintf(last, sizeof(last), "event app %d ", 1000 + total);
+  int count = read_events(slow, last, lines, sizeof(lines));
+  assert(count < total);
+  assert(strstr(lines, "event app 101 buffers 2\n") == lines);
+  assert(strstr(lines, "event dropped "));
+  assert(!strstr(lines, "event focus") && !strstr(lines, "event layout"));
+
+  // what got through is in order
+  int previous = 0;
+  for (const char *p = strstr(lines, "event app "); p != NULL;
+       p = strstr(p + 1, "event app ")) {
+    int pid = atoi(p + strlen("event app "));
+    assert(pid > previous);
+    previous = pid;
+  }
+  assert(previous == 1000 + total);
+  assert(server.events_dropped > 0);
+
+  // subscribing is a request of its own
+  int fd = wm_client_connect(path);
+  assert(fd >= 0);
+  assert(wm_client_request(fd, "subscribe; apps", reply, sizeof(reply)) > 0);
+  assert(strcmp(reply, "error subscribe must be alone\n\n") == 0);
+  assert(wm_client_request(fd, "focus", reply, sizeof(reply)) > 0);
+  assert(strcmp(reply, "focus 0\nok\n\n") == 0);
+  close(fd);
+
+  close(watcher);
+  close(slow);
+  wm_server_stop(&server);
+}
+
+// mirror
+
+// shm name private to this test run
+static const char *mirror_name(void) {
+  static char name[WM_MIRROR_NAME_SIZE];
+  snprintf(name, sizeof(name), "/dwin_test_%d", (int)getpid());
+  return name;
+}
+
+TEST(mirror_write_read) {
+  WMState state;
+  setup_control(&state);
+  wm_state_set_buffer_mask(&state, 103, WM_BUFFER_BIT(0) | WM_BUFFER_BIT(2));
+
+  WMMirrorReader reader;
+  WMMirrorState mirror;
+  assert(!wm_mirror_attach(&reader, mirror_name()));
+
+  WMMirrorWriter writer;
+  assert(wm_mirror_open(&writer, mirror_name()));
+  assert(wm_mirror_write(&writer, &state));
+  assert(wm_mirror_attach(&reader, mirror_name()));
+  assert(wm_mirror_read(&reader, &mirror));
+  assert(mirror.state_version == state.version);
+  assert(mirror.active_buffer == 0 && mirror.view_mask == WM_BUFFER_BIT(0));
+  assert(mirror.focused_pid == 101 && !mirror.is_passthrough_mode);
+  assert(mirror.app_count[0] == 3 && mirror.app_count[1] == 1);
+  assert(mirror.app_count[2] == 1 && mirror.apps[2][0] == 103);
+  assert(mirror.apps[0][0] == 101 && mirror.apps[1][0] == 104);
+
+  // a switch and passthrough
+  wm_state_set_view(&state, 1, WM_BUFFER_BIT(1) | WM_BUFFER_BIT(2));
+  wm_state_set_focused(&state, 104);
+  state.is_passthrough_mode = true;
+  state.version++;
+  assert(wm_mirror_write(&writer, &state));
+  assert(wm_mirror_read(&reader, &mirror));
+  assert(mirror.active_buffer == 1 && mirror.focused_pid == 104);
+  assert(mirror.view_mask == (WM_BUFFER_BIT(1) | WM_BUFFER_BIT(2)));
+  assert(mirror.is_passthrough_mode);
+
+  // unchanged state isn't rewritten
+  WMMirrorState stale = mirror;
+  stale.focused_pid = 1;
+  wm_mirror_store(&writer, &stale);
+  assert(wm_mirror_write(&writer, &state));
+  assert(wm_mirror_read(&reader, &mirror) && mirror.focused_pid == 1);
+
+  // readers learn dwin quit
+  wm_mirror_close(&writer);
+  assert(!wm_mirror_read(&reader, &mirror));
+  wm_mirror_detach(&reader);
+  assert(!wm_mirror_attach(&reader, mirror_name()));
+  assert(!wm_mirror_write(&writer, &state));
+}
+
+// image of writer generation g: every field derives from it, so any mix of
+// two generations shows
+static void mirror_generation(uint32_t g, WMMirrorState *out) {
+  memset(out, 0, sizeof(*out));
+  out->state_version = g;
+  out->active_buffer = (int32_t)(g % WM_MAX_BUFFERS);
+  out->view_mask = WM_BUFFER_BIT(out->active_buffer);
+  out->focused_pid = (pid_t)g;
+  for (int i = 0; i < WM_MAX_BUFFERS; i++) {
+    out->app_count[i] = (int32_t)((g + (uint32_t)i) % (WM_MAX_APPS + 1));
+    for (int j = 0; j < out->app_count[i]; j++)
+      out->apps[i][j] = (pid_t)(g + (uint32_t)i);
+  }
+}
+
+// reader process: 0 if every image read was whole and the writer was seen
+// moving
+static int mirror_check_reads(const char *name, int reads) {
+  WMMirrorReader reader;
+  if (!wm_mirror_attach(&reader, name))
+    return 1;
+
+  static WMMirrorState mirror;
+  static WMMirrorState expected;
+  uint32_t first = 0;
+  uint32_t last = 0;
+  int read = 0;
+  for (int i = 0; i < reads; i++) {
+    if (!wm_mirror_read(&reader, &mirror))
+      continue; // the writer kept it busy, not torn
+    mirror_generation(mirror.state_version, &expected);
+    if (memcmp(&mirror, &expected, sizeof(mirror)) != 0)
+      return 2;
+    if (mirror.state_version < last)
+      return 3; // went back in time
+    if (read++ == 0)
+      first = mirror.state_version;
+    last = mirror.state_version;
+  }
+  wm_mirror_detach(&reader);
+  return read > reads / 2 && last > first ? 0 : 4;
+}
+
+TEST(mirror_no_torn_reads) {
+  static WMMirrorState mirror;
+  WMMirrorWriter writer;
+  const char *name = mirror_name(); // the readers have other pids
+  assert(wm_mirror_open(&writer, name));
+  uint32_t generation = 1;
+  mirror_generation(generation, &mirror);
+  wm_mirror_store(&writer, &mirror);
+
+  // readers in other processes while the writer churns
+  enum { READERS = 3 };
+  pid_t readers[READERS];
+  for (int i = 0; i < READERS; i++) {
+    readers[i] = fork();
+    assert(readers[i] >= 0);
+    if (readers[i] == 0)
+      _exit(mirror_check_reads(name, 100000));
+  }
+
+  int running = READERS;
+  while (running > 0) {
+    mirror_generation(++generation, &mirror);
+    wm_mirror_store(&writer, &mirror);
+
+    int status;
+    for (int i = 0; i < READERS; i++) {
+      if (readers[i] > 0 && waitpid(readers[i], &status, WNOHANG) > 0) {
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        readers[i] = 0;
+        running--;
+      }
+    }
+  }
+  wm_mirror_close(&writer);
+}
+
+// hooks
+
+TEST(hooks_config) {
+  const char *path = test_path("hooks");
+  write_file(path, "hook = buffer, echo \"$DWIN_BUFFER\" | tee a, b\n"
+                   "hook = focus,  ~/bin/bar\n"
+                   "hook = windows, nope\n"
+                   "hook = app,\n"
+                   "hook_timeout = 250\n");
+  WMConfig config;
+  wm_config_init(&config);
+  assert(config.hook_timeout_ms == WM_HOOK_TIMEOUT_MS);
+  assert(wm_config_load(&config, path));
+  unlink(path);
+
+  assert(config.hooks_count == 2);
+  assert(config.hooks[0].event == WM_CONTROL_EVENT_BUFFER);
+  assert(strcmp(config.hooks[0].command, "echo \"$DWIN_BUFFER\" | tee a, b") ==
+         0);
+  assert(config.hooks[1].event == WM_CONTROL_EVENT_FOCUS);
+  assert(strcmp(config.hooks[1].command, "~/bin/bar") == 0);
+  assert(config.hook_timeout_ms == 250);
+
+  char env[WM_HOOK_ENV_SIZE];
+  WMControlEvent event = {.type = WM_CONTROL_EVENT_BUFFER,
+                          .buffer = 1,
+                          .view = WM_BUFFER_BIT(1) | WM_BUFFER_BIT(2),
+                          .buffers = WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1)};
+  int length = wm_hooks_format_env(&event, env, sizeof(env));
+  const char expected[] = "DWIN_EVENT=buffer\0DWIN_BUFFER=2\0DWIN_VIEW=2,3\0"
+                          "DWIN_OCCUPIED=1,2";
+  assert(length == (int)sizeof(expected));
+  assert(memcmp(env, expected, sizeof(expected)) == 0);
+  assert(wm_hooks_format_env(&event, env, 20) == 0);
+}
+
+typedef struct {
+  _Atomic int finished;
+  WMHookResult results[16];
+} HookLog;
+
+static void log_hook(const WMHookResult *result, void *context) {
+  HookLog *log = context;
+  int index = atomic_load(&log->finished);
+  if (index < 16)
+    log->results[index] = *result;
+  atomic_store(&log->finished, index + 1);
+}
+
+static uint64_t monotonic_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// wait (up to 5s) for count runs to finish
+static bool wait_hooks(HookLog *log, int count) {
+  for (int i = 0; i < 5000 && atomic_load(&log->finished) < count; i++)
+    usleep(1000);
+  return atomic_load(&log->finished) == count;
+}
+
+TEST(hooks_run_with_event_env) {
+  const char *path = test_path("hook_out");
+  char command[WM_HOOK_COMMAND_SIZE];
+  snprintf(command, sizeof(command),
+           "printf '%%s %%s %%s' \"$DWIN_EVENT\" \"$DWIN_PID\" \"$HOME\" > %s; "
+           "exit 3",
+           path);
+  WMConfig config;
+  wm_config_init(&config);
+  assert(wm_config_add_hook(&config, WM_CONTROL_EVENT_FOCUS, command));
+
+  static WMHookRunner runner;
+  static HookLog log;
+  memset(&log, 0, sizeof(log));
+  assert(wm_hooks_start(&runner, &config, log_hook, &log));
+
+  // only the classes with hooks are queued
+  WMControlEvent events[] = {
+      {.type = WM_CONTROL_EVENT_APP, .pid = 700},
+      {.type = WM_CONTROL_EVENT_FOCUS, .pid = 812},
+  };
+  assert(wm_hooks_dispatch(&runner, events, 2) == 1);
+  assert(wait_hooks(&log, 1));
+  assert(log.results[0].status == 3 && !log.results[0].timed_out);
+  assert(log.results[0].hook == 0);
+
+  // variables of the event, the rest of the environment inherited
+  FILE *file = fopen(path, "r");
+  assert(file);
+  char line[256];
+  assert(fgets(line, sizeof(line), file));
+  fclose(file);
+  unlink(path);
+  char expected[256];
+  snprintf(expected, sizeof(expected), "focus 812 %s", getenv("HOME"));
+  assert(strcmp(line, expected) == 0);
+
+  WMHookStats stats;
+  wm_hooks_stats(&runner, &stats);
+  assert(stats.queued == 1 && stats.started == 1 && stats.reaped == 1);
+  assert(stats.failed == 1 && stats.running == 0 && stats.queue_depth == 0);
+  assert(stats.max_ns > 0 && stats.total_ns == stats.max_ns);
+  wm_hooks_stop(&runner);
+
+  // no hooks, no thread
+  wm_config_init(&config);
+  assert(wm_hooks_start(&runner, &config, NULL, NULL));
+  assert(wm_hooks_dispatch(&runner, events, 2) == 0);
+  wm_hooks_stop(&runner);
+}
+
+TEST(hooks_cap_coalesce_timeout) {
+  WMConfig config;
+  wm_config_init(&config);
+  config.hook_timeout_ms = 150;
+  // the whole process group goes at the timeout
+  assert(wm_config_add_hook(&config, WM_CONTROL_EVENT_APP,
+                            "sleep 5 & sleep 5; wait"));
+
+  static WMHookRunner runner;
+  static HookLog log;
+  memset(&log, 0, sizeof(log));
+  assert(wm_hooks_start(&runner, &config, log_hook, &log));
+
+  uint64_t start = monotonic_ns();
+  WMControlEvent events[6];
+  for (int i = 0; i < 6; i++)
+    events[i] = (WMControlEvent){.type = WM_CONTROL_EVENT_APP, .pid = i + 1};
+  assert(wm_hooks_dispatch(&runner, events, 6) == 6);
+
+  // the last two wait for a slot, the same run again is dropped
+  assert(wm_hooks_dispatch(&runner, &events[5], 1) == 0);
+  assert(wait_hooks(&log, 6));
+  assert(monotonic_ns() - start < 2000 * MS); // not 5s per wave
+
+  WMHookStats stats;
+  wm_hooks_stats(&runner, &stats);
+  assert(stats.queued == 6 && stats.coalesced == 1 && stats.dropped == 0);
+  assert(stats.max_running == WM_HOOK_MAX_RUNNING);
+  assert(stats.max_queue_depth >= 2);
+  assert(stats.timed_out == 6 && stats.running == 0);
+  for (int i = 0; i < 6; i++)
+    assert(log.results[i].timed_out && log.results[i].status == -1);
+  wm_hooks_stop(&runner);
+}
+
+// log
+
+static WMLogRecord test_record(int thread, int i) {
+  WMLogRecord record = {
+      .format = WM_LOG_TEST_VALUES,
+      .count = 5,
+      .args = {wm_log_integer(thread), wm_log_integer(i),
+               wm_log_integer(i * 3), wm_log_double(i / 2.0),
+               wm_log_integer('a' + thread)},
+  };
+  return record;
+}
+
+TEST(log_format_record) {
+  char text[128];
+  WMLogRecord record = test_record(-5, 7);
+  record.args[2] = 255;
+  record.args[3] = wm_log_double(3.14159);
+  record.args[4] = 'x';
+  assert(wm_log_format_record(&record, text, sizeof(text)) ==
+         (int)strlen(text));
+  assert(strcmp(text,
+                "[Test] int -5 unsigned 7 hex 0xff double 3.142 char x") == 0);
+
+  // arguments the record lacks print as '?', truncation keeps the NUL
+  record.count = 2;
+  wm_log_format_record(&record, text, sizeof(text));
+  assert(strcmp(text, "[Test] int -5 unsigned 7 hex ? double ? char ?") == 0);
+  assert(wm_log_format_record(&record, text, 10) == 9);
+  assert(strcmp(text, "[Test] in") == 0);
+
+  // every format takes at most WM_LOG_MAX_ARGS and renders them
+  for (int format = 0; format < WM_LOG_FORMAT_COUNT; format++) {
+    WMLogRecord full = {.format = (uint16_t)format, .count = WM_LOG_MAX_ARGS,
+                        .args = {65, 65, 65, 65, 65}};
+    wm_log_format_record(&full, text, sizeof(text));
+    assert(text[0] == '[' && strchr(text, '?') == NULL);
+  }
+  record.format = WM_LOG_FORMAT_COUNT;
+  wm_log_format_record(&record, text, sizeof(text));
+  assert(strncmp(text, "[Log] unknown record", 20) == 0);
+}
+
+// records of a log file after its header, -1 if it has none
+static int read_log(const char *path, WMLogRecord *records, int max) {
+  FILE *file = fopen(path, "rb");
+  assert(file);
+  WMLogFileHeader header;
+  int count = -1;
+  if (fread(&header, sizeof(header), 1, file) == 1 &&
+      header.magic == WM_LOG_MAGIC)
+    count = (int)fread(records, sizeof(WMLogRecord), (size_t)max, file);
+  fclose(file);
+  return count;
+}
+
+#define LOG_WRITERS 4
+#define LOG_RECORDS 20000
+
+static _Atomic int g_log_writers_ready;
+static _Atomic int g_log_writers_done;
+
+// writers start together and keep their ring until all are done, an exited
+// thread's ring goes to the next one
+static void *log_writer(void *argument) {
+  int thread = (int)(intptr_t)argument;
+  atomic_fetch_add(&g_log_writers_ready, 1);
+  while (atomic_load(&g_log_writers_ready) < LOG_WRITERS)
+    ;
+  for (int i = 0; i < LOG_RECORDS; i++)
+    WM_LOG(WM_LOG_TEST_VALUES, thread, i, i * 3, i / 2.0, 'a' + thread);
+  atomic_fetch_add(&g_log_writers_done, 1);
+  while (atomic_load(&g_log_writers_done) < LOG_WRITERS)
+    usleep(100);
+  return NULL;
+}
+
+// each ring's records in order and whole; with those reported lost they
+// add up to what its thread wrote
+static void check_log(const WMLogRecord *records, int count, int writers,
+                      int per_writer) {
+  int seen[WM_LOG_MAX_THREADS + 1] = {0};
+  uint64_t lost[WM_LOG_MAX_THREADS + 1] = {0};
+  int last[WM_LOG_MAX_THREADS + 1];
+  int writer_ring[LOG_WRITERS];
+  for (int i = 0; i <= WM_LOG_MAX_THREADS; i++)
+    last[i] = -1;
+  for (int i = 0; i < writers; i++)
+    writer_ring[i] = -1;
+
+  for (int r = 0; r < count; r++) {
+    const WMLogRecord *record = &records[r];
+    assert(record->thread <= WM_LOG_MAX_THREADS);
+    if (record->format == WM_LOG_LOST) {
+      assert(record->args[1] == record->thread);
+      lost[record->thread] += record->args[0];
+      continue;
+    }
+    assert(record->format == WM_LOG_TEST_VALUES && record->count == 5);
+    WMLogRecord expected =
+        test_record((int)record->args[0], (int)record->args[1]);
+    assert(memcmp(record->args, expected.args, sizeof(expected.args)) == 0);
+
+    int writer = (int)record->args[0];
+    assert(writer >= 0 && writer < writers);
+    assert(writer_ring[writer] < 0 || writer_ring[writer] == record->thread);
+    writer_ring[writer] = record->thread;
+    assert((int)record->args[1] > last[record->thread]);
+    last[record->thread] = (int)record->args[1];
+    seen[record->thread]++;
+  }
+
+  for (int i = 0; i < writers; i++) {
+    assert(writer_ring[i] >= 0);
+    assert(seen[writer_ring[i]] + lost[writer_ring[i]] ==
+           (uint64_t)per_writer);
+  }
+}
+
+TEST(log_drain_threads) {
+  const char *path = test_path("log");
+  assert(wm_log_start(path));
+  assert(!wm_log_start(path)); // one drainer
+
+  // writers racing the drainer and explicit drains
+  pthread_t threads[LOG_WRITERS];
+  atomic_store(&g_log_writers_ready, 0);
+  atomic_store(&g_log_writers_done, 0);
+  for (int i = 0; i < LOG_WRITERS; i++)
+    assert(pthread_create(&threads[i], NULL, log_writer,
+                          (void *)(intptr_t)i) == 0);
+  while (atomic_load(&g_log_writers_done) < LOG_WRITERS) {
+    wm_log_drain();
+    usleep(200);
+  }
+  for (int i = 0; i < LOG_WRITERS; i++)
+    pthread_join(threads[i], NULL);
+  wm_log_stop();
+  assert(wm_log_drain() == 0); // stopped, no file
+
+  static WMLogRecord records[LOG_WRITERS * LOG_RECORDS + 64];
+  int count = read_log(path, records, LOG_WRITERS * LOG_RECORDS + 64);
+  assert(count > 0);
+  check_log(records, count, LOG_WRITERS, LOG_RECORDS);
+
+  // the decoder prints every record
+  FILE *text = tmpfile();
+  assert(wm_log_decode(path, text) == count);
+  rewind(text);
+  char line[256];
+  assert(fgets(line, sizeof(line), text));
+  assert(line[2] == ':' && line[8] == '.' && strstr(line, " t"));
+  fclose(text);
+  unlink(path);
+
+  // a file of another layout is refused
+  write_file(path, "not a log");
+  assert(wm_log_decode(path, stdout) == -1);
+  unlink(path);
+}
+
+TEST(log_ring_overwrite) {
+  const char *path = test_path("log");
+  assert(wm_log_start(path));
+  wm_log_drain(); // what earlier tests left
+
+  // three rings' worth before anything drains: the oldest are reported
+  for (int i = 0; i < 3 * WM_LOG_RING_SIZE; i++)
+    WM_LOG(WM_LOG_TEST_VALUES, 0, i, i * 3, i / 2.0, 'a');
+  wm_log_stop();
+
+  static WMLogRecord records[4 * WM_LOG_RING_SIZE];
+  int count = read_log(path, records, 4 * WM_LOG_RING_SIZE);
+  check_log(records, count, 1, 3 * WM_LOG_RING_SIZE);
+  bool reported = false;
+  for (int i = 0; i < count; i++)
+    reported |= records[i].format == WM_LOG_LOST;
+  assert(reported);
+  unlink(path);
+}
+
+// crash hook of log_crash_dump: leaves a file behind
+static const char *g_crash_hook_path;
+static void crash_hook(void) {
+  int fd = open(g_crash_hook_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd >= 0)
+    close(fd);
+}
+
+TEST(log_crash_dump) {
+  const char *path = test_path("crash");
+  static char hook_path[256];
+  snprintf(hook_path, sizeof(hook_path), "%s.hook", path);
+  unlink(hook_path);
+  g_crash_hook_path = hook_path;
+  fflush(stdout);
+  pid_t child = fork();
+  assert(child >= 0);
+  if (child == 0) {
+    struct rlimit no_core = {0, 0};
+    setrlimit(RLIMIT_CORE, &no_core);
+    if (!wm_log_install_crash_handler(path))
+      _exit(1);
+    wm_log_set_crash_hook(crash_hook);
+    for (int i = 0; i < 10; i++)
+      WM_LOG(WM_LOG_TEST_VALUES, 0, 4200 + i, 0, 0.0, 'a');
+    abort();
+  }
+
+  // the handler dumps and runs the hook, then the child dies of the signal
+  // anyway
+  int status;
+  assert(waitpid(child, &status, 0) == child);
+  assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+  assert(access(hook_path, F_OK) == 0);
+  unlink(hook_path);
+
+  // the last records of every ring, earlier tests' too
+  static WMLogRecord records[WM_LOG_MAX_THREADS * WM_LOG_RING_SIZE + 1];
+  int count =
+      read_log(path, records, WM_LOG_MAX_THREADS * WM_LOG_RING_SIZE + 1);
+  assert(count >= 11);
+  assert(records[count - 1].format == WM_LOG_CRASH);
+  assert(records[count - 1].args[0] == SIGABRT);
+  assert(records[count - 2].format == WM_LOG_TEST_VALUES);
+  assert(records[count - 2].args[1] == 4209);
+
+  FILE *text = tmpfile();
+  assert(wm_log_decode(path, text) == count);
+  rewind(text);
+  char line[256];
+  char last[256] = "";
+  while (fgets(line, sizeof(line), text))
+    memcpy(last, line, sizeof(last));
+  fclose(text);
+  char expected[64];
+  snprintf(expected, sizeof(expected), "[Log] crashed with signal %d\n",
+           SIGABRT);
+  assert(strstr(last, expected) != NULL);
+  unlink(path);
+}
+
+// display
+
+// three side by side displays: 0 at 0..1000, 1 at 1000..2000, 2 at 2000..2800
+static void setup_displays(WMState *state) {
+  WMDisplayInfo infos[] = {
+      {.id = 11, .frame = {0, 0, 1000, 800}},
+      {.id = 22, .frame = {1000, 0, 1000, 800}},
+      {.id = 33, .frame = {2000, 100, 800, 600}},
+  };
+  wm_display_configure(state, infos, 3);
+}
+
+static bool rect_inside(WMRect rect, WMRect frame) {
+  return rect.x >= frame.x && rect.y >= frame.y &&
+         rect.x + rect.width <= frame.x + frame.width &&
+         rect.y + rect.height <= frame.y + frame.height;
+}
+
+TEST(display_configure) {
+  WMState state;
+  WMSwitch sw;
+  FakeSwitchBackend fake;
+  setup_switch(&state, &sw, &fake);
+
+  // the startup display becomes the first reported one and keeps its view
+  uint32_t version = state.version;
+  setup_displays(&state);
+  assert(state.display_count == 3);
+  assert(state.focused_display == 0);
+  assert(state.version != version);
+  assert(wm_state_display_view(&state, 0) == WM_BUFFER_BIT(0));
+  assert(wm_state_display_view(&state, 1) == 0);
+  assert(state.displays[1].active_buffer == -1);
+  assert(wm_display_at(&state, 1500, 10) == 1);
+  assert(wm_display_at(&state, 2100, 50) == -1); // above display 2
+  assert(wm_display_at(&state, -1, 0) == -1);
+
+  // same report: nothing stale, nothing changed
+  WMDisplayInfo infos[] = {
+      {.id = 11, .frame = {0, 0, 1000, 800}},
+      {.id = 22, .frame = {1000, 0, 1000, 800}},
+      {.id = 33, .frame = {2000, 100, 800, 600}},
+  };
+  version = state.version;
+  assert(wm_display_configure(&state, infos, 3) == 0);
+  assert(state.version == version);
+
+  // display 1 shows buffer 1, gets focus back later
+  assert(wm_display_focus(&state, 1));
+  assert(!wm_display_focus(&state, 1));
+  assert(!wm_display_focus(&state, 3));
+  assert(state.active_buffer == -1);
+  wm_state_set_view(&state, 1, WM_BUFFER_BIT(1));
+  assert(wm_display_of_buffer(&state, 1) == 1);
+  assert(wm_display_of_buffer(&state, 0) == 0);
+  assert(wm_display_of_buffer(&state, 2) == -1);
+
+  // resizing a display makes only it stale
+  infos[2].frame.width = 1200;
+  assert(wm_display_configure(&state, infos, 3) == WM_DISPLAY_BIT(2));
+  assert(state.focused_display == 1);
+  assert(state.active_buffer == 1);
+
+  // unplugging the focused display: its buffer moves to the first one,
+  // focus follows, the display left shifts down and is stale
+  WMDisplayInfo left[] = {infos[0], infos[2]};
+  assert(wm_display_configure(&state, left, 2) ==
+         (WM_DISPLAY_BIT(0) | WM_DISPLAY_BIT(1)));
+  assert(state.display_count == 2);
+  assert(state.focused_display == 0);
+  assert(state.active_buffer == 0);
+  assert(wm_state_get_view(&state) == (WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1)));
+  assert(wm_state_get_shown(&state) == wm_state_get_view(&state));
+  wm_state_check_invariants(&state);
+
+  // an empty report (displays asleep) changes nothing
+  assert(wm_display_configure(&state, infos, 0) == 0);
+  assert(state.display_count == 2);
+}
+
+TEST(display_switch_independent) {
+  WMState state;
+  WMSwitch sw;
+  FakeSwitchBackend fake;
+  setup_switch(&state, &sw, &fake);
+  setup_displays(&state);
+
+  // display 1 shows buffer 2, display 0 keeps buffer 0 on screen
+  WMEffects effects;
+  wm_display_focus(&state, 1);
+  assert(wm_action_switch_view(&state, 2, WM_BUFFER_BIT(2), &effects));
+  assert(effects.to_show_count == 1 && effects.to_show[0] == 300);
+  assert(effects.to_hide_count == 0);
+  assert(wm_state_get_shown(&state) == (WM_BUFFER_BIT(0) | WM_BUFFER_BIT(2)));
+
+  // switching display 1 to buffer 1 hides only its own apps
+  assert(wm_switch_begin(&sw, &state, 1, WM_BUFFER_BIT(1)));
+  assert(sw.plan.show_count == 2);
+  assert(sw.plan.hide_count == 1 && sw.plan.hide[0] == 300);
+  assert(wm_state_display_view(&state, 0) == WM_BUFFER_BIT(0));
+
+  // taking buffer 0 from display 0 swaps: display 0 gets buffer 1, nothing
+  // leaves the screen
+  wm_action_switch_view(&state, 0, WM_BUFFER_BIT(0), &effects);
+  assert(effects.to_show_count == 0 && effects.to_hide_count == 0);
+  assert(wm_state_display_view(&state, 0) == WM_BUFFER_BIT(1));
+  assert(state.displays[0].active_buffer == 1);
+  assert(wm_state_display_view(&state, 1) == WM_BUFFER_BIT(0));
+  wm_state_check_invariants(&state);
+
+  // a sticky app's focus is recorded in whichever display shows it
+  wm_state_set_buffer_mask(&state, 101, WM_BUFFER_BIT(0) | WM_BUFFER_BIT(1));
+  wm_state_set_focused(&state, 101);
+  assert(state.buffers[0].last_focused_pid == 101);
+  assert(state.buffers[1].last_focused_pid == 101);
+}
+
+TEST(display_layout) {
+  WMState state;
+  WMSwitch sw;
+  FakeSwitchBackend fake;
+  WMConfig config;
+  wm_config_init(&config);
+  setup_switch(&state, &sw, &fake);
+  setup_displays(&state);
+  wm_display_focus(&state, 1);
+  wm_state_set_view(&state, 1, WM_BUFFER_BIT(1));
+  wm_display_focus(&state, 2);
+  wm_state_set_view(&state, 2, WM_BUFFER_BIT(2));
+
+  // a sticky app tiles on the first display showing it
+  wm_state_set_buffer_mask(&state, 102, WM_BUFFER_BIT(0) | WM_BUFFER_BIT(2));
+
+  static WMDisplayLayout serial[WM_MAX_DISPLAYS];
+  static WMDisplayLayout parallel[WM_MAX_DISPLAYS];
+  WMDisplayMask all = WM_DISPLAY_BIT(0) | WM_DISPLAY_BIT(1) | WM_DISPLAY_BIT(2);
+  wm_display_compute_all(&state, &config, all, serial, false);
+  wm_display_compute_all(&state, &config, all, parallel, true);
+
+  int expected[] = {3, 2, 1};
+  for (int d = 0; d < 3; d++) {
+    assert(serial[d].count == expected[d]);
+    assert(serial[d].display_id == state.displays[d].id);
+    for (int i = 0; i < serial[d].count; i++)
+      assert(rect_inside(serial[d].frames[i].frame, state.displays[d].frame));
+    assert(parallel[d].count == serial[d].count);
+    assert(memcmp(parallel[d].frames, serial[d].frames,
+                  serial[d].count * sizeof(WMFrameChange)) == 0);
+  }
+  assert(serial[2].frames[0].pid == 300);
+
+  // the same layout has no changes, a new app on display 1 splits the
+  // second half (the first app keeps its frame)
+  WMFrameChange changes[WM_MAX_APPS];
+  assert(wm_display_changes(&serial[1], &parallel[1], changes,
+                            WM_MAX_APPS) == 0);
+  wm_state_register_app(&state, 202, "com.test.202");
+  wm_state_assign_to_buffer(&state, 202, 1);
+  WMDisplayLayout next;
+  assert(wm_display_compute(&state, 1, &config, &next) == 3);
+  assert(wm_display_changes(&serial[1], &next, changes, WM_MAX_APPS) == 2);
+  assert(changes[0].pid == 201 && changes[1].pid == 202);
+  assert(wm_display_changes(&serial[1], &next, changes, 1) == 1);
+  assert(wm_display_compute(&state, 3, &config, &next) == 0);
+
+  // floating windows keep their place relative to a resized display
+  WMRect from = {0, 0, 1000, 800};
+  WMRect to = {1000, 0, 2000, 400};
+  WMRect moved = wm_display_rescale((WMRect){100, 200, 500, 400}, from, to);
+  assert(moved.x == 1200 && moved.y == 100);
+  assert(moved.width == 1000 && moved.height == 200);
+  WMRect kept = wm_display_rescale(moved, (WMRect){0}, to);
+  assert(kept.x == moved.x && kept.width == moved.width);
+}
+
+// plans
+
+// the switch wm_switch_begin would run on a copy of state, with the tiling
+// of the focused display after it
+static void fresh_switch(const WMState *state, const WMLatencyModel *latency,
+                         const WMConfig *config, int buffer,
+                         WMSwitchPlan *plan, WMDisplayLayout *layout) {
+  static WMState copy;
+  WMSwitch sw;
+  FakeSwitchBackend fake;
+  copy = *state;
+  memset(&fake, 0, sizeof(fake));
+  fake.state = &copy;
+  WMSwitchBackend backend = {.run_stage = fake_switch_run_stage,
+                             .finish = fake_switch_finish,
+                             .clock = fake_switch_clock,
+                             .context = &fake};
+  wm_switch_init(&sw, &backend);
+  sw.latency = latency;
+  assert(wm_switch_begin(&sw, &copy, buffer, WM_BUFFER_BIT(buffer)));
+  *plan = sw.plan;
+  wm_display_compute(&copy, copy.focused_display, config, layout);
+}
+
+static void check_plan(const WMSwitchPlan *ready, const WMSwitchPlan *fresh,
+                       const WMDisplayLayout *layout) {
+  assert(ready->primary_buffer == fresh->primary_buffer);
+  assert(ready->view == fresh->view);
+  assert(ready->shown_view == fresh->shown_view);
+  assert(ready->focus_pid == fresh->focus_pid);
+  assert(ready->show_count == fresh->show_count);
+  assert(memcmp(ready->show, fresh->show,
+                ready->show_count * sizeof(pid_t)) == 0);
+  assert(ready->hide_count == fresh->hide_count);
+  assert(memcmp(ready->hide, fresh->hide,
+                ready->hide_count * sizeof(pid_t)) == 0);
+  assert(ready->frame_count == layout->count);
+  assert(memcmp(ready->frames, layout->frames,
+                layout->count * sizeof(WMFrameChange)) == 0);
+}
+
+TEST(plans_use_and_invalidate) {
+  WMState state;
+  WMSwitch sw;
+  FakeSwitchBackend fake;
+  WMConfig config;
+  static WMPlanCache plans;
+  wm_config_init(&config);
+  setup_switch(&state, &sw, &fake);
+  setup_displays(&state);
+  wm_plans_init(&plans);
+  sw.plans = &plans;
+
+  // every buffer gets a plan, a second pass has nothing to do
+  assert(wm_plans_refresh(&plans, &state, NULL, &config) == WM_MAX_BUFFERS);
+  assert(wm_plans_refresh(&plans, &state, NULL, &config) == 0);
+
+  // a focus change makes them stale, a switch then makes its own
+  wm_state_set_focused(&state, 101);
+  assert(wm_plans_lookup(&plans, &state, NULL, 1, WM_BUFFER_BIT(1)) == NULL);
+  assert(wm_plans_refresh(&plans, &state, NULL, &config) == WM_MAX_BUFFERS);
+
+  // views of several buffers aren't planned
+  assert(wm_plans_lookup(&plans, &state, NULL, 1,
+                         WM_BUFFER_BIT(1) | WM_BUFFER_BIT(2)) == NULL);
+  assert(plans.misses == 2);
+
+  // the switch runs the ready plan, its frames hold until the state moves
+  assert(wm_switch_begin(&sw, &state, 1, WM_BUFFER_BIT(1)));
+  assert(plans.hits == 1);
+  assert(sw.plan.focus_pid == 200 && sw.plan.hide_count == 3);
+  const WMFrameChange *frames;
+  assert(wm_switch_ready_frames(&sw, &state, &frames) == 2);
+  assert(frames[0].pid == 200);
+  wm_state_set_floating(&state, 201, true);
+  assert(wm_switch_ready_frames(&sw, &state, &frames) == -1);
+
+  // a buffer shown on another display swaps, no plan for it
+  wm_display_focus(&state, 1);
+  wm_state_set_view(&state, 2, WM_BUFFER_BIT(2));
+  wm_display_focus(&state, 0);
+  wm_plans_refresh(&plans, &state, NULL, &config);
+  assert(!plans.buffers[2].ready);
+  assert(plans.buffers[0].ready);
+
+  // new latency estimates or another config make them stale too
+  static WMLatencyModel latency;
+  wm_latency_init(&latency);
+  assert(wm_plans_refresh(&plans, &state, &latency, &config) == 0);
+  wm_latency_record(&latency, "com.test.300", WM_OP_HIDE, 9 * MS);
+  assert(wm_plans_lookup(&plans, &state, &latency, 0, WM_BUFFER_BIT(0)) ==
+         NULL);
+  WMConfig other = config;
+  wm_plans_refresh(&plans, &state, &latency, &config);
+  assert(wm_plans_refresh(&plans, &state, &latency, &other) ==
+         WM_MAX_BUFFERS - 1);
+}
+
+TEST(plans_match_fresh) {
+  WMState state;
+  WMSwitch sw;
+  FakeSwitchBackend fake;
+  WMConfig config;
+  static WMPlanCache plans;
+  static WMLatencyModel latency;
+  wm_config_init(&config);
+  wm_latency_init(&latency);
+  setup_switch(&state, &sw, &fake);
+  setup_displays(&state);
+  wm_plans_init(&plans);
+
+  // random edits, after each one every plan that is ready must be what a
+  // switch computed from scratch would do
+  uint32_t seed = 47;
+  int checked = 0;
+  for (int step = 0; step < 400; step++) {
+    seed = seed * 1103515245u + 12345u;
+    uint32_t r = seed >> 8;
+    pid_t pid = 100 + (pid_t)(r % 3);
+    if (r % 5 == 1)
+      pid = 200 + (pid_t)(r % 2);
+    int buffer = (int)((r >> 4) % WM_MAX_BUFFERS);
+    switch ((r >> 8) % 7) {
+    case 0:
+      wm_state_assign_to_buffer(&state, pid, buffer);
+      break;
+    case 1:
+      wm_state_toggle_buffer(&state, pid, buffer);
+      break;
+    case 2:
+      wm_state_set_floating(&state, pid, (r >> 12) & 1);
+      break;
+    case 3:
+      wm_state_set_focused(&state, pid);
+      break;
+    case 4:
+      wm_display_focus(&state, (int)((r >> 12) % 3));
+      wm_state_set_view(&state, buffer, WM_BUFFER_BIT(buffer));
+      break;
+    case 5: {
+      char bundle[32];
+      snprintf(bundle, sizeof(bundle), "com.test.%d", (int)pid);
+      wm_latency_record(&latency, bundle, (WMLatencyOp)((r >> 12) % 5),
+                        (r % 300) * MS);
+      break;
+    }
+    default: {
+      WMDisplayInfo infos[] = {
+          {.id = 11, .frame = {0, 0, 1000 + (r % 3) * 100.0, 800}},
+          {.id = 22, .frame = {1300, 0, 1000, 800}},
+          {.id = 33, .frame = {2300, 100, 800, 600}},
+      };
+      wm_display_configure(&state, infos, 3);
+      break;
+    }
+    }
+
+    wm_plans_refresh(&plans, &state, &latency, &config);
+    for (int b = 0; b < WM_MAX_BUFFERS; b++) {
+      const WMSwitchPlan *ready =
+          wm_plans_lookup(&plans, &state, &latency, b, WM_BUFFER_BIT(b));
+      int display = wm_display_of_buffer(&state, b);
+      assert((ready != NULL) ==
+             (display < 0 || display == state.focused_display));
+      if (ready == NULL || (b == state.active_buffer &&
+                            wm_state_get_view(&state) == WM_BUFFER_BIT(b)))
+        continue; // a swap, or no switch at all
+
+      WMSwitchPlan fresh;
+      WMDisplayLayout layout;
+      fresh_switch(&state, &latency, &config, b, &fresh, &layout);
+      check_plan(ready, &fresh, &layout);
+      checked++;
+    }
+  }
+  assert(checked > 500);
+}
+
+TEST(plans_hold_over_samples) {
+  WMState state;
+  WMSwitch sw;
+  FakeSwitchBackend fake;
+  WMConfig config;
+  static WMPlanCache plans;
+  static WMLatencyModel latency;
+  wm_config_init(&config);
+  wm_latency_init(&latency);
+  setup_switch(&state, &sw, &fake);
+  setup_displays(&state);
+  wm_plans_init(&plans);
+
+  wm_latency_record(&latency, "com.test.100", WM_OP_HIDE, 20 * MS);
+  wm_latency_record(&latency, "com.test.101", WM_OP_HIDE, 100 * MS);
+  wm_latency_record(&latency, "com.test.102", WM_OP_HIDE, 300 * MS);
+  wm_plans_refresh(&plans, &state, &latency, &config);
+
+  // samples that leave the order as it is, or time ops nothing is ordered
+  // by, keep the plans: each lookup hits and is what a switch would do
+  uint32_t seed = 48;
+  for (int i = 0; i < 100; i++) {
+    seed = seed * 1103515245u + 12345u;
+    uint32_t r = seed >> 8;
+    wm_latency_record(&latency, "com.test.101", WM_OP_HIDE,
+                      (80 + r % 40) * MS);
+    wm_latency_record(&latency, "com.test.200", WM_OP_FRAME, (r % 50) * MS);
+
+    const WMSwitchPlan *ready =
+        wm_plans_lookup(&plans, &state, &latency, 1, WM_BUFFER_BIT(1));
+    assert(ready != NULL);
+    WMSwitchPlan fresh;
+    WMDisplayLayout layout;
+    memset(&layout, 0, sizeof(layout)); // frames are compared with padding
+    fresh_switch(&state, &latency, &config, 1, &fresh, &layout);
+    check_plan(ready, &fresh, &layout);
+  }
+  assert(plans.hits == 100 && plans.misses == 0);
+
+  // one that reorders them makes them stale until the next refresh
+  wm_latency_record(&latency, "com.test.100", WM_OP_HIDE, 900 * MS);
+  assert(wm_plans_lookup(&plans, &state, &latency, 1, WM_BUFFER_BIT(1)) ==
+         NULL);
+  assert(wm_plans_refresh(&plans, &state, &latency, &config) > 0);
+  assert(wm_plans_lookup(&plans, &state, &latency, 1, WM_BUFFER_BIT(1)) !=
+         NULL);
+  assert(plans.hits == 101 && plans.misses == 1);
+}
+
+// park
+
+static double covered(WMRect a, WMRect b) {
+  double w = (a.x + a.width < b.x + b.width ? a.x + a.width : b.x + b.width) -
+             (a.x > b.x ? a.x : b.x);
+  double h =
+      (a.y + a.height < b.y + b.height ? a.y + a.height : b.y + b.height) -
+      (a.y > b.y ? a.y : b.y);
+  return w > 0 && h > 0 ? w * h : 0;
+}
+
+TEST(park_config_mode) {
+  const char *path = test_path("config_park");
+  write_file(path, "visibility = auto\n"
+                   "visibility = com.spotify.client, park\n"
+                   "visibility = com.apple.Safari, park\n"
+                   "visibility = com.apple.Safari, hide\n"
+                   "visibility = com.bad, sideways\n"
+                   "visibility = , park\n");
+  WMConfig config;
+  assert(wm_config_load(&config, path));
+  unlink(path);
+  assert(config.visibility == WM_VISIBILITY_AUTO);
+  assert(config.visibility_rules_count == 2); // the last Safari line wins
+  assert(wm_config_visibility(&config, "com.spotify.client") ==
+         WM_VISIBILITY_PARK);
+  assert(wm_config_visibility(&config, "com.apple.Safari") ==
+         WM_VISIBILITY_HIDE);
+  assert(wm_config_visibility(&config, "com.bad") == WM_VISIBILITY_AUTO);
+
+  // auto parks what was measured slow to hide or unhide
+  static WMLatencyModel latency;
+  wm_latency_init(&latency);
+  wm_latency_record(&latency, "com.slow", WM_OP_UNHIDE, 400 * MS);
+  wm_latency_record(&latency, "com.fast", WM_OP_HIDE, 20 * MS);
+  assert(wm_park_mode(&config, &latency, "com.slow") == WM_VISIBILITY_PARK);
+  assert(wm_park_mode(&config, &latency, "com.fast") == WM_VISIBILITY_HIDE);
+  assert(wm_park_mode(&config, &latency, "com.new") == WM_VISIBILITY_HIDE);
+  assert(wm_park_mode(&config, NULL, "com.slow") == WM_VISIBILITY_HIDE);
+  assert(wm_park_mode(&config, &latency, "com.apple.Safari") ==
+         WM_VISIBILITY_HIDE);
+
+  WMConfig defaults;
+  wm_config_init(&defaults);
+  assert(wm_park_mode(&defaults, &latency, "com.slow") == WM_VISIBILITY_HIDE);
+}
+
+TEST(park_position) {
+  WMState state;
+  wm_state_init(&state);
+  setup_displays(&state);
+
+  // a display to the right: its window goes past the bottom left corner
+  WMRect parked = wm_park_position(&state, (WMRect){100, 100, 400, 300});
+  assert(parked.x == 1 - 400 && parked.y == 799);
+  assert(parked.width == 400 && parked.height == 300);
+
+  // the rightmost display parks bottom right
+  parked = wm_park_position(&state, (WMRect){2100, 200, 300, 200});
+  assert(parked.x == 2799 && parked.y == 699);
+
+  // any window of any display: a sliver stays on its display, none of it
+  // on the others
+  uint32_t seed = 48;
+  for (int i = 0; i < 300; i++) {
+    seed = seed * 1103515245u + 12345u;
+    int d = (int)((seed >> 8) % 3);
+    WMRect area = state.displays[d].frame;
+    WMRect frame = {area.x + (seed >> 12) % 200, area.y + (seed >> 16) % 200,
+                    50 + (seed >> 4) % 700, 50 + (seed >> 20) % 500};
+    parked = wm_park_position(&state, frame);
+    assert(same_frame((WMRect){0, 0, parked.width, parked.height},
+                      (WMRect){0, 0, frame.width, frame.height}));
+    for (int j = 0; j < 3; j++) {
+      double area_on = covered(parked, state.displays[j].frame);
+      assert(area_on ==
+             (j == d ? WM_PARK_SLIVER * WM_PARK_SLIVER : 0));
+    }
+  }
+}
+
+TEST(park_round_trip) {
+  WMState state;
+  wm_state_init(&state);
+  setup_displays(&state);
+  WMParkStore store;
+  wm_park_init(&store);
+
+  // frames come back exactly, on every display
+  WMRect frames[] = {{12, 40, 488, 748},
+                     {1012.5, 40, 976, 364.25},
+                     {2012, 112, 776, 576}};
+  WMRect parked;
+  for (int i = 0; i < 3; i++)
+    assert(wm_park_save(&store, &state, 100 + i, frames[i], &parked));
+  assert(wm_park_is_parked(&store, 101));
+  assert(!wm_park_is_parked(&store, 200));
+
+  // parked twice (switched away again before it came back): still the
+  // frame from before
+  WMRect again;
+  assert(wm_park_save(&store, &state, 101,
+                      wm_park_position(&state, frames[1]), &again));
+  assert(store.count == 3);
+
+  WMRect frame;
+  for (int i = 2; i >= 0; i--) {
+    assert(wm_park_restore(&store, &state, 100 + i, &frame));
+    assert(same_frame(frame, frames[i]));
+  }
+  assert(!wm_park_restore(&store, &state, 100, &frame));
+  assert(store.count == 0);
+
+  // its display was resized while it was away: same place relative to it
+  assert(wm_park_save(&store, &state, 100, frames[0], &parked));
+  assert(wm_park_save(&store, &state, 102, frames[2], &parked));
+  wm_park_save(&store, &state, 103, frames[0], &parked);
+  wm_park_forget(&store, 103);
+  assert(!wm_park_is_parked(&store, 103));
+  WMDisplayInfo infos[] = {
+      {.id = 11, .frame = {0, 0, 2000, 1600}},
+      {.id = 22, .frame = {2000, 0, 1000, 800}},
+  };
+  wm_display_configure(&state, infos, 2);
+  assert(wm_park_restore(&store, &state, 100, &frame));
+  assert(same_frame(frame, (WMRect){24, 80, 976, 1496}));
+
+  // its display went away: onto the focused one
+  assert(wm_park_restore(&store, &state, 102, &frame));
+  assert(rect_inside(frame, state.displays[state.focused_display].frame));
+}
+
+TEST(park_persist) {
+  const char *path = test_path("parked");
+  WMState state;
+  wm_state_init(&state);
+  setup_displays(&state);
+  wm_state_register_app(&state, 100, "com.spotify.client");
+  wm_state_register_app(&state, 101, "com.apple.Music");
+  wm_state_register_app(&state, 102, "com.apple.Notes");
+
+  WMParkStore store;
+  wm_park_init(&store);
+  WMRect frames[] = {{12, 40, 488, 748}, {1012.5, 40, 976, 364.25}};
+  WMRect parked;
+  assert(wm_park_save(&store, &state, 100, frames[0], &parked));
+  assert(wm_park_save(&store, &state, 101, frames[1], &parked));
+  assert(wm_park_save(&store, &state, 102, frames[1], &parked));
+  wm_park_forget(&store, 102);
+  assert(store.dirty);
+  assert(wm_park_write(&store, path));
+  assert(!store.dirty);
+
+  // dwin died with them parked: the next start takes back the windows of
+  // apps still running as the same pid and bundle
+  WMState next;
+  wm_state_init(&next);
+  setup_displays(&next);
+  wm_state_register_app(&next, 100, "com.spotify.client");
+  wm_state_register_app(&next, 101, "com.apple.Safari"); // pid reused
+  WMParkStore recovered;
+  wm_park_init(&recovered);
+  assert(wm_park_read(&recovered, &next, path) == 1);
+  assert(recovered.dirty);
+  assert(wm_park_is_parked(&recovered, 100));
+  assert(!wm_park_is_parked(&recovered, 101));
+  WMRect frame;
+  assert(wm_park_restore(&recovered, &next, 100, &frame));
+  assert(same_frame(frame, frames[0]));
+
+  // nothing parked is written too, a corrupt or missing file is refused
+  assert(wm_park_write(&recovered, path));
+  assert(wm_park_read(&recovered, &next, path) == 0);
+  assert(wm_park_write(&store, path));
+  FILE *file = fopen(path, "r+b");
+  assert(file);
+  fseek(file, sizeof(WMStoreHeader) + 8, SEEK_SET);
+  fputc('X', file);
+  fclose(file);
+  assert(wm_park_read(&recovered, &next, path) == -1);
+  unlink(path);
+  assert(wm_park_read(&recovered, &next, path) == -1);
+  assert(recovered.count == 0);
+}
+
+TEST(minsize_learn) {
+  WMMinSizeStore store;
+  wm_minsize_init(&store);
+  const char *bundle = "com.tinyspeck.slackmacgap";
+  WMSize screen = {1600, 1000};
+
+  // a window taking what it was asked for teaches nothing
+  assert(!wm_minsize_learn(&store, bundle, (WMSize){400, 500},
+                           (WMSize){400.5, 500}, screen));
+  assert(store.table.entry_count == 0);
+  assert(!wm_minsize_tracked(&store, bundle));
+  WMSize min = wm_minsize_get(&store, bundle);
+  assert(min.width == 0 && min.height == 0);
+
+  // one it kept wider is pending until a second refusal agrees, then it
+  // is its minimum in whole points
+  assert(!wm_minsize_learn(&store, bundle, (WMSize){400, 500},
+                           (WMSize){620.4, 500}, screen));
+  assert(wm_minsize_tracked(&store, bundle) && store.dirty);
+  assert(wm_minsize_get(&store, bundle).width == 0);
+  assert(wm_minsize_learn(&store, bundle, (WMSize){380, 500},
+                          (WMSize){620, 500}, screen));
+  min = wm_minsize_get(&store, bundle);
+  assert(min.width == 621 && min.height == 0);
+  assert(!wm_minsize_learn(&store, bundle, (WMSize){621, 200},
+                           (WMSize){621, 300}, screen));
+  assert(wm_minsize_learn(&store, bundle, (WMSize){621, 200},
+                          (WMSize){621, 300}, screen));
+  min = wm_minsize_get(&store, bundle);
+  assert(min.width == 621 && min.height == 300);
+  assert(store.updates == 2);
+
+  // a slow resize reporting the old size, then taking the new one, is
+  // never learned
+  const char *slow = "com.jetbrains.CLion";
+  assert(!wm_minsize_learn(&store, slow, (WMSize){500, 800},
+                           (WMSize){1000, 800}, screen));
+  assert(!wm_minsize_learn(&store, slow, (WMSize){500, 800},
+                           (WMSize){500, 800}, screen));
+  assert(!wm_minsize_learn(&store, slow, (WMSize){400, 800},
+                           (WMSize){1000, 800}, screen));
+  assert(!wm_minsize_learn(&store, slow, (WMSize){400, 800},
+                           (WMSize){720, 800}, screen));
+  assert(wm_minsize_get(&store, slow).width == 0);
+
+  // no more than the usable area, however large the window stays
+  assert(!wm_minsize_learn(&store, slow, (WMSize){800, 800},
+                           (WMSize){2400, 800}, screen));
+  assert(wm_minsize_learn(&store, slow, (WMSize){800, 800},
+                          (WMSize){2500, 800}, screen));
+  assert(wm_minsize_get(&store, slow).width == screen.width);
+  assert(!wm_minsize_learn(&store, slow, (WMSize){1600, 800},
+                           (WMSize){2500, 800}, screen));
+
+  // taking less than the minimum (the app changed) forgets it
+  assert(wm_minsize_learn(&store, bundle, (WMSize){500, 600},
+                          (WMSize){500, 600}, screen));
+  min = wm_minsize_get(&store, bundle);
+  assert(min.width == 0 && min.height == 300);
+  assert(wm_minsize_get(NULL, bundle).width == 0);
+  assert(wm_minsize_get(&store, "com.apple.Terminal").width == 0);
+
+  // round trip through the file, corrupt files are ignored
+  const char *path = test_path("minsize");
+  for (int i = 0; i < 2; i++)
+    wm_minsize_learn(&store, "com.apple.Terminal", (WMSize){100, 100},
+                     (WMSize){480, 300}, screen);
+  assert(wm_minsize_save(&store, path) && !store.dirty);
+  WMMinSizeStore loaded;
+  wm_minsize_init(&loaded);
+  assert(wm_minsize_load(&loaded, path));
+  assert(loaded.table.entry_count == 3);
+  min = wm_minsize_get(&loaded, "com.apple.Terminal");
+  assert(min.width == 480 && min.height == 300);
+  assert(wm_minsize_get(&loaded, bundle).height == 300);
+
+  FILE *file = fopen(path, "r+b");
+  assert(file != NULL);
+  fseek(file, (long)sizeof(WMStoreHeader) + 7, SEEK_SET);
+  fputc(0x5a, file);
+  fclose(file);
+  wm_minsize_init(&loaded);
+  assert(!wm_minsize_load(&loaded, path));
+  assert(loaded.table.entry_count == 0);
+  unlink(path);
+}
+
+TEST(minsize_layout) {
+  WMState state;
+  wm_state_init(&state);
+  WMMinSizeStore store;
+  wm_minsize_init(&store);
+  WMConfig config;
+  wm_config_init(&config);
+  config.gaps_outer = (WMGap){0, 0, 0, 0};
+  config.gaps_inner = (WMGap){8, 8, 8, 8};
+  WMDisplayInfo info = {.id = 1, .frame = {0, 0, 1008, 800}};
+  wm_display_configure(&state, &info, 1);
+  wm_state_register_app(&state, 1, "com.apple.Terminal");
+  wm_state_register_app(&state, 2, "com.tinyspeck.slackmacgap");
+  wm_state_register_app(&state, 3, "com.google.Chrome");
+  for (pid_t pid = 1; pid <= 3; pid++)
+    wm_state_assign_to_buffer(&state, pid, 0);
+
+  // without a store nothing is learned
+  WMRect asked = {508, 404, 500, 396};
+  assert(!wm_state_learn_min_size(&state, 2, asked, (WMSize){700, 396}));
+  state.min_sizes = &store;
+
+  WMFrameChange frames[3];
+  assert(wm_display_tile_view(&state, 0, WM_BUFFER_BIT(0), &config, frames,
+                              3) == 3);
+  assert(frames[1].frame.width == 500);
+
+  // slack kept 700 wide twice: the first split leaves it room
+  uint32_t version = state.version;
+  assert(!wm_state_learn_min_size(&state, 2, asked, (WMSize){700, 396}));
+  assert(state.version == version);
+  assert(wm_state_learn_min_size(&state, 2, asked, (WMSize){700, 396}));
+  assert(state.version != version);
+  assert(wm_state_min_size(&state, 2).width == 700);
+  assert(wm_display_tile_view(&state, 0, WM_BUFFER_BIT(0), &config, frames,
+                              3) == 3);
+  assert(same_frame(frames[0].frame, (WMRect){0, 0, 300, 800}));
+  assert(same_frame(frames[1].frame, (WMRect){308, 404, 700, 396}));
+  assert(same_frame(frames[2].frame, (WMRect){308, 0, 700, 396}));
+  version = state.version;
+  assert(!wm_state_learn_min_size(&state, 2, frames[1].frame,
+                                  (WMSize){700, 396}));
+  assert(state.version == version);
+
+  // terminal needs 300, which the split already gives it
+  for (int i = 0; i < 2; i++)
+    wm_state_learn_min_size(&state, 1, (WMRect){0, 0, 200, 800},
+                            (WMSize){300, 800});
+  wm_display_tile_view(&state, 0, WM_BUFFER_BIT(0), &config, frames, 3);
+  assert(frames[0].frame.width == 300 && frames[1].frame.width == 700);
+
+  // can't both fit: they share the width by what they need
+  info.frame = (WMRect){0, 0, 908, 800};
+  wm_display_configure(&state, &info, 1);
+  wm_display_tile_view(&state, 0, WM_BUFFER_BIT(0), &config, frames, 3);
+  assert(frames[0].frame.width == 270 && frames[1].frame.width == 630);
+  assert(frames[1].frame.x == 278);
+
+  // a snapped window grows away from the edge it is against
+  WMRect area = {0, 0, 1000, 800};
+  WMRect right = wm_layout_fit((WMRect){504, 0, 496, 800},
+                               (WMSize){700, 0}, area);
+  assert(same_frame(right, (WMRect){300, 0, 700, 800}));
+  WMRect left =
+      wm_layout_fit((WMRect){0, 0, 496, 800}, (WMSize){700, 900}, area);
+  assert(same_frame(left, (WMRect){0, 0, 700, 900}));
+  WMRect centered = wm_layout_fit((WMRect){200, 120, 600, 560},
+                                  (WMSize){900, 0}, area);
+  assert(same_frame(centered, (WMRect){100, 120, 900, 560}));
+}
+
+// size the apps from first on need at depth first, as the layout splits
+static WMSize needed(const WMSize *mins, int first, int count, double gap) {
+  WMSize need = mins[first];
+  if (first == count - 1)
+    return need;
+  WMSize rest = needed(mins, first + 1, count, gap);
+  if (first % 2 == 0) {
+    need.width += gap + rest.width;
+    need.height = rest.height > need.height ? rest.height : need.height;
+  } else {
+    need.width = rest.width > need.width ? rest.width : need.width;
+    need.height += gap + rest.height;
+  }
+  return need;
+}
+
+// frames[first] and the frames after it split area exactly around gap,
+// each at its minimum, the split off the half only as far as one needs
+static void check_fit(const WMFrameChange *frames, int first, int count,
+                      WMRect area, double gap, const WMSize *mins,
+                      bool snapped) {
+  WMRect tile = frames[first].frame;
+  assert(tile.width >= mins[first].width &&
+         tile.height >= mins[first].height);
+  if (first == count - 1) {
+    assert(same_frame(tile, area));
+    return;
+  }
+
+  WMRect rest = bounds(frames + first + 1, count - first - 1);
+  WMSize need = needed(mins, first + 1, count, gap);
+  bool horizontal = first % 2 == 0;
+  double length = horizontal ? area.width : area.height;
+  double half = (length - gap) / 2;
+  if (snapped)
+    half = (length - gap) - (double)(int64_t)((length - gap) / 2);
+  double size = horizontal ? tile.width : tile.height;
+  double rest_size = horizontal ? rest.width : rest.height;
+  double min_size = horizontal ? mins[first].width : mins[first].height;
+  double need_size = horizontal ? need.width : need.height;
+  assert(rest_size >= need_size);
+  assert(size == half || size == min_size || rest_size == need_size);
+
+  if (horizontal) {
+    assert(tile.x == area.x && tile.y == area.y &&
+           tile.height == area.height);
+    assert(rest.y == area.y && rest.height == area.height);
+    assert(rest.x == tile.x + tile.width + gap);
+    assert(rest.x + rest.width == area.x + area.width);
+  } else {
+    assert(tile.x == area.x && tile.width == area.width);
+    assert(rest.x == area.x && rest.width == area.width);
+    assert(rest.y == area.y && tile.y == rest.y + rest.height + gap);
+    assert(tile.y + tile.height == area.y + area.height);
+  }
+  check_fit(frames, first + 1, count, rest, gap, mins, snapped);
+}
+
+TEST(minsize_fit_random) {
+  WMConfig config;
+  wm_config_init(&config);
+  pid_t pids[16];
+  for (int i = 0; i < 16; i++)
+    pids[i] = 100 + i;
+
+  uint32_t seed = 50;
+  int feasible = 0, infeasible = 0;
+  for (int it = 0; it < 4000; it++) {
+    seed = seed * 1103515245u + 12345u;
+    int count = 2 + (int)((seed >> 8) % 15);
+    bool snapped = (seed >> 16) % 4 != 0;
+    config.layout_snap =
+        snapped ? WM_LAYOUT_SNAP_POINTS : WM_LAYOUT_SNAP_OFF;
+    int gap = (int)((seed >> 20) % 17);
+    config.gaps_inner = (WMGap){gap, gap, gap, gap};
+    config.gaps_outer = (WMGap){0, 0, 0, 0};
+
+    // mixed minimums: most apps have none, some are wide or tall
+    WMSize mins[16];
+    for (int i = 0; i < count; i++) {
+      seed = seed * 1103515245u + 12345u;
+      int kind = (int)((seed >> 8) % 5);
+      mins[i] = (WMSize){0, 0};
+      if (kind == 1 || kind == 3)
+        mins[i].width = 200 + (double)((seed >> 12) % 600);
+      if (kind == 2 || kind == 3)
+        mins[i].height = 150 + (double)((seed >> 20) % 400);
+    }
+    seed = seed * 1103515245u + 12345u;
+    WMRect screen = {.x = (double)((seed >> 8) % 2000),
+                     .y = (double)((seed >> 4) % 100),
+                     .width = 800 + (double)((seed >> 12) % 6000),
+                     .height = 600 + (double)((seed >> 18) % 3000)};
+
+    WMFrameChange frames[16], again[16];
+    int n = wm_layout_compute_dwindle_fit(pids, mins, count, &config, screen,
+                                          1, frames, 16);
+    assert(n == count);
+    assert(wm_layout_compute_dwindle_fit(pids, mins, count, &config, screen,
+                                         1, again, 16) == n);
+    assert(memcmp(frames, again, sizeof(frames[0]) * (size_t)n) == 0);
+
+    // no minimums: the plain layout, unless its gaps overflowed
+    WMSize none[16] = {{0, 0}};
+    wm_layout_compute_dwindle_fit(pids, none, count, &config, screen, 1,
+                                  again, 16);
+    WMFrameChange plain[16];
+    wm_layout_compute_dwindle_fit(pids, NULL, count, &config, screen, 1,
+                                  plain, 16);
+    bool overflow = false;
+    for (int i = 0; i < n; i++)
+      overflow |= plain[i].frame.width < 0 || plain[i].frame.height < 0;
+    if (!overflow)
+      assert(memcmp(plain, again, sizeof(plain[0]) * (size_t)n) == 0);
+
+    WMSize need = needed(mins, 0, count, gap);
+    if (need.width > screen.width || need.height > screen.height) {
+      // the first split still tiles exactly (the next app spans the rest)
+      WMRect rest = frames[1].frame;
+      assert(rest.x == frames[0].frame.x + frames[0].frame.width + gap);
+      assert(rest.x + rest.width == screen.x + screen.width);
+      infeasible++;
+      continue;
+    }
+    feasible++;
+    for (int i = 0; i < n; i++)
+      assert(!snapped || on_grid(frames[i].frame.width, 1));
+    check_fit(frames, 0, n, screen, gap, mins, snapped);
+  }
+  assert(feasible > 1000 && infeasible > 100);
+}
+
 int main(void) {
   printf("Running core tests...\n");
   printf("\nState:\n");
@@ -814,11 +5148,23 @@ int main(void) {
   RUN_TEST(state_set_focused);
   RUN_TEST(state_set_floating);
   RUN_TEST(state_pid_map_collision);
+  RUN_TEST(state_buffer_mask_tags);
+  RUN_TEST(state_view_pids_symmetric_difference);
+  RUN_TEST(state_view_default);
+  RUN_TEST(state_set_focused_sticky);
+  RUN_TEST(state_register_apps_bulk);
+  RUN_TEST(state_register_apps_capacity);
+  RUN_TEST(state_backend_handles);
   printf("\nConfig:\n");
   RUN_TEST(config_init);
   RUN_TEST(config_add_rule);
+  RUN_TEST(config_rule_index);
   RUN_TEST(config_add_binding);
   RUN_TEST(config_default_bindings);
+  RUN_TEST(config_load);
+  RUN_TEST(config_binding_index);
+  RUN_TEST(config_cache_round_trip);
+  RUN_TEST(config_cache_stale);
   printf("\nEffects:\n");
   RUN_TEST(effects_init);
   RUN_TEST(effects_add);
@@ -828,8 +5174,16 @@ int main(void) {
   RUN_TEST(action_switch_buffer_empty);
   RUN_TEST(action_switch_buffer_with_last_focused);
   RUN_TEST(action_process_move_buffer);
+  RUN_TEST(action_switch_buffer_shared_app);
+  RUN_TEST(action_process_toggle_view);
+  RUN_TEST(action_process_toggle_tag_and_sticky);
   RUN_TEST(action_process_switch);
   RUN_TEST(action_process_passthrough);
+  RUN_TEST(action_queue_switch_burst);
+  RUN_TEST(action_queue_autorepeat_burst);
+  RUN_TEST(action_queue_snap_burst);
+  RUN_TEST(action_queue_keeps_order);
+  RUN_TEST(action_queue_overflow_burst);
   printf("\nLayout:\n");
   RUN_TEST(layout_apply_gaps);
   RUN_TEST(layout_rect_valid);
@@ -846,6 +5200,103 @@ int main(void) {
   RUN_TEST(layout_dwindle_empty);
   RUN_TEST(layout_dwindle_floating_skipped);
   RUN_TEST(layout_dwindle_after_snap_retile);
+  RUN_TEST(layout_dwindle_view);
+  RUN_TEST(layout_snap_exact);
+  RUN_TEST(layout_snap_modes);
+  printf("\nSnapshot:\n");
+  RUN_TEST(snapshot_round_trip);
+  RUN_TEST(snapshot_display_views);
+  RUN_TEST(snapshot_pid_reuse);
+  RUN_TEST(snapshot_dirty_records);
+  RUN_TEST(snapshot_corrupt);
+  printf("\nPlacement:\n");
+  RUN_TEST(placement_record_lookup);
+  RUN_TEST(placement_eviction);
+  RUN_TEST(placement_corruption_recovery);
+  RUN_TEST(placement_register_apps);
+  printf("\nKeys:\n");
+  RUN_TEST(keys_single_chord);
+  RUN_TEST(keys_sequence);
+  RUN_TEST(keys_layer);
+  RUN_TEST(keys_parse_sequences);
+  printf("\nSwitch:\n");
+  RUN_TEST(switch_stages_in_order);
+  RUN_TEST(switch_stage_deadline);
+  RUN_TEST(switch_cancel_merge);
+  RUN_TEST(switch_slowest_first);
+  printf("\nEvents:\n");
+  RUN_TEST(events_activation_storm);
+  RUN_TEST(events_storm_max_delay);
+  RUN_TEST(events_self_vs_user);
+  RUN_TEST(events_launch_terminate);
+  printf("\nTimer:\n");
+  RUN_TEST(timer_fire_order);
+  RUN_TEST(timer_random_steps);
+  RUN_TEST(timer_cancel);
+  RUN_TEST(timer_backoff);
+  printf("\nRelayout:\n");
+  RUN_TEST(relayout_burst);
+  RUN_TEST(relayout_launch_storm);
+  RUN_TEST(relayout_hidden_deferred);
+
+  printf("\nExecutor:\n");
+  RUN_TEST(executor_priority_order);
+  RUN_TEST(executor_budget_spreads);
+  RUN_TEST(executor_begin_supersedes);
+  RUN_TEST(executor_config_budget);
+
+  printf("\nHealth:\n");
+  RUN_TEST(health_breaker_backoff);
+  RUN_TEST(health_probe_deadline);
+  RUN_TEST(health_strikes);
+  RUN_TEST(health_hung_app_switch);
+
+  printf("\nLatency:\n");
+  RUN_TEST(store_table);
+  RUN_TEST(latency_estimate_regression);
+  RUN_TEST(latency_start_finish);
+  RUN_TEST(latency_persist);
+  printf("\nControl:\n");
+  RUN_TEST(control_parse);
+  RUN_TEST(control_apply_batch);
+  RUN_TEST(control_reply_queries);
+  RUN_TEST(control_socket_roundtrip);
+  RUN_TEST(control_event_diff);
+  RUN_TEST(control_event_ring);
+  RUN_TEST(control_subscribe_stream);
+  printf("\nMirror:\n");
+  RUN_TEST(mirror_write_read);
+  RUN_TEST(mirror_no_torn_reads);
+  printf("\nHooks:\n");
+  RUN_TEST(hooks_config);
+  RUN_TEST(hooks_run_with_event_env);
+  RUN_TEST(hooks_cap_coalesce_timeout);
+  printf("\nLog:\n");
+  RUN_TEST(log_format_record);
+  RUN_TEST(log_drain_threads);
+  RUN_TEST(log_ring_overwrite);
+  RUN_TEST(log_crash_dump);
+
+  printf("\nDisplay:\n");
+  RUN_TEST(display_configure);
+  RUN_TEST(display_switch_independent);
+  RUN_TEST(display_layout);
+
+  printf("\nPlans:\n");
+  RUN_TEST(plans_use_and_invalidate);
+  RUN_TEST(plans_match_fresh);
+  RUN_TEST(plans_hold_over_samples);
+
+  printf("\nPark:\n");
+  RUN_TEST(park_config_mode);
+  RUN_TEST(park_position);
+  RUN_TEST(park_round_trip);
+  RUN_TEST(park_persist);
+
+  printf("\nMin sizes:\n");
+  RUN_TEST(minsize_learn);
+  RUN_TEST(minsize_layout);
+  RUN_TEST(minsize_fit_random);
   printf("\nAll tests passed\n");
   return 0;
 }